@@ -0,0 +1,718 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include "gmime-charset-detect.h"
+#include "gmime-charset-native.h"
+#include "gmime-charset.h"
+#include "gmime-common.h"
+#include "gmime-iconv.h"
+
+
+/* A single-pass charset detector: rather than converting the input
+ * once per candidate charset to find out which of them it fits, the
+ * input is fed through a model of each candidate that counts the
+ * bytes that could not be converted from it.
+ *
+ * The UTF-8 model and the single-byte models are exact: they count
+ * precisely the bytes that a conversion would reject. The single-byte
+ * models are derived from iconv itself the first time a charset is
+ * seen and need nothing more than a histogram of the input. The
+ * models for the CJK multibyte charsets only know the structure of
+ * the lead and trail bytes, not which code points are assigned, so
+ * they may miss invalid input but never find input invalid that
+ * iconv would accept. Charsets that fit none of the models are
+ * assumed to fit until a conversion proves otherwise. */
+
+typedef enum {
+	MODEL_UNKNOWN,
+	MODEL_SINGLE_BYTE,
+	MODEL_UTF8,
+	MODEL_SHIFT_JIS,
+	MODEL_EUC_JP,
+	MODEL_EUC,
+	MODEL_GBK,
+	MODEL_BIG5
+} DetectModel;
+
+static struct {
+	const char *name;
+	DetectModel model;
+} multibyte_charsets[] = {
+	{ "Shift_JIS",   MODEL_SHIFT_JIS },
+	{ "shift-jis",   MODEL_SHIFT_JIS },
+	{ "sjis",        MODEL_SHIFT_JIS },
+	{ "x-sjis",      MODEL_SHIFT_JIS },
+	{ "ms_kanji",    MODEL_SHIFT_JIS },
+	{ "cp932",       MODEL_SHIFT_JIS },
+	{ "CP31j",       MODEL_SHIFT_JIS },
+	{ "euc-jp",      MODEL_EUC_JP    },
+	{ "eucjp",       MODEL_EUC_JP    },
+	{ "ujis",        MODEL_EUC_JP    },
+	{ "x-euc-jp",    MODEL_EUC_JP    },
+	{ "euc-kr",      MODEL_EUC       },
+	{ "euckr",       MODEL_EUC       },
+	{ "gbk",         MODEL_GBK       },
+	{ "cp936",       MODEL_GBK       },
+	{ "gb18030",     MODEL_GBK       },
+	{ "big5",        MODEL_BIG5      },
+	{ "big5-hkscs",  MODEL_BIG5      },
+	{ "big5hkscs",   MODEL_BIG5      },
+	{ "cp950",       MODEL_BIG5      },
+};
+
+typedef struct {
+	char *charset;
+	DetectModel type;
+	
+	/* for single-byte charsets: the bytes that are unassigned */
+	unsigned char unassigned[256];
+	guint nunassigned;
+} CharsetModel;
+
+typedef struct {
+	const char *charset;
+	const CharsetModel *model;
+	
+	/* the state of the multibyte models */
+	unsigned char seq[4];
+	guint nseq, need;
+	size_t ninval;
+	
+	/* the number of bytes a conversion actually failed on */
+	gboolean rejected;
+	size_t actual;
+} Candidate;
+
+struct _GMimeCharsetDetector {
+	/* how often each byte occurs, if any candidate is single-byte */
+	gboolean histogram;
+	size_t counts[256];
+	size_t length;
+	
+	guint n;
+	Candidate candidates[1];
+};
+
+
+#define DETECTOR_SIZE(n) (G_STRUCT_OFFSET (GMimeCharsetDetector, candidates) + MAX (n, 1) * sizeof (Candidate))
+
+G_LOCK_DEFINE_STATIC (models);
+static GHashTable *models = NULL;
+
+
+static void
+charset_model_free (CharsetModel *model)
+{
+	g_free (model->charset);
+	g_free (model);
+}
+
+
+/**
+ * g_mime_charset_detect_shutdown:
+ *
+ * Frees the charset models cached by the charset detector.
+ **/
+void
+g_mime_charset_detect_shutdown (void)
+{
+	if (models == NULL)
+		return;
+	
+	g_hash_table_destroy (models);
+	models = NULL;
+	
+#ifdef G_THREADS_ENABLED
+	if (glib_check_version (2, 37, 4) == NULL) {
+		/* The implementation of g_mutex_clear() prior
+		 * to glib 2.37.4 did not properly reset the
+		 * internal mutex pointer to NULL, so re-initializing
+		 * GMime would not properly re-initialize the mutexes.
+		 **/
+		g_mutex_clear (&G_LOCK_NAME (models));
+	}
+#endif
+}
+
+
+/**
+ * g_mime_charset_detect_init:
+ *
+ * Initializes the charset detector.
+ **/
+void
+g_mime_charset_detect_init (void)
+{
+	if (models != NULL)
+		return;
+	
+	models = g_hash_table_new_full (g_mime_strcase_hash, g_mime_strcase_equal, NULL, (GDestroyNotify) charset_model_free);
+	
+#ifdef G_THREADS_ENABLED
+	g_mutex_init (&G_LOCK_NAME (models));
+#endif
+}
+
+
+/* builds the table for single-byte charset @charset one byte at a
+ * time, or returns %FALSE if @charset is not a single-byte charset */
+static gboolean
+charset_model_build_table (CharsetModel *model, const char *charset)
+{
+	char in[1], out[16], *inbuf, *outbuf;
+	size_t inleft, outleft;
+	iconv_t cd;
+	int c;
+	
+	if ((cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1)
+		return FALSE;
+	
+	for (c = 0; c < 256; c++) {
+		in[0] = (char) c;
+		inbuf = in;
+		inleft = 1;
+		outbuf = out;
+		outleft = sizeof (out);
+		
+		iconv (cd, NULL, NULL, NULL, NULL);
+		
+		if (iconv (cd, &inbuf, &inleft, &outbuf, &outleft) == (size_t) -1) {
+			/* EINVAL means that @c starts a multibyte sequence */
+			if (errno != EILSEQ)
+				break;
+			
+			model->unassigned[model->nunassigned++] = c;
+			continue;
+		}
+		
+		/* stateful charsets may not produce anything until flushed, if at all */
+		if (iconv (cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1 || outbuf == out)
+			break;
+	}
+	
+	g_mime_iconv_close (cd);
+	
+	return c == 256;
+}
+
+static CharsetModel *
+charset_model_new (const char *charset)
+{
+	CharsetModel *model;
+	const char *name;
+	guint i;
+	
+	model = g_new0 (CharsetModel, 1);
+	model->charset = g_strdup (charset);
+	model->type = MODEL_UNKNOWN;
+	
+	if (!g_ascii_strcasecmp (charset, "x-unknown"))
+		charset = g_mime_locale_charset ();
+	
+	if (g_mime_charset_native (charset) == GMIME_CHARSET_NATIVE_UTF_8) {
+		model->type = MODEL_UTF8;
+		return model;
+	}
+	
+	name = g_mime_charset_iconv_name (charset);
+	
+	for (i = 0; i < G_N_ELEMENTS (multibyte_charsets); i++) {
+		if (!g_ascii_strcasecmp (name, multibyte_charsets[i].name)) {
+			model->type = multibyte_charsets[i].model;
+			return model;
+		}
+	}
+	
+	if (charset_model_build_table (model, name))
+		model->type = MODEL_SINGLE_BYTE;
+	
+	return model;
+}
+
+static const CharsetModel *
+charset_model (const char *charset)
+{
+	CharsetModel *model;
+	
+	G_LOCK (models);
+	
+	if (!(model = g_hash_table_lookup (models, charset))) {
+		model = charset_model_new (charset);
+		g_hash_table_insert (models, model->charset, model);
+	}
+	
+	G_UNLOCK (models);
+	
+	return model;
+}
+
+
+/**
+ * g_mime_charset_detector_new:
+ * @charsets: a %NULL-terminated list of candidate charsets, in order of preference
+ *
+ * Creates a new detector which determines which of @charsets some
+ * input is in.
+ *
+ * Returns: a new charset detector.
+ **/
+GMimeCharsetDetector *
+g_mime_charset_detector_new (const char **charsets)
+{
+	GMimeCharsetDetector *detector;
+	guint i, n;
+	
+	for (n = 0; charsets[n]; n++)
+		;
+	
+	detector = g_malloc (DETECTOR_SIZE (n));
+	detector->histogram = FALSE;
+	detector->n = n;
+	
+	for (i = 0; i < n; i++) {
+		detector->candidates[i].model = charset_model (charsets[i]);
+		detector->candidates[i].charset = detector->candidates[i].model->charset;
+		
+		if (detector->candidates[i].model->type == MODEL_SINGLE_BYTE)
+			detector->histogram = TRUE;
+	}
+	
+	g_mime_charset_detector_reset (detector);
+	
+	return detector;
+}
+
+
+/**
+ * g_mime_charset_detector_copy:
+ * @detector: a charset detector
+ *
+ * Creates a new detector for the same candidate charsets as @detector
+ * which has not seen any input.
+ *
+ * Returns: a new charset detector.
+ **/
+GMimeCharsetDetector *
+g_mime_charset_detector_copy (GMimeCharsetDetector *detector)
+{
+	GMimeCharsetDetector *copy;
+	
+	copy = g_memdup (detector, DETECTOR_SIZE (detector->n));
+	g_mime_charset_detector_reset (copy);
+	
+	return copy;
+}
+
+
+/**
+ * g_mime_charset_detector_free:
+ * @detector: a charset detector
+ *
+ * Frees the charset detector.
+ **/
+void
+g_mime_charset_detector_free (GMimeCharsetDetector *detector)
+{
+	g_free (detector);
+}
+
+
+/* the length of the sequence that @c starts, or -1 if it can't start one */
+static int
+sequence_length (DetectModel model, unsigned char c)
+{
+	switch (model) {
+	case MODEL_UTF8:
+		if (c < 0x80)
+			return 1;
+		if (c < 0xc2)
+			return -1;
+		if (c < 0xe0)
+			return 2;
+		if (c < 0xf0)
+			return 3;
+		return c < 0xf5 ? 4 : -1;
+	case MODEL_SHIFT_JIS:
+		return (c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xfc) ? 2 : 1;
+	case MODEL_EUC_JP:
+		if (c == 0x8f)
+			return 3;
+		return c == 0x8e || (c >= 0xa1 && c <= 0xfe) ? 2 : 1;
+	case MODEL_EUC:
+		return c >= 0xa1 && c <= 0xfe ? 2 : 1;
+	case MODEL_GBK:
+	case MODEL_BIG5:
+		return c >= 0x81 && c <= 0xfe ? 2 : 1;
+	default:
+		return 1;
+	}
+}
+
+/* whether @c may follow the first @n bytes of a sequence */
+static gboolean
+sequence_continues (DetectModel model, const unsigned char *seq, guint n, unsigned char c)
+{
+	switch (model) {
+	case MODEL_UTF8:
+		if (n == 1) {
+			switch (seq[0]) {
+			case 0xe0: return c >= 0xa0 && c <= 0xbf;
+			case 0xed: return c >= 0x80 && c <= 0x9f;
+			case 0xf0: return c >= 0x90 && c <= 0xbf;
+			case 0xf4: return c >= 0x80 && c <= 0x8f;
+			}
+		}
+		
+		return c >= 0x80 && c <= 0xbf;
+	case MODEL_SHIFT_JIS:
+		return c >= 0x40 && c <= 0xfc && c != 0x7f;
+	case MODEL_EUC_JP:
+		if (seq[0] == 0x8e)
+			return c >= 0xa1 && c <= 0xdf;
+		
+		return c >= 0xa1 && c <= 0xfe;
+	case MODEL_EUC:
+		return c >= 0xa1 && c <= 0xfe;
+	case MODEL_GBK:
+		/* gb18030 also has 4-byte sequences */
+		if (n == 1)
+			return (c >= 0x30 && c <= 0x39) || (c >= 0x40 && c <= 0xfe && c != 0x7f);
+		
+		if (n == 2)
+			return c >= 0x81 && c <= 0xfe;
+		
+		return c >= 0x30 && c <= 0x39;
+	case MODEL_BIG5:
+		return (c >= 0x40 && c <= 0x7e) || (c >= 0xa1 && c <= 0xfe);
+	default:
+		return FALSE;
+	}
+}
+
+static void
+candidate_step (Candidate *cand, unsigned char c)
+{
+	unsigned char seq[4];
+	guint i, n;
+	int need;
+	
+	if (cand->nseq > 0) {
+		if (sequence_continues (cand->model->type, cand->seq, cand->nseq, c)) {
+			if (cand->model->type == MODEL_GBK && cand->nseq == 1 && c < 0x40)
+				cand->need = 4;
+			
+			cand->seq[cand->nseq++] = c;
+			
+			if (cand->nseq == cand->need)
+				cand->nseq = 0;
+			
+			return;
+		}
+		
+		/* like iconv, skip the lead byte and rescan the bytes that followed it */
+		memcpy (seq, cand->seq, cand->nseq);
+		n = cand->nseq;
+		cand->nseq = 0;
+		cand->ninval++;
+		
+		for (i = 1; i < n; i++)
+			candidate_step (cand, seq[i]);
+	}
+	
+	if ((need = sequence_length (cand->model->type, c)) == -1) {
+		cand->ninval++;
+	} else if (need > 1) {
+		cand->need = need;
+		cand->seq[0] = c;
+		cand->nseq = 1;
+	}
+}
+
+
+/* the same as candidate_step() for each byte, but for UTF-8 there is
+ * no need to rescan: the bytes that followed the lead byte of an
+ * invalid sequence are all continuation bytes, invalid on their own */
+static void
+utf8_step (Candidate *cand, const unsigned char *inptr, const unsigned char *inend)
+{
+	size_t ninval = cand->ninval;
+	guint nseq = cand->nseq;
+	guint need = cand->need;
+	unsigned char c;
+	guint64 word;
+	
+	while (inptr < inend) {
+		/* skip over ASCII 8 bytes at a time */
+		while (nseq == 0 && inend - inptr >= 8) {
+			memcpy (&word, inptr, 8);
+			if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+				break;
+			
+			inptr += 8;
+		}
+		
+		if (inptr == inend)
+			break;
+		
+		c = *inptr++;
+		
+		if (nseq > 0) {
+			if (sequence_continues (MODEL_UTF8, cand->seq, nseq, c)) {
+				if (++nseq == need)
+					nseq = 0;
+				
+				continue;
+			}
+			
+			ninval += nseq;
+			nseq = 0;
+		}
+		
+		if (c < 128)
+			continue;
+		
+		if (c < 0xc2 || c > 0xf4) {
+			ninval++;
+			continue;
+		}
+		
+		need = c < 0xe0 ? 2 : (c < 0xf0 ? 3 : 4);
+		cand->seq[0] = c;
+		nseq = 1;
+	}
+	
+	cand->ninval = ninval;
+	cand->nseq = nseq;
+	cand->need = need;
+}
+
+
+/**
+ * g_mime_charset_detector_step:
+ * @detector: a charset detector
+ * @inbuf: the next chunk of input
+ * @inlen: the length of @inbuf
+ *
+ * Feeds the next chunk of input through each of the candidate
+ * charsets' models.
+ **/
+void
+g_mime_charset_detector_step (GMimeCharsetDetector *detector, const char *inbuf, size_t inlen)
+{
+	const unsigned char *inend = (const unsigned char *) inbuf + inlen;
+	register const unsigned char *inptr;
+	Candidate *cand, *end;
+	
+	end = detector->candidates + detector->n;
+	detector->length += inlen;
+	
+	if (detector->histogram) {
+		for (inptr = (const unsigned char *) inbuf; inptr < inend; inptr++)
+			detector->counts[*inptr]++;
+	}
+	
+	for (cand = detector->candidates; cand < end; cand++) {
+		if (cand->model->type < MODEL_UTF8)
+			continue;
+		
+		if (cand->model->type == MODEL_UTF8) {
+			utf8_step (cand, (const unsigned char *) inbuf, inend);
+			continue;
+		}
+		
+		for (inptr = (const unsigned char *) inbuf; inptr < inend; inptr++) {
+			/* none of the multibyte models care about ASCII outside of a sequence */
+			if (*inptr < 128 && cand->nseq == 0)
+				continue;
+			
+			candidate_step (cand, *inptr);
+		}
+	}
+}
+
+
+/**
+ * g_mime_charset_detector_length:
+ * @detector: a charset detector
+ *
+ * Gets the number of bytes that have been fed to @detector.
+ *
+ * Returns: the number of bytes seen by @detector.
+ **/
+size_t
+g_mime_charset_detector_length (GMimeCharsetDetector *detector)
+{
+	return detector->length;
+}
+
+
+/**
+ * g_mime_charset_detector_reset:
+ * @detector: a charset detector
+ *
+ * Forgets all of the input that has been fed to @detector, as well
+ * as any charsets that were rejected.
+ **/
+void
+g_mime_charset_detector_reset (GMimeCharsetDetector *detector)
+{
+	Candidate *cand;
+	guint i;
+	
+	for (i = 0; i < detector->n; i++) {
+		cand = &detector->candidates[i];
+		cand->rejected = FALSE;
+		cand->actual = 0;
+		cand->ninval = 0;
+		cand->nseq = 0;
+	}
+	
+	if (detector->histogram)
+		memset (detector->counts, 0, sizeof (detector->counts));
+	
+	detector->length = 0;
+}
+
+
+/* the number of bytes of the input that @cand could not convert */
+static size_t
+candidate_ninval (GMimeCharsetDetector *detector, Candidate *cand)
+{
+	const CharsetModel *model = cand->model;
+	size_t ninval = 0;
+	guint i;
+	
+	if (cand->rejected)
+		return cand->actual;
+	
+	switch (model->type) {
+	case MODEL_UNKNOWN:
+		return 0;
+	case MODEL_SINGLE_BYTE:
+		for (i = 0; i < model->nunassigned; i++)
+			ninval += detector->counts[model->unassigned[i]];
+		
+		return ninval;
+	default:
+		/* a sequence cut short by the end of the input is invalid too */
+		return cand->ninval + cand->nseq;
+	}
+}
+
+/* whether the number of invalid bytes counted for @cand is exact */
+static gboolean
+candidate_is_exact (Candidate *cand)
+{
+	return cand->rejected || cand->model->type == MODEL_SINGLE_BYTE || cand->model->type == MODEL_UTF8;
+}
+
+
+/**
+ * g_mime_charset_detector_best:
+ * @detector: a charset detector
+ * @exact: set to whether the input is known to fit the returned charset as well as it appears to
+ *
+ * Gets the first of the candidate charsets that the input fits
+ * without any invalid bytes or, if there is none, the first of the
+ * ones with the fewest invalid bytes.
+ *
+ * If @exact is %FALSE, the input may still turn out to have invalid
+ * bytes in the returned charset (or more of them than it seemed): if
+ * the conversion finds any, the charset should be passed to
+ * g_mime_charset_detector_reject() and the next best charset tried.
+ *
+ * Returns: the best matching charset or %NULL if there are no
+ * candidates left.
+ **/
+const char *
+g_mime_charset_detector_best (GMimeCharsetDetector *detector, gboolean *exact)
+{
+	Candidate *cand, *best = NULL;
+	size_t ninval, min = 0;
+	guint i;
+	
+	for (i = 0; i < detector->n; i++) {
+		cand = &detector->candidates[i];
+		
+		if (!cand->rejected && candidate_ninval (detector, cand) == 0) {
+			*exact = candidate_is_exact (cand);
+			return cand->charset;
+		}
+	}
+	
+	for (i = 0; i < detector->n; i++) {
+		cand = &detector->candidates[i];
+		
+		/* a charset that can't be converted from at all */
+		if (cand->rejected && cand->actual == (size_t) -1)
+			continue;
+		
+		ninval = candidate_ninval (detector, cand);
+		
+		/* ties go to whichever charset comes first */
+		if (best == NULL || ninval < min) {
+			min = ninval;
+			best = cand;
+		}
+	}
+	
+	if (best == NULL)
+		return NULL;
+	
+	*exact = candidate_is_exact (best);
+	
+	return best->charset;
+}
+
+
+/**
+ * g_mime_charset_detector_reject:
+ * @detector: a charset detector
+ * @charset: a charset returned by g_mime_charset_detector_best()
+ * @ninval: the number of invalid bytes that the conversion from @charset found or -1 if it can't be converted from
+ *
+ * Tells @detector how many invalid bytes the input actually had in
+ * @charset, after it did not convert as cleanly as it seemed to.
+ **/
+void
+g_mime_charset_detector_reject (GMimeCharsetDetector *detector, const char *charset, size_t ninval)
+{
+	Candidate *cand;
+	guint i;
+	
+	for (i = 0; i < detector->n; i++) {
+		cand = &detector->candidates[i];
+		
+		if (cand->charset == charset || !strcmp (cand->charset, charset)) {
+			cand->rejected = TRUE;
+			cand->actual = ninval;
+			break;
+		}
+	}
+}
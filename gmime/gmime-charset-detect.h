@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+
+#ifndef __GMIME_CHARSET_DETECT_H__
+#define __GMIME_CHARSET_DETECT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GMimeCharsetDetector GMimeCharsetDetector;
+
+G_GNUC_INTERNAL void g_mime_charset_detect_init (void);
+G_GNUC_INTERNAL void g_mime_charset_detect_shutdown (void);
+
+G_GNUC_INTERNAL GMimeCharsetDetector *g_mime_charset_detector_new (const char **charsets);
+G_GNUC_INTERNAL GMimeCharsetDetector *g_mime_charset_detector_copy (GMimeCharsetDetector *detector);
+G_GNUC_INTERNAL void g_mime_charset_detector_free (GMimeCharsetDetector *detector);
+
+G_GNUC_INTERNAL void g_mime_charset_detector_step (GMimeCharsetDetector *detector, const char *inbuf, size_t inlen);
+G_GNUC_INTERNAL size_t g_mime_charset_detector_length (GMimeCharsetDetector *detector);
+G_GNUC_INTERNAL void g_mime_charset_detector_reset (GMimeCharsetDetector *detector);
+
+G_GNUC_INTERNAL const char *g_mime_charset_detector_best (GMimeCharsetDetector *detector, gboolean *exact);
+G_GNUC_INTERNAL void g_mime_charset_detector_reject (GMimeCharsetDetector *detector, const char *charset, size_t ninval);
+
+G_END_DECLS
+
+#endif /* __GMIME_CHARSET_DETECT_H__ */
@@ -0,0 +1,319 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include "gmime-charset-native.h"
+#include "gmime-charset.h"
+
+
+/* Table-driven converters from the charsets that make up nearly all
+ * mail into UTF-8. They behave like iconv(3): they stop with EILSEQ
+ * at a byte that cannot be converted, with EINVAL at a multibyte
+ * sequence that is cut short by the end of the input and with E2BIG
+ * when the output buffer is full, leaving *@inbuf pointing at the
+ * offending byte in each case. */
+
+#define ROW(c) \
+	(c) + 0x0, (c) + 0x1, (c) + 0x2, (c) + 0x3, (c) + 0x4, (c) + 0x5, (c) + 0x6, (c) + 0x7, \
+	(c) + 0x8, (c) + 0x9, (c) + 0xa, (c) + 0xb, (c) + 0xc, (c) + 0xd, (c) + 0xe, (c) + 0xf
+
+/* the code points for bytes 0x80-0xff; 0 marks an unassigned byte */
+static const gunichar iso_8859_1[128] = {
+	ROW (0x80), ROW (0x90), ROW (0xa0), ROW (0xb0),
+	ROW (0xc0), ROW (0xd0), ROW (0xe0), ROW (0xf0)
+};
+
+static const gunichar iso_8859_15[128] = {
+	ROW (0x80), ROW (0x90),
+	0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x20ac, 0x00a5, 0x0160, 0x00a7,
+	0x0161, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,
+	0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x017d, 0x00b5, 0x00b6, 0x00b7,
+	0x017e, 0x00b9, 0x00ba, 0x00bb, 0x0152, 0x0153, 0x0178, 0x00bf,
+	ROW (0xc0), ROW (0xd0), ROW (0xe0), ROW (0xf0)
+};
+
+static const gunichar windows_1252[128] = {
+	0x20ac, 0x0000, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017d, 0x0000,
+	0x0000, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x0000, 0x017e, 0x0178,
+	ROW (0xa0), ROW (0xb0), ROW (0xc0), ROW (0xd0), ROW (0xe0), ROW (0xf0)
+};
+
+static struct {
+	const char *name;
+	GMimeCharsetNative charset;
+} native_charsets[] = {
+	{ "UTF-8",          GMIME_CHARSET_NATIVE_UTF_8        },
+	{ "utf8",           GMIME_CHARSET_NATIVE_UTF_8        },
+	{ "us-ascii",       GMIME_CHARSET_NATIVE_US_ASCII     },
+	{ "ascii",          GMIME_CHARSET_NATIVE_US_ASCII     },
+	{ "ANSI_X3.4-1968", GMIME_CHARSET_NATIVE_US_ASCII     },
+	{ "iso-8859-1",     GMIME_CHARSET_NATIVE_ISO_8859_1   },
+	{ "latin1",         GMIME_CHARSET_NATIVE_ISO_8859_1   },
+	{ "l1",             GMIME_CHARSET_NATIVE_ISO_8859_1   },
+	{ "iso-8859-15",    GMIME_CHARSET_NATIVE_ISO_8859_15  },
+	{ "latin9",         GMIME_CHARSET_NATIVE_ISO_8859_15  },
+	{ "latin-9",        GMIME_CHARSET_NATIVE_ISO_8859_15  },
+	{ "windows-cp1252", GMIME_CHARSET_NATIVE_WINDOWS_1252 },
+	{ "windows-1252",   GMIME_CHARSET_NATIVE_WINDOWS_1252 },
+	{ "cp1252",         GMIME_CHARSET_NATIVE_WINDOWS_1252 },
+};
+
+
+/**
+ * g_mime_charset_native:
+ * @charset: charset name
+ *
+ * Looks up the built-in converter from @charset to UTF-8.
+ *
+ * Returns: the native charset for @charset or
+ * %GMIME_CHARSET_NATIVE_NONE if it has to be converted with iconv.
+ **/
+GMimeCharsetNative
+g_mime_charset_native (const char *charset)
+{
+	guint i;
+	
+	if (charset == NULL)
+		return GMIME_CHARSET_NATIVE_NONE;
+	
+	if (!g_ascii_strcasecmp (charset, "x-unknown"))
+		charset = g_mime_locale_charset ();
+	
+	charset = g_mime_charset_canon_name (charset);
+	
+	for (i = 0; i < G_N_ELEMENTS (native_charsets); i++) {
+		if (!g_ascii_strcasecmp (charset, native_charsets[i].name))
+			return native_charsets[i].charset;
+	}
+	
+	return GMIME_CHARSET_NATIVE_NONE;
+}
+
+
+/* copies the longest run of ASCII that fits, 8 bytes at a time */
+static inline void
+copy_ascii (const unsigned char **in, const unsigned char *inend, unsigned char **out, unsigned char *outend)
+{
+	register const unsigned char *inptr = *in;
+	register unsigned char *outptr = *out;
+	guint64 word;
+	
+	while (inend - inptr >= 8 && outend - outptr >= 8) {
+		memcpy (&word, inptr, 8);
+		if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+			break;
+		
+		memcpy (outptr, inptr, 8);
+		outptr += 8;
+		inptr += 8;
+	}
+	
+	while (inptr < inend && outptr < outend && *inptr < 0x80)
+		*outptr++ = *inptr++;
+	
+	*out = outptr;
+	*in = inptr;
+}
+
+static size_t
+convert_8bit (const gunichar *table, char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	const unsigned char *inptr = (const unsigned char *) *inbuf;
+	const unsigned char *inend = inptr + *inleft;
+	unsigned char *outptr = (unsigned char *) *outbuf;
+	unsigned char *outend = outptr + *outleft;
+	size_t rv = 0;
+	gunichar c;
+	
+	while (inptr < inend) {
+		copy_ascii (&inptr, inend, &outptr, outend);
+		
+		if (inptr == inend)
+			break;
+		
+		if (outptr == outend)
+			goto e2big;
+		
+		if (table == NULL || (c = table[*inptr - 0x80]) == 0) {
+			errno = EILSEQ;
+			rv = (size_t) -1;
+			break;
+		}
+		
+		if (c < 0x800) {
+			if (outend - outptr < 2)
+				goto e2big;
+			
+			*outptr++ = 0xc0 | (c >> 6);
+		} else {
+			if (outend - outptr < 3)
+				goto e2big;
+			
+			*outptr++ = 0xe0 | (c >> 12);
+			*outptr++ = 0x80 | ((c >> 6) & 0x3f);
+		}
+		
+		*outptr++ = 0x80 | (c & 0x3f);
+		inptr++;
+	}
+	
+ done:
+	*inleft -= (char *) inptr - *inbuf;
+	*outleft -= (char *) outptr - *outbuf;
+	*inbuf = (char *) inptr;
+	*outbuf = (char *) outptr;
+	
+	return rv;
+	
+ e2big:
+	errno = E2BIG;
+	rv = (size_t) -1;
+	goto done;
+}
+
+/* validates the input as UTF-8 (as defined by rfc3629, so no
+ * surrogates, overlong forms or code points beyond U+10FFFF) while
+ * copying it to the output */
+static size_t
+convert_utf8 (char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	const unsigned char *inptr = (const unsigned char *) *inbuf;
+	const unsigned char *inend = inptr + *inleft;
+	unsigned char *outptr = (unsigned char *) *outbuf;
+	unsigned char *outend = outptr + *outleft;
+	unsigned char c, min, max;
+	size_t rv = 0;
+	int n, i;
+	
+	while (inptr < inend) {
+		copy_ascii (&inptr, inend, &outptr, outend);
+		
+		if (inptr == inend)
+			break;
+		
+		if (outptr == outend)
+			goto e2big;
+		
+		c = *inptr;
+		
+		if (c < 0xc2 || c > 0xf4)
+			goto eilseq;
+		
+		n = c < 0xe0 ? 2 : (c < 0xf0 ? 3 : 4);
+		min = c == 0xe0 ? 0xa0 : (c == 0xf0 ? 0x90 : 0x80);
+		max = c == 0xed ? 0x9f : (c == 0xf4 ? 0x8f : 0xbf);
+		
+		if (inend - inptr < n) {
+			/* like iconv, treat a sequence that is cut short by
+			 * the end of the input as incomplete as long as what
+			 * there is of it consists of continuation bytes */
+			for (i = 1; inptr + i < inend; i++) {
+				if ((inptr[i] & 0xc0) != 0x80)
+					goto eilseq;
+			}
+			
+			errno = EINVAL;
+			rv = (size_t) -1;
+			break;
+		}
+		
+		for (i = 1; i < n; i++) {
+			if (inptr[i] < min || inptr[i] > max)
+				goto eilseq;
+			
+			min = 0x80;
+			max = 0xbf;
+		}
+		
+		if (outend - outptr < n)
+			goto e2big;
+		
+		memcpy (outptr, inptr, n);
+		outptr += n;
+		inptr += n;
+	}
+	
+ done:
+	*inleft -= (char *) inptr - *inbuf;
+	*outleft -= (char *) outptr - *outbuf;
+	*inbuf = (char *) inptr;
+	*outbuf = (char *) outptr;
+	
+	return rv;
+	
+ eilseq:
+	errno = EILSEQ;
+	rv = (size_t) -1;
+	goto done;
+	
+ e2big:
+	errno = E2BIG;
+	rv = (size_t) -1;
+	goto done;
+}
+
+
+/**
+ * g_mime_charset_native_iconv:
+ * @charset: a native charset
+ * @inbuf: input buffer
+ * @inleft: number of bytes left in @inbuf
+ * @outbuf: output buffer
+ * @outleft: number of bytes left in @outbuf
+ *
+ * Converts text in @charset to UTF-8 with the same calling
+ * conventions as iconv(3). None of the native charsets are stateful,
+ * so a %NULL @inbuf (which would reset or flush an iconv descriptor)
+ * does nothing.
+ *
+ * Returns: %0 on success or (size_t) %-1 on fail as well as setting
+ * errno to %EILSEQ, %EINVAL or %E2BIG.
+ **/
+size_t
+g_mime_charset_native_iconv (GMimeCharsetNative charset, char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	if (inbuf == NULL || *inbuf == NULL)
+		return 0;
+	
+	switch (charset) {
+	case GMIME_CHARSET_NATIVE_US_ASCII:
+		return convert_8bit (NULL, inbuf, inleft, outbuf, outleft);
+	case GMIME_CHARSET_NATIVE_ISO_8859_1:
+		return convert_8bit (iso_8859_1, inbuf, inleft, outbuf, outleft);
+	case GMIME_CHARSET_NATIVE_ISO_8859_15:
+		return convert_8bit (iso_8859_15, inbuf, inleft, outbuf, outleft);
+	case GMIME_CHARSET_NATIVE_WINDOWS_1252:
+		return convert_8bit (windows_1252, inbuf, inleft, outbuf, outleft);
+	case GMIME_CHARSET_NATIVE_UTF_8:
+		return convert_utf8 (inbuf, inleft, outbuf, outleft);
+	default:
+		errno = EBADF;
+		return (size_t) -1;
+	}
+}
@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __GMIME_CHARSET_NATIVE_H__
+#define __GMIME_CHARSET_NATIVE_H__
+
+#include <glib.h>
+#include <iconv.h>
+
+G_BEGIN_DECLS
+
+/* the charsets that GMime can convert into UTF-8 without iconv */
+typedef enum {
+	GMIME_CHARSET_NATIVE_NONE = 0,
+	GMIME_CHARSET_NATIVE_US_ASCII,
+	GMIME_CHARSET_NATIVE_ISO_8859_1,
+	GMIME_CHARSET_NATIVE_ISO_8859_15,
+	GMIME_CHARSET_NATIVE_WINDOWS_1252,
+	GMIME_CHARSET_NATIVE_UTF_8
+} GMimeCharsetNative;
+
+G_GNUC_INTERNAL GMimeCharsetNative g_mime_charset_native (const char *charset);
+
+G_GNUC_INTERNAL size_t g_mime_charset_native_iconv (GMimeCharsetNative charset, char **inbuf, size_t *inleft,
+						    char **outbuf, size_t *outleft);
+
+/* converts with the native converter for @native if there is one, or with @cd otherwise */
+#define g_mime_charset_convert(native, cd, inbuf, inleft, outbuf, outleft) \
+	((native) ? g_mime_charset_native_iconv (native, inbuf, inleft, outbuf, outleft) : \
+	 iconv (cd, inbuf, inleft, outbuf, outleft))
+
+G_END_DECLS
+
+#endif /* __GMIME_CHARSET_NATIVE_H__ */
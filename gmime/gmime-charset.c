@@ -172,7 +172,7 @@ static int initialized = 0;
 #ifdef G_THREADS_ENABLED
 G_LOCK_DEFINE_STATIC (lock);
 #define CHARSET_UNLOCK() G_UNLOCK (lock)
-#define CHARSET_LOCK() G_UNLOCK (lock)
+#define CHARSET_LOCK() G_LOCK (lock)
 #else
 #define CHARSET_UNLOCK()
 #define CHARSET_LOCK()
@@ -27,8 +27,13 @@
 #include <string.h>
 #include <ctype.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 #include "gmime-table-private.h"
 #include "gmime-encodings.h"
+#include "gmime-internal.h"
 
 
 #ifdef ENABLE_WARNINGS
@@ -75,6 +80,248 @@ static unsigned char gmime_base64_rank[256] = {
 	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
 };
 
+/* number of base64 quartets per line of encoded output */
+#define BASE64_QUARTETS_PER_LINE 19
+
+/* Wide base64 kernels: the encoder converts whole 3-byte groups to
+ * quartets (without line breaks) and returns the number of groups it
+ * converted, the decoder converts runs of quartets that consist solely
+ * of base64 alphabet characters (no padding, whitespace or garbage,
+ * which are left to the scalar code) and returns the new input
+ * position. Both may stop early and leave the rest to the callers. */
+typedef size_t (* Base64EncodeFunc) (const unsigned char *inptr, const unsigned char *inend, size_t ngroups, unsigned char *outptr);
+typedef const unsigned char * (* Base64DecodeFunc) (const unsigned char *inptr, const unsigned char *inend, unsigned char **outptr, const unsigned char **retry);
+
+#ifdef HAVE_X86_SIMD
+/* The following are based on the algorithms described by Wojciech Muła
+ * and used by Alfred Klomp's base64 library. */
+
+__attribute__((target("sse4.1")))
+static inline __m128i
+base64_encode_block_sse41 (__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i t0, t1, t2, t3, indices, mask;
+	
+	/* split each 3-byte group into four 6-bit values, one per byte */
+	in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+	t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+	t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+	t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+	in = _mm_or_si128 (t1, t3);
+	
+	/* translate the 6-bit values into the base64 alphabet */
+	indices = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+	mask = _mm_cmpgt_epi8 (in, _mm_set1_epi8 (25));
+	indices = _mm_sub_epi8 (indices, mask);
+	
+	return _mm_add_epi8 (in, _mm_shuffle_epi8 (lut, indices));
+}
+
+/* decodes 16 base64 characters into 12 bytes at @outptr or returns a
+ * mask of the characters that aren't in the base64 alphabet */
+__attribute__((target("sse4.1")))
+static inline unsigned int
+base64_decode_block_sse41 (const unsigned char *inptr, unsigned char *outptr)
+{
+	const __m128i lut_lo = _mm_setr_epi8 (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8 (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8 (0x2f);
+	__m128i in, hi_nibbles, lo_nibbles, hi, lo, roll, out;
+	guint32 tail;
+	
+	in = _mm_loadu_si128 ((const __m128i *) inptr);
+	hi_nibbles = _mm_and_si128 (_mm_srli_epi32 (in, 4), mask_2f);
+	lo_nibbles = _mm_and_si128 (in, mask_2f);
+	hi = _mm_shuffle_epi8 (lut_hi, hi_nibbles);
+	lo = _mm_shuffle_epi8 (lut_lo, lo_nibbles);
+	
+	if (!_mm_testz_si128 (lo, hi))
+		return ~(unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_and_si128 (lo, hi), _mm_setzero_si128 ())) & 0xffff;
+	
+	roll = _mm_shuffle_epi8 (lut_roll, _mm_add_epi8 (_mm_cmpeq_epi8 (in, mask_2f), hi_nibbles));
+	in = _mm_add_epi8 (in, roll);
+	
+	/* pack each quartet of 6-bit values into 3 bytes */
+	out = _mm_maddubs_epi16 (in, _mm_set1_epi32 (0x01400140));
+	out = _mm_madd_epi16 (out, _mm_set1_epi32 (0x00011000));
+	out = _mm_shuffle_epi8 (out, _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	
+	_mm_storel_epi64 ((__m128i *) outptr, out);
+	tail = (guint32) _mm_extract_epi32 (out, 2);
+	memcpy (outptr + 8, &tail, sizeof (tail));
+	
+	return 0;
+}
+
+__attribute__((target("sse4.1")))
+static size_t
+base64_encode_sse41 (const unsigned char *inptr, const unsigned char *inend, size_t ngroups, unsigned char *outptr)
+{
+	size_t n = 0;
+	
+	/* each block encodes 12 bytes but loads 16 */
+	while (ngroups - n >= 4 && inend - inptr >= 16) {
+		_mm_storeu_si128 ((__m128i *) outptr, base64_encode_block_sse41 (_mm_loadu_si128 ((const __m128i *) inptr)));
+		outptr += 16;
+		inptr += 12;
+		n += 4;
+	}
+	
+	return n;
+}
+
+__attribute__((target("sse4.1")))
+static const unsigned char *
+base64_decode_sse41 (const unsigned char *inptr, const unsigned char *inend, unsigned char **outbuf, const unsigned char **retry)
+{
+	unsigned char *outptr = *outbuf;
+	unsigned int mask;
+	
+	*retry = inend;
+	
+	while (inend - inptr >= 16) {
+		if ((mask = base64_decode_block_sse41 (inptr, outptr)) != 0) {
+			*retry = inptr + __builtin_ctz (mask) + 1;
+			break;
+		}
+		
+		outptr += 12;
+		inptr += 16;
+	}
+	
+	*outbuf = outptr;
+	
+	return inptr;
+}
+
+__attribute__((target("avx2")))
+static size_t
+base64_encode_avx2 (const unsigned char *inptr, const unsigned char *inend, size_t ngroups, unsigned char *outptr)
+{
+	const __m256i lut = _mm256_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+					      65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m256i in, t0, t1, t2, t3, indices, mask;
+	size_t n = 0;
+	
+	/* each block encodes 2 x 12 bytes, the second of which loads 16 */
+	while (ngroups - n >= 8 && inend - inptr >= 28) {
+		in = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) inptr)),
+					      _mm_loadu_si128 ((const __m128i *) (inptr + 12)), 1);
+		
+		in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+							       10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+		t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+		t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+		in = _mm256_or_si256 (t1, t3);
+		
+		indices = _mm256_subs_epu8 (in, _mm256_set1_epi8 (51));
+		mask = _mm256_cmpgt_epi8 (in, _mm256_set1_epi8 (25));
+		indices = _mm256_sub_epi8 (indices, mask);
+		
+		_mm256_storeu_si256 ((__m256i *) outptr, _mm256_add_epi8 (in, _mm256_shuffle_epi8 (lut, indices)));
+		outptr += 32;
+		inptr += 24;
+		n += 8;
+	}
+	
+	if (ngroups - n >= 4 && inend - inptr >= 16) {
+		_mm_storeu_si128 ((__m128i *) outptr, base64_encode_block_sse41 (_mm_loadu_si128 ((const __m128i *) inptr)));
+		n += 4;
+	}
+	
+	return n;
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *
+base64_decode_avx2 (const unsigned char *inptr, const unsigned char *inend, unsigned char **outbuf, const unsigned char **retry)
+{
+	const __m256i lut_lo = _mm256_setr_epi8 (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+						 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8 (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+						 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+						   0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8 (0x2f);
+	__m256i in, hi_nibbles, lo_nibbles, hi, lo, roll, out;
+	unsigned char *outptr = *outbuf;
+	unsigned int mask;
+	
+	*retry = inend;
+	
+	while (inend - inptr >= 32) {
+		in = _mm256_loadu_si256 ((const __m256i *) inptr);
+		hi_nibbles = _mm256_and_si256 (_mm256_srli_epi32 (in, 4), mask_2f);
+		lo_nibbles = _mm256_and_si256 (in, mask_2f);
+		hi = _mm256_shuffle_epi8 (lut_hi, hi_nibbles);
+		lo = _mm256_shuffle_epi8 (lut_lo, lo_nibbles);
+		
+		if (!_mm256_testz_si256 (lo, hi)) {
+			mask = ~(unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_and_si256 (lo, hi), _mm256_setzero_si256 ()));
+			*retry = inptr + __builtin_ctz (mask) + 1;
+			*outbuf = outptr;
+			
+			return inptr;
+		}
+		
+		roll = _mm256_shuffle_epi8 (lut_roll, _mm256_add_epi8 (_mm256_cmpeq_epi8 (in, mask_2f), hi_nibbles));
+		in = _mm256_add_epi8 (in, roll);
+		
+		out = _mm256_maddubs_epi16 (in, _mm256_set1_epi32 (0x01400140));
+		out = _mm256_madd_epi16 (out, _mm256_set1_epi32 (0x00011000));
+		out = _mm256_shuffle_epi8 (out, _mm256_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+								  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		
+		/* move the two 12-byte halves next to each other */
+		out = _mm256_permutevar8x32_epi32 (out, _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 7, 7));
+		_mm_storeu_si128 ((__m128i *) outptr, _mm256_castsi256_si128 (out));
+		_mm_storel_epi64 ((__m128i *) (outptr + 16), _mm256_extracti128_si256 (out, 1));
+		
+		outptr += 24;
+		inptr += 32;
+	}
+	
+	if (inend - inptr >= 16) {
+		if ((mask = base64_decode_block_sse41 (inptr, outptr)) != 0) {
+			*retry = inptr + __builtin_ctz (mask) + 1;
+		} else {
+			outptr += 12;
+			inptr += 16;
+		}
+	}
+	
+	*outbuf = outptr;
+	
+	return inptr;
+}
+#endif /* HAVE_X86_SIMD */
+
+/* picked at runtime based on the capabilities of the cpu */
+static Base64EncodeFunc base64_encode_fast = NULL;
+static Base64DecodeFunc base64_decode_fast = NULL;
+
+
+void
+g_mime_encodings_init (void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init ();
+	
+	if (__builtin_cpu_supports ("avx2")) {
+		base64_encode_fast = base64_encode_avx2;
+		base64_decode_fast = base64_decode_avx2;
+	} else if (__builtin_cpu_supports ("sse4.1")) {
+		base64_encode_fast = base64_encode_sse41;
+		base64_decode_fast = base64_decode_sse41;
+	}
+#endif
+}
+
 static unsigned char gmime_uu_rank[256] = {
 	 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
 	 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
@@ -99,6 +346,29 @@ static unsigned char tohex[16] = {
 	'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
 };
 
+static unsigned char gmime_hex_rank[256] = {
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,255,255,255,255,255,255,
+	255, 10, 11, 12, 13, 14, 15,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255, 10, 11, 12, 13, 14, 15,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+	255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+};
+
+/* characters that the quoted-printable encoder can always copy verbatim
+ * (blanks only qualify when they are not at the end of a line) */
+#define is_qpliteral(x) ((gmime_special_table[(unsigned char)(x)] & (IS_QPSAFE | IS_BLANK)) == IS_QPSAFE)
+
 
 /**
  * g_mime_content_encoding_from_string:
@@ -445,6 +715,23 @@ g_mime_encoding_base64_encode_step (const unsigned char *inbuf, size_t inlen, un
 		
 		/* yes, we jump into the loop, no i'm not going to change it, its beautiful! */
 		while (inptr < inend) {
+			/* encode as much of the rest of the line as we can in one go */
+			if (base64_encode_fast != NULL && already < BASE64_QUARTETS_PER_LINE) {
+				size_t n = MIN ((size_t) (inend + 2 - inptr) / 3, (size_t) (BASE64_QUARTETS_PER_LINE - already));
+				
+				if ((n = base64_encode_fast (inptr, inend + 2, n, outptr)) > 0) {
+					outptr += n * 4;
+					inptr += n * 3;
+					
+					if ((already += n) >= BASE64_QUARTETS_PER_LINE) {
+						*outptr++ = '\n';
+						already = 0;
+					}
+					
+					continue;
+				}
+			}
+			
 			c1 = *inptr++;
 		skip1:
 			c2 = *inptr++;
@@ -455,7 +742,7 @@ g_mime_encoding_base64_encode_step (const unsigned char *inbuf, size_t inlen, un
 			*outptr++ = base64_alphabet [((c2 & 0x0f) << 2) | (c3 >> 6)];
 			*outptr++ = base64_alphabet [c3 & 0x3f];
 			/* this is a bit ugly ... */
-			if ((++already) >= 19) {
+			if ((++already) >= BASE64_QUARTETS_PER_LINE) {
 				*outptr++ = '\n';
 				already = 0;
 			}
@@ -501,6 +788,9 @@ g_mime_encoding_base64_encode_step (const unsigned char *inbuf, size_t inlen, un
  *
  * Decodes a chunk of base64 encoded data.
  *
+ * @outbuf may overlap @inbuf as long as it starts at least 16 bytes
+ * before it.
+ *
  * Returns: the number of bytes decoded (which have been dumped in
  * @outbuf).
  **/
@@ -508,8 +798,8 @@ size_t
 g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, int *state, guint32 *save)
 {
 	register const unsigned char *inptr;
-	register unsigned char *outptr;
-	const unsigned char *inend;
+	const unsigned char *inend, *retry;
+	unsigned char *outptr;
 	register guint32 saved;
 	unsigned char c;
 	int npad, n, i;
@@ -517,6 +807,7 @@ g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, un
 	inend = inbuf + inlen;
 	outptr = outbuf;
 	inptr = inbuf;
+	retry = inbuf;
 	
 	npad = (*state >> 8) & 0xff;
 	n = *state & 0xff;
@@ -524,6 +815,21 @@ g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, un
 	
 	/* convert 4 base64 bytes to 3 normal bytes */
 	while (inptr < inend) {
+		if (n == 0 && npad == 0 && inptr >= retry && base64_decode_fast != NULL) {
+			unsigned char *start = outptr;
+			
+			/* decode whole quartets in bulk until we hit something
+			 * (e.g. a line break) that needs special care */
+			inptr = base64_decode_fast (inptr, inend, &outptr, &retry);
+			
+			/* the kernels decode at least 4 quartets at a time, so
+			 * @saved can be rebuilt from the last 4 decoded bytes */
+			if (outptr - start >= 4)
+				saved = ((guint32) outptr[-4] << 24) | (outptr[-3] << 16) | (outptr[-2] << 8) | outptr[-1];
+			
+			continue;
+		}
+		
 		c = gmime_base64_rank[*inptr++];
 		if (c != 0xff) {
 			saved = (saved << 6) | c;
@@ -945,9 +1251,41 @@ g_mime_encoding_quoted_encode_step (const unsigned char *inbuf, size_t inlen, un
 	register unsigned char *outptr = outbuf;
 	register guint32 sofar = *save;  /* keeps track of how many chars on a line */
 	register int last = *state;  /* keeps track if last char to end was a space cr etc */
+	const unsigned char *start;
 	unsigned char c;
+	size_t n;
 	
 	while (inptr < inend) {
+		if (last == -1 && is_qpliteral (*inptr)) {
+			/* copy the whole run of literal characters at once,
+			 * inserting soft line breaks where needed */
+			start = inptr++;
+			while (inptr < inend) {
+				if (!is_qpliteral (*inptr)) {
+					if (!is_blank (*inptr) || inptr + 1 == inend || inptr[1] == '\r' || inptr[1] == '\n')
+						break;
+				}
+				
+				inptr++;
+			}
+	
+			while (start < inptr) {
+				if (sofar > 74) {
+					*outptr++ = '=';
+					*outptr++ = '\n';
+					sofar = 0;
+				}
+	
+				n = MIN ((size_t) (inptr - start), 75 - sofar);
+				memcpy (outptr, start, n);
+				outptr += n;
+				start += n;
+				sofar += n;
+			}
+	
+			continue;
+		}
+	
 		c = *inptr++;
 		if (c == '\r') {
 			if (last != -1) {
@@ -1028,6 +1366,9 @@ g_mime_encoding_quoted_encode_step (const unsigned char *inbuf, size_t inlen, un
  * Decodes a block of quoted-printable encoded data. Performs a
  * 'decode step' on a chunk of QP encoded data.
  *
+ * @outbuf may overlap @inbuf as long as it starts at least 16 bytes
+ * before it.
+ *
  * Returns: the number of bytes decoded.
  **/
 size_t
@@ -1043,9 +1384,11 @@ g_mime_encoding_quoted_decode_step (const unsigned char *inbuf, size_t inlen, un
 	const register unsigned char *inptr = inbuf;
 	const unsigned char *inend = inbuf + inlen;
 	register unsigned char *outptr = outbuf;
+	const unsigned char *eq;
 	guint32 isave = *save;
 	int istate = *state;
 	unsigned char c;
+	size_t n;
 	
 	d(printf ("quoted-printable, decoding text '%.*s'\n", inlen, inbuf));
 	
@@ -1053,22 +1396,44 @@ g_mime_encoding_quoted_decode_step (const unsigned char *inbuf, size_t inlen, un
 		switch (istate) {
 		case 0:
 			while (inptr < inend) {
-				c = *inptr++;
-				/* FIXME: use a specials table to avoid 3 comparisons for the common case */
-				if (c == '=') { 
+				/* copy everything up to the next '=' verbatim */
+				if (!(eq = memchr (inptr, '=', inend - inptr))) {
+					n = inend - inptr;
+					memmove (outptr, inptr, n);
+					outptr += n;
+					inptr = inend;
+					break;
+				}
+	
+				n = eq - inptr;
+				memmove (outptr, inptr, n);
+				outptr += n;
+				inptr = eq + 1;
+	
+				if (inend - inptr < 2) {
+					/* let the state machine handle the rest */
 					istate = 1;
 					break;
 				}
-#ifdef CANONICALISE_EOL
-				/*else if (c=='\r') {
-					state = 3;
-				} else if (c=='\n') {
-					*outptr++ = '\r';
-					*outptr++ = c;
-					} */
-#endif
-				else {
-					*outptr++ = c;
+	
+				if (inptr[0] == '\n') {
+					/* soft break ... unix end of line */
+					inptr++;
+				} else if (gmime_hex_rank[inptr[0]] != 0xff && gmime_hex_rank[inptr[1]] != 0xff) {
+					isave = tohex[gmime_hex_rank[inptr[0]]];
+					*outptr++ = (gmime_hex_rank[inptr[0]] << 4) | gmime_hex_rank[inptr[1]];
+					inptr += 2;
+				} else if (inptr[0] == '\r' && inptr[1] == '\n') {
+					/* soft break ... canonical end of line */
+					isave = '\r';
+					inptr += 2;
+				} else {
+					/* just output the data */
+					isave = inptr[0];
+					*outptr++ = '=';
+					*outptr++ = inptr[0];
+					*outptr++ = inptr[1];
+					inptr += 2;
 				}
 			}
 			break;
@@ -1084,11 +1449,9 @@ g_mime_encoding_quoted_decode_step (const unsigned char *inbuf, size_t inlen, un
 			break;
 		case 2:
 			c = *inptr++;
-			if (isxdigit (c) && isxdigit (isave)) {
-				c = toupper ((int) c);
-				isave = toupper ((int) isave);
-				*outptr++ = (((isave >= 'A' ? isave - 'A' + 10 : isave - '0') & 0x0f) << 4)
-					| ((c >= 'A' ? c - 'A' + 10 : c - '0') & 0x0f);
+			if (gmime_hex_rank[c] != 0xff && gmime_hex_rank[isave & 0xff] != 0xff) {
+				*outptr++ = (gmime_hex_rank[isave & 0xff] << 4) | gmime_hex_rank[c];
+				isave = tohex[gmime_hex_rank[isave & 0xff]];
 			} else if (c == '\n' && isave == '\r') {
 				/* soft break ... canonical end of line */
 			} else {
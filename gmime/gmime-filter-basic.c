@@ -252,5 +252,10 @@ g_mime_filter_basic_new (GMimeContentEncoding encoding, gboolean encode)
 	else
 		g_mime_encoding_init_decode (&basic->encoder, encoding);
 	
+	/* base64 and quoted-printable decoding never write past what they've read */
+	if (!encode && (encoding == GMIME_CONTENT_ENCODING_BASE64 ||
+			encoding == GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE))
+		g_mime_filter_set_flags ((GMimeFilter *) basic, GMIME_FILTER_FLAGS_IN_PLACE);
+	
 	return (GMimeFilter *) basic;
 }
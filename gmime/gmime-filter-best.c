@@ -100,6 +100,8 @@ static void
 g_mime_filter_best_init (GMimeFilterBest *filter, GMimeFilterBestClass *klass)
 {
 	filter->frombuf[5] = '\0';
+	
+	g_mime_filter_set_flags ((GMimeFilter *) filter, GMIME_FILTER_FLAGS_PASS_THROUGH);
 }
 
 static void
@@ -26,6 +26,8 @@
 #include <errno.h>
 
 #include "gmime-filter-charset.h"
+#include "gmime-charset-detect.h"
+#include "gmime-charset-native.h"
 #include "gmime-charset.h"
 #include "gmime-iconv.h"
 
@@ -41,6 +43,16 @@
  **/
 
 
+/* how much of the input is sampled before settling on the charset to convert from */
+#define DETECT_SAMPLE_SIZE 4096
+
+struct _GMimeFilterCharsetPrivate {
+	GMimeCharsetNative native;	/* the built-in converter used instead of cd, if any */
+	GMimeCharsetDetector *detector;	/* determines from_charset, if it was not given */
+	gboolean detecting;		/* TRUE while from_charset is still being determined */
+};
+
+
 static void g_mime_filter_charset_class_init (GMimeFilterCharsetClass *klass);
 static void g_mime_filter_charset_init (GMimeFilterCharset *filter, GMimeFilterCharsetClass *klass);
 static void g_mime_filter_charset_finalize (GObject *object);
@@ -103,6 +115,10 @@ g_mime_filter_charset_init (GMimeFilterCharset *filter, GMimeFilterCharsetClass
 	filter->from_charset = NULL;
 	filter->to_charset = NULL;
 	filter->cd = (iconv_t) -1;
+	filter->priv = g_new (struct _GMimeFilterCharsetPrivate, 1);
+	filter->priv->native = GMIME_CHARSET_NATIVE_NONE;
+	filter->priv->detector = NULL;
+	filter->priv->detecting = FALSE;
 }
 
 static void
@@ -115,6 +131,11 @@ g_mime_filter_charset_finalize (GObject *object)
 	if (filter->cd != (iconv_t) -1)
 		g_mime_iconv_close (filter->cd);
 	
+	if (filter->priv->detector)
+		g_mime_charset_detector_free (filter->priv->detector);
+	
+	g_free (filter->priv);
+	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -123,8 +144,47 @@ static GMimeFilter *
 filter_copy (GMimeFilter *filter)
 {
 	GMimeFilterCharset *charset = (GMimeFilterCharset *) filter;
+	GMimeFilterCharset *copy;
+	
+	if (charset->priv->detector == NULL)
+		return g_mime_filter_charset_new (charset->from_charset, charset->to_charset);
+	
+	copy = g_object_newv (GMIME_TYPE_FILTER_CHARSET, 0, NULL);
+	copy->priv->detector = g_mime_charset_detector_copy (charset->priv->detector);
+	copy->to_charset = g_strdup (charset->to_charset);
+	copy->priv->detecting = TRUE;
 	
-	return g_mime_filter_charset_new (charset->from_charset, charset->to_charset);
+	return (GMimeFilter *) copy;
+}
+
+/* settles on the charset that the sampled input fits best */
+static void
+filter_detect_charset (GMimeFilterCharset *charset)
+{
+	GMimeCharsetNative native;
+	const char *from;
+	gboolean exact;
+	iconv_t cd;
+	
+	charset->priv->detecting = FALSE;
+	
+	while ((from = g_mime_charset_detector_best (charset->priv->detector, &exact))) {
+		native = GMIME_CHARSET_NATIVE_NONE;
+		cd = (iconv_t) -1;
+		
+		if (g_mime_charset_native (charset->to_charset) == GMIME_CHARSET_NATIVE_UTF_8)
+			native = g_mime_charset_native (from);
+		
+		if (!native && (cd = g_mime_iconv_open (charset->to_charset, from)) == (iconv_t) -1) {
+			g_mime_charset_detector_reject (charset->priv->detector, from, (size_t) -1);
+			continue;
+		}
+		
+		charset->from_charset = g_strdup (from);
+		charset->priv->native = native;
+		charset->cd = cd;
+		break;
+	}
 }
 
 static void
@@ -136,7 +196,23 @@ filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	char *inbuf;
 	char *outbuf;
 	
-	if (charset->cd == (iconv_t) -1)
+	if (charset->priv->detecting) {
+		/* everything backed up so far has already been sampled */
+		converted = g_mime_charset_detector_length (charset->priv->detector);
+		g_mime_charset_detector_step (charset->priv->detector, in + converted, len - converted);
+		
+		if (len < DETECT_SAMPLE_SIZE) {
+			g_mime_filter_backup (filter, in, len);
+			*out = in;
+			*outlen = 0;
+			*outprespace = prespace;
+			return;
+		}
+		
+		filter_detect_charset (charset);
+	}
+	
+	if (charset->cd == (iconv_t) -1 && !charset->priv->native)
 		goto noop;
 	
 	g_mime_filter_set_size (filter, len * 5 + 16, FALSE);
@@ -147,7 +223,7 @@ filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	inleft = len;
 	
 	do {
-		converted = iconv (charset->cd, &inbuf, &inleft, &outbuf, &outleft);
+		converted = g_mime_charset_convert (charset->priv->native, charset->cd, &inbuf, &inleft, &outbuf, &outleft);
 		if (converted == (size_t) -1) {
 			if (errno == E2BIG || errno == EINVAL)
 				break;
@@ -203,7 +279,13 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	char *inbuf;
 	char *outbuf;
 	
-	if (charset->cd == (iconv_t) -1)
+	if (charset->priv->detecting) {
+		converted = g_mime_charset_detector_length (charset->priv->detector);
+		g_mime_charset_detector_step (charset->priv->detector, in + converted, len - converted);
+		filter_detect_charset (charset);
+	}
+	
+	if (charset->cd == (iconv_t) -1 && !charset->priv->native)
 		goto noop;
 	
 	g_mime_filter_set_size (filter, len * 5 + 16, FALSE);
@@ -215,7 +297,7 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	
 	if (inleft > 0) {
 		do {
-			converted = iconv (charset->cd, &inbuf, &inleft, &outbuf, &outleft);
+			converted = g_mime_charset_convert (charset->priv->native, charset->cd, &inbuf, &inleft, &outbuf, &outleft);
 			if (converted != (size_t) -1)
 				continue;
 			
@@ -258,7 +340,7 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	}
 	
 	/* flush the iconv conversion */
-	while (iconv (charset->cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+	while (g_mime_charset_convert (charset->priv->native, charset->cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
 		if (errno != E2BIG)
 			break;
 		
@@ -286,8 +368,21 @@ filter_reset (GMimeFilter *filter)
 {
 	GMimeFilterCharset *charset = (GMimeFilterCharset *) filter;
 	
-	if (charset->cd != (iconv_t) -1)
+	if (charset->priv->detector != NULL) {
+		/* start over with detecting the charset */
+		if (charset->cd != (iconv_t) -1) {
+			g_mime_iconv_close (charset->cd);
+			charset->cd = (iconv_t) -1;
+		}
+		
+		g_mime_charset_detector_reset (charset->priv->detector);
+		charset->priv->native = GMIME_CHARSET_NATIVE_NONE;
+		g_free (charset->from_charset);
+		charset->from_charset = NULL;
+		charset->priv->detecting = TRUE;
+	} else if (charset->cd != (iconv_t) -1) {
 		iconv (charset->cd, NULL, NULL, NULL, NULL);
+	}
 }
 
 
@@ -304,17 +399,59 @@ filter_reset (GMimeFilter *filter)
 GMimeFilter *
 g_mime_filter_charset_new (const char *from_charset, const char *to_charset)
 {
+	GMimeCharsetNative native = GMIME_CHARSET_NATIVE_NONE;
 	GMimeFilterCharset *new;
-	iconv_t cd;
+	iconv_t cd = (iconv_t) -1;
+	
+	/* the most common charsets are converted to UTF-8 without iconv */
+	if (g_mime_charset_native (to_charset) == GMIME_CHARSET_NATIVE_UTF_8)
+		native = g_mime_charset_native (from_charset);
 	
-	cd = g_mime_iconv_open (to_charset, from_charset);
-	if (cd == (iconv_t) -1)
+	if (!native && (cd = g_mime_iconv_open (to_charset, from_charset)) == (iconv_t) -1)
 		return NULL;
 	
 	new = g_object_newv (GMIME_TYPE_FILTER_CHARSET, 0, NULL);
 	new->from_charset = g_strdup (from_charset);
 	new->to_charset = g_strdup (to_charset);
+	new->priv->native = native;
 	new->cd = cd;
 	
 	return (GMimeFilter *) new;
 }
+
+
+/**
+ * g_mime_filter_charset_new_detect:
+ * @options: (nullable): a #GMimeParserOptions or %NULL
+ * @to_charset: charset to convert to
+ *
+ * Creates a new #GMimeFilterCharset filter for input in an unknown
+ * charset, such as the content of a text part without a charset
+ * parameter.
+ *
+ * The filter holds on to the first few kilobytes of input and
+ * converts from whichever of the fallback charsets in @options (or
+ * in the default parser options, if @options is %NULL) they fit
+ * best, in a single pass, the same way g_mime_utils_decode_8bit()
+ * does. If none of them can be converted from, the input is passed
+ * through as-is.
+ *
+ * Returns: a new charset filter.
+ **/
+GMimeFilter *
+g_mime_filter_charset_new_detect (GMimeParserOptions *options, const char *to_charset)
+{
+	GMimeFilterCharset *new;
+	
+	g_return_val_if_fail (to_charset != NULL, NULL);
+	
+	if (options == NULL)
+		options = g_mime_parser_options_get_default ();
+	
+	new = g_object_newv (GMIME_TYPE_FILTER_CHARSET, 0, NULL);
+	new->priv->detector = g_mime_charset_detector_new (g_mime_parser_options_get_fallback_charsets (options));
+	new->to_charset = g_strdup (to_charset);
+	new->priv->detecting = TRUE;
+	
+	return (GMimeFilter *) new;
+}
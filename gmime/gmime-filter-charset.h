@@ -24,6 +24,7 @@
 
 #include <iconv.h>
 #include <gmime/gmime-filter.h>
+#include <gmime/gmime-parser-options.h>
 
 G_BEGIN_DECLS
 
@@ -43,6 +44,7 @@ typedef struct _GMimeFilterCharsetClass GMimeFilterCharsetClass;
  * @from_charset: charset that the filter is converting from
  * @to_charset: charset the filter is converting to
  * @cd: charset conversion state
+ * @priv: private state data
  *
  * A filter to convert between charsets.
  **/
@@ -52,6 +54,8 @@ struct _GMimeFilterCharset {
 	char *from_charset;
 	char *to_charset;
 	iconv_t cd;
+	
+	struct _GMimeFilterCharsetPrivate *priv;
 };
 
 struct _GMimeFilterCharsetClass {
@@ -63,6 +67,7 @@ struct _GMimeFilterCharsetClass {
 GType g_mime_filter_charset_get_type (void);
 
 GMimeFilter *g_mime_filter_charset_new (const char *from_charset, const char *to_charset);
+GMimeFilter *g_mime_filter_charset_new_detect (GMimeParserOptions *options, const char *to_charset);
 
 G_END_DECLS
 
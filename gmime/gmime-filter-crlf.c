@@ -236,5 +236,9 @@ g_mime_filter_crlf_new (gboolean encode, gboolean dots)
 	new->encode = encode;
 	new->dots = dots;
 	
+	/* decoding never grows the data by more than the pending '\r' */
+	if (!encode)
+		g_mime_filter_set_flags ((GMimeFilter *) new, GMIME_FILTER_FLAGS_IN_PLACE);
+	
 	return (GMimeFilter *) new;
 }
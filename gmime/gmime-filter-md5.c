@@ -103,6 +103,8 @@ g_mime_filter_md5_init (GMimeFilterMd5 *filter, GMimeFilterMd5Class *klass)
 {
 	filter->priv = g_new (struct _GMimeFilterMd5Private, 1);
 	md5_init (&filter->priv->md5);
+	
+	g_mime_filter_set_flags ((GMimeFilter *) filter, GMIME_FILTER_FLAGS_PASS_THROUGH);
 }
 
 static void
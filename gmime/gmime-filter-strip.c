@@ -99,7 +99,8 @@ g_mime_filter_strip_class_init (GMimeFilterStripClass *klass)
 static void
 g_mime_filter_strip_init (GMimeFilterStrip *filter, GMimeFilterStripClass *klass)
 {
-	/* no-op */
+	/* the output is always a subset of the input */
+	g_mime_filter_set_flags ((GMimeFilter *) filter, GMIME_FILTER_FLAGS_IN_PLACE);
 }
 
 static void
@@ -138,7 +139,7 @@ filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 			inptr++;
 		}
 		
-		memcpy (outptr, start, last - start);
+		memmove (outptr, start, last - start);
 		outptr += (last - start);
 		if (inptr < inend) {
 			/* write the newline */
@@ -0,0 +1,361 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include "gmime-filter-text.h"
+#include "gmime-charset.h"
+#include "gmime-charset-native.h"
+#include "gmime-iconv.h"
+
+
+/**
+ * SECTION: gmime-filter-text
+ * @title: GMimeFilterText
+ * @short_description: Text extraction filter
+ * @see_also: #GMimeFilterBasic, #GMimeFilterCharset, #GMimeFilterCRLF
+ *
+ * A #GMimeFilter which turns the raw content of a textual MIME part
+ * into UTF-8 text with UNIX line endings in a single pass. It is
+ * equivalent to (but a lot cheaper than) stacking a #GMimeFilterBasic
+ * decoder, a #GMimeFilterCharset and a #GMimeFilterCRLF decoder.
+ **/
+
+
+struct _GMimeFilterTextPrivate {
+	GMimeCharsetNative native;	/* the built-in converter used instead of cd, if any */
+	char *decbuf;			/* the decoded content before it is converted */
+	size_t decsize;			/* the size of decbuf */
+	size_t declen;			/* the number of unconverted bytes left over in decbuf */
+	gboolean saw_cr;		/* TRUE if the last converted character was a '\r' */
+};
+
+static void g_mime_filter_text_class_init (GMimeFilterTextClass *klass);
+static void g_mime_filter_text_init (GMimeFilterText *filter, GMimeFilterTextClass *klass);
+static void g_mime_filter_text_finalize (GObject *object);
+
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_text_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterTextClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_text_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterText),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_text_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterText", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_text_class_init (GMimeFilterTextClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	object_class->finalize = g_mime_filter_text_finalize;
+	
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+}
+
+static void
+g_mime_filter_text_init (GMimeFilterText *filter, GMimeFilterTextClass *klass)
+{
+	filter->charset = NULL;
+	filter->cd = (iconv_t) -1;
+	filter->priv = g_new (struct _GMimeFilterTextPrivate, 1);
+	filter->priv->native = GMIME_CHARSET_NATIVE_NONE;
+	filter->priv->decbuf = NULL;
+	filter->priv->decsize = 0;
+	filter->priv->declen = 0;
+	filter->priv->saw_cr = FALSE;
+}
+
+static void
+g_mime_filter_text_finalize (GObject *object)
+{
+	GMimeFilterText *filter = (GMimeFilterText *) object;
+	
+	if (filter->cd != (iconv_t) -1)
+		g_mime_iconv_close (filter->cd);
+	g_free (filter->charset);
+	g_free (filter->priv->decbuf);
+	g_free (filter->priv);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	
+	return g_mime_filter_text_new (text->decoder.encoding, text->charset);
+}
+
+/* Converts CRLF sequences into LF in place the same way that
+ * GMimeFilterCRLF does, holding back a trailing '\r' until we know
+ * what follows it. There must be 1 byte of space in front of @inbuf
+ * for a '\r' held back from the previous block. */
+static char *
+canonicalize_eol (GMimeFilterText *text, char *inbuf, size_t inlen, size_t *outlen)
+{
+	register char *inptr = inbuf;
+	char *inend = inbuf + inlen;
+	char *outptr, *start, *cr;
+	size_t n;
+	
+	if (text->priv->saw_cr) {
+		start = outptr = inbuf - 1;
+	} else {
+		if (!(inptr = memchr (inbuf, '\r', inlen))) {
+			*outlen = inlen;
+			return inbuf;
+		}
+		
+		start = inbuf;
+		outptr = inptr;
+	}
+	
+	while (inptr < inend) {
+		if (*inptr == '\r') {
+			text->priv->saw_cr = TRUE;
+			inptr++;
+			continue;
+		}
+		
+		if (text->priv->saw_cr) {
+			text->priv->saw_cr = FALSE;
+			
+			if (*inptr != '\n')
+				*outptr++ = '\r';
+		}
+		
+		/* copy everything up to the next '\r' */
+		if (!(cr = memchr (inptr, '\r', inend - inptr)))
+			cr = inend;
+		
+		n = cr - inptr;
+		memmove (outptr, inptr, n);
+		outptr += n;
+		inptr = cr;
+	}
+	
+	*outlen = outptr - start;
+	
+	return start;
+}
+
+static void
+filter_text (GMimeFilter *filter, char *inbuf, size_t inlen, gboolean flush,
+	     char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	size_t inleft, outleft, converted, len, n;
+	char *inptr, *outptr;
+	
+	len = g_mime_encoding_outlen (&text->decoder, inlen);
+	
+	if (text->cd == (iconv_t) -1 && !text->priv->native) {
+		/* no charset conversion needed, decode straight into the output buffer */
+		g_mime_filter_set_size (filter, len + 1, FALSE);
+		
+		if (flush)
+			n = g_mime_encoding_flush (&text->decoder, inbuf, inlen, filter->outbuf + 1);
+		else
+			n = g_mime_encoding_step (&text->decoder, inbuf, inlen, filter->outbuf + 1);
+		
+		outptr = filter->outbuf + 1 + n;
+	} else {
+		if (text->priv->declen == 0 && text->decoder.encoding != GMIME_CONTENT_ENCODING_BASE64 &&
+		    text->decoder.encoding != GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE) {
+			/* nothing to decode, convert the input as-is */
+			inptr = inbuf;
+			inleft = inlen;
+		} else {
+			if (text->priv->declen + len > text->priv->decsize) {
+				text->priv->decsize = text->priv->declen + len;
+				text->priv->decbuf = g_realloc (text->priv->decbuf, text->priv->decsize);
+			}
+			
+			inptr = text->priv->decbuf + text->priv->declen;
+			if (flush)
+				n = g_mime_encoding_flush (&text->decoder, inbuf, inlen, inptr);
+			else
+				n = g_mime_encoding_step (&text->decoder, inbuf, inlen, inptr);
+			
+			inleft = text->priv->declen + n;
+			inptr = text->priv->decbuf;
+		}
+		
+		g_mime_filter_set_size (filter, inleft * 5 + 17, FALSE);
+		outptr = filter->outbuf + 1;
+		outleft = filter->outsize - 1;
+		
+		while (inleft > 0) {
+			if (g_mime_charset_convert (text->priv->native, text->cd, &inptr, &inleft, &outptr, &outleft) != (size_t) -1)
+				continue;
+			
+			if (errno == E2BIG) {
+				/* grow our output buffer and try again */
+				converted = outptr - filter->outbuf;
+				g_mime_filter_set_size (filter, inleft * 5 + filter->outsize + 16, TRUE);
+				outptr = filter->outbuf + converted;
+				outleft = filter->outsize - converted;
+			} else if (errno == EINVAL) {
+				/* an incomplete multibyte sequence; save it for next time */
+				break;
+			} else {
+				/* eat the invalid bytes in the sequence and continue */
+				inptr++;
+				inleft--;
+			}
+		}
+		
+		if (flush) {
+			/* flush the iconv conversion */
+			while (g_mime_charset_convert (text->priv->native, text->cd, NULL, NULL, &outptr, &outleft) == (size_t) -1) {
+				if (errno != E2BIG)
+					break;
+				
+				converted = outptr - filter->outbuf;
+				g_mime_filter_set_size (filter, filter->outsize + 16, TRUE);
+				outptr = filter->outbuf + converted;
+				outleft = filter->outsize - converted;
+			}
+			
+			text->priv->declen = 0;
+		} else if (inleft > 0) {
+			if (inleft > text->priv->decsize) {
+				text->priv->decsize = inleft;
+				text->priv->decbuf = g_realloc (text->priv->decbuf, text->priv->decsize);
+			}
+			
+			memmove (text->priv->decbuf, inptr, inleft);
+			text->priv->declen = inleft;
+		} else {
+			text->priv->declen = 0;
+		}
+	}
+	
+	*outbuf = canonicalize_eol (text, filter->outbuf + 1, outptr - (filter->outbuf + 1), outlen);
+	*outprespace = filter->outpre + (*outbuf - filter->outbuf);
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	       char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	filter_text (filter, inbuf, inlen, FALSE, outbuf, outlen, outprespace);
+}
+
+static void
+filter_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		 char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	filter_text (filter, inbuf, inlen, TRUE, outbuf, outlen, outprespace);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	
+	g_mime_encoding_reset (&text->decoder);
+	
+	if (text->cd != (iconv_t) -1)
+		iconv (text->cd, NULL, NULL, NULL, NULL);
+	
+	text->priv->saw_cr = FALSE;
+	text->priv->declen = 0;
+}
+
+
+/**
+ * g_mime_filter_text_new:
+ * @encoding: the Content-Transfer-Encoding of the input
+ * @charset: the charset of the input or %NULL if no conversion is needed
+ *
+ * Creates a new #GMimeFilterText filter which decodes content encoded
+ * with @encoding, converts it from @charset to UTF-8 and canonicalizes
+ * CRLF line endings to LF.
+ *
+ * Note: uuencoded content is not supported.
+ *
+ * Returns: a new text filter or %NULL if the charset conversion is not
+ * possible.
+ **/
+GMimeFilter *
+g_mime_filter_text_new (GMimeContentEncoding encoding, const char *charset)
+{
+	GMimeCharsetNative native;
+	GMimeFilterText *new;
+	iconv_t cd = (iconv_t) -1;
+	
+	g_return_val_if_fail (encoding != GMIME_CONTENT_ENCODING_UUENCODE, NULL);
+	
+	native = g_mime_charset_native (charset);
+	
+	if (charset != NULL && !native && (cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1)
+		return NULL;
+	
+	new = g_object_newv (GMIME_TYPE_FILTER_TEXT, 0, NULL);
+	g_mime_encoding_init_decode (&new->decoder, encoding);
+	new->charset = g_strdup (charset);
+	new->priv->native = native;
+	new->cd = cd;
+	
+	return (GMimeFilter *) new;
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __GMIME_FILTER_TEXT_H__
+#define __GMIME_FILTER_TEXT_H__
+
+#include <iconv.h>
+#include <gmime/gmime-encodings.h>
+#include <gmime/gmime-filter.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_TEXT            (g_mime_filter_text_get_type ())
+#define GMIME_FILTER_TEXT(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_TEXT, GMimeFilterText))
+#define GMIME_FILTER_TEXT_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_TEXT, GMimeFilterTextClass))
+#define GMIME_IS_FILTER_TEXT(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_TEXT))
+#define GMIME_IS_FILTER_TEXT_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_TEXT))
+#define GMIME_FILTER_TEXT_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_TEXT, GMimeFilterTextClass))
+
+typedef struct _GMimeFilterText GMimeFilterText;
+typedef struct _GMimeFilterTextClass GMimeFilterTextClass;
+
+/**
+ * GMimeFilterText:
+ * @parent_object: parent #GMimeFilter
+ * @decoder: #GMimeEncoding state
+ * @charset: charset that the filter is converting from
+ * @cd: charset conversion state
+ * @priv: private state data
+ *
+ * A filter which decodes the Content-Transfer-Encoding of textual
+ * content, converts it to UTF-8 and canonicalizes the line endings
+ * to LF all at once.
+ **/
+struct _GMimeFilterText {
+	GMimeFilter parent_object;
+	
+	GMimeEncoding decoder;
+	char *charset;
+	iconv_t cd;
+	
+	struct _GMimeFilterTextPrivate *priv;
+};
+
+struct _GMimeFilterTextClass {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_text_get_type (void);
+
+GMimeFilter *g_mime_filter_text_new (GMimeContentEncoding encoding, const char *charset);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_TEXT_H__ */
@@ -101,6 +101,8 @@ g_mime_filter_windows_init (GMimeFilterWindows *filter, GMimeFilterWindowsClass
 {
 	filter->claimed_charset = NULL;
 	filter->is_windows = FALSE;
+	
+	g_mime_filter_set_flags ((GMimeFilter *) filter, GMIME_FILTER_FLAGS_PASS_THROUGH);
 }
 
 static void
@@ -26,6 +26,7 @@
 #include <string.h> /* for memcpy */
 
 #include "gmime-filter.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -42,6 +43,14 @@
 struct _GMimeFilterPrivate {
 	char *inbuf;
 	size_t inlen;
+	
+	GMimeFilterFlags flags;
+	
+	/* the real output buffer while outbuf is borrowed from the input */
+	gboolean borrowed;
+	char *outbuf;
+	size_t outsize;
+	size_t outpre;
 };
 
 #define PRE_HEAD (64)
@@ -156,17 +165,38 @@ g_mime_filter_copy (GMimeFilter *filter)
 }
 
 
+/* restores the filter's own output buffer after filtering in place */
 static void
-filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+filter_unborrow (GMimeFilter *filter)
+{
+	struct _GMimeFilterPrivate *p = _PRIVATE (filter);
+	
+	filter->outbuf = p->outbuf;
+	filter->outsize = p->outsize;
+	filter->outpre = p->outpre;
+	filter->outptr = filter->outbuf;
+	p->borrowed = FALSE;
+}
+
+static gboolean
+buffer_contains (const char *buf, size_t len, const char *ptr)
+{
+	return buf != NULL && ptr >= buf && ptr <= buf + len;
+}
+
+static void
+filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace, gboolean *writable,
 	    char **outbuf, size_t *outlen, size_t *outprespace,
 	    void (*filterfunc) (GMimeFilter *filter,
 				char *inbuf, size_t inlen, size_t prespace,
 				char **outbuf, size_t *outlen, size_t *outprespace))
 {
+	struct _GMimeFilterPrivate *p = _PRIVATE (filter);
+	gboolean in_place = writable != NULL && *writable;
+	
 	/* here we take a performance hit, if the input buffer doesn't
 	   have the pre-space required.  We make a buffer that does... */
 	if (prespace < filter->backlen) {
-		struct _GMimeFilterPrivate *p = _PRIVATE (filter);
 		size_t newlen = inlen + prespace + filter->backlen;
 		
 		if (p->inlen < newlen) {
@@ -180,6 +210,9 @@ filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 		memcpy (p->inbuf + p->inlen - inlen, inbuf, inlen);
 		inbuf = p->inbuf + p->inlen - inlen;
 		prespace = p->inlen - inlen;
+		
+		/* the copy is ours to scribble on */
+		in_place = writable != NULL;
 	}
 	
 	/* preload any backed up data */
@@ -191,7 +224,40 @@ filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 		filter->backlen = 0;
 	}
 	
+	if (!in_place || !(p->flags & GMIME_FILTER_FLAGS_IN_PLACE) || prespace < GMIME_FILTER_IN_PLACE_SLACK) {
+		filterfunc (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+		
+		if (writable == NULL || (p->flags & GMIME_FILTER_FLAGS_PASS_THROUGH))
+			return;
+		
+		/* the output is writable if it is one of our own buffers or
+		 * if it is (part of) a writable input buffer */
+		if (buffer_contains (filter->outreal, filter->outpre + filter->outsize, *outbuf) ||
+		    buffer_contains (p->inbuf, p->inlen, *outbuf))
+			*writable = TRUE;
+		else if (!buffer_contains (inbuf - prespace, prespace + inlen, *outbuf))
+			*writable = FALSE;
+		
+		return;
+	}
+	
+	/* let the filter use its input buffer as its output buffer */
+	p->outbuf = filter->outbuf;
+	p->outsize = filter->outsize;
+	p->outpre = filter->outpre;
+	p->borrowed = TRUE;
+	
+	filter->outbuf = inbuf - GMIME_FILTER_IN_PLACE_SLACK;
+	filter->outsize = inlen + GMIME_FILTER_IN_PLACE_SLACK;
+	filter->outpre = prespace - GMIME_FILTER_IN_PLACE_SLACK;
+	filter->outptr = filter->outbuf;
+	
 	filterfunc (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+	
+	if (p->borrowed)
+		filter_unborrow (filter);
+	else
+		*writable = buffer_contains (filter->outreal, filter->outpre + filter->outsize, *outbuf);
 }
 
 
@@ -222,7 +288,7 @@ g_mime_filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t pre
 {
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
-	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace,
+	filter_run (filter, inbuf, inlen, prespace, NULL, outbuf, outlen, outprespace,
 		    GMIME_FILTER_GET_CLASS (filter)->filter);
 }
 
@@ -255,11 +321,40 @@ g_mime_filter_complete (GMimeFilter *filter,
 {
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
-	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace,
+	filter_run (filter, inbuf, inlen, prespace, NULL, outbuf, outlen, outprespace,
 		    GMIME_FILTER_GET_CLASS (filter)->complete);
 }
 
 
+/**
+ * _g_mime_filter_run:
+ * @filter: filter
+ * @flush: %TRUE to complete the filtering or %FALSE otherwise
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @prespace: prespace buffer length
+ * @writable: whether or not @inbuf (including its prespace) may be
+ *   modified; updated to reflect whether the output buffer may be
+ * @outbuf: pointer to output buffer
+ * @outlen: pointer to output length
+ * @outprespace: pointer to output prespace buffer length
+ *
+ * Like g_mime_filter_filter() or g_mime_filter_complete(), but lets
+ * a filter with the %GMIME_FILTER_FLAGS_IN_PLACE flag filter a
+ * writable input buffer in place. Used by filter chains to hand their
+ * buffers from one filter to the next without copying.
+ **/
+void
+_g_mime_filter_run (GMimeFilter *filter, gboolean flush, char *inbuf, size_t inlen, size_t prespace,
+		    gboolean *writable, char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterClass *klass = GMIME_FILTER_GET_CLASS (filter);
+	
+	filter_run (filter, inbuf, inlen, prespace, writable, outbuf, outlen, outprespace,
+		    flush ? klass->complete : klass->filter);
+}
+
+
 static void
 filter_reset (GMimeFilter *filter)
 {
@@ -285,6 +380,40 @@ g_mime_filter_reset (GMimeFilter *filter)
 }
 
 
+/**
+ * g_mime_filter_get_flags:
+ * @filter: a #GMimeFilter object
+ *
+ * Gets the flags describing how @filter treats its buffers.
+ *
+ * Returns: the #GMimeFilterFlags of @filter.
+ **/
+GMimeFilterFlags
+g_mime_filter_get_flags (GMimeFilter *filter)
+{
+	g_return_val_if_fail (GMIME_IS_FILTER (filter), GMIME_FILTER_FLAGS_NONE);
+	
+	return filter->priv->flags;
+}
+
+
+/**
+ * g_mime_filter_set_flags:
+ * @filter: a #GMimeFilter object
+ * @flags: #GMimeFilterFlags
+ *
+ * Sets the flags describing how @filter treats its buffers. This is
+ * meant to be used by #GMimeFilter implementations.
+ **/
+void
+g_mime_filter_set_flags (GMimeFilter *filter, GMimeFilterFlags flags)
+{
+	g_return_if_fail (GMIME_IS_FILTER (filter));
+	
+	filter->priv->flags = flags;
+}
+
+
 /**
  * g_mime_filter_backup:
  * @filter: filter
@@ -324,6 +453,20 @@ g_mime_filter_set_size (GMimeFilter *filter, size_t size, gboolean keep)
 {
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
+	if (filter->outsize < size && filter->priv->borrowed) {
+		/* the filter needs more room than filtering in place allows */
+		char *outbuf = filter->outbuf;
+		size_t outsize = filter->outsize;
+		
+		filter_unborrow (filter);
+		g_mime_filter_set_size (filter, size, FALSE);
+		
+		if (keep)
+			memcpy (filter->outbuf, outbuf, outsize);
+		
+		return;
+	}
+	
 	if (filter->outsize < size) {
 		size_t offset = filter->outptr - filter->outreal;
 		
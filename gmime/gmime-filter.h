@@ -38,6 +38,34 @@ G_BEGIN_DECLS
 typedef struct _GMimeFilter GMimeFilter;
 typedef struct _GMimeFilterClass GMimeFilterClass;
 
+/**
+ * GMimeFilterFlags:
+ * @GMIME_FILTER_FLAGS_NONE: No flags.
+ * @GMIME_FILTER_FLAGS_PASS_THROUGH: The filter only inspects the data
+ *   passing through it and always outputs its input buffer unchanged.
+ * @GMIME_FILTER_FLAGS_IN_PLACE: The filter never writes its output
+ *   ahead of the input that it has consumed (allowing for up to
+ *   %GMIME_FILTER_IN_PLACE_SLACK bytes of slack), so a filter chain
+ *   may let it write its output over its input buffer.
+ *
+ * Flags describing how a #GMimeFilter treats its buffers, used by
+ * #GMimeStreamFilter to avoid copying data between filters.
+ **/
+typedef enum {
+	GMIME_FILTER_FLAGS_NONE         = 0,
+	GMIME_FILTER_FLAGS_PASS_THROUGH = 1 << 0,
+	GMIME_FILTER_FLAGS_IN_PLACE     = 1 << 1
+} GMimeFilterFlags;
+
+/**
+ * GMIME_FILTER_IN_PLACE_SLACK:
+ *
+ * The number of bytes in front of the input buffer that a filter with
+ * the %GMIME_FILTER_FLAGS_IN_PLACE flag is allowed to start writing
+ * its output at when filtering in place.
+ **/
+#define GMIME_FILTER_IN_PLACE_SLACK 16
+
 /**
  * GMimeFilter:
  * @parent_object: parent #GObject
@@ -103,6 +131,9 @@ void g_mime_filter_complete (GMimeFilter *filter,
 
 void g_mime_filter_reset (GMimeFilter *filter);
 
+GMimeFilterFlags g_mime_filter_get_flags (GMimeFilter *filter);
+void g_mime_filter_set_flags (GMimeFilter *filter, GMimeFilterFlags flags);
+
 
 /* sets/returns number of bytes backed up on the input */
 void g_mime_filter_backup (GMimeFilter *filter, const char *data, size_t length);
@@ -26,13 +26,16 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "gmime-table-private.h"
 #include "gmime-stream-mem.h"
 #include "gmime-internal.h"
 #include "gmime-common.h"
 #include "gmime-header.h"
 #include "gmime-events.h"
 #include "gmime-utils.h"
+#include "internet-address.h"
 
+#include "arena.h"
 #include "list.h"
 
 
@@ -46,12 +49,55 @@
  * values.
  **/
 
+/* the parts of a header that live in its list's arena or in the name
+ * pool (and so must not be freed) */
+enum {
+	HEADER_ARENA_NODE      = (1 << 0),
+	HEADER_ARENA_NAME      = (1 << 1),
+	HEADER_ARENA_VALUE     = (1 << 2),
+	HEADER_ARENA_RAW_VALUE = (1 << 3),
+	HEADER_INTERNED_NAME   = (1 << 4),
+};
+
+/* the forms of a header's value that have been asked for so far */
+enum {
+	HEADER_CACHED_DECODED    = (1 << 0),
+	HEADER_CACHED_ADDRESSES  = (1 << 1),
+	HEADER_CACHED_DATE       = (1 << 2),
+	HEADER_CACHED_MESSAGE_ID = (1 << 3),
+};
+
+/* a date header's value, parsed */
+typedef struct {
+	time_t date;
+	int tz_offset;
+} HeaderDate;
+
+/* what a header's value was last decoded or parsed into; it only gets
+ * allocated once somebody asks for one of them and is thrown away as
+ * soon as the value changes.
+ *
+ * Like the unfolded value, each form is stored by whichever reader
+ * gets to it first, and only then marked as cached in @cached, so
+ * that other readers never see the flag without the value. */
+typedef struct {
+	InternetAddressList *addresses;
+	char *message_id;
+	char *decoded;
+	HeaderDate *date;
+	guint cached;
+} HeaderCache;
+
 struct _GMimeHeader {
 	GMimeHeaderList *list;
+	HeaderCache *cache;
 	gint64 offset;
 	char *name;
 	char *value;
 	char *raw_value;
+	GMimeHeaderId id;
+	guint hash;
+	guint flags;
 };
 
 struct _GMimeHeaderList {
@@ -60,8 +106,449 @@ struct _GMimeHeaderList {
 	GMimeEvent *changed;
 	GHashTable *hash;
 	GPtrArray *list;
+	gboolean use_arena;
+	Arena *arena;
+	Arena *names;
 };
 
+#define header_free_value(header) G_STMT_START {                       \
+	if (!(header->flags & HEADER_ARENA_VALUE))                     \
+		g_free (header->value);                                \
+	header->flags &= ~HEADER_ARENA_VALUE;                          \
+} G_STMT_END
+
+#define header_free_raw_value(header) G_STMT_START {                   \
+	if (!(header->flags & HEADER_ARENA_RAW_VALUE))                 \
+		g_free (header->raw_value);                            \
+	header->flags &= ~HEADER_ARENA_RAW_VALUE;                      \
+} G_STMT_END
+
+
+static HeaderCache *
+header_get_cache (GMimeHeader *header)
+{
+	HeaderCache *cache;
+	
+	if ((cache = g_atomic_pointer_get (&header->cache)) != NULL)
+		return cache;
+	
+	cache = g_slice_new0 (HeaderCache);
+	
+	if (!g_atomic_pointer_compare_and_exchange (&header->cache, NULL, cache))
+		g_slice_free (HeaderCache, cache);
+	
+	return g_atomic_pointer_get (&header->cache);
+}
+
+/* stores @value as the cached form that @flag stands for unless
+ * another reader has already stored one, in which case @value gets
+ * freed and theirs is returned instead */
+static gpointer
+header_cache_store (HeaderCache *cache, guint flag, gpointer *form, gpointer value, GDestroyNotify free_func)
+{
+	if (!g_atomic_pointer_compare_and_exchange (form, NULL, value) && value != NULL)
+		free_func (value);
+	
+	g_atomic_int_or (&cache->cached, flag);
+	
+	return g_atomic_pointer_get (form);
+}
+
+static void
+header_invalidate_cache (GMimeHeader *header)
+{
+	HeaderCache *cache = header->cache;
+	
+	if (cache == NULL)
+		return;
+	
+	if (cache->addresses)
+		g_object_unref (cache->addresses);
+	
+	g_free (cache->message_id);
+	g_free (cache->decoded);
+	g_free (cache->date);
+	
+	g_slice_free (HeaderCache, cache);
+	header->cache = NULL;
+}
+
+
+/* strings already in the arena are immutable and live as long as it
+ * does, so they can be shared instead of duplicated */
+#define arena_adopt(arena, str) (arena_contains (arena, str) ? (char *) (str) : arena_strdup (arena, str))
+
+
+/**
+ * _g_mime_header_id:
+ * @name: a header field name
+ * @len: the length of @name
+ *
+ * Interns @name if it is one of the fields that GMime looks for. The
+ * length and a single character pick out the only possible match, so
+ * at most one case-insensitive compare is ever needed.
+ *
+ * Returns: the #GMimeHeaderId for @name.
+ **/
+GMimeHeaderId
+_g_mime_header_id (const char *name, size_t len)
+{
+	GMimeHeaderId id = GMIME_HEADER_ID_UNKNOWN;
+	const char *match = NULL;
+	
+#define CANDIDATE(str, ident) (match = str, id = GMIME_HEADER_ID_##ident)
+	if (len >= 8 && !g_ascii_strncasecmp (name, "Content-", 8)) {
+		name += 8;
+		len -= 8;
+	
+		switch (len) {
+		case 2: CANDIDATE ("id", CONTENT_ID); break;
+		case 3: CANDIDATE ("md5", CONTENT_MD5); break;
+		case 4:
+			if ((name[0] | 0x20) == 't')
+				CANDIDATE ("type", CONTENT_TYPE);
+			else
+				CANDIDATE ("base", CONTENT_BASE);
+			break;
+		case 6: CANDIDATE ("length", CONTENT_LENGTH); break;
+		case 8:
+			if ((name[1] | 0x20) == 'o')
+				CANDIDATE ("location", CONTENT_LOCATION);
+			else
+				CANDIDATE ("language", CONTENT_LANGUAGE);
+			break;
+		case 11:
+			if ((name[1] | 0x20) == 'i')
+				CANDIDATE ("disposition", CONTENT_DISPOSITION);
+			else
+				CANDIDATE ("description", CONTENT_DESCRIPTION);
+			break;
+		case 17: CANDIDATE ("transfer-encoding", CONTENT_TRANSFER_ENCODING); break;
+		}
+	
+		if (match == NULL || g_ascii_strncasecmp (name, match, len) != 0)
+			return GMIME_HEADER_ID_CONTENT;
+	
+		return id;
+	}
+	
+	switch (len) {
+	case 2:
+		if ((name[0] | 0x20) == 't')
+			CANDIDATE ("to", TO);
+		else
+			CANDIDATE ("cc", CC);
+		break;
+	case 3: CANDIDATE ("bcc", BCC); break;
+	case 4:
+		if ((name[0] | 0x20) == 'd')
+			CANDIDATE ("date", DATE);
+		else
+			CANDIDATE ("from", FROM);
+		break;
+	case 6: CANDIDATE ("sender", SENDER); break;
+	case 7: CANDIDATE ("subject", SUBJECT); break;
+	case 8: CANDIDATE ("reply-to", REPLY_TO); break;
+	case 10:
+		if ((name[0] | 0x20) == 'm')
+			CANDIDATE ("message-id", MESSAGE_ID);
+		else
+			CANDIDATE ("references", REFERENCES);
+		break;
+	case 11: CANDIDATE ("in-reply-to", IN_REPLY_TO); break;
+	case 12: CANDIDATE ("mime-version", MIME_VERSION); break;
+	}
+#undef CANDIDATE
+	
+	if (match == NULL || g_ascii_strncasecmp (name, match, len) != 0)
+		return GMIME_HEADER_ID_UNKNOWN;
+	
+	return id;
+}
+
+
+/* Header names are interned in a process-wide pool: a mailbox has a
+ * few hundred distinct field names spread over millions of headers, so
+ * they all share one canonical copy of each. Slots in the pool's open
+ * addressing table are only ever filled in, never changed or emptied,
+ * so lookups don't take the lock. Inserts are serialized, and when the
+ * table grows, the new one is published atomically while the old ones
+ * are kept around (for readers still probing them) until shutdown.
+ *
+ * To keep a stream of made-up names from growing the pool without
+ * bound, it stops taking new names once it is full and long names are
+ * never interned; those get copied per header like before. */
+#define NAME_POOL_MAX_NAMES   4096
+#define NAME_POOL_MAX_LENGTH  128
+#define NAME_POOL_INITIAL_SIZE 256
+
+typedef struct {
+	GMimeHeaderId id;
+	guint hash;
+	char name[1];
+} InternedName;
+
+typedef struct _NamePoolTable {
+	struct _NamePoolTable *retired;
+	guint size;
+	InternedName *slots[1];
+} NamePoolTable;
+
+G_LOCK_DEFINE_STATIC (name_pool);
+static NamePoolTable *name_pool = NULL;
+static Arena *name_pool_arena = NULL;
+static guint name_pool_count = 0;
+
+
+/* the same hash as g_mime_strcase_hash(), for names that aren't nul-terminated */
+static guint
+header_name_hash (const char *name, size_t len)
+{
+	guint h = 0;
+	
+	while (len-- > 0)
+		h = (h << 5) - h + g_ascii_tolower (*name++);
+	
+	return h;
+}
+
+static NamePoolTable *
+name_pool_table_new (guint size)
+{
+	NamePoolTable *table;
+	
+	table = g_malloc0 (G_STRUCT_OFFSET (NamePoolTable, slots) + size * sizeof (InternedName *));
+	table->size = size;
+	
+	return table;
+}
+
+static void
+name_pool_table_insert (NamePoolTable *table, InternedName *entry)
+{
+	guint mask = table->size - 1;
+	guint i = entry->hash & mask;
+	
+	while (table->slots[i] != NULL)
+		i = (i + 1) & mask;
+	
+	/* the entry must be complete before readers can see it */
+	g_atomic_pointer_set (&table->slots[i], entry);
+}
+
+static InternedName *
+name_pool_lookup (NamePoolTable *table, const char *name, size_t len, guint hash)
+{
+	guint mask = table->size - 1;
+	InternedName *entry;
+	guint i = hash & mask;
+	
+	while ((entry = g_atomic_pointer_get (&table->slots[i])) != NULL) {
+		if (entry->hash == hash && !strncmp (entry->name, name, len) && entry->name[len] == '\0')
+			return entry;
+		
+		i = (i + 1) & mask;
+	}
+	
+	return NULL;
+}
+
+static InternedName *
+name_pool_intern (const char *name, size_t len)
+{
+	NamePoolTable *table, *grown;
+	InternedName *entry;
+	guint hash, i;
+	
+	if (len > NAME_POOL_MAX_LENGTH || (table = g_atomic_pointer_get (&name_pool)) == NULL)
+		return NULL;
+	
+	hash = header_name_hash (name, len);
+	
+	if ((entry = name_pool_lookup (table, name, len, hash)))
+		return entry;
+	
+	G_LOCK (name_pool);
+	
+	/* another thread may have added it (or grown the table) meanwhile */
+	if ((table = name_pool) == NULL || (entry = name_pool_lookup (table, name, len, hash)) ||
+	    name_pool_count >= NAME_POOL_MAX_NAMES) {
+		G_UNLOCK (name_pool);
+		return entry;
+	}
+	
+	if ((name_pool_count + 1) * 2 > table->size) {
+		grown = name_pool_table_new (table->size * 2);
+		grown->retired = table;
+		
+		for (i = 0; i < table->size; i++) {
+			if (table->slots[i] != NULL)
+				name_pool_table_insert (grown, table->slots[i]);
+		}
+		
+		g_atomic_pointer_set (&name_pool, grown);
+		table = grown;
+	}
+	
+	entry = arena_alloc (name_pool_arena, G_STRUCT_OFFSET (InternedName, name) + len + 1);
+	memcpy (entry->name, name, len);
+	entry->name[len] = '\0';
+	entry->id = _g_mime_header_id (name, len);
+	entry->hash = hash;
+	
+	name_pool_table_insert (table, entry);
+	name_pool_count++;
+	
+	G_UNLOCK (name_pool);
+	
+	return entry;
+}
+
+
+/**
+ * _g_mime_header_intern_name:
+ * @name: a header field name
+ * @len: the length of @name
+ * @id: return location for the #GMimeHeaderId of @name
+ *
+ * Looks up (or adds) the canonical copy of @name in the header name
+ * pool. Interned names stay valid until g_mime_shutdown() (or for as
+ * long as a header list created before then is around) and two
+ * headers spelled the same way share the same pointer.
+ *
+ * Returns: the interned name or %NULL if the pool would not take it.
+ **/
+const char *
+_g_mime_header_intern_name (const char *name, size_t len, GMimeHeaderId *id)
+{
+	InternedName *entry;
+	
+	if (!(entry = name_pool_intern (name, len))) {
+		*id = _g_mime_header_id (name, len);
+		return NULL;
+	}
+	
+	*id = entry->id;
+	
+	return entry->name;
+}
+
+
+void
+g_mime_header_init (void)
+{
+#ifdef G_THREADS_ENABLED
+	g_mutex_init (&G_LOCK_NAME (name_pool));
+#endif
+	
+	name_pool_arena = arena_new (4096);
+	name_pool = name_pool_table_new (NAME_POOL_INITIAL_SIZE);
+	name_pool_count = 0;
+}
+
+
+void
+g_mime_header_shutdown (void)
+{
+	NamePoolTable *table, *retired;
+	
+#ifdef G_THREADS_ENABLED
+	if (glib_check_version (2, 37, 4) == NULL) {
+		/* The implementation of g_mutex_clear() prior
+		 * to glib 2.37.4 did not properly reset the
+		 * internal mutex pointer to NULL, so re-initializing
+		 * GMime would not properly re-initialize the mutexes.
+		 **/
+		g_mutex_clear (&G_LOCK_NAME (name_pool));
+	}
+#endif
+	
+	for (table = name_pool; table != NULL; table = retired) {
+		retired = table->retired;
+		g_free (table);
+	}
+	
+	/* header lists hold their own references on the arena, so the
+	 * names their headers point to stick around until they're gone */
+	arena_unref (name_pool_arena);
+	name_pool_arena = NULL;
+	name_pool = NULL;
+}
+
+
+/* checks whether @header is named @name, whose id and case-insensitive
+ * hash are given; only names that GMime doesn't know ever need to be
+ * compared as strings */
+static gboolean
+header_has_name (const GMimeHeader *header, GMimeHeaderId id, guint hash, const char *name)
+{
+	if (header->id != id)
+		return FALSE;
+	
+	if ((id != GMIME_HEADER_ID_UNKNOWN && id != GMIME_HEADER_ID_CONTENT) || header->name == name)
+		return TRUE;
+	
+	return header->hash == hash && !g_ascii_strcasecmp (header->name, name);
+}
+
+
+/**
+ * _g_mime_header_unfold:
+ * @value: a raw (folded) header value
+ *
+ * Unfolds @value in place and trims leading and trailing whitespace.
+ *
+ * Returns: @value
+ **/
+char *
+_g_mime_header_unfold (char *value)
+{
+	register char *inptr = value;
+	char *outptr = value;
+	
+	while (is_lwsp (*inptr))
+		inptr++;
+	
+	while (*inptr) {
+		if (*inptr == '\n' || (*inptr == '\r' && inptr[1] == '\n')) {
+			inptr++;
+			continue;
+		}
+		
+		*outptr++ = *inptr++;
+	}
+	
+	while (outptr > value && is_lwsp (outptr[-1]))
+		outptr--;
+	
+	*outptr = '\0';
+	
+	return value;
+}
+
+
+/* the parser only gives us the raw value for headers that nothing
+ * interprets while the message is being constructed; unfold it the
+ * first time somebody asks for it.
+ *
+ * Callers treat the getters as read-only, so several threads may be
+ * reading the same list at once: whoever unfolds the value first gets
+ * to store it and everybody else throws their copy away. */
+static const char *
+header_get_value (GMimeHeader *header)
+{
+	char *value;
+	
+	if (g_atomic_pointer_get (&header->value) == NULL && header->raw_value != NULL) {
+		value = _g_mime_header_unfold (g_strdup (header->raw_value));
+		
+		if (!g_atomic_pointer_compare_and_exchange (&header->value, NULL, value))
+			g_free (value);
+	}
+	
+	return g_atomic_pointer_get (&header->value);
+}
+
 
 /**
  * g_mime_header_new:
@@ -77,14 +564,64 @@ struct _GMimeHeaderList {
 static GMimeHeader *
 g_mime_header_new (GMimeHeaderList *headers, const char *name, const char *value, const char *raw_value, gint64 offset)
 {
+	InternedName *interned;
 	GMimeHeader *header;
+	size_t len;
+	Arena *arena;
+	
+	len = strlen (name);
+	
+	/* only use names from the pool that the list is keeping alive */
+	if ((interned = name_pool_intern (name, len)) && headers->names != name_pool_arena)
+		interned = NULL;
+	
+	if (headers->use_arena) {
+		/* the parser is populating the list; strings it allocated
+		 * from the arena are adopted as-is rather than copied */
+		arena = headers->arena;
+		
+		header = arena_alloc (arena, sizeof (GMimeHeader));
+		header->flags = HEADER_ARENA_NODE;
+		
+		if (interned == NULL) {
+			header->name = arena_adopt (arena, name);
+			header->flags |= HEADER_ARENA_NAME;
+		}
+		
+		if (value) {
+			header->value = arena_adopt (arena, value);
+			header->flags |= HEADER_ARENA_VALUE;
+		} else {
+			header->value = NULL;
+		}
+		
+		if (raw_value) {
+			header->raw_value = arena_adopt (arena, raw_value);
+			header->flags |= HEADER_ARENA_RAW_VALUE;
+		} else {
+			header->raw_value = NULL;
+		}
+	} else {
+		header = g_slice_new (GMimeHeader);
+		header->name = interned ? NULL : g_strdup (name);
+		header->value = g_strdup (value);
+		header->raw_value = raw_value ? g_strdup (raw_value) : NULL;
+		header->flags = 0;
+	}
+	
+	if (interned != NULL) {
+		header->flags |= HEADER_INTERNED_NAME;
+		header->name = interned->name;
+		header->hash = interned->hash;
+		header->id = interned->id;
+	} else {
+		header->hash = header_name_hash (name, len);
+		header->id = _g_mime_header_id (name, len);
+	}
 	
-	header = g_slice_new (GMimeHeader);
 	header->list = headers;
-	header->name = g_strdup (name);
-	header->value = g_strdup (value);
-	header->raw_value = raw_value ? g_strdup (raw_value) : NULL;
 	header->offset = offset;
+	header->cache = NULL;
 	
 	return header;
 }
@@ -99,11 +636,15 @@ g_mime_header_new (GMimeHeaderList *headers, const char *name, const char *value
 static void
 g_mime_header_free (GMimeHeader *header)
 {
-	g_free (header->name);
-	g_free (header->value);
-	g_free (header->raw_value);
+	header_invalidate_cache (header);
+	header_free_raw_value (header);
+	header_free_value (header);
+	
+	if (!(header->flags & (HEADER_ARENA_NAME | HEADER_INTERNED_NAME)))
+		g_free (header->name);
 	
-	g_slice_free (GMimeHeader, header);
+	if (!(header->flags & HEADER_ARENA_NODE))
+		g_slice_free (GMimeHeader, header);
 }
 
 
@@ -134,13 +675,18 @@ g_mime_header_get_name (GMimeHeader *header)
  *
  * Note: The returned value should be decoded with a function such as
  * g_mime_utils_header_decode_text() before displaying to the user.
+ *
+ * Headers parsed from a stream keep their folded value and only get
+ * unfolded the first time they are asked for. That makes this a
+ * mutating call, but it is safe to make from several threads that are
+ * reading the same headers at the same time.
  **/
 const char *
 g_mime_header_get_value (GMimeHeader *header)
 {
 	g_return_val_if_fail (header != NULL, NULL);
 	
-	return header->value;
+	return header_get_value (header);
 }
 
 
@@ -157,18 +703,195 @@ g_mime_header_get_value (GMimeHeader *header)
 void
 g_mime_header_set_value (GMimeHeader *header, const char *value)
 {
+	char *buf;
+	
 	g_return_if_fail (header != NULL);
 	g_return_if_fail (value != NULL);
 	
-	g_free (header->raw_value);
-	g_free (header->value);
+	/* @value may well be one of the strings we are about to free */
+	buf = g_strdup (value);
+	
+	header_invalidate_cache (header);
+	header_free_raw_value (header);
+	header_free_value (header);
 	
-	header->value = g_strdup (value);
+	header->value = buf;
+	header->raw_value = NULL;
 	
 	g_mime_event_emit (header->list->changed, NULL);
 }
 
 
+/**
+ * g_mime_header_get_decoded_value:
+ * @header: a #GMimeHeader
+ *
+ * Gets the header's value decoded into UTF-8 the same way that
+ * g_mime_utils_header_decode_text() would.
+ *
+ * The value is only decoded the first time this is called; the result
+ * is kept and returned again until the header's value changes.
+ *
+ * Like g_mime_header_get_value(), this is safe to call from several
+ * threads that are reading the same headers at the same time.
+ *
+ * Returns: the decoded header value or %NULL if the header has no
+ * value.
+ **/
+const char *
+g_mime_header_get_decoded_value (GMimeHeader *header)
+{
+	HeaderCache *cache;
+	const char *value;
+	char *decoded;
+	
+	g_return_val_if_fail (header != NULL, NULL);
+	
+	if (!(value = header_get_value (header)))
+		return NULL;
+	
+	cache = header_get_cache (header);
+	
+	if (g_atomic_int_get (&cache->cached) & HEADER_CACHED_DECODED)
+		return g_atomic_pointer_get (&cache->decoded);
+	
+	decoded = g_mime_utils_header_decode_text (header->list->options, value);
+	
+	return header_cache_store (cache, HEADER_CACHED_DECODED, (gpointer *) &cache->decoded,
+				   decoded, g_free);
+}
+
+
+/**
+ * g_mime_header_get_addresses:
+ * @header: a #GMimeHeader
+ *
+ * Gets the list of addresses in an address header such as To or
+ * From. The value is only parsed the first time this is called; the
+ * same list is returned again until the header's value changes.
+ *
+ * Like g_mime_header_get_value(), this is safe to call from several
+ * threads that are reading the same headers at the same time.
+ *
+ * Note: the returned list belongs to @header and must not be
+ * modified. Use g_mime_header_set_value() to change the addresses.
+ *
+ * Returns: (transfer none): the list of addresses or %NULL if the
+ * header has no value or it could not be parsed.
+ **/
+InternetAddressList *
+g_mime_header_get_addresses (GMimeHeader *header)
+{
+	InternetAddressList *addresses;
+	HeaderCache *cache;
+	const char *value;
+	
+	g_return_val_if_fail (header != NULL, NULL);
+	
+	if (!(value = header_get_value (header)))
+		return NULL;
+	
+	cache = header_get_cache (header);
+	
+	if (g_atomic_int_get (&cache->cached) & HEADER_CACHED_ADDRESSES)
+		return g_atomic_pointer_get (&cache->addresses);
+	
+	addresses = internet_address_list_parse (header->list->options, value);
+	
+	return header_cache_store (cache, HEADER_CACHED_ADDRESSES, (gpointer *) &cache->addresses,
+				   addresses, g_object_unref);
+}
+
+
+/**
+ * g_mime_header_get_date:
+ * @header: a #GMimeHeader
+ * @tz_offset: (out) (allow-none): timezone offset
+ *
+ * Gets the date in a date header, as parsed by
+ * g_mime_utils_header_decode_date(). The value is only parsed the
+ * first time this is called; the result is reused until the header's
+ * value changes.
+ *
+ * Like g_mime_header_get_value(), this is safe to call from several
+ * threads that are reading the same headers at the same time.
+ *
+ * Returns: the time_t representation of the date or %0 if the header
+ * has no value or it could not be parsed.
+ **/
+time_t
+g_mime_header_get_date (GMimeHeader *header, int *tz_offset)
+{
+	HeaderCache *cache;
+	const char *value;
+	HeaderDate *date;
+	
+	g_return_val_if_fail (header != NULL, (time_t) 0);
+	
+	if (!(value = header_get_value (header))) {
+		if (tz_offset)
+			*tz_offset = 0;
+		
+		return (time_t) 0;
+	}
+	
+	cache = header_get_cache (header);
+	
+	if (g_atomic_int_get (&cache->cached) & HEADER_CACHED_DATE) {
+		date = g_atomic_pointer_get (&cache->date);
+	} else {
+		date = g_new (HeaderDate, 1);
+		date->date = g_mime_utils_header_decode_date (value, &date->tz_offset);
+		date = header_cache_store (cache, HEADER_CACHED_DATE, (gpointer *) &cache->date,
+					   date, g_free);
+	}
+	
+	if (tz_offset)
+		*tz_offset = date->tz_offset;
+	
+	return date->date;
+}
+
+
+/**
+ * g_mime_header_get_message_id:
+ * @header: a #GMimeHeader
+ *
+ * Gets the msg-id token in a header such as Message-Id or Content-Id,
+ * as decoded by g_mime_utils_decode_message_id(). The value is only
+ * decoded the first time this is called; the result is reused until
+ * the header's value changes.
+ *
+ * Like g_mime_header_get_value(), this is safe to call from several
+ * threads that are reading the same headers at the same time.
+ *
+ * Returns: the msg-id (without the angle brackets) or %NULL if the
+ * header has no value or it does not contain one.
+ **/
+const char *
+g_mime_header_get_message_id (GMimeHeader *header)
+{
+	HeaderCache *cache;
+	const char *value;
+	char *message_id;
+	
+	g_return_val_if_fail (header != NULL, NULL);
+	
+	if (!(value = header_get_value (header)))
+		return NULL;
+	
+	cache = header_get_cache (header);
+	
+	if (g_atomic_int_get (&cache->cached) & HEADER_CACHED_MESSAGE_ID)
+		return g_atomic_pointer_get (&cache->message_id);
+	
+	message_id = g_mime_utils_decode_message_id (value);
+	
+	return header_cache_store (cache, HEADER_CACHED_MESSAGE_ID, (gpointer *) &cache->message_id,
+				   message_id, g_free);
+}
+
+
 /**
  * g_mime_header_get_raw_value:
  * @header: a #GMimeHeader
@@ -209,17 +932,90 @@ _g_mime_header_set_offset (GMimeHeader *header, gint64 offset)
 	header->offset = offset;
 }
 
-static ssize_t
-default_writer (GMimeParserOptions *options, GMimeStream *stream, const char *name, const char *value)
+/* writes @count headers, followed by @suffix (if non-%NULL), using as
+ * few stream writes as the custom header writers allow */
+ssize_t
+_g_mime_headers_write_to_stream (GMimeHeader **headers, guint count, GMimeStream *stream, const char *suffix)
 {
-	ssize_t nwritten;
+	GMimeStreamIOVector *vector;
+	ssize_t nwritten, total = 0;
+	GMimeHeaderWriter writer;
+	GMimeHeader *header;
+	GPtrArray *values;
+	size_t n = 0;
 	char *val;
+	guint i;
+	
+	vector = g_new (GMimeStreamIOVector, count * 3 + 1);
+	values = g_ptr_array_new ();
+	
+	for (i = 0; i < count; i++) {
+		header = headers[i];
+		
+		if (header->raw_value) {
+			vector[n].data = header->name;
+			vector[n].len = strlen (header->name);
+			n++;
+			
+			vector[n].data = ":";
+			vector[n].len = 1;
+			n++;
+			
+			vector[n].data = header->raw_value;
+			vector[n].len = strlen (header->raw_value);
+			n++;
+		} else if (header->value) {
+			if (!(writer = g_hash_table_lookup (header->list->writers, header->name))) {
+				val = g_mime_utils_header_printf (header->list->options, "%s: %s\n", header->name, header->value);
+				g_ptr_array_add (values, val);
+				
+				vector[n].data = val;
+				vector[n].len = strlen (val);
+				n++;
+				continue;
+			}
+			
+			/* custom writers write to the stream themselves */
+			if (n > 0) {
+				if ((nwritten = g_mime_stream_writev (stream, vector, n)) == -1)
+					goto exception;
+				
+				total += nwritten;
+				n = 0;
+			}
+			
+			if ((nwritten = writer (header->list->options, stream, header->name, header->value)) == -1)
+				goto exception;
+			
+			total += nwritten;
+		}
+	}
 	
-	val = g_mime_utils_header_printf (options, "%s: %s\n", name, value);
-	nwritten = g_mime_stream_write_string (stream, val);
-	g_free (val);
+	if (suffix != NULL) {
+		vector[n].data = (char *) suffix;
+		vector[n].len = strlen (suffix);
+		n++;
+	}
 	
-	return nwritten;
+	if (n > 0) {
+		if ((nwritten = g_mime_stream_writev (stream, vector, n)) == -1)
+			goto exception;
+		
+		total += nwritten;
+	}
+	
+	g_ptr_array_foreach (values, (GFunc) g_free, NULL);
+	g_ptr_array_free (values, TRUE);
+	g_free (vector);
+	
+	return total;
+	
+ exception:
+	g_ptr_array_foreach (values, (GFunc) g_free, NULL);
+	g_ptr_array_free (values, TRUE);
+	g_free (vector);
+	
+	return -1;
 }
 
 
@@ -235,33 +1031,10 @@ default_writer (GMimeParserOptions *options, GMimeStream *stream, const char *na
 ssize_t
 g_mime_header_write_to_stream (GMimeHeader *header, GMimeStream *stream)
 {
-	ssize_t nwritten, total = 0;
-	GMimeHeaderWriter writer;
-	char *val;
-	
 	g_return_val_if_fail (header != NULL, -1);
 	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
 	
-	if (header->raw_value) {
-		val = g_strdup_printf ("%s:%s", header->name, header->raw_value);
-		nwritten = g_mime_stream_write_string (stream, val);
-		g_free (val);
-		
-		if (nwritten == -1)
-			return -1;
-		
-		total += nwritten;
-	} else if (header->value) {
-		if (!(writer = g_hash_table_lookup (header->list->writers, header->name)))
-			writer = default_writer;
-		
-		if ((nwritten = writer (header->list->options, stream, header->name, header->value)) == -1)
-			return -1;
-		
-		total += nwritten;
-	}
-	
-	return total;
+	return _g_mime_headers_write_to_stream (&header, 1, stream, NULL);
 }
 
 
@@ -289,6 +1062,11 @@ g_mime_header_list_new (GMimeParserOptions *options)
 					  g_mime_strcase_equal);
 	headers->changed = g_mime_event_new (headers);
 	headers->list = g_ptr_array_new ();
+	headers->use_arena = FALSE;
+	headers->arena = NULL;
+	
+	/* our headers' interned names have to outlive g_mime_shutdown() */
+	headers->names = name_pool_arena ? arena_ref (name_pool_arena) : NULL;
 	
 	return headers;
 }
@@ -319,6 +1097,12 @@ g_mime_header_list_destroy (GMimeHeaderList *headers)
 	
 	g_mime_event_destroy (headers->changed);
 	
+	if (headers->arena)
+		arena_unref (headers->arena);
+	
+	if (headers->names)
+		arena_unref (headers->names);
+	
 	g_slice_free (GMimeHeaderList, headers);
 }
 
@@ -347,6 +1131,35 @@ g_mime_header_list_clear (GMimeHeaderList *headers)
 }
 
 
+/**
+ * _g_mime_header_list_set_arena:
+ * @headers: a #GMimeHeaderList
+ * @arena: an #Arena or %NULL
+ *
+ * Sets the arena that headers subsequently added to @headers get
+ * allocated from or, if @arena is %NULL, goes back to allocating them
+ * on the heap. The list keeps a reference on the arena for as long as
+ * it lives.
+ *
+ * Note: only the parser uses this, since memory allocated from an
+ * arena does not get released until the arena itself is.
+ **/
+void
+_g_mime_header_list_set_arena (GMimeHeaderList *headers, Arena *arena)
+{
+	if (arena == NULL) {
+		headers->use_arena = FALSE;
+		return;
+	}
+	
+	if (headers->arena == NULL)
+		headers->arena = arena_ref (arena);
+	
+	/* a list can only hold on to a single arena */
+	headers->use_arena = headers->arena == arena;
+}
+
+
 GMimeParserOptions *
 _g_mime_header_list_get_options (GMimeHeaderList *headers)
 {
@@ -356,8 +1169,14 @@ _g_mime_header_list_get_options (GMimeHeaderList *headers)
 void
 _g_mime_header_list_set_options (GMimeHeaderList *headers, GMimeParserOptions *options)
 {
+	guint i;
+	
 	g_mime_parser_options_free (headers->options);
 	headers->options = _g_mime_parser_options_clone (options);
+	
+	/* the values would decode differently now */
+	for (i = 0; i < headers->list->len; i++)
+		header_invalidate_cache (headers->list->pdata[i]);
 }
 
 
@@ -513,6 +1332,9 @@ g_mime_header_list_append (GMimeHeaderList *headers, const char *name, const cha
  *
  * Note: The returned value should be decoded with a function such as
  * g_mime_utils_header_decode_text() before displaying to the user.
+ *
+ * Like g_mime_header_get_value(), this may unfold the header's value
+ * the first time it is asked for, which is safe to do concurrently.
  **/
 const char *
 g_mime_header_list_get (const GMimeHeaderList *headers, const char *name)
@@ -525,7 +1347,7 @@ g_mime_header_list_get (const GMimeHeaderList *headers, const char *name)
 	if (!(header = g_hash_table_lookup (headers->hash, name)))
 		return NULL;
 	
-	return header->value;
+	return header_get_value ((GMimeHeader *) header);
 }
 
 
@@ -533,30 +1355,38 @@ void
 _g_mime_header_list_set (GMimeHeaderList *headers, const char *name, const char *value, const char *raw_value, gint64 offset)
 {
 	GMimeHeader *header, *hdr;
-	guint i;
+	char *buf, *raw;
+	guint i, j;
 	
 	if ((header = g_hash_table_lookup (headers->hash, name))) {
-		g_free (header->raw_value);
-		header->raw_value = raw_value ? g_strdup (raw_value) : NULL;
+		/* @value may well be one of the strings we are about to free */
+		raw = raw_value ? g_strdup (raw_value) : NULL;
+		buf = g_strdup (value);
 		
-		g_free (header->value);
-		header->value = g_strdup (value);
+		header_invalidate_cache (header);
+		header_free_raw_value (header);
+		header_free_value (header);
 		
+		header->raw_value = raw;
+		header->value = buf;
 		header->offset = offset;
 		
-		for (i = headers->list->len - 1; i > 0; i--) {
-			hdr = (GMimeHeader *) headers->list->pdata[i];
-			
-			if (hdr == header)
-				break;
-			
-			if (g_ascii_strcasecmp (header->name, hdr->name) != 0)
-				continue;
+		/* drop any later headers with the same name, compacting
+		 * the rest of the list as we go */
+		for (i = 0; headers->list->pdata[i] != header; i++)
+			;
+		
+		for (j = ++i; j < headers->list->len; j++) {
+			hdr = (GMimeHeader *) headers->list->pdata[j];
 			
-			g_ptr_array_remove_index (headers->list, i);
-			g_mime_header_free (hdr);
+			if (header_has_name (hdr, header->id, header->hash, header->name))
+				g_mime_header_free (hdr);
+			else
+				headers->list->pdata[i++] = hdr;
 		}
 		
+		g_ptr_array_set_size (headers->list, i);
+		
 		g_mime_event_emit (headers->changed, NULL);
 	} else {
 		_g_mime_header_list_append (headers, name, value, raw_value, offset);
@@ -627,7 +1457,7 @@ g_mime_header_list_get_header (GMimeHeaderList *headers, int index)
 gboolean
 g_mime_header_list_remove (GMimeHeaderList *headers, const char *name)
 {
-	GMimeHeader *header, *node;
+	GMimeHeader *header, *hdr, *next = NULL;
 	guint i;
 	
 	g_return_val_if_fail (headers != NULL, FALSE);
@@ -637,27 +1467,27 @@ g_mime_header_list_remove (GMimeHeaderList *headers, const char *name)
 		return FALSE;
 	
 	/* get the index of the header */
-	for (i = 0; i < headers->list->len; i++) {
-		if (headers->list->pdata[i] == header)
-			break;
+	for (i = 0; headers->list->pdata[i] != header; i++)
+		;
+	
+	/* shift the rest of the list down over it, looking out for
+	 * the next header with the same name as we go */
+	for ( ; i + 1 < headers->list->len; i++) {
+		hdr = (GMimeHeader *) headers->list->pdata[i + 1];
+		headers->list->pdata[i] = hdr;
+		
+		if (next == NULL && header_has_name (hdr, header->id, header->hash, header->name))
+			next = hdr;
 	}
 	
-	g_ptr_array_remove_index (headers->list, i);
+	g_ptr_array_set_size (headers->list, i);
 	g_hash_table_remove (headers->hash, name);
-	g_mime_header_free (header);
 	
-	/* look for another header with the same name... */
-	while (i < headers->list->len) {
-		header = (GMimeHeader *) headers->list->pdata[i];
-		
-		if (!g_ascii_strcasecmp (header->name, name)) {
-			/* enter this node into the lookup table */
-			g_hash_table_insert (headers->hash, header->name, header);
-			break;
-		}
-		
-		i++;
-	}
+	/* enter the next instance, if any, into the lookup table */
+	if (next != NULL)
+		g_hash_table_insert (headers->hash, next->name, next);
+	
+	g_mime_header_free (header);
 	
 	g_mime_event_emit (headers->changed, NULL);
 	
@@ -695,7 +1525,7 @@ g_mime_header_list_remove_at (GMimeHeaderList *headers, int index)
 		for (i = (guint) index; i < headers->list->len; i++) {
 			hdr = (GMimeHeader *) headers->list->pdata[i];
 			
-			if (!g_ascii_strcasecmp (header->name, hdr->name)) {
+			if (header_has_name (hdr, header->id, header->hash, header->name)) {
 				g_hash_table_insert (headers->hash, hdr->name, hdr);
 				break;
 			}
@@ -720,23 +1550,20 @@ g_mime_header_list_remove_at (GMimeHeaderList *headers, int index)
 ssize_t
 g_mime_header_list_write_to_stream (const GMimeHeaderList *headers, GMimeStream *stream)
 {
-	ssize_t nwritten, total = 0;
-	GMimeHeader *header;
-	guint i;
-	
 	g_return_val_if_fail (headers != NULL, -1);
 	g_return_val_if_fail (stream != NULL, -1);
 	
-	for (i = 0; i < headers->list->len; i++) {
-		header = (GMimeHeader *) headers->list->pdata[i];
-		
-		if ((nwritten = g_mime_header_write_to_stream (header, stream)) == -1)
-			return -1;
-		
-		total += nwritten;
-	}
-	
-	return total;
+	return _g_mime_header_list_write_to_stream (headers, stream, NULL);
+}
+
+
+/* like g_mime_header_list_write_to_stream(), but lets the caller
+ * write something after the headers (such as the blank line that
+ * terminates them) within the same vectored write */
+ssize_t
+_g_mime_header_list_write_to_stream (const GMimeHeaderList *headers, GMimeStream *stream, const char *suffix)
+{
+	return _g_mime_headers_write_to_stream ((GMimeHeader **) headers->list->pdata, headers->list->len, stream, suffix);
 }
 
 
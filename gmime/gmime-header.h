@@ -23,6 +23,9 @@
 #define __GMIME_HEADER_H__
 
 #include <glib.h>
+#include <time.h>
+
+#include <gmime/internet-address.h>
 #include <gmime/gmime-parser-options.h>
 #include <gmime/gmime-stream.h>
 
@@ -56,6 +59,11 @@ const char *g_mime_header_get_name (GMimeHeader *header);
 const char *g_mime_header_get_value (GMimeHeader *header);
 void g_mime_header_set_value (GMimeHeader *header, const char *value);
 
+const char *g_mime_header_get_decoded_value (GMimeHeader *header);
+InternetAddressList *g_mime_header_get_addresses (GMimeHeader *header);
+time_t g_mime_header_get_date (GMimeHeader *header, int *tz_offset);
+const char *g_mime_header_get_message_id (GMimeHeader *header);
+
 gint64 g_mime_header_get_offset (GMimeHeader *header);
 
 ssize_t g_mime_header_write_to_stream (GMimeHeader *header, GMimeStream *stream);
@@ -58,19 +58,51 @@
  **/
 
 #define ICONV_CACHE_SIZE   (16)
+#define ICONV_POOL_SIZE    (4)
+#define ICONV_THREAD_SLOTS (8)
 
+/* a bucket in the global LRU: the descriptors for one charset pair
+ * that are not currently owned by a thread or a caller */
 typedef struct {
 	CacheNode node;
-	guint32 refcount : 31;
-	guint32 used : 1;
-	iconv_t cd;
+	guint32 refcount;
+	guint32 navail;
+	iconv_t avail[ICONV_POOL_SIZE];
 } IconvCacheNode;
 
+typedef struct _IconvThreadCache IconvThreadCache;
+
+/* a descriptor owned by a thread; only the owning thread ever marks
+ * it as used, but any thread may mark it unused again (with the cache
+ * lock held) if the descriptor is passed along and closed elsewhere.
+ * @name is the "from:to" pair as requested by the caller, so that the
+ * charset aliases don't have to be looked up again to reuse it, while
+ * @key is the cache key for the iconv names it was opened with. */
+typedef struct {
+	volatile gint used;
+	size_t fromlen;
+	char *name;
+	char *key;
+	iconv_t cd;
+} IconvSlot;
+
+struct _IconvThreadCache {
+	IconvSlot slots[ICONV_THREAD_SLOTS];
+	gint generation;
+	guint next;
+};
+
 
 static Cache *iconv_cache = NULL;
 static GHashTable *iconv_open_hash = NULL;
+static GHashTable *iconv_slot_hash = NULL;
+static volatile gint generation = 0;
 static int initialized = 0;
 
+static void iconv_thread_cache_free (gpointer user_data);
+
+static GPrivate iconv_thread_cache = G_PRIVATE_INIT (iconv_thread_cache_free);
+
 #ifdef GMIME_ICONV_DEBUG
 static int cache_misses = 0;
 static int shutdown = 0;
@@ -89,13 +121,26 @@ G_LOCK_DEFINE_STATIC (lock);
 #endif /* G_THREADS_ENABLED */
 
 
+static void
+iconv_reset (iconv_t cd)
+{
+	/* Apparently iconv on Solaris <= 7 segfaults if you pass in
+	 * NULL for anything but inbuf; work around that. (NULL outbuf
+	 * or NULL *outbuf is allowed by Unix98.)
+	 */
+	size_t inleft = 0, outleft = 0;
+	char *outbuf = NULL;
+	
+	iconv (cd, NULL, &inleft, &outbuf, &outleft);
+}
+
+
 /* caller *must* hold the iconv_cache_lock to call any of the following functions */
 
 
 /**
  * iconv_cache_node_new: (skip)
  * @key: cache key
- * @cd: iconv descriptor
  *
  * Creates a new cache node, inserts it into the cache and increments
  * the cache size.
@@ -103,18 +148,13 @@ G_LOCK_DEFINE_STATIC (lock);
  * Returns: a pointer to the newly allocated cache node.
  **/
 static IconvCacheNode *
-iconv_cache_node_new (const char *key, iconv_t cd)
+iconv_cache_node_new (const char *key)
 {
 	IconvCacheNode *node;
 	
-#ifdef GMIME_ICONV_DEBUG
-	cache_misses++;
-#endif
-	
 	node = (IconvCacheNode *) cache_node_insert (iconv_cache, key);
-	node->refcount = 1;
-	node->used = TRUE;
-	node->cd = cd;
+	node->refcount = 0;
+	node->navail = 0;
 	
 	return node;
 }
@@ -124,15 +164,17 @@ static void
 iconv_cache_node_free (CacheNode *node)
 {
 	IconvCacheNode *inode = (IconvCacheNode *) node;
+	guint32 i;
 	
 #ifdef GMIME_ICONV_DEBUG
 	if (shutdown) {
-		fprintf (stderr, "%s: open=%d; used=%s\n", node->key,
-			 inode->refcount, inode->used ? "yes" : "no");
+		fprintf (stderr, "%s: open=%d; pooled=%d\n", node->key,
+			 inode->refcount, inode->navail);
 	}
 #endif
 	
-	iconv_close (inode->cd);
+	for (i = 0; i < inode->navail; i++)
+		iconv_close (inode->avail[i]);
 }
 
 
@@ -154,6 +196,178 @@ iconv_cache_node_expire (Cache *cache, CacheNode *node)
 }
 
 
+/**
+ * iconv_cache_acquire:
+ * @key: cache key
+ * @to: charset to convert to
+ * @from: charset to convert from
+ *
+ * Takes an idle descriptor for @key out of the pool, or opens a new
+ * one if there are none.
+ *
+ * Returns: a descriptor reset to its initial state or (iconv_t) %-1
+ * on fail.
+ **/
+static iconv_t
+iconv_cache_acquire (const char *key, const char *to, const char *from)
+{
+	IconvCacheNode *node;
+	iconv_t cd;
+	
+	if ((node = (IconvCacheNode *) cache_node_lookup (iconv_cache, key, TRUE)) && node->navail > 0) {
+		cd = node->avail[--node->navail];
+		iconv_reset (cd);
+		return cd;
+	}
+	
+#ifdef GMIME_ICONV_DEBUG
+	cache_misses++;
+#endif
+	
+	return iconv_open (to, from);
+}
+
+
+/**
+ * iconv_cache_release:
+ * @key: cache key
+ * @cd: iconv descriptor
+ *
+ * Gives @cd back to the pool for @key, closing it if the pool is
+ * already full.
+ **/
+static void
+iconv_cache_release (const char *key, iconv_t cd)
+{
+	IconvCacheNode *node;
+	
+	if (!(node = (IconvCacheNode *) cache_node_lookup (iconv_cache, key, FALSE)))
+		node = iconv_cache_node_new (key);
+	
+	if (node->navail < ICONV_POOL_SIZE)
+		node->avail[node->navail++] = cd;
+	else
+		iconv_close (cd);
+}
+
+
+/**
+ * iconv_slot_clear:
+ * @slot: a thread-owned descriptor
+ * @cached: %TRUE if the slot is still registered with the cache
+ *
+ * Disowns the descriptor held by @slot. If it is idle, it is given
+ * back to the pool (or closed if the cache is gone); if a caller
+ * still has it open, it becomes an ordinary outstanding descriptor
+ * that g_mime_iconv_close() will find in the open hash.
+ **/
+static void
+iconv_slot_clear (IconvSlot *slot, gboolean cached)
+{
+	IconvCacheNode *node;
+	
+	if (slot->cd == (iconv_t) -1)
+		return;
+	
+	if (cached) {
+		g_hash_table_remove (iconv_slot_hash, slot->cd);
+		
+		if (g_atomic_int_get (&slot->used)) {
+			if (!(node = (IconvCacheNode *) cache_node_lookup (iconv_cache, slot->key, FALSE)))
+				node = iconv_cache_node_new (slot->key);
+			
+			g_hash_table_insert (iconv_open_hash, slot->cd, ((CacheNode *) node)->key);
+			node->refcount++;
+		} else {
+			iconv_cache_release (slot->key, slot->cd);
+		}
+	} else if (!g_atomic_int_get (&slot->used)) {
+		/* the cache this slot belonged to has since been shut
+		 * down; whoever has a used descriptor open will close it
+		 * via iconv_close() */
+		iconv_close (slot->cd);
+	}
+	
+	g_atomic_int_set (&slot->used, FALSE);
+	slot->cd = (iconv_t) -1;
+	g_free (slot->name);
+	slot->name = NULL;
+	g_free (slot->key);
+	slot->key = NULL;
+}
+
+
+/* the remaining functions are called without holding the lock */
+
+
+static void
+iconv_thread_cache_free (gpointer user_data)
+{
+	IconvThreadCache *tc = user_data;
+	gboolean cached;
+	guint i;
+	
+	ICONV_CACHE_LOCK ();
+	
+	cached = initialized > 0 && tc->generation == g_atomic_int_get (&generation);
+	
+	for (i = 0; i < ICONV_THREAD_SLOTS; i++)
+		iconv_slot_clear (&tc->slots[i], cached);
+	
+	ICONV_CACHE_UNLOCK ();
+	
+	g_free (tc);
+}
+
+
+/**
+ * iconv_thread_cache_get:
+ * @create: whether to create the calling thread's cache if it has none
+ *
+ * Gets the calling thread's descriptor cache, discarding its contents
+ * first if they were cached by an earlier g_mime_iconv_init().
+ *
+ * Returns: the calling thread's cache or %NULL.
+ **/
+static IconvThreadCache *
+iconv_thread_cache_get (gboolean create)
+{
+	IconvThreadCache *tc;
+	guint i;
+	
+	if ((tc = g_private_get (&iconv_thread_cache)) != NULL) {
+		if (tc->generation == g_atomic_int_get (&generation))
+			return tc;
+		
+		for (i = 0; i < ICONV_THREAD_SLOTS; i++)
+			iconv_slot_clear (&tc->slots[i], FALSE);
+		
+		tc->generation = g_atomic_int_get (&generation);
+		
+		return tc;
+	}
+	
+	if (!create)
+		return NULL;
+	
+	tc = g_new (IconvThreadCache, 1);
+	tc->generation = g_atomic_int_get (&generation);
+	tc->next = 0;
+	
+	for (i = 0; i < ICONV_THREAD_SLOTS; i++) {
+		tc->slots[i].cd = (iconv_t) -1;
+		tc->slots[i].used = FALSE;
+		tc->slots[i].name = NULL;
+		tc->slots[i].key = NULL;
+		tc->slots[i].fromlen = 0;
+	}
+	
+	g_private_set (&iconv_thread_cache, tc);
+	
+	return tc;
+}
+
+
 static void
 iconv_open_node_free (gpointer key, gpointer value, gpointer user_data)
 {
@@ -163,10 +377,8 @@ iconv_open_node_free (gpointer key, gpointer value, gpointer user_data)
 	node = (IconvCacheNode *) cache_node_lookup (iconv_cache, value, FALSE);
 	g_assert (node);
 	
-	if (cd != node->cd) {
-		node->refcount--;
-		iconv_close (cd);
-	}
+	node->refcount--;
+	iconv_close (cd);
 }
 
 
@@ -180,6 +392,9 @@ iconv_open_node_free (gpointer key, gpointer value, gpointer user_data)
 void
 g_mime_iconv_shutdown (void)
 {
+	IconvThreadCache *tc;
+	guint i;
+	
 	if (--initialized)
 		return;
 	
@@ -189,6 +404,18 @@ g_mime_iconv_shutdown (void)
 	shutdown = 1;
 #endif
 	
+	/* hand the calling thread's descriptors back to the cache so
+	 * that they get closed with the rest; any other thread discards
+	 * its own the next time it uses them */
+	if ((tc = g_private_get (&iconv_thread_cache)) != NULL) {
+		for (i = 0; i < ICONV_THREAD_SLOTS; i++)
+			iconv_slot_clear (&tc->slots[i], tc->generation == generation);
+		
+		g_private_replace (&iconv_thread_cache, NULL);
+	}
+	
+	g_atomic_int_inc (&generation);
+	
 #ifdef G_THREADS_ENABLED
 	if (glib_check_version (2, 37, 4) == NULL) {
 		/* The implementation of g_mutex_clear() prior
@@ -204,6 +431,9 @@ g_mime_iconv_shutdown (void)
 	g_hash_table_destroy (iconv_open_hash);
 	iconv_open_hash = NULL;
 	
+	g_hash_table_destroy (iconv_slot_hash);
+	iconv_slot_hash = NULL;
+	
 	cache_free (iconv_cache);
 	iconv_cache = NULL;
 }
@@ -232,6 +462,7 @@ g_mime_iconv_init (void)
 	g_mime_charset_map_init ();
 	
 	iconv_open_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
+	iconv_slot_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
 	iconv_cache = cache_new (iconv_cache_node_expire, iconv_cache_node_free,
 				 sizeof (IconvCacheNode), ICONV_CACHE_SIZE);
 }
@@ -247,6 +478,10 @@ g_mime_iconv_init (void)
  * descriptor can be used with iconv() (or the g_mime_iconv() wrapper) any
  * number of times until closed using g_mime_iconv_close().
  *
+ * Descriptors are recycled: each thread keeps a few of the ones it
+ * has closed so that it can reopen them without locking, and the
+ * rest are pooled per charset pair for any thread to reuse.
+ *
  * See the manual page for iconv_open(3) for further details.
  *
  * Returns: a new conversion descriptor for use with g_mime_iconv() on
@@ -256,9 +491,13 @@ g_mime_iconv_init (void)
 iconv_t
 g_mime_iconv_open (const char *to, const char *from)
 {
+	size_t fromlen, tolen;
+	IconvThreadCache *tc;
 	IconvCacheNode *node;
+	char *name, *key;
+	IconvSlot *slot;
 	iconv_t cd;
-	char *key;
+	guint i;
 	
 	if (from == NULL || to == NULL) {
 		errno = EINVAL;
@@ -268,6 +507,30 @@ g_mime_iconv_open (const char *to, const char *from)
 	if (!g_ascii_strcasecmp (from, "x-unknown"))
 		from = g_mime_locale_charset ();
 	
+	fromlen = strlen (from);
+	
+	/* first try the descriptors that this thread already owns */
+	tc = iconv_thread_cache_get (TRUE);
+	
+	for (i = 0; i < ICONV_THREAD_SLOTS; i++) {
+		slot = &tc->slots[i];
+		
+		if (slot->cd == (iconv_t) -1 || slot->fromlen != fromlen || g_atomic_int_get (&slot->used))
+			continue;
+		
+		if (!g_ascii_strncasecmp (slot->name, from, fromlen) && !g_ascii_strcasecmp (slot->name + fromlen + 1, to)) {
+			g_atomic_int_set (&slot->used, TRUE);
+			iconv_reset (slot->cd);
+			return slot->cd;
+		}
+	}
+	
+	tolen = strlen (to);
+	name = g_alloca (fromlen + tolen + 2);
+	memcpy (name, from, fromlen);
+	name[fromlen] = ':';
+	memcpy (name + fromlen + 1, to, tolen + 1);
+	
 	from = g_mime_charset_iconv_name (from);
 	to = g_mime_charset_iconv_name (to);
 	key = g_alloca (strlen (from) + strlen (to) + 2);
@@ -275,35 +538,42 @@ g_mime_iconv_open (const char *to, const char *from)
 	
 	ICONV_CACHE_LOCK ();
 	
-	if ((node = (IconvCacheNode *) cache_node_lookup (iconv_cache, key, TRUE))) {
-		if (node->used) {
-			if ((cd = iconv_open (to, from)) == (iconv_t) -1)
-				goto exception;
-		} else {
-			/* Apparently iconv on Solaris <= 7 segfaults if you pass in
-			 * NULL for anything but inbuf; work around that. (NULL outbuf
-			 * or NULL *outbuf is allowed by Unix98.)
-			 */
-			size_t inleft = 0, outleft = 0;
-			char *outbuf = NULL;
-			
-			cd = node->cd;
-			node->used = TRUE;
-			
-			/* reset the descriptor */
-			iconv (cd, NULL, &inleft, &outbuf, &outleft);
+	if ((cd = iconv_cache_acquire (key, to, from)) == (iconv_t) -1)
+		goto exception;
+	
+	/* keep the descriptor in an empty or idle slot if there is one */
+	for (i = 0, slot = NULL; i < ICONV_THREAD_SLOTS && slot == NULL; i++) {
+		if (tc->slots[i].cd == (iconv_t) -1)
+			slot = &tc->slots[i];
+	}
+	
+	for (i = 0; i < ICONV_THREAD_SLOTS && slot == NULL; i++) {
+		IconvSlot *victim = &tc->slots[(tc->next + i) % ICONV_THREAD_SLOTS];
+		
+		if (!g_atomic_int_get (&victim->used)) {
+			tc->next = (tc->next + i + 1) % ICONV_THREAD_SLOTS;
+			iconv_slot_clear (victim, TRUE);
+			slot = victim;
 		}
+	}
+	
+	if (slot != NULL) {
+		slot->name = g_strdup (name);
+		slot->key = g_strdup (key);
+		slot->fromlen = fromlen;
+		slot->cd = cd;
+		g_atomic_int_set (&slot->used, TRUE);
 		
-		node->refcount++;
+		g_hash_table_insert (iconv_slot_hash, cd, slot);
 	} else {
-		if ((cd = iconv_open (to, from)) == (iconv_t) -1)
-			goto exception;
+		/* every slot is in use; track it in the global cache instead */
+		if (!(node = (IconvCacheNode *) cache_node_lookup (iconv_cache, key, FALSE)))
+			node = iconv_cache_node_new (key);
 		
-		node = iconv_cache_node_new (key, cd);
+		g_hash_table_insert (iconv_open_hash, cd, ((CacheNode *) node)->key);
+		node->refcount++;
 	}
 	
-	g_hash_table_insert (iconv_open_hash, cd, ((CacheNode *) node)->key);
-	
 	ICONV_CACHE_UNLOCK ();
 	
 	return cd;
@@ -338,15 +608,33 @@ g_mime_iconv_open (const char *to, const char *from)
 int
 g_mime_iconv_close (iconv_t cd)
 {
+	IconvThreadCache *tc;
 	IconvCacheNode *node;
+	IconvSlot *slot;
 	const char *key;
+	guint i;
 	
 	if (cd == (iconv_t) -1)
 		return 0;
 	
+	/* descriptors opened by this thread go straight back to its slots */
+	if ((tc = iconv_thread_cache_get (FALSE)) != NULL) {
+		for (i = 0; i < ICONV_THREAD_SLOTS; i++) {
+			slot = &tc->slots[i];
+			
+			if (slot->cd == cd && g_atomic_int_get (&slot->used)) {
+				g_atomic_int_set (&slot->used, FALSE);
+				return 0;
+			}
+		}
+	}
+	
 	ICONV_CACHE_LOCK ();
 	
-	if ((key = g_hash_table_lookup (iconv_open_hash, cd))) {
+	if ((slot = g_hash_table_lookup (iconv_slot_hash, cd))) {
+		/* opened by another thread which still owns it */
+		g_atomic_int_set (&slot->used, FALSE);
+	} else if ((key = g_hash_table_lookup (iconv_open_hash, cd))) {
 		g_hash_table_remove (iconv_open_hash, cd);
 		
 		node = (IconvCacheNode *) cache_node_lookup (iconv_cache, key, FALSE);
@@ -359,8 +647,8 @@ g_mime_iconv_close (iconv_t cd)
 		
 		node->refcount--;
 		
-		if (cd == node->cd)
-			node->used = FALSE;
+		if (node->navail < ICONV_POOL_SIZE)
+			node->avail[node->navail++] = cd;
 		else
 			iconv_close (cd);
 	} else {
@@ -26,6 +26,8 @@
 #include <gmime/gmime-object.h>
 #include <gmime/gmime-events.h>
 #include <gmime/gmime-utils.h>
+#include <gmime/gmime-filter.h>
+#include <util/arena.h>
 
 G_BEGIN_DECLS
 
@@ -34,24 +36,79 @@ G_GNUC_INTERNAL void g_mime_parser_options_init (void);
 G_GNUC_INTERNAL void g_mime_parser_options_shutdown (void);
 G_GNUC_INTERNAL GMimeParserOptions *_g_mime_parser_options_clone (GMimeParserOptions *options);
 
+/* gmime-encodings */
+G_GNUC_INTERNAL void g_mime_encodings_init (void);
+
+/* GMimeFilter */
+G_GNUC_INTERNAL void _g_mime_filter_run (GMimeFilter *filter, gboolean flush, char *inbuf, size_t inlen, size_t prespace,
+					 gboolean *writable, char **outbuf, size_t *outlen, size_t *outprespace);
+
 /* GMimeHeader */
+
+/* the header fields that GMime itself looks for, interned to integers
+ * when a header is created so that they can be matched without string
+ * compares; every other field is GMIME_HEADER_ID_UNKNOWN except for
+ * Content-* fields, which are at least GMIME_HEADER_ID_CONTENT */
+typedef enum {
+	GMIME_HEADER_ID_UNKNOWN = 0,
+	GMIME_HEADER_ID_BCC,
+	GMIME_HEADER_ID_CC,
+	GMIME_HEADER_ID_DATE,
+	GMIME_HEADER_ID_FROM,
+	GMIME_HEADER_ID_IN_REPLY_TO,
+	GMIME_HEADER_ID_MESSAGE_ID,
+	GMIME_HEADER_ID_MIME_VERSION,
+	GMIME_HEADER_ID_REFERENCES,
+	GMIME_HEADER_ID_REPLY_TO,
+	GMIME_HEADER_ID_SENDER,
+	GMIME_HEADER_ID_SUBJECT,
+	GMIME_HEADER_ID_TO,
+
+	/* any other Content-* field */
+	GMIME_HEADER_ID_CONTENT,
+	GMIME_HEADER_ID_CONTENT_BASE,
+	GMIME_HEADER_ID_CONTENT_DESCRIPTION,
+	GMIME_HEADER_ID_CONTENT_DISPOSITION,
+	GMIME_HEADER_ID_CONTENT_ID,
+	GMIME_HEADER_ID_CONTENT_LANGUAGE,
+	GMIME_HEADER_ID_CONTENT_LENGTH,
+	GMIME_HEADER_ID_CONTENT_LOCATION,
+	GMIME_HEADER_ID_CONTENT_MD5,
+	GMIME_HEADER_ID_CONTENT_TRANSFER_ENCODING,
+	GMIME_HEADER_ID_CONTENT_TYPE,
+} GMimeHeaderId;
+
+#define _g_mime_header_id_is_content(id) ((id) >= GMIME_HEADER_ID_CONTENT)
+
+G_GNUC_INTERNAL void g_mime_header_init (void);
+G_GNUC_INTERNAL void g_mime_header_shutdown (void);
+G_GNUC_INTERNAL GMimeHeaderId _g_mime_header_id (const char *name, size_t len);
+G_GNUC_INTERNAL const char *_g_mime_header_intern_name (const char *name, size_t len, GMimeHeaderId *id);
 G_GNUC_INTERNAL const char *_g_mime_header_get_raw_value (GMimeHeader *header);
 G_GNUC_INTERNAL void _g_mime_header_set_offset (GMimeHeader *header, gint64 offset);
+G_GNUC_INTERNAL char *_g_mime_header_unfold (char *value);
+G_GNUC_INTERNAL ssize_t _g_mime_headers_write_to_stream (GMimeHeader **headers, guint count, GMimeStream *stream, const char *suffix);
 
 /* GMimeHeaderList */
 G_GNUC_INTERNAL GMimeParserOptions *_g_mime_header_list_get_options (GMimeHeaderList *headers);
 G_GNUC_INTERNAL void _g_mime_header_list_set_options (GMimeHeaderList *headers, GMimeParserOptions *options);
+G_GNUC_INTERNAL void _g_mime_header_list_set_arena (GMimeHeaderList *headers, Arena *arena);
 G_GNUC_INTERNAL gboolean _g_mime_header_list_has_raw_value (const GMimeHeaderList *headers, const char *name);
 G_GNUC_INTERNAL void _g_mime_header_list_prepend (GMimeHeaderList *headers, const char *name, const char *value, const char *raw_value, gint64 offset);
 G_GNUC_INTERNAL void _g_mime_header_list_append (GMimeHeaderList *headers, const char *name, const char *value, const char *raw_value, gint64 offset);
 G_GNUC_INTERNAL void _g_mime_header_list_set (GMimeHeaderList *headers, const char *name, const char *value, const char *raw_value, gint64 offset);
 G_GNUC_INTERNAL GMimeEvent *_g_mime_header_list_get_changed_event (GMimeHeaderList *headers);
+G_GNUC_INTERNAL ssize_t _g_mime_header_list_write_to_stream (const GMimeHeaderList *headers, GMimeStream *stream, const char *suffix);
 
 /* GMimeObject */
 G_GNUC_INTERNAL void _g_mime_object_set_content_type (GMimeObject *object, GMimeContentType *content_type);
+G_GNUC_INTERNAL GType _g_mime_object_lookup_type (const char *type, const char *subtype);
 G_GNUC_INTERNAL void _g_mime_object_prepend_header (GMimeObject *object, const char *header, const char *value, const char *raw_value, gint64 offset);
 G_GNUC_INTERNAL void _g_mime_object_append_header (GMimeObject *object, const char *header, const char *value, const char *raw_value, gint64 offset);
 G_GNUC_INTERNAL void _g_mime_object_set_header (GMimeObject *object, const char *header, const char *value, const char *raw_value, gint64 offset);
+G_GNUC_INTERNAL void _g_mime_object_set_raw (GMimeObject *object, GMimeStream *stream, gint64 headers_begin, gint64 content_begin, gint64 content_end);
+G_GNUC_INTERNAL void _g_mime_object_set_dirty (GMimeObject *object);
+G_GNUC_INTERNAL ssize_t _g_mime_object_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean content_only);
 
 /* utils */
 G_GNUC_INTERNAL char *_g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char *field, const char *value);
@@ -0,0 +1,511 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "gmime-mbox-index.h"
+#include "gmime-stream-file.h"
+#include "gmime-stream-mmap.h"
+#include "gmime-stream-fs.h"
+#include "gmime-error.h"
+
+
+/**
+ * SECTION: gmime-mbox-index
+ * @title: GMimeMboxIndex
+ * @short_description: A persistent index of the messages in an mbox
+ * @see_also: #GMimeParser
+ *
+ * A #GMimeMboxIndex records where each message in an mbox begins and
+ * ends so that, once saved to disk, a mailbox can be reopened without
+ * rescanning it and any message can be parsed by seeking straight to
+ * it with g_mime_mbox_index_seek().
+ *
+ * Along with the offsets, the index keeps a fingerprint (the size and
+ * modification time) of the mbox that it was last updated from so
+ * that g_mime_mbox_index_update() only needs to scan the messages that
+ * have been appended to a growing mailbox since.
+ **/
+
+
+/* on-disk format (all integers are little-endian):
+ *
+ * magic    8 bytes  "GMimeIdx"
+ * version  guint32
+ * count    guint32
+ * size     gint64   size of the mbox when last updated
+ * mtime    gint64   modification time of the mbox when last updated
+ * entries  count * (start, headers_end, end) as gint64's
+ */
+#define INDEX_MAGIC "GMimeIdx"
+#define INDEX_MAGIC_LEN 8
+#define INDEX_VERSION 1
+#define INDEX_HEADER_LEN (INDEX_MAGIC_LEN + 4 + 4 + 8 + 8)
+#define INDEX_ENTRY_LEN (3 * 8)
+
+struct _GMimeMboxIndex {
+	GArray *entries;
+	gint64 size;
+	gint64 mtime;
+};
+
+
+/**
+ * g_mime_mbox_index_new:
+ *
+ * Creates a new, empty, mbox index.
+ *
+ * Returns: a new #GMimeMboxIndex.
+ **/
+GMimeMboxIndex *
+g_mime_mbox_index_new (void)
+{
+	GMimeMboxIndex *index;
+	
+	index = g_slice_new (GMimeMboxIndex);
+	index->entries = g_array_new (FALSE, FALSE, sizeof (GMimeMboxIndexEntry));
+	index->size = 0;
+	index->mtime = 0;
+	
+	return index;
+}
+
+
+/**
+ * g_mime_mbox_index_free:
+ * @index: a #GMimeMboxIndex
+ *
+ * Frees the mbox index.
+ **/
+void
+g_mime_mbox_index_free (GMimeMboxIndex *index)
+{
+	g_return_if_fail (index != NULL);
+	
+	g_array_free (index->entries, TRUE);
+	g_slice_free (GMimeMboxIndex, index);
+}
+
+
+static gint64
+decode_int64 (const unsigned char *inptr)
+{
+	guint64 v;
+	
+	memcpy (&v, inptr, sizeof (v));
+	
+	return (gint64) GUINT64_FROM_LE (v);
+}
+
+static guint32
+decode_int32 (const unsigned char *inptr)
+{
+	guint32 v;
+	
+	memcpy (&v, inptr, sizeof (v));
+	
+	return GUINT32_FROM_LE (v);
+}
+
+
+/**
+ * g_mime_mbox_index_load:
+ * @filename: the path of the index file
+ * @err: a #GError
+ *
+ * Loads an mbox index previously written by g_mime_mbox_index_save().
+ *
+ * Before relying on the offsets, the index should be brought up to
+ * date with the mbox using g_mime_mbox_index_update().
+ *
+ * Returns: (transfer full): the mbox index or %NULL on error.
+ **/
+GMimeMboxIndex *
+g_mime_mbox_index_load (const char *filename, GError **err)
+{
+	const unsigned char *inptr;
+	GMimeMboxIndexEntry *entry;
+	GMimeMboxIndex *index;
+	guint32 count, i;
+	char *contents;
+	gsize len;
+	
+	g_return_val_if_fail (filename != NULL, NULL);
+	
+	if (!g_file_get_contents (filename, &contents, &len, err))
+		return NULL;
+	
+	inptr = (const unsigned char *) contents;
+	
+	if (len < INDEX_HEADER_LEN || memcmp (inptr, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0 ||
+	    decode_int32 (inptr + INDEX_MAGIC_LEN) != INDEX_VERSION)
+		goto invalid;
+	
+	count = decode_int32 (inptr + INDEX_MAGIC_LEN + 4);
+	if ((len - INDEX_HEADER_LEN) / INDEX_ENTRY_LEN != count || (len - INDEX_HEADER_LEN) % INDEX_ENTRY_LEN != 0)
+		goto invalid;
+	
+	index = g_mime_mbox_index_new ();
+	index->size = decode_int64 (inptr + INDEX_MAGIC_LEN + 8);
+	index->mtime = decode_int64 (inptr + INDEX_MAGIC_LEN + 16);
+	g_array_set_size (index->entries, count);
+	inptr += INDEX_HEADER_LEN;
+	
+	for (i = 0; i < count; i++) {
+		entry = &g_array_index (index->entries, GMimeMboxIndexEntry, i);
+		entry->start = decode_int64 (inptr);
+		entry->headers_end = decode_int64 (inptr + 8);
+		entry->end = decode_int64 (inptr + 16);
+		inptr += INDEX_ENTRY_LEN;
+	}
+	
+	g_free (contents);
+	
+	return index;
+	
+ invalid:
+	g_set_error (err, GMIME_ERROR, GMIME_ERROR_PARSE_ERROR,
+		     "`%s' is not a valid mbox index", filename);
+	g_free (contents);
+	
+	return NULL;
+}
+
+
+static void
+encode_int64 (GByteArray *buf, gint64 value)
+{
+	guint64 v = GUINT64_TO_LE ((guint64) value);
+	
+	g_byte_array_append (buf, (unsigned char *) &v, sizeof (v));
+}
+
+static void
+encode_int32 (GByteArray *buf, guint32 value)
+{
+	guint32 v = GUINT32_TO_LE (value);
+	
+	g_byte_array_append (buf, (unsigned char *) &v, sizeof (v));
+}
+
+
+/**
+ * g_mime_mbox_index_save:
+ * @index: a #GMimeMboxIndex
+ * @filename: the path of the index file
+ * @err: a #GError
+ *
+ * Atomically writes @index to @filename.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ **/
+gboolean
+g_mime_mbox_index_save (GMimeMboxIndex *index, const char *filename, GError **err)
+{
+	GMimeMboxIndexEntry *entry;
+	gboolean retval;
+	GByteArray *buf;
+	guint i;
+	
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	
+	buf = g_byte_array_sized_new (INDEX_HEADER_LEN + index->entries->len * INDEX_ENTRY_LEN);
+	g_byte_array_append (buf, (unsigned char *) INDEX_MAGIC, INDEX_MAGIC_LEN);
+	encode_int32 (buf, INDEX_VERSION);
+	encode_int32 (buf, index->entries->len);
+	encode_int64 (buf, index->size);
+	encode_int64 (buf, index->mtime);
+	
+	for (i = 0; i < index->entries->len; i++) {
+		entry = &g_array_index (index->entries, GMimeMboxIndexEntry, i);
+		encode_int64 (buf, entry->start);
+		encode_int64 (buf, entry->headers_end);
+		encode_int64 (buf, entry->end);
+	}
+	
+	retval = g_file_set_contents (filename, (char *) buf->data, buf->len, err);
+	g_byte_array_free (buf, TRUE);
+	
+	return retval;
+}
+
+
+/**
+ * g_mime_mbox_index_clear:
+ * @index: a #GMimeMboxIndex
+ *
+ * Removes all of the messages from the index.
+ **/
+void
+g_mime_mbox_index_clear (GMimeMboxIndex *index)
+{
+	g_return_if_fail (index != NULL);
+	
+	g_array_set_size (index->entries, 0);
+	index->size = 0;
+	index->mtime = 0;
+}
+
+
+/**
+ * g_mime_mbox_index_add:
+ * @index: a #GMimeMboxIndex
+ * @parser: a #GMimeParser scanning an mbox
+ *
+ * Appends the message that @parser has just constructed to the
+ * index. This allows an index to be generated while parsing an mbox
+ * with g_mime_parser_construct_message() (or from the callback passed
+ * to g_mime_parser_construct_mbox()).
+ *
+ * Since the index can't know whether that was the last message in the
+ * mbox, the next g_mime_mbox_index_update() will rescan the mbox from
+ * the start of the last message that was added.
+ **/
+void
+g_mime_mbox_index_add (GMimeMboxIndex *index, GMimeParser *parser)
+{
+	GMimeMboxIndexEntry entry;
+	
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (GMIME_IS_PARSER (parser));
+	
+	entry.start = g_mime_parser_get_from_offset (parser);
+	entry.headers_end = g_mime_parser_get_headers_end (parser);
+	entry.end = g_mime_parser_tell (parser);
+	
+	g_array_append_val (index->entries, entry);
+	index->mtime = 0;
+}
+
+
+static void
+mbox_fingerprint (GMimeStream *mbox, gint64 *size, gint64 *mtime)
+{
+	struct stat st;
+	FILE *fp;
+	int fd = -1;
+	
+	if (GMIME_IS_STREAM_FS (mbox)) {
+		fd = GMIME_STREAM_FS (mbox)->fd;
+	} else if (GMIME_IS_STREAM_MMAP (mbox)) {
+		fd = GMIME_STREAM_MMAP (mbox)->fd;
+	} else if (GMIME_IS_STREAM_FILE (mbox)) {
+		if ((fp = GMIME_STREAM_FILE (mbox)->fp))
+			fd = fileno (fp);
+	}
+	
+	if (fd != -1 && fstat (fd, &st) == 0) {
+		*size = (gint64) st.st_size;
+		*mtime = (gint64) st.st_mtime;
+	} else {
+		/* without a file to stat, the size is all we have to go by */
+		*size = -1;
+		*mtime = 0;
+	}
+	
+	if (mbox->bound_end != -1 && (*size == -1 || mbox->bound_end < *size))
+		*size = mbox->bound_end;
+	else if (*size == -1 && (*size = g_mime_stream_length (mbox)) != -1)
+		*size += mbox->bound_start;
+}
+
+static gboolean
+mbox_has_from_line (GMimeStream *mbox, gint64 offset)
+{
+	char buf[5];
+	
+	if (g_mime_stream_seek (mbox, offset, GMIME_STREAM_SEEK_SET) != offset)
+		return FALSE;
+	
+	if (g_mime_stream_read (mbox, buf, sizeof (buf)) != sizeof (buf))
+		return FALSE;
+	
+	return strncmp (buf, "From ", sizeof (buf)) == 0;
+}
+
+
+/**
+ * g_mime_mbox_index_update:
+ * @index: a #GMimeMboxIndex
+ * @parser: a #GMimeParser
+ * @mbox: the mbox stream
+ *
+ * Brings @index up to date with @mbox.
+ *
+ * If the size and modification time of @mbox match the fingerprint
+ * recorded by the previous update, there is nothing to do. If @mbox
+ * has grown and the last indexed message is still where the index
+ * says it is, @mbox is assumed to have been appended to and only the
+ * last indexed message and any that follow it are scanned. Otherwise
+ * the index is rebuilt from scratch.
+ *
+ * The messages are scanned by reinitializing @parser with @mbox, so
+ * its settings (such as whether or not to respect Content-Length
+ * headers) should match those that will later be used to parse the
+ * messages. The headers-only setting is enabled for the duration of
+ * the scan so that no content is loaded.
+ *
+ * Returns: the number of messages that were (re)scanned or %-1 on error.
+ **/
+int
+g_mime_mbox_index_update (GMimeMboxIndex *index, GMimeParser *parser, GMimeStream *mbox)
+{
+	GMimeMboxIndexEntry *last;
+	GMimeMessage *message;
+	gint64 size, mtime;
+	gboolean headers_only;
+	gint64 offset;
+	guint kept = 0;
+	
+	g_return_val_if_fail (index != NULL, -1);
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), -1);
+	g_return_val_if_fail (GMIME_IS_STREAM (mbox), -1);
+	
+	mbox_fingerprint (mbox, &size, &mtime);
+	
+	if (index->mtime != 0 && size == index->size && mtime == index->mtime)
+		return 0;
+	
+	offset = mbox->bound_start;
+	
+	if (index->entries->len > 0) {
+		last = &g_array_index (index->entries, GMimeMboxIndexEntry, index->entries->len - 1);
+	
+		if (size >= index->size && size >= last->end && mbox_has_from_line (mbox, last->start)) {
+			/* the last message may have ended at what used to be
+			 * the end of the mbox, so it needs to be rescanned */
+			kept = index->entries->len - 1;
+			offset = last->start;
+		}
+	
+		g_array_set_size (index->entries, kept);
+	}
+	
+	if (g_mime_stream_seek (mbox, offset, GMIME_STREAM_SEEK_SET) == -1) {
+		g_mime_mbox_index_clear (index);
+		return -1;
+	}
+	
+	headers_only = g_mime_parser_get_headers_only (parser);
+	g_mime_parser_set_headers_only (parser, TRUE);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	g_mime_parser_init_with_stream (parser, mbox);
+	
+	while (!g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message (parser)))
+			break;
+	
+		g_mime_mbox_index_add (index, parser);
+		g_object_unref (message);
+	}
+	
+	/* if the scan didn't make it to the end, make sure that the next
+	 * update tries again */
+	index->mtime = g_mime_parser_eos (parser) ? mtime : 0;
+	index->size = size;
+	
+	g_mime_parser_set_headers_only (parser, headers_only);
+	
+	return (int) (index->entries->len - kept);
+}
+
+
+/**
+ * g_mime_mbox_index_get_count:
+ * @index: a #GMimeMboxIndex
+ *
+ * Gets the number of messages in the index.
+ *
+ * Returns: the number of indexed messages.
+ **/
+guint
+g_mime_mbox_index_get_count (GMimeMboxIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+	
+	return index->entries->len;
+}
+
+
+/**
+ * g_mime_mbox_index_get_entry:
+ * @index: a #GMimeMboxIndex
+ * @n: the index of the message
+ *
+ * Gets the location of the @n'th message in the mbox.
+ *
+ * Returns: the #GMimeMboxIndexEntry for the @n'th message or %NULL if
+ * @n is out of range.
+ **/
+const GMimeMboxIndexEntry *
+g_mime_mbox_index_get_entry (GMimeMboxIndex *index, guint n)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+	
+	if (n >= index->entries->len)
+		return NULL;
+	
+	return &g_array_index (index->entries, GMimeMboxIndexEntry, n);
+}
+
+
+/**
+ * g_mime_mbox_index_seek:
+ * @index: a #GMimeMboxIndex
+ * @n: the index of the message
+ * @parser: a #GMimeParser
+ * @mbox: the mbox stream
+ *
+ * Seeks @mbox to the start of the @n'th message and reinitializes
+ * @parser with it so that the next call to
+ * g_mime_parser_construct_message() will construct that message.
+ *
+ * Returns: %TRUE on success or %FALSE if @n is out of range or @mbox
+ * could not be seeked.
+ **/
+gboolean
+g_mime_mbox_index_seek (GMimeMboxIndex *index, guint n, GMimeParser *parser, GMimeStream *mbox)
+{
+	const GMimeMboxIndexEntry *entry;
+	
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), FALSE);
+	g_return_val_if_fail (GMIME_IS_STREAM (mbox), FALSE);
+	
+	if (!(entry = g_mime_mbox_index_get_entry (index, n)))
+		return FALSE;
+	
+	if (g_mime_stream_seek (mbox, entry->start, GMIME_STREAM_SEEK_SET) != entry->start)
+		return FALSE;
+	
+	g_mime_parser_set_scan_from (parser, TRUE);
+	g_mime_parser_init_with_stream (parser, mbox);
+	
+	return TRUE;
+}
@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __GMIME_MBOX_INDEX_H__
+#define __GMIME_MBOX_INDEX_H__
+
+#include <glib.h>
+
+#include <gmime/gmime-parser.h>
+#include <gmime/gmime-stream.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GMimeMboxIndex GMimeMboxIndex;
+
+/**
+ * GMimeMboxIndexEntry:
+ * @start: The stream offset of the message's From-line.
+ * @headers_end: The stream offset of the end of the message's headers.
+ * @end: The stream offset of the end of the message.
+ *
+ * The location of a message within an mbox.
+ **/
+typedef struct {
+	gint64 start;
+	gint64 headers_end;
+	gint64 end;
+} GMimeMboxIndexEntry;
+
+GMimeMboxIndex *g_mime_mbox_index_new (void);
+void g_mime_mbox_index_free (GMimeMboxIndex *index);
+
+GMimeMboxIndex *g_mime_mbox_index_load (const char *filename, GError **err);
+gboolean g_mime_mbox_index_save (GMimeMboxIndex *index, const char *filename, GError **err);
+
+void g_mime_mbox_index_clear (GMimeMboxIndex *index);
+void g_mime_mbox_index_add (GMimeMboxIndex *index, GMimeParser *parser);
+int g_mime_mbox_index_update (GMimeMboxIndex *index, GMimeParser *parser, GMimeStream *mbox);
+
+guint g_mime_mbox_index_get_count (GMimeMboxIndex *index);
+const GMimeMboxIndexEntry *g_mime_mbox_index_get_entry (GMimeMboxIndex *index, guint n);
+
+gboolean g_mime_mbox_index_seek (GMimeMboxIndex *index, guint n, GMimeParser *parser, GMimeStream *mbox);
+
+G_END_DECLS
+
+#endif /* __GMIME_MBOX_INDEX_H__ */
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "gmime-message-part.h"
+#include "gmime-internal.h"
 
 #define d(x)
 
@@ -115,14 +116,8 @@ message_part_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean
 	ssize_t nwritten, total = 0;
 	
 	if (!content_only) {
-		/* write the content headers */
-		if ((nwritten = g_mime_header_list_write_to_stream (object->headers, stream)) == -1)
-			return -1;
-		
-		total += nwritten;
-		
-		/* terminate the headers */
-		if ((nwritten = g_mime_stream_write (stream, "\n", 1)) == -1)
+		/* write the content headers and the blank line terminating them */
+		if ((nwritten = _g_mime_header_list_write_to_stream (object->headers, stream, "\n")) == -1)
 			return -1;
 		
 		total += nwritten;
@@ -202,6 +197,8 @@ g_mime_message_part_set_message (GMimeMessagePart *part, GMimeMessage *message)
 {
 	g_return_if_fail (GMIME_IS_MESSAGE_PART (part));
 	
+	_g_mime_object_set_dirty ((GMimeObject *) part);
+	
 	if (message)
 		g_object_ref (message);
 	
@@ -898,19 +898,24 @@ message_remove_header (GMimeObject *object, const char *header)
 
 
 static ssize_t
-write_headers_to_stream (GMimeObject *object, GMimeStream *stream)
+write_headers_to_stream (GMimeObject *object, GMimeStream *stream, const char *suffix)
 {
 	GMimeMessage *message = (GMimeMessage *) object;
 	GMimeObject *mime_part = message->mime_part;
-	ssize_t nwritten, total = 0;
 	
 	if (mime_part != NULL) {
 		int body_count = g_mime_header_list_get_count (mime_part->headers);
 		int count = g_mime_header_list_get_count (object->headers);
 		GMimeHeader *header, *body_header;
 		gint64 body_offset, offset;
+		GPtrArray *headers;
 		int body_index = 0;
 		int index = 0;
+		ssize_t nwritten;
+		
+		/* merge the two lists back into their original order
+		 * so that they can all be written out in one go */
+		headers = g_ptr_array_sized_new (count + body_count);
 		
 		while (index < count && body_index < body_count) {
 			body_header = g_mime_header_list_get_header (mime_part->headers, body_index);
@@ -921,47 +926,29 @@ write_headers_to_stream (GMimeObject *object, GMimeStream *stream)
 			offset = g_mime_header_get_offset (header);
 			
 			if (offset >= 0 && offset < body_offset) {
-				if ((nwritten = g_mime_header_write_to_stream (header, stream)) == -1)
-					return -1;
-				
-				total += nwritten;
+				g_ptr_array_add (headers, header);
 				index++;
 			} else {
-				if ((nwritten = g_mime_header_write_to_stream (body_header, stream)) == -1)
-					return -1;
-				
-				total += nwritten;
+				g_ptr_array_add (headers, body_header);
 				body_index++;
 			}
 		}
 		
-		while (index < count) {
-			header = g_mime_header_list_get_header (object->headers, index);
-			
-			if ((nwritten = g_mime_header_write_to_stream (header, stream)) == -1)
-				return -1;
-			
-			total += nwritten;
-			index++;
-		}
+		while (index < count)
+			g_ptr_array_add (headers, g_mime_header_list_get_header (object->headers, index++));
 		
-		while (body_index < body_count) {
-			header = g_mime_header_list_get_header (mime_part->headers, body_index);
-			
-			if ((nwritten = g_mime_header_write_to_stream (header, stream)) == -1)
-				return -1;
-			
-			total += nwritten;
-			body_index++;
-		}
+		while (body_index < body_count)
+			g_ptr_array_add (headers, g_mime_header_list_get_header (mime_part->headers, body_index++));
+		
+		nwritten = _g_mime_headers_write_to_stream ((GMimeHeader **) headers->pdata, headers->len, stream, suffix);
+		g_ptr_array_free (headers, TRUE);
 		
-		return total;
+		return nwritten;
 	}
 	
-	return g_mime_header_list_write_to_stream (object->headers, stream);
+	return _g_mime_header_list_write_to_stream (object->headers, stream, suffix);
 }
 
-
 static char *
 message_get_headers (GMimeObject *object)
 {
@@ -972,7 +959,7 @@ message_get_headers (GMimeObject *object)
 	ba = g_byte_array_new ();
 	stream = g_mime_stream_mem_new ();
 	g_mime_stream_mem_set_byte_array (GMIME_STREAM_MEM (stream), ba);
-	write_headers_to_stream (object, stream);
+	write_headers_to_stream (object, stream, NULL);
 	g_object_unref (stream);
 	g_byte_array_append (ba, (unsigned char *) "", 1);
 	str = (char *) ba->data;
@@ -989,19 +976,15 @@ message_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean cont
 	ssize_t nwritten, total = 0;
 	
 	if (!content_only) {
-		if ((nwritten = write_headers_to_stream (object, stream)) == -1)
-			return -1;
-		
-		total += nwritten;
-		
-		if ((nwritten = g_mime_stream_write (stream, "\n", 1)) == -1)
+		/* write the headers and the blank line terminating them */
+		if ((nwritten = write_headers_to_stream (object, stream, "\n")) == -1)
 			return -1;
 		
 		total += nwritten;
 	}
 	
 	if (mime_part) {
-		if ((nwritten = GMIME_OBJECT_GET_CLASS (mime_part)->write_to_stream (mime_part, stream, TRUE)) == -1)
+		if ((nwritten = _g_mime_object_write_to_stream (mime_part, stream, TRUE)) == -1)
 			return -1;
 		
 		total += nwritten;
@@ -1509,6 +1492,8 @@ g_mime_message_set_mime_part (GMimeMessage *message, GMimeObject *mime_part)
 	if (message->mime_part)
 		g_object_unref (message->mime_part);
 	
+	_g_mime_object_set_dirty ((GMimeObject *) message);
+	
 	if (mime_part) {
 		GMimeHeaderList *headers = ((GMimeObject *) message)->headers;
 		GMimeHeader *header;
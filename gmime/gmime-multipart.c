@@ -146,78 +146,85 @@ g_mime_multipart_finalize (GObject *object)
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+#define vector_append(vector, n, buf, buflen) G_STMT_START { \
+	vector[n].data = (char *) (buf);                         \
+	vector[n].len = (buflen);                                \
+	n++;                                                     \
+} G_STMT_END
+
 static ssize_t
 multipart_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean content_only)
 {
 	GMimeMultipart *multipart = (GMimeMultipart *) object;
 	ssize_t nwritten, total = 0;
+	GMimeStreamIOVector vector[6];
 	const char *boundary;
 	GMimeObject *part;
+	size_t n = 0;
+	size_t len;
 	guint i;
 	
-	boundary = g_mime_object_get_content_type_parameter (object, "boundary");
+	/* the subparts can't be told apart without a boundary, so make
+	 * one up if need be before the Content-Type header is written */
+	if (multipart->children->len > 0)
+		boundary = g_mime_multipart_get_boundary (multipart);
+	else
+		boundary = g_mime_object_get_content_type_parameter (object, "boundary");
+	
+	len = boundary ? strlen (boundary) : 0;
 	
 	if (!content_only) {
-		/* write the content headers */
-		if ((nwritten = g_mime_header_list_write_to_stream (object->headers, stream)) == -1)
+		/* write the content headers and the blank line terminating them */
+		if ((nwritten = _g_mime_header_list_write_to_stream (object->headers, stream, "\n")) == -1)
 			return -1;
 		
 		total += nwritten;
-		
-		/* terminate the headers */
-		if (g_mime_stream_write (stream, "\n", 1) == -1)
-			return -1;
-		
-		total++;
 	}
 	
-	/* write the preface */
+	/* the preface and boundary lines get gathered up and written
+	 * together with whatever comes before or after each subpart */
 	if (multipart->preface) {
-		if ((nwritten = g_mime_stream_write_string (stream, multipart->preface)) == -1)
-			return -1;
-		
-		total += nwritten;
-		
-		if (g_mime_stream_write (stream, "\n", 1) == -1)
-			return -1;
-		
-		total++;
+		vector_append (vector, n, multipart->preface, strlen (multipart->preface));
+		vector_append (vector, n, "\n", 1);
 	}
 	
 	for (i = 0; i < multipart->children->len; i++) {
 		part = multipart->children->pdata[i];
 		
 		/* write the boundary */
-		if ((nwritten = g_mime_stream_printf (stream, "--%s\n", boundary)) == -1)
+		vector_append (vector, n, "--", 2);
+		vector_append (vector, n, boundary, len);
+		vector_append (vector, n, "\n", 1);
+		
+		if ((nwritten = g_mime_stream_writev (stream, vector, n)) == -1)
 			return -1;
 		
 		total += nwritten;
+		n = 0;
 		
 		/* write this part out */
 		if ((nwritten = g_mime_object_write_to_stream (part, stream)) == -1)
 			return -1;
 		
 		total += nwritten;
-
-		if (!GMIME_IS_MULTIPART (part) || ((GMimeMultipart *) part)->write_end_boundary) {
-			if (g_mime_stream_write (stream, "\n", 1) == -1)
-				return -1;
-			
-			total++;
-		}
+		
+		if (!GMIME_IS_MULTIPART (part) || ((GMimeMultipart *) part)->write_end_boundary)
+			vector_append (vector, n, "\n", 1);
 	}
 	
 	/* write the end-boundary (but only if a boundary is set) */
 	if (multipart->write_end_boundary && boundary) {
-		if ((nwritten = g_mime_stream_printf (stream, "--%s--\n", boundary)) == -1)
-			return -1;
-		
-		total += nwritten;
+		vector_append (vector, n, "--", 2);
+		vector_append (vector, n, boundary, len);
+		vector_append (vector, n, "--\n", 3);
 	}
 	
 	/* write the postface */
-	if (multipart->postface) {
-		if ((nwritten = g_mime_stream_write_string (stream, multipart->postface)) == -1)
+	if (multipart->postface)
+		vector_append (vector, n, multipart->postface, strlen (multipart->postface));
+	
+	if (n > 0) {
+		if ((nwritten = g_mime_stream_writev (stream, vector, n)) == -1)
 			return -1;
 		
 		total += nwritten;
@@ -307,6 +314,8 @@ g_mime_multipart_set_preface (GMimeMultipart *multipart, const char *preface)
 {
 	g_return_if_fail (GMIME_IS_MULTIPART (multipart));
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	g_free (multipart->preface);
 	multipart->preface = g_strdup (preface);
 }
@@ -341,6 +350,8 @@ g_mime_multipart_set_postface (GMimeMultipart *multipart, const char *postface)
 {
 	g_return_if_fail (GMIME_IS_MULTIPART (multipart));
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	g_free (multipart->postface);
 	multipart->postface = g_strdup (postface);
 }
@@ -386,6 +397,8 @@ g_mime_multipart_clear (GMimeMultipart *multipart)
 {
 	g_return_if_fail (GMIME_IS_MULTIPART (multipart));
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	GMIME_MULTIPART_GET_CLASS (multipart)->clear (multipart);
 }
 
@@ -411,6 +424,8 @@ g_mime_multipart_add (GMimeMultipart *multipart, GMimeObject *part)
 	g_return_if_fail (GMIME_IS_MULTIPART (multipart));
 	g_return_if_fail (GMIME_IS_OBJECT (part));
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	GMIME_MULTIPART_GET_CLASS (multipart)->add (multipart, part);
 }
 
@@ -460,6 +475,8 @@ g_mime_multipart_insert (GMimeMultipart *multipart, int index, GMimeObject *part
 	g_return_if_fail (GMIME_IS_OBJECT (part));
 	g_return_if_fail (index >= 0);
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	GMIME_MULTIPART_GET_CLASS (multipart)->insert (multipart, index, part);
 }
 
@@ -491,6 +508,8 @@ g_mime_multipart_remove (GMimeMultipart *multipart, GMimeObject *part)
 	g_return_val_if_fail (GMIME_IS_MULTIPART (multipart), FALSE);
 	g_return_val_if_fail (GMIME_IS_OBJECT (part), FALSE);
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	return GMIME_MULTIPART_GET_CLASS (multipart)->remove (multipart, part);
 }
 
@@ -527,6 +546,8 @@ g_mime_multipart_remove_at (GMimeMultipart *multipart, int index)
 	g_return_val_if_fail (GMIME_IS_MULTIPART (multipart), NULL);
 	g_return_val_if_fail (index >= 0, NULL);
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	return GMIME_MULTIPART_GET_CLASS (multipart)->remove_at (multipart, index);
 }
 
@@ -555,6 +576,8 @@ g_mime_multipart_replace (GMimeMultipart *multipart, int index, GMimeObject *rep
 	if ((guint) index >= multipart->children->len)
 		return NULL;
 	
+	_g_mime_object_set_dirty ((GMimeObject *) multipart);
+	
 	replaced = multipart->children->pdata[index];
 	multipart->children->pdata[index] = replacement;
 	g_object_ref (replacement);
@@ -29,6 +29,10 @@
 #include "gmime-common.h"
 #include "gmime-object.h"
 #include "gmime-stream-mem.h"
+#include "gmime-message-part.h"
+#include "gmime-multipart.h"
+#include "gmime-message.h"
+#include "gmime-part.h"
 #include "gmime-internal.h"
 #include "gmime-events.h"
 #include "gmime-utils.h"
@@ -50,6 +54,15 @@ struct _type_bucket {
 	GHashTable *subtype_hash;
 };
 
+/* the range of the parser's stream that an object was constructed
+ * from; it is dropped as soon as the object gets modified */
+struct _GMimeObjectRaw {
+	GMimeStream *stream;
+	gint64 headers_begin;
+	gint64 content_begin;
+	gint64 content_end;
+};
+
 struct _subtype_bucket {
 	char *subtype;
 	GType object_type;
@@ -77,6 +90,7 @@ static ssize_t write_disposition (GMimeParserOptions *options, GMimeStream *stre
 
 static void content_type_changed (GMimeContentType *content_type, gpointer args, GMimeObject *object);
 static void content_disposition_changed (GMimeContentDisposition *disposition, gpointer args, GMimeObject *object);
+static void header_list_changed (GMimeHeaderList *headers, gpointer args, GMimeObject *object);
 
 
 static GHashTable *type_hash = NULL;
@@ -137,9 +151,13 @@ g_mime_object_init (GMimeObject *object, GMimeObjectClass *klass)
 	object->content_type = NULL;
 	object->disposition = NULL;
 	object->content_id = NULL;
+	object->raw = NULL;
 	
 	g_mime_header_list_register_writer (object->headers, "Content-Type", write_content_type);
 	g_mime_header_list_register_writer (object->headers, "Content-Disposition", write_disposition);
+	
+	g_mime_event_add (_g_mime_header_list_get_changed_event (object->headers),
+			  (GMimeEventCallback) header_list_changed, object);
 }
 
 
@@ -161,6 +179,8 @@ g_mime_object_finalize (GObject *object)
 	if (mime->headers)
 		g_mime_header_list_destroy (mime->headers);
 	
+	_g_mime_object_set_dirty (mime);
+	
 	g_free (mime->content_id);
 	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -253,6 +273,12 @@ content_disposition_changed (GMimeContentDisposition *disposition, gpointer args
 	}
 }
 
+static void
+header_list_changed (GMimeHeaderList *headers, gpointer args, GMimeObject *object)
+{
+	_g_mime_object_set_dirty (object);
+}
+
 
 /**
  * g_mime_object_register_type:
@@ -291,6 +317,34 @@ g_mime_object_register_type (const char *type, const char *subtype, GType object
 }
 
 
+GType
+_g_mime_object_lookup_type (const char *type, const char *subtype)
+{
+	struct _type_bucket *bucket;
+	struct _subtype_bucket *sub;
+	GType obj_type;
+	
+	if ((bucket = g_hash_table_lookup (type_hash, type))) {
+		if (!(sub = g_hash_table_lookup (bucket->subtype_hash, subtype)))
+			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
+		
+		obj_type = sub ? sub->object_type : 0;
+	} else {
+		bucket = g_hash_table_lookup (type_hash, "*");
+		obj_type = bucket ? bucket->object_type : 0;
+	}
+	
+	if (!obj_type) {
+		/* use the default mime object */
+		if ((bucket = g_hash_table_lookup (type_hash, "*"))) {
+			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
+			obj_type = sub ? sub->object_type : 0;
+		}
+	}
+	
+	return obj_type;
+}
+
 /**
  * g_mime_object_new:
  * @options: a #GMimeParserOptions
@@ -310,33 +364,13 @@ g_mime_object_register_type (const char *type, const char *subtype, GType object
 GMimeObject *
 g_mime_object_new (GMimeParserOptions *options, GMimeContentType *content_type)
 {
-	struct _type_bucket *bucket;
-	struct _subtype_bucket *sub;
 	GMimeObject *object;
 	GType obj_type;
 	
 	g_return_val_if_fail (GMIME_IS_CONTENT_TYPE (content_type), NULL);
 	
-	if ((bucket = g_hash_table_lookup (type_hash, content_type->type))) {
-		if (!(sub = g_hash_table_lookup (bucket->subtype_hash, content_type->subtype)))
-			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
-		
-		obj_type = sub ? sub->object_type : 0;
-	} else {
-		bucket = g_hash_table_lookup (type_hash, "*");
-		obj_type = bucket ? bucket->object_type : 0;
-	}
-	
-	if (!obj_type) {
-		/* use the default mime object */
-		if ((bucket = g_hash_table_lookup (type_hash, "*"))) {
-			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
-			obj_type = sub ? sub->object_type : 0;
-		}
-		
-		if (!obj_type)
-			return NULL;
-	}
+	if (!(obj_type = _g_mime_object_lookup_type (content_type->type, content_type->subtype)))
+		return NULL;
 	
 	object = g_object_newv (obj_type, 0, NULL);
 	_g_mime_header_list_set_options (object->headers, options);
@@ -366,33 +400,13 @@ g_mime_object_new (GMimeParserOptions *options, GMimeContentType *content_type)
 GMimeObject *
 g_mime_object_new_type (GMimeParserOptions *options, const char *type, const char *subtype)
 {
-	struct _type_bucket *bucket;
-	struct _subtype_bucket *sub;
 	GMimeObject *object;
 	GType obj_type;
 	
 	g_return_val_if_fail (type != NULL, NULL);
 	
-	if ((bucket = g_hash_table_lookup (type_hash, type))) {
-		if (!(sub = g_hash_table_lookup (bucket->subtype_hash, subtype)))
-			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
-		
-		obj_type = sub ? sub->object_type : 0;
-	} else {
-		bucket = g_hash_table_lookup (type_hash, "*");
-		obj_type = bucket ? bucket->object_type : 0;
-	}
-	
-	if (!obj_type) {
-		/* use the default mime object */
-		if ((bucket = g_hash_table_lookup (type_hash, "*"))) {
-			sub = g_hash_table_lookup (bucket->subtype_hash, "*");
-			obj_type = sub ? sub->object_type : 0;
-		}
-		
-		if (!obj_type)
-			return NULL;
-	}
+	if (!(obj_type = _g_mime_object_lookup_type (type, subtype)))
+		return NULL;
 	
 	object = g_object_newv (obj_type, 0, NULL);
 	_g_mime_header_list_set_options (object->headers, options);
@@ -1009,6 +1023,105 @@ object_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean conte
 }
 
 
+void
+_g_mime_object_set_raw (GMimeObject *object, GMimeStream *stream, gint64 headers_begin, gint64 content_begin, gint64 content_end)
+{
+	struct _GMimeObjectRaw *raw;
+	
+	_g_mime_object_set_dirty (object);
+	
+	raw = g_slice_new (struct _GMimeObjectRaw);
+	raw->headers_begin = headers_begin;
+	raw->content_begin = content_begin;
+	raw->content_end = content_end;
+	raw->stream = stream;
+	g_object_ref (stream);
+	
+	object->raw = raw;
+}
+
+void
+_g_mime_object_set_dirty (GMimeObject *object)
+{
+	struct _GMimeObjectRaw *raw = object->raw;
+	
+	if (raw == NULL)
+		return;
+	
+	g_object_unref (raw->stream);
+	g_slice_free (struct _GMimeObjectRaw, raw);
+	object->raw = NULL;
+}
+
+/* checks that neither @object nor anything beneath it has been
+ * modified since it was parsed */
+static gboolean
+object_is_pristine (GMimeObject *object)
+{
+	struct _GMimeObjectRaw *raw = object->raw;
+	
+	if (raw == NULL)
+		return FALSE;
+	
+	if (GMIME_IS_MULTIPART (object)) {
+		GMimeMultipart *multipart = (GMimeMultipart *) object;
+		guint i;
+		
+		for (i = 0; i < multipart->children->len; i++) {
+			if (!object_is_pristine (multipart->children->pdata[i]))
+				return FALSE;
+		}
+	} else if (GMIME_IS_MESSAGE (object)) {
+		GMimeMessage *message = (GMimeMessage *) object;
+		
+		return message->mime_part && object_is_pristine (message->mime_part);
+	} else if (GMIME_IS_MESSAGE_PART (object)) {
+		GMimeMessagePart *part = (GMimeMessagePart *) object;
+		
+		return part->message && object_is_pristine ((GMimeObject *) part->message);
+	} else if (GMIME_IS_PART (object)) {
+		GMimePart *part = (GMimePart *) object;
+		GMimeStream *content;
+		
+		/* the content object can be changed behind our back */
+		if (part->content == NULL || part->content->encoding != part->encoding)
+			return FALSE;
+		
+		content = part->content->stream;
+		
+		return content && content->super_stream == raw->stream &&
+			content->bound_start == raw->content_begin &&
+			content->bound_end == raw->content_end;
+	}
+	
+	return TRUE;
+}
+
+ssize_t
+_g_mime_object_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean content_only)
+{
+	struct _GMimeObjectRaw *raw = object->raw;
+	GMimeStream *substream;
+	ssize_t nwritten;
+	gint64 begin;
+	
+	if (raw != NULL && object_is_pristine (object)) {
+		begin = content_only ? raw->content_begin : raw->headers_begin;
+		
+		if (begin != -1) {
+			/* nothing has changed; copy the original bytes */
+			substream = g_mime_stream_substream (raw->stream, begin, raw->content_end);
+			nwritten = g_mime_stream_write_to_stream (substream, stream);
+			g_object_unref (substream);
+			
+			return nwritten;
+		}
+	}
+	
+	return GMIME_OBJECT_GET_CLASS (object)->write_to_stream (object, stream, content_only);
+}
+
+
 /**
  * g_mime_object_write_to_stream:
  * @object: a #GMimeObject
@@ -1016,6 +1129,11 @@ object_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean conte
  *
  * Write the contents of the MIME object to @stream.
  *
+ * If @object was constructed by a #GMimeParser with a persistent
+ * stream and neither it nor any of its children have been modified
+ * since, the original bytes are copied straight from the parser's
+ * stream rather than being re-serialized.
+ *
  * Returns: the number of bytes written or %-1 on fail.
  **/
 ssize_t
@@ -1024,7 +1142,7 @@ g_mime_object_write_to_stream (GMimeObject *object, GMimeStream *stream)
 	g_return_val_if_fail (GMIME_IS_OBJECT (object), -1);
 	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
 	
-	return GMIME_OBJECT_GET_CLASS (object)->write_to_stream (object, stream, FALSE);
+	return _g_mime_object_write_to_stream (object, stream, FALSE);
 }
 
 
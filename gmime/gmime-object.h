@@ -62,6 +62,9 @@ struct _GMimeObject {
 	GMimeHeaderList *headers;
 	
 	char *content_id;
+	
+	/* <private> */
+	struct _GMimeObjectRaw *raw;
 };
 
 struct _GMimeObjectClass {
@@ -27,6 +27,14 @@
 
 #include "gmime-parser-options.h"
 
+struct _GMimeParserOptions {
+	GMimeRfcComplianceMode addresses;
+	GMimeRfcComplianceMode parameters;
+	GMimeRfcComplianceMode rfc2047;
+	size_t scan_buffer_size;
+	char **charsets;
+};
+
 static char *default_charsets[3] = { "utf-8", "iso-8859-1", NULL };
 
 static GMimeParserOptions *default_options = NULL;
@@ -87,6 +95,8 @@ g_mime_parser_options_new (void)
 	options->charsets[1] = g_strdup ("iso-8859-1");
 	options->charsets[2] = NULL;
 	
+	options->scan_buffer_size = 0;
+	
 	return options;
 }
 
@@ -118,6 +128,8 @@ _g_mime_parser_options_clone (GMimeParserOptions *options)
 		clone->charsets[i] = g_strdup (options->charsets[i]);
 	clone->charsets[i] = NULL;
 	
+	clone->scan_buffer_size = options->scan_buffer_size;
+	
 	return clone;
 }
 
@@ -325,3 +337,42 @@ g_mime_parser_options_set_fallback_charsets (GMimeParserOptions *options, const
 		options->charsets[i] = g_strdup (charsets[i]);
 	options->charsets[n] = NULL;
 }
+
+
+/**
+ * g_mime_parser_options_get_scan_buffer_size:
+ * @options: a #GMimeParserOptions
+ *
+ * Gets the size of the buffer that #GMimeParser reads its stream into.
+ *
+ * Returns: the size of the scan buffer or %0 if the parser sizes it
+ * automatically.
+ **/
+size_t
+g_mime_parser_options_get_scan_buffer_size (GMimeParserOptions *options)
+{
+	g_return_val_if_fail (options != NULL, 0);
+	
+	return options->scan_buffer_size;
+}
+
+
+/**
+ * g_mime_parser_options_set_scan_buffer_size:
+ * @options: a #GMimeParserOptions
+ * @size: the size of the scan buffer or %0 to size it automatically
+ *
+ * Sets the size of the buffer that #GMimeParser reads its stream into.
+ *
+ * By default (%0), the parser starts out with a small buffer and grows
+ * it when it encounters long stretches of content, which reduces the
+ * number of reads made on large messages without wasting memory on
+ * small ones. Sizes smaller than 4096 bytes are rounded up.
+ **/
+void
+g_mime_parser_options_set_scan_buffer_size (GMimeParserOptions *options, size_t size)
+{
+	g_return_if_fail (options != NULL);
+	
+	options->scan_buffer_size = size;
+}
@@ -40,19 +40,10 @@ typedef enum {
 
 /**
  * GMimeParserOptions:
- * @addresses: The compliance mode that should be used when parsing rfc822 addresses.
- * @parameters: The compliance mode that should be used when parsing Content-Type and Content-Disposition parameters.
- * @rfc2047: The compliance mode that should be used when decoding rfc2047 encoded words.
- * @charsets: The fallback charsets to try when decoding 8-bit headers.
  *
  * A set of parser options used by #GMimeParser and various other parsing functions.
  **/
-typedef struct {
-	GMimeRfcComplianceMode addresses;
-	GMimeRfcComplianceMode parameters;
-	GMimeRfcComplianceMode rfc2047;
-	char **charsets;
-} GMimeParserOptions;
+typedef struct _GMimeParserOptions GMimeParserOptions;
 
 GMimeParserOptions *g_mime_parser_options_get_default (void);
 
@@ -71,6 +62,9 @@ void g_mime_parser_options_set_rfc2047_compliance_mode (GMimeParserOptions *opti
 const char **g_mime_parser_options_get_fallback_charsets (GMimeParserOptions *options);
 void g_mime_parser_options_set_fallback_charsets (GMimeParserOptions *options, const char **charsets);
 
+size_t g_mime_parser_options_get_scan_buffer_size (GMimeParserOptions *options);
+void g_mime_parser_options_set_scan_buffer_size (GMimeParserOptions *options, size_t size);
+
 G_END_DECLS
 
 #endif /* __GMIME_PARSER_OPTIONS_H__ */
@@ -26,13 +26,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #include "gmime-parser.h"
 
 #include "gmime-table-private.h"
 #include "gmime-message-part.h"
 #include "gmime-parse-utils.h"
+#include "gmime-stream-mmap.h"
 #include "gmime-stream-mem.h"
+#include "gmime-stream-fs.h"
 #include "gmime-multipart.h"
 #include "gmime-internal.h"
 #include "gmime-common.h"
@@ -75,7 +86,9 @@ typedef struct _boundary_stack {
 
 typedef struct _header_raw {
 	struct _header_raw *next;
-	char *name, *value, *raw_value;
+	const char *name;
+	char *value, *raw_value;
+	GMimeHeaderId id;
 	gint64 offset;
 } HeaderRaw;
 
@@ -98,16 +111,25 @@ static GMimeObject *parser_construct_multipart (GMimeParser *parser, GMimeParser
 
 static GObjectClass *parent_class = NULL;
 
-/* size of read buffer */
+/* initial (and minimum) size of read buffer */
 #define SCAN_BUF 4096
 
+/* maximum size the read buffer will automatically grow to */
+#define SCAN_BUF_MAX (256 * 1024)
+
+/* number of consecutive reads within the same content before growing
+ * the read buffer */
+#define SCAN_GROW_FILLS 4
+
 /* headroom guaranteed to be before each read buffer */
 #define SCAN_HEAD 128
 
-/* conservative growth sizes */
-#define HEADER_INIT_SIZE 128
+/* conservative growth size */
 #define HEADER_RAW_INIT_SIZE 1024
 
+/* initial block size of the per-message header arena */
+#define HEADER_ARENA_BLOCK_SIZE 4096
+
 
 enum {
 	GMIME_PARSER_STATE_ERROR = -1,
@@ -126,7 +148,8 @@ struct _GMimeParserPrivate {
 	gint64 offset;
 	
 	/* i/o buffers */
-	char realbuf[SCAN_HEAD + SCAN_BUF + 4];
+	size_t scansize;
+	char *realbuf;
 	char *inbuf;
 	char *inptr;
 	char *inend;
@@ -137,17 +160,19 @@ struct _GMimeParserPrivate {
 	GMimeParserHeaderRegexFunc header_cb;
 	gpointer user_data;
 	
+	/* event scanning state */
+	GMimeParserEventFunc event_cb;
+	gpointer event_data;
+	GByteArray *chunk;
+	gint64 chunk_offset;
+	int depth;
+	
 #if defined (HAVE_GLIB_REGEX)
 	GRegex *regex;
 #elif defined (HAVE_REGEX_H)
 	regex_t regex;
 #endif
 	
-	/* header buffer */
-	char *headerbuf;
-	char *headerptr;
-	size_t headerleft;
-	
 	/* raw header buffer */
 	char *rawbuf;
 	char *rawptr;
@@ -164,9 +189,15 @@ struct _GMimeParserPrivate {
 	/* current header field offset */
 	gint64 header_offset;
 	
+	/* end offset of the most recently scanned content */
+	gint64 content_end;
+	
 	short int state;
 	
-	unsigned short int unused:10;
+	unsigned short int unused:7;
+	unsigned short int headers_only:1;
+	unsigned short int adaptive:1;
+	unsigned short int mapped:1;
 	unsigned short int midline:1;
 	unsigned short int seekable:1;
 	unsigned short int scan_from:1;
@@ -174,7 +205,9 @@ struct _GMimeParserPrivate {
 	unsigned short int persist_stream:1;
 	unsigned short int respect_content_length:1;
 	
+	/* parsed headers (allocated from the current message's arena) */
 	HeaderRaw *headers;
+	Arena *arena;
 	
 	BoundaryStack *bounds;
 };
@@ -182,6 +215,116 @@ struct _GMimeParserPrivate {
 static const char MBOX_BOUNDARY[6] = "From ";
 #define MBOX_BOUNDARY_LEN 5
 
+/* a line can only be a boundary if it begins with "--" (or "From " if
+ * we are scanning an mbox); note that @p[1] must be readable, which is
+ * normally guaranteed by the '\n' sentinel at *inend (see optimization
+ * comment [1]) but needs an explicit check when scanning a memory map */
+#define possible_boundary_start(scan_from, p) \
+	((p[0] == '-' && p[1] == '-') || (scan_from && p[0] == 'F'))
+
+/* Skips over all of the complete lines starting at @inptr (which is
+ * known not to be a boundary) that cannot possibly be boundaries and
+ * returns a pointer to the beginning of the next line that might be
+ * one or, if there are none, to the beginning of the last (possibly
+ * partial) line in the buffer. */
+typedef const char * (* ScanLinesFunc) (const char *inptr, const char *inend, gboolean scan_from);
+
+static const char *
+scan_lines_tail (const char *inptr, const char *inend, gboolean scan_from, const char *line)
+{
+	while ((inptr = memchr (inptr, '\n', inend - inptr)) != NULL) {
+		line = ++inptr;
+		
+		if (inend - inptr > 1 && possible_boundary_start (scan_from, inptr))
+			break;
+	}
+	
+	return line;
+}
+
+static const char *
+scan_lines_generic (const char *inptr, const char *inend, gboolean scan_from)
+{
+	return scan_lines_tail (inptr, inend, scan_from, inptr);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static const char *
+scan_lines_sse2 (const char *inptr, const char *inend, gboolean scan_from)
+{
+	const __m128i nl = _mm_set1_epi8 ('\n');
+	const __m128i dash = _mm_set1_epi8 ('-');
+	const __m128i eff = _mm_set1_epi8 ('F');
+	__m128i c0, c1, c2, eol, hit;
+	const char *line = inptr;
+	unsigned int nlmask, mask;
+	
+	/* each block peeks 2 bytes past itself at the next line's start */
+	while (inptr + 18 <= inend) {
+		c0 = _mm_loadu_si128 ((const __m128i *) inptr);
+		
+		eol = _mm_cmpeq_epi8 (c0, nl);
+		if ((nlmask = (unsigned int) _mm_movemask_epi8 (eol)) != 0) {
+			c1 = _mm_loadu_si128 ((const __m128i *) (inptr + 1));
+			c2 = _mm_loadu_si128 ((const __m128i *) (inptr + 2));
+			
+			hit = _mm_and_si128 (_mm_cmpeq_epi8 (c1, dash), _mm_cmpeq_epi8 (c2, dash));
+			if (scan_from)
+				hit = _mm_or_si128 (hit, _mm_cmpeq_epi8 (c1, eff));
+			
+			if ((mask = (unsigned int) _mm_movemask_epi8 (_mm_and_si128 (eol, hit))) != 0)
+				return inptr + __builtin_ctz (mask) + 1;
+			
+			line = inptr + (31 - __builtin_clz (nlmask)) + 1;
+		}
+		
+		inptr += 16;
+	}
+	
+	return scan_lines_tail (inptr, inend, scan_from, line);
+}
+
+__attribute__((target("avx2")))
+static const char *
+scan_lines_avx2 (const char *inptr, const char *inend, gboolean scan_from)
+{
+	const __m256i nl = _mm256_set1_epi8 ('\n');
+	const __m256i dash = _mm256_set1_epi8 ('-');
+	const __m256i eff = _mm256_set1_epi8 ('F');
+	__m256i c0, c1, c2, eol, hit;
+	const char *line = inptr;
+	unsigned int nlmask, mask;
+	
+	/* each block peeks 2 bytes past itself at the next line's start */
+	while (inptr + 34 <= inend) {
+		c0 = _mm256_loadu_si256 ((const __m256i *) inptr);
+		
+		eol = _mm256_cmpeq_epi8 (c0, nl);
+		if ((nlmask = (unsigned int) _mm256_movemask_epi8 (eol)) != 0) {
+			c1 = _mm256_loadu_si256 ((const __m256i *) (inptr + 1));
+			c2 = _mm256_loadu_si256 ((const __m256i *) (inptr + 2));
+			
+			hit = _mm256_and_si256 (_mm256_cmpeq_epi8 (c1, dash), _mm256_cmpeq_epi8 (c2, dash));
+			if (scan_from)
+				hit = _mm256_or_si256 (hit, _mm256_cmpeq_epi8 (c1, eff));
+			
+			if ((mask = (unsigned int) _mm256_movemask_epi8 (_mm256_and_si256 (eol, hit))) != 0)
+				return inptr + __builtin_ctz (mask) + 1;
+			
+			line = inptr + (31 - __builtin_clz (nlmask)) + 1;
+		}
+		
+		inptr += 32;
+	}
+	
+	return scan_lines_tail (inptr, inend, scan_from, line);
+}
+#endif /* HAVE_X86_SIMD */
+
+/* picked at runtime based on the capabilities of the cpu */
+static ScanLinesFunc scan_lines = scan_lines_generic;
+
 static void
 parser_push_boundary (GMimeParser *parser, const char *boundary)
 {
@@ -229,16 +372,26 @@ parser_pop_boundary (GMimeParser *parser)
 	g_slice_free (BoundaryStack, s);
 }
 
+/* header values are only unfolded when something needs them */
+static const char *
+header_raw_value (struct _GMimeParserPrivate *priv, HeaderRaw *header)
+{
+	if (header->value == NULL)
+		header->value = _g_mime_header_unfold (arena_strdup (priv->arena, header->raw_value));
+	
+	return header->value;
+}
+
 static const char *
-header_raw_find (HeaderRaw *headers, const char *name, gint64 *offset)
+header_raw_find (struct _GMimeParserPrivate *priv, GMimeHeaderId id, gint64 *offset)
 {
-	HeaderRaw *header = headers;
+	HeaderRaw *header = priv->headers;
 	
 	while (header) {
-		if (!g_ascii_strcasecmp (header->name, name)) {
+		if (header->id == id) {
 			if (offset)
 				*offset = header->offset;
-			return header->value;
+			return header_raw_value (priv, header);
 		}
 		
 		header = header->next;
@@ -247,23 +400,39 @@ header_raw_find (HeaderRaw *headers, const char *name, gint64 *offset)
 	return NULL;
 }
 
+static const char *
+header_raw_object_value (struct _GMimeParserPrivate *priv, HeaderRaw *header)
+{
+	/* headers interpreted by GMimeObject, GMimePart and GMimeMessage as
+	 * they get appended need their values up front */
+	switch (header->id) {
+	case GMIME_HEADER_ID_UNKNOWN:
+	case GMIME_HEADER_ID_IN_REPLY_TO:
+	case GMIME_HEADER_ID_MIME_VERSION:
+	case GMIME_HEADER_ID_REFERENCES:
+		/* leave it to g_mime_header_get_value() to unfold */
+		return header->value;
+	default:
+		return header_raw_value (priv, header);
+	}
+}
+
 static void
 header_raw_clear (HeaderRaw **headers)
 {
-	HeaderRaw *header, *next;
+	/* the headers themselves get freed along with the arena */
+	*headers = NULL;
+}
+
+static void
+parser_release_arena (struct _GMimeParserPrivate *priv)
+{
+	header_raw_clear (&priv->headers);
 	
-	header = *headers;
-	while (header) {
-		next = header->next;
-		g_free (header->name);
-		g_free (header->value);
-		
-		g_slice_free (HeaderRaw, header);
-		
-		header = next;
+	if (priv->arena) {
+		arena_unref (priv->arena);
+		priv->arena = NULL;
 	}
-	
-	*headers = NULL;
 }
 
 GType
@@ -299,6 +468,15 @@ g_mime_parser_class_init (GMimeParserClass *klass)
 	parent_class = g_type_class_ref (G_TYPE_OBJECT);
 	
 	object_class->finalize = g_mime_parser_finalize;
+	
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init ();
+	
+	if (__builtin_cpu_supports ("avx2"))
+		scan_lines = scan_lines_avx2;
+	else if (__builtin_cpu_supports ("sse2"))
+		scan_lines = scan_lines_sse2;
+#endif
 }
 
 static void
@@ -307,8 +485,17 @@ g_mime_parser_init (GMimeParser *parser, GMimeParserClass *klass)
 	parser->priv = g_new (struct _GMimeParserPrivate, 1);
 	parser->priv->respect_content_length = FALSE;
 	parser->priv->persist_stream = TRUE;
+	parser->priv->headers_only = FALSE;
 	parser->priv->have_regex = FALSE;
 	parser->priv->scan_from = FALSE;
+	parser->priv->adaptive = TRUE;
+	
+	parser->priv->realbuf = g_malloc (SCAN_HEAD + SCAN_BUF + 4);
+	parser->priv->scansize = SCAN_BUF;
+	
+	parser->priv->event_cb = NULL;
+	parser->priv->event_data = NULL;
+	parser->priv->chunk = NULL;
 	
 #if defined (HAVE_GLIB_REGEX)
 	parser->priv->regex = NULL;
@@ -332,6 +519,7 @@ g_mime_parser_finalize (GObject *object)
 		regfree (&parser->priv->regex);
 #endif
 	
+	g_free (parser->priv->realbuf);
 	g_free (parser->priv);
 	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -362,10 +550,6 @@ parser_init (GMimeParser *parser, GMimeStream *stream)
 	priv->from_offset = -1;
 	priv->from_line = g_byte_array_new ();
 	
-	priv->headerbuf = g_malloc (HEADER_INIT_SIZE);
-	priv->headerleft = HEADER_INIT_SIZE - 1;
-	priv->headerptr = priv->headerbuf;
-	
 	priv->rawbuf = g_malloc (HEADER_RAW_INIT_SIZE);
 	priv->rawleft = HEADER_RAW_INIT_SIZE - 1;
 	priv->rawptr = priv->rawbuf;
@@ -378,10 +562,16 @@ parser_init (GMimeParser *parser, GMimeStream *stream)
 	
 	priv->header_offset = -1;
 	
+	priv->content_end = -1;
+	
 	priv->midline = FALSE;
 	priv->seekable = offset != -1;
+	priv->mapped = priv->seekable && GMIME_IS_STREAM_MMAP (stream) &&
+		((GMimeStreamMmap *) stream)->map != NULL &&
+		offset <= (gint64) ((GMimeStreamMmap *) stream)->maplen;
 	
 	priv->headers = NULL;
+	priv->arena = NULL;
 	
 	priv->bounds = NULL;
 }
@@ -396,10 +586,9 @@ parser_close (GMimeParser *parser)
 	
 	g_byte_array_free (priv->from_line, TRUE);
 	
-	g_free (priv->headerbuf);
 	g_free (priv->rawbuf);
 	
-	header_raw_clear (&priv->headers);
+	parser_release_arena (priv);
 	
 	while (priv->bounds)
 		parser_pop_boundary (parser);
@@ -500,6 +689,8 @@ g_mime_parser_get_persist_stream (GMimeParser *parser)
  * If @persist is %TRUE, the @parser will attempt to construct
  * messages/parts whose content will remain on disk rather than being
  * loaded into memory so as to reduce memory usage. This is the default.
+ * It also lets g_mime_object_write_to_stream() copy any unmodified
+ * parts back out of the stream exactly as they were parsed.
  *
  * If @persist is %FALSE, the @parser will always load message content
  * into memory.
@@ -519,6 +710,54 @@ g_mime_parser_set_persist_stream (GMimeParser *parser, gboolean persist)
 }
 
 
+/**
+ * g_mime_parser_get_headers_only:
+ * @parser: a #GMimeParser context
+ *
+ * Gets whether or not @parser is set to only parse the headers and
+ * MIME structure of messages, leaving their content unloaded.
+ *
+ * Returns: %TRUE if the @parser will not load content into memory or
+ * %FALSE otherwise.
+ **/
+gboolean
+g_mime_parser_get_headers_only (GMimeParser *parser)
+{
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), FALSE);
+	
+	return parser->priv->headers_only;
+}
+
+
+/**
+ * g_mime_parser_set_headers_only:
+ * @parser: a #GMimeParser context
+ * @headers_only: %TRUE to skip loading content or %FALSE otherwise
+ *
+ * Sets whether or not @parser should only parse the headers and MIME
+ * structure of messages, which is all that is needed for things like
+ * building message listings.
+ *
+ * If @headers_only is %TRUE, the @parser will never copy the content
+ * of leaf parts into memory. If the underlying stream is seekable,
+ * each part's content is bound to a substream of it and so is only
+ * loaded from the stream when it is accessed (regardless of the
+ * persist attribute). Otherwise, the parts are left without any
+ * content.
+ *
+ * Note: Content that is only terminated by the end of the stream
+ * (such as the body of a message that is not multipart) is not
+ * scanned at all when the stream is seekable.
+ **/
+void
+g_mime_parser_set_headers_only (GMimeParser *parser, gboolean headers_only)
+{
+	g_return_if_fail (GMIME_IS_PARSER (parser));
+	
+	parser->priv->headers_only = headers_only;
+}
+
+
 /**
  * g_mime_parser_get_scan_from:
  * @parser: a #GMimeParser context
@@ -647,6 +886,45 @@ g_mime_parser_set_header_regex (GMimeParser *parser, const char *regex,
 }
 
 
+static void
+parser_resize_buffer (struct _GMimeParserPrivate *priv, size_t size)
+{
+	size_t inlen = priv->inend - priv->inptr;
+	char *realbuf;
+	
+	/* never shrink the buffer below what it currently holds */
+	size = MAX (size, MAX (inlen, SCAN_BUF));
+	
+	if (size == priv->scansize)
+		return;
+	
+	realbuf = g_malloc (SCAN_HEAD + size + 4);
+	memcpy (realbuf + SCAN_HEAD, priv->inptr, inlen);
+	g_free (priv->realbuf);
+	
+	priv->realbuf = realbuf;
+	priv->scansize = size;
+	priv->inbuf = realbuf + SCAN_HEAD;
+	priv->inptr = priv->inbuf;
+	priv->inend = priv->inbuf + inlen;
+}
+
+static void
+parser_apply_options (GMimeParser *parser, GMimeParserOptions *options)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	size_t size;
+	
+	size = g_mime_parser_options_get_scan_buffer_size (options);
+	
+	if (size > 0) {
+		parser_resize_buffer (priv, size);
+		priv->adaptive = FALSE;
+	} else {
+		priv->adaptive = TRUE;
+	}
+}
+
 static ssize_t
 parser_fill (GMimeParser *parser, size_t atleast)
 {
@@ -685,7 +963,7 @@ parser_fill (GMimeParser *parser, size_t atleast)
 	
 	priv->inptr = inptr;
 	priv->inend = inbuf;
-	inend = priv->realbuf + SCAN_HEAD + SCAN_BUF;
+	inend = priv->realbuf + SCAN_HEAD + priv->scansize;
 	
 	if ((nread = g_mime_stream_read (priv->stream, inbuf, inend - inbuf)) > 0) {
 		priv->offset += nread;
@@ -847,23 +1125,6 @@ next_alloc_size (size_t n)
 }
 #endif
 
-#define header_append(priv, start, len) G_STMT_START {                    \
-	if (priv->headerleft <= len) {                                    \
-		size_t hlen, hoff;                                        \
-		                                                          \
-		hoff = priv->headerptr - priv->headerbuf;                 \
-		hlen = next_alloc_size (hoff + len + 1);                  \
-		                                                          \
-		priv->headerbuf = g_realloc (priv->headerbuf, hlen);      \
-		priv->headerptr = priv->headerbuf + hoff;                 \
-		priv->headerleft = (hlen - 1) - hoff;                     \
-	}                                                                 \
-	                                                                  \
-	memcpy (priv->headerptr, start, len);                             \
-	priv->headerptr += len;                                           \
-	priv->headerleft -= len;                                          \
-} G_STMT_END
-
 #define raw_header_append(priv, start, len) G_STMT_START {                \
 	if (priv->rawleft <= len) {                                       \
 		size_t hlen, hoff;                                        \
@@ -887,9 +1148,10 @@ header_parse (GMimeParser *parser, HeaderRaw **tail)
 	struct _GMimeParserPrivate *priv = parser->priv;
 	register char *inptr;
 	HeaderRaw *header;
+	size_t len;
 	
-	*priv->headerptr = '\0';
-	inptr = priv->headerbuf;
+	*priv->rawptr = '\0';
+	inptr = priv->rawbuf;
 	while (*inptr && *inptr != ':' && !is_type (*inptr, IS_SPACE | IS_CTRL))
 		inptr++;
 	
@@ -897,45 +1159,44 @@ header_parse (GMimeParser *parser, HeaderRaw **tail)
 		/* ignore invalid headers */
 		w(g_warning ("Invalid header at %lld: '%s'",
 			     (long long) priv->header_offset,
-			     priv->headerbuf));
+			     priv->rawbuf));
 		
-		priv->headerleft += priv->headerptr - priv->headerbuf;
-		priv->headerptr = priv->headerbuf;
+		priv->rawleft += priv->rawptr - priv->rawbuf;
+		priv->rawptr = priv->rawbuf;
 		
 		return;
 	}
 	
-	header = g_slice_new (HeaderRaw);
-	header->next = NULL;
-	
-	header->name = g_strndup (priv->headerbuf, (size_t) (inptr - priv->headerbuf));
-	header->value = g_mime_strdup_trim (inptr + 1);
+	/* all of the headers of a message get allocated from its arena */
+	if (priv->arena == NULL)
+		priv->arena = arena_new (HEADER_ARENA_BLOCK_SIZE);
 	
-	*priv->rawptr = '\0';
-	inptr = priv->rawbuf;
-	while (*inptr != ':')
-		inptr++;
+	header = arena_alloc (priv->arena, sizeof (HeaderRaw));
+	header->next = NULL;
 	
-	header->raw_value = g_strdup (inptr + 1);
+	/* only the raw value is kept; it gets unfolded on demand */
+	/* names are shared with every other header spelled the same way */
+	len = (size_t) (inptr - priv->rawbuf);
+	if (!(header->name = _g_mime_header_intern_name (priv->rawbuf, len, &header->id)))
+		header->name = arena_strndup (priv->arena, priv->rawbuf, len);
+	header->raw_value = arena_strdup (priv->arena, inptr + 1);
 	header->offset = priv->header_offset;
+	header->value = NULL;
 	
 	(*tail)->next = header;
 	*tail = header;
 	
-	priv->headerleft += priv->headerptr - priv->headerbuf;
-	priv->headerptr = priv->headerbuf;
-	
 	priv->rawleft += priv->rawptr - priv->rawbuf;
 	priv->rawptr = priv->rawbuf;
 	
 #if defined (HAVE_GLIB_REGEX)
 	if (priv->regex && g_regex_match (priv->regex, header->name, 0, NULL))
-		priv->header_cb (parser, header->name, header->value,
+		priv->header_cb (parser, header->name, header_raw_value (priv, header),
 				 header->offset, priv->user_data);
 #elif defined (HAVE_REGEX_H)
 	if (priv->have_regex &&
 	    !regexec (&priv->header_regex, header->name, 0, NULL, 0))
-		priv->header_cb (parser, header->name, header->value,
+		priv->header_cb (parser, header->name, header_raw_value (priv, header),
 				 header->offset, priv->user_data);
 #endif
 }
@@ -956,16 +1217,14 @@ has_message_headers (HeaderRaw *headers)
 	
 	header = headers;
 	while (header != NULL) {
-		if (!g_ascii_strcasecmp (header->name, "Subject"))
-			found |= SUBJECT;
-		else if (!g_ascii_strcasecmp (header->name, "From"))
-			found |= FROM;
-		else if (!g_ascii_strcasecmp (header->name, "Date"))
-			found |= DATE;
-		else if (!g_ascii_strcasecmp (header->name, "To"))
-			found |= TO;
-		else if (!g_ascii_strcasecmp (header->name, "Cc"))
-			found |= CC;
+		switch (header->id) {
+		case GMIME_HEADER_ID_SUBJECT: found |= SUBJECT; break;
+		case GMIME_HEADER_ID_FROM: found |= FROM; break;
+		case GMIME_HEADER_ID_DATE: found |= DATE; break;
+		case GMIME_HEADER_ID_TO: found |= TO; break;
+		case GMIME_HEADER_ID_CC: found |= CC; break;
+		default: break;
+		}
 		
 		header = header->next;
 	}
@@ -980,7 +1239,7 @@ has_content_headers (HeaderRaw *headers)
 	
 	header = headers;
 	while (header != NULL) {
-		if (!g_ascii_strcasecmp (header->name, "Content-Type"))
+		if (header->id == GMIME_HEADER_ID_CONTENT_TYPE)
 			return TRUE;
 		
 		header = header->next;
@@ -1111,23 +1370,17 @@ parser_step_headers (GMimeParser *parser)
 				}
 				
 				raw_header_append (priv, start, len);
-				header_append (priv, start, len);
 				left = (ssize_t) (inend - inptr);
 				priv->midline = TRUE;
 				priv->inptr = inptr;
 				goto refill;
 			}
 			
-			raw_header_append (priv, start, len);
-			
-			if (inptr > start && inptr[-1] == '\r')
-				len--;
-			
 			/* check to see if we've reached the end of the headers */
-			if (!priv->midline && len == 0)
+			if (!priv->midline && (len == 0 || (len == 1 && *start == '\r')))
 				goto headers_end;
 			
-			header_append (priv, start, len);
+			raw_header_append (priv, start, len);
 			
 			/* inptr has to be less than inend - 1 */
 			raw_header_append (priv, "\n", 1);
@@ -1145,12 +1398,11 @@ parser_step_headers (GMimeParser *parser)
 	start = inptr;
 	
 	len = (size_t) (inend - inptr);
-	header_append (priv, inptr, len);
 	raw_header_append (priv, inptr, len);
 	
  headers_end:
 	
-	if (priv->headerptr > priv->headerbuf)
+	if (priv->rawptr > priv->rawbuf)
 		header_parse (parser, &tail);
 	
 	priv->headers_end = parser_offset (priv, start);
@@ -1210,7 +1462,7 @@ parser_content_type (GMimeParser *parser, GMimeContentType *parent)
 	
 	content_type = g_slice_new (ContentType);
 	
-	if (!(value = header_raw_find (priv->headers, "Content-Type", NULL)) ||
+	if (!(value = header_raw_find (priv, GMIME_HEADER_ID_CONTENT_TYPE, NULL)) ||
 	    !g_mime_parse_content_type (&value, &content_type->type, &content_type->subtype)) {
 		if (parent != NULL && g_mime_content_type_is_type (parent, "multipart", "digest")) {
 			content_type->type = g_strdup ("message");
@@ -1317,8 +1569,66 @@ enum {
 	FOUND_END_BOUNDARY
 };
 
-#define content_save(content, start, len) G_STMT_START {                     \
-	if (content)                                                         \
+/* content larger than this gets passed to the event callback in pieces */
+#define CONTENT_CHUNK_SIZE 4096
+
+static void
+parser_emit (GMimeParser *parser, GMimeParserEvent *event)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	
+	event->depth = priv->depth;
+	priv->event_cb (parser, event, priv->event_data);
+}
+
+static void
+parser_emit_content (GMimeParser *parser, const char *data, size_t len)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeParserEvent event;
+	
+	if (len == 0)
+		return;
+	
+	memset (&event, 0, sizeof (event));
+	event.type = GMIME_PARSER_EVENT_CONTENT;
+	event.offset = priv->chunk_offset;
+	event.data = data;
+	event.len = len;
+	
+	parser_emit (parser, &event);
+	
+	priv->chunk_offset += len;
+}
+
+/* passes content on to the event callback while only ever holding
+ * back the last 2 bytes, which may turn out to be the line terminator
+ * that belongs to the next boundary */
+static void
+parser_chunk_save (GMimeParser *parser, const char *start, size_t len)
+{
+	GByteArray *chunk = parser->priv->chunk;
+	size_t n;
+	
+	if (chunk->len + len <= CONTENT_CHUNK_SIZE) {
+		g_byte_array_append (chunk, (unsigned char *) start, len);
+	} else if (len >= 2) {
+		parser_emit_content (parser, (char *) chunk->data, chunk->len);
+		parser_emit_content (parser, start, len - 2);
+		g_byte_array_set_size (chunk, 0);
+		g_byte_array_append (chunk, (unsigned char *) start + len - 2, 2);
+	} else {
+		g_byte_array_append (chunk, (unsigned char *) start, len);
+		n = chunk->len - 2;
+		parser_emit_content (parser, (char *) chunk->data, n);
+		g_byte_array_remove_range (chunk, 0, n);
+	}
+}
+
+#define content_save(parser, priv, content, start, len) G_STMT_START {       \
+	if (content == (priv)->chunk && content != NULL)                     \
+		parser_chunk_save (parser, start, len);                      \
+	else if (content)                                                    \
 		g_byte_array_append (content, (unsigned char *) start, len); \
 } G_STMT_END
 
@@ -1368,10 +1678,14 @@ check_boundary (struct _GMimeParserPrivate *priv, const char *start, size_t len)
 		
 		s = priv->bounds;
 		while (s) {
-			if (offset >= s->content_end &&
-			    is_boundary (start, len, s->boundary, s->boundarylenfinal)) {
-				d(printf ("found %s\n", s->content_end != -1 && offset >= s->content_end ?
-					  "end of content" : "end boundary"));
+			/* nothing within a message's Content-Length can end it */
+			if (offset < s->content_end) {
+				s = s->parent;
+				continue;
+			}
+			
+			if (is_boundary (start, len, s->boundary, s->boundarylenfinal)) {
+				d(printf ("found %s\n", s->content_end != -1 ? "end of content" : "end boundary"));
 				return FOUND_END_BOUNDARY;
 			}
 			
@@ -1413,23 +1727,99 @@ found_immediate_boundary (struct _GMimeParserPrivate *priv, gboolean end)
  * inend every trip through our inner while-loop. This cuts the number
  * of instructions down from ~7 to ~4, assuming the compiler does its
  * job correctly ;-)
+ *
+ * 2. Only lines beginning with "--" (or "From " when scanning an
+ * mbox) can be boundaries, so rather than checking every line of
+ * content individually, we use scan_lines() to skip straight to the
+ * next line that could be one and save everything in between in a
+ * single chunk. On x86 cpus that support it, the scan is done 16 or
+ * 32 bytes at a time using SSE2 or AVX2.
+ *
+ * 3. When the stream is a GMimeStreamMmap, the content already sits in
+ * memory, so rather than copying it through realbuf a few KB at a time
+ * we scan it in place and then resync realbuf to the boundary that
+ * terminated it. If the stream is persistent, the content never gets
+ * copied at all; otherwise it is copied exactly once.
  **/
 
 
 /* we add 2 for \r\n */
 #define MAX_BOUNDARY_LEN(bounds) (bounds ? bounds->boundarylenmax + 2 : 0)
 
+static int
+parser_scan_mapped_content (GMimeParser *parser, GByteArray *content, guint *crlf, size_t atleast)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeStreamMmap *mstream = (GMimeStreamMmap *) priv->stream;
+	GMimeStream *stream = priv->stream;
+	const char *begin, *start, *inend;
+	register const char *inptr;
+	const char *eol = NULL;
+	int found = 0;
+	
+	inend = mstream->map + mstream->maplen;
+	if (stream->bound_end != -1 && stream->bound_end < (gint64) mstream->maplen)
+		inend = mstream->map + stream->bound_end;
+	
+	begin = inptr = mstream->map + parser_offset (priv, NULL);
+	
+	/* point the buffer at the map so that parser_offset() and
+	 * check_boundary() work while we scan it */
+	priv->inptr = (char *) inptr;
+	priv->inend = (char *) inend;
+	priv->offset = (gint64) (inend - mstream->map);
+	
+	/* Note: see optimization comment [3] */
+	while (inptr < inend) {
+		start = inptr;
+		
+		if (inend - inptr > 1 && !possible_boundary_start (priv->scan_from, inptr)) {
+			/* Note: see optimization comment [2] */
+			inptr = scan_lines (inptr, inend, priv->scan_from);
+			
+			if (inptr > start)
+				continue;
+		}
+		
+		if (!(eol = memchr (inptr, '\n', (size_t) (inend - inptr))))
+			eol = inend;
+		
+		if ((found = check_boundary (priv, start, (size_t) (eol - start))))
+			break;
+		
+		inptr = eol < inend ? eol + 1 : inend;
+	}
+	
+	if (found) {
+		/* don't chew up the boundary */
+		*crlf = eol[-1] == '\r' ? 2 : 1;
+	} else {
+		found = FOUND_EOS;
+		start = inend;
+		*crlf = 0;
+	}
+	
+	content_save (parser, priv, content, begin, (size_t) (start - begin));
+	
+	/* resync the buffer to the start of the boundary */
+	priv->inptr = priv->inend = priv->inbuf;
+	priv->offset = g_mime_stream_seek (stream, (gint64) (start - mstream->map), GMIME_STREAM_SEEK_SET);
+	priv->midline = FALSE;
+	parser_fill (parser, atleast);
+	
+	return found;
+}
+
 static int
 parser_scan_content (GMimeParser *parser, GByteArray *content, guint *crlf)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
-	char *aligned, *start, *inend;
 	register char *inptr;
-	register int *dword;
+	char *start, *inend;
 	size_t nleft, len;
 	size_t atleast;
+	int nfills = 0;
 	int found = 0;
-	int mask;
 	
 	d(printf ("scan-content\n"));
 	
@@ -1442,9 +1832,19 @@ parser_scan_content (GMimeParser *parser, GByteArray *content, guint *crlf)
 	/* figure out minimum amount of data we need */
 	atleast = MAX (SCAN_HEAD, MAX_BOUNDARY_LEN (priv->bounds));
 	
+	if (priv->mapped)
+		return parser_scan_mapped_content (parser, content, crlf, atleast);
+	
 	do {
 	refill:
 		nleft = priv->inend - inptr;
+		
+		/* long content; grow the buffer to cut down on reads */
+		if (priv->adaptive && ++nfills > SCAN_GROW_FILLS && priv->scansize < SCAN_BUF_MAX) {
+			parser_resize_buffer (priv, priv->scansize * 2);
+			nfills = 0;
+		}
+		
 		if (parser_fill (parser, atleast) <= 0) {
 			start = priv->inptr;
 			found = FOUND_EOS;
@@ -1463,26 +1863,22 @@ parser_scan_content (GMimeParser *parser, GByteArray *content, guint *crlf)
 		priv->midline = FALSE;
 		
 		while (inptr < inend) {
-			aligned = (char *) (((long) (inptr + 3)) & ~3);
 			start = inptr;
 			
-			/* Note: see optimization comment [1] */
-			while (inptr < aligned && *inptr != '\n')
-				inptr++;
-			
-			if (inptr == aligned) {
-				dword = (int *) inptr;
+			if (!possible_boundary_start (priv->scan_from, inptr)) {
+				/* Note: see optimization comment [2] */
+				inptr = (char *) scan_lines (inptr, inend, priv->scan_from);
 				
-				do {
-					mask = *dword++ ^ 0x0A0A0A0A;
-					mask = ((mask - 0x01010101) & (~mask & 0x80808080));
-				} while (mask == 0);
-				
-				inptr = (char *) (dword - 1);
-				while (*inptr != '\n')
-					inptr++;
+				if (inptr > start) {
+					content_save (parser, priv, content, start, (size_t) (inptr - start));
+					continue;
+				}
 			}
 			
+			/* Note: see optimization comment [1] */
+			while (*inptr != '\n')
+				inptr++;
+			
 			len = (size_t) (inptr - start);
 			
 			if (inptr < inend) {
@@ -1507,7 +1903,7 @@ parser_scan_content (GMimeParser *parser, GByteArray *content, guint *crlf)
 					goto boundary;
 			}
 			
-			content_save (content, start, len);
+			content_save (parser, priv, content, start, len);
 		}
 		
 		priv->inptr = inptr;
@@ -1530,6 +1926,34 @@ parser_scan_content (GMimeParser *parser, GByteArray *content, guint *crlf)
 	return found;
 }
 
+/* when nothing but the end of the stream can terminate the content,
+ * a seekable stream lets us jump straight there instead of scanning */
+static gint64
+parser_skip_to_eos (GMimeParser *parser)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	gint64 start, end;
+	
+	if (priv->bounds != NULL || priv->scan_from || !priv->seekable)
+		return -1;
+	
+	start = parser_offset (priv, NULL);
+	
+	if ((end = g_mime_stream_seek (priv->stream, 0, GMIME_STREAM_SEEK_END)) < start) {
+		g_mime_stream_seek (priv->stream, priv->offset, GMIME_STREAM_SEEK_SET);
+		return -1;
+	}
+	
+	priv->inptr = priv->inend = priv->inbuf;
+	priv->midline = FALSE;
+	priv->offset = end;
+	
+	/* streams only report eos once a read comes up empty */
+	parser_fill (parser, SCAN_HEAD);
+	
+	return end;
+}
+
 static void
 parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part, int *found)
 {
@@ -1538,32 +1962,49 @@ parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part, int *f
 	GByteArray *content = NULL;
 	GMimeDataWrapper *wrapper;
 	GMimeStream *stream;
+	gboolean persist;
 	gint64 start, end;
 	guint crlf;
 	
 	g_assert (priv->state >= GMIME_PARSER_STATE_HEADERS_END);
 	
-	if (priv->persist_stream && priv->seekable)
+	persist = (priv->persist_stream || priv->headers_only) && priv->seekable;
+	
+	if (persist) {
 		start = parser_offset (priv, NULL);
-	else
+		
+		if ((end = parser_skip_to_eos (parser)) != -1) {
+			*found = FOUND_EOS;
+			goto content;
+		}
+	} else if (!priv->headers_only) {
 		content = g_byte_array_new ();
+	}
 	
 	*found = parser_scan_content (parser, content, &crlf);
 	if (*found != FOUND_EOS) {
 		/* last '\n' belongs to the boundary */
-		if (priv->persist_stream && priv->seekable)
+		if (persist)
 			end = parser_offset (priv, NULL) - crlf;
-		else if (content->len > crlf)
-			g_byte_array_set_size (content, content->len - crlf);
-		else
-			g_byte_array_set_size (content, 0);
-	} else if (priv->persist_stream && priv->seekable) {
+		else if (content != NULL)
+			g_byte_array_set_size (content, content->len > crlf ? content->len - crlf : 0);
+	} else if (persist) {
 		end = parser_offset (priv, NULL);
 	}
 	
+ content:
+	
+	if (persist)
+		priv->content_end = end;
+	
+	if (!persist && content == NULL) {
+		/* headers-only on a stream that we cannot come back to */
+		return;
+	}
+	
 	encoding = g_mime_part_get_content_encoding (mime_part);
 	
-	if (priv->persist_stream && priv->seekable)
+	if (persist)
 		stream = g_mime_stream_substream (priv->stream, start, end);
 	else
 		stream = g_mime_stream_mem_new_with_byte_array (content);
@@ -1574,12 +2015,31 @@ parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part, int *f
 	g_object_unref (stream);
 }
 
+/* remember where @object came from so that it can be written back
+ * out verbatim for as long as it remains unmodified */
+static void
+parser_set_raw (GMimeParser *parser, GMimeObject *object, gint64 headers_begin, gint64 content_begin)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	gint64 begin = headers_begin != -1 ? headers_begin : content_begin;
+	
+	if (!(priv->persist_stream || priv->headers_only) || !priv->seekable)
+		return;
+	
+	/* content that was never scanned (e.g. an empty message/rfc822 part) */
+	if (begin == -1 || priv->content_end < begin)
+		return;
+	
+	_g_mime_object_set_raw (object, priv->stream, headers_begin, content_begin, priv->content_end);
+}
+
 static void
 parser_scan_message_part (GMimeParser *parser, GMimeParserOptions *options, GMimeMessagePart *mpart, int *found)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
 	ContentType *content_type;
 	GMimeMessage *message;
+	gint64 headers_begin;
 	GMimeObject *object;
 	GMimeStream *stream;
 	HeaderRaw *header;
@@ -1629,13 +2089,17 @@ parser_scan_message_part (GMimeParser *parser, GMimeParserOptions *options, GMim
 		return;
 	}
 	
+	headers_begin = priv->headers_begin;
+	
 	message = g_mime_message_new (FALSE);
+	_g_mime_header_list_set_arena (((GMimeObject *) message)->headers, priv->arena);
 	header = priv->headers;
 	while (header) {
-		if (g_ascii_strncasecmp (header->name, "Content-", 8) != 0)
-			_g_mime_object_append_header ((GMimeObject *) message, header->name, header->value, header->raw_value, header->offset);
+		if (!_g_mime_header_id_is_content (header->id))
+			_g_mime_object_append_header ((GMimeObject *) message, header->name, header_raw_object_value (priv, header), header->raw_value, header->offset);
 		header = header->next;
 	}
+	_g_mime_header_list_set_arena (((GMimeObject *) message)->headers, NULL);
 	
 	content_type = parser_content_type (parser, NULL);
 	if (content_type_is_type (content_type, "multipart", "*"))
@@ -1646,6 +2110,9 @@ parser_scan_message_part (GMimeParser *parser, GMimeParserOptions *options, GMim
 	content_type_destroy (content_type);
 	message->mime_part = object;
 	
+	/* the message's own content is only ever written via its toplevel part */
+	parser_set_raw (parser, (GMimeObject *) message, headers_begin, -1);
+	
 	g_mime_message_part_set_message (mpart, message);
 	g_object_unref (message);
 }
@@ -1654,11 +2121,15 @@ static GMimeObject *
 parser_construct_leaf_part (GMimeParser *parser, GMimeParserOptions *options, ContentType *content_type, gboolean toplevel, int *found)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
+	gint64 headers_begin, content_begin;
 	GMimeObject *object;
 	HeaderRaw *header;
 	
 	g_assert (priv->state >= GMIME_PARSER_STATE_HEADERS_END);
 	
+	/* a message's toplevel part shares the message's header block */
+	headers_begin = toplevel ? -1 : priv->headers_begin;
+	
 	object = g_mime_object_new_type (options, content_type->type, content_type->subtype);
 	
 	if (!content_type->exists) {
@@ -1669,12 +2140,14 @@ parser_construct_leaf_part (GMimeParser *parser, GMimeParserOptions *options, Co
 		g_object_unref (mime_type);
 	}
 	
+	_g_mime_header_list_set_arena (object->headers, priv->arena);
 	header = priv->headers;
 	while (header) {
-		if (!toplevel || !g_ascii_strncasecmp (header->name, "Content-", 8))
-			_g_mime_object_append_header (object, header->name, header->value, header->raw_value, header->offset);
+		if (!toplevel || _g_mime_header_id_is_content (header->id))
+			_g_mime_object_append_header (object, header->name, header_raw_object_value (priv, header), header->raw_value, header->offset);
 		header = header->next;
 	}
+	_g_mime_header_list_set_arena (object->headers, NULL);
 	
 	header_raw_clear (&priv->headers);
 	
@@ -1686,11 +2159,15 @@ parser_construct_leaf_part (GMimeParser *parser, GMimeParserOptions *options, Co
 		}
 	}
 	
+	content_begin = parser_offset (priv, NULL);
+	
 	if (GMIME_IS_MESSAGE_PART (object))
 		parser_scan_message_part (parser, options, (GMimeMessagePart *) object, found);
 	else
 		parser_scan_mime_part_content (parser, (GMimePart *) object, found);
 	
+	parser_set_raw (parser, object, headers_begin, content_begin);
+	
 	return object;
 }
 
@@ -1722,6 +2199,7 @@ crlf2lf (char *in)
 static int
 parser_scan_multipart_face (GMimeParser *parser, GMimeMultipart *multipart, gboolean preface)
 {
+	struct _GMimeParserPrivate *priv = parser->priv;
 	GByteArray *buffer;
 	char *face;
 	guint crlf;
@@ -1730,6 +2208,10 @@ parser_scan_multipart_face (GMimeParser *parser, GMimeMultipart *multipart, gboo
 	buffer = g_byte_array_new ();
 	found = parser_scan_content (parser, buffer, &crlf);
 	
+	/* an empty face leaves the newline with the preceding boundary
+	 * line, only the '\n' of which gets written back out */
+	priv->content_end = parser_offset (priv, NULL) - (buffer->len > 0 ? crlf : MIN (crlf, 1));
+	
 	if (buffer->len >= crlf) {
 		/* last '\n' belongs to the boundary */
 		g_byte_array_set_size (buffer, buffer->len + 1);
@@ -1796,6 +2278,7 @@ static GMimeObject *
 parser_construct_multipart (GMimeParser *parser, GMimeParserOptions *options, ContentType *content_type, gboolean toplevel, int *found)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
+	gint64 headers_begin, content_begin;
 	GMimeMultipart *multipart;
 	const char *boundary;
 	GMimeObject *object;
@@ -1804,14 +2287,18 @@ parser_construct_multipart (GMimeParser *parser, GMimeParserOptions *options, Co
 	
 	g_assert (priv->state >= GMIME_PARSER_STATE_HEADERS_END);
 	
+	headers_begin = toplevel ? -1 : priv->headers_begin;
+	
 	object = g_mime_object_new_type (options, content_type->type, content_type->subtype);
 	
+	_g_mime_header_list_set_arena (object->headers, priv->arena);
 	header = priv->headers;
 	while (header) {
-		if (!toplevel || !g_ascii_strncasecmp (header->name, "Content-", 8))
-			_g_mime_object_append_header (object, header->name, header->value, header->raw_value, header->offset);
+		if (!toplevel || _g_mime_header_id_is_content (header->id))
+			_g_mime_object_append_header (object, header->name, header_raw_object_value (priv, header), header->raw_value, header->offset);
 		header = header->next;
 	}
+	_g_mime_header_list_set_arena (object->headers, NULL);
 	
 	header_raw_clear (&priv->headers);
 	
@@ -1825,6 +2312,8 @@ parser_construct_multipart (GMimeParser *parser, GMimeParserOptions *options, Co
 		}
 	}
 	
+	content_begin = parser_offset (priv, NULL);
+	
 	boundary = g_mime_object_get_content_type_parameter (object, "boundary");
 	if (boundary) {
 		parser_push_boundary (parser, boundary);
@@ -1843,6 +2332,9 @@ parser_construct_multipart (GMimeParser *parser, GMimeParserOptions *options, Co
 		} else {
 			multipart->write_end_boundary = FALSE;
 			parser_pop_boundary (parser);
+			
+			/* nothing gets written between this and the next boundary */
+			priv->content_end = parser_offset (priv, NULL);
 		}
 	} else {
 		w(g_warning ("multipart without boundary encountered"));
@@ -1850,6 +2342,8 @@ parser_construct_multipart (GMimeParser *parser, GMimeParserOptions *options, Co
 		*found = parser_scan_multipart_preface (parser, multipart);
 	}
 	
+	parser_set_raw (parser, object, headers_begin, content_begin);
+	
 	return object;
 }
 
@@ -1861,11 +2355,15 @@ parser_construct_part (GMimeParser *parser, GMimeParserOptions *options)
 	GMimeObject *object;
 	int found;
 	
+	parser_apply_options (parser, options);
+	
 	/* get the headers */
 	priv->state = GMIME_PARSER_STATE_HEADERS;
 	while (priv->state < GMIME_PARSER_STATE_HEADERS_END) {
-		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR)
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			parser_release_arena (priv);
 			return NULL;
+		}
 	}
 	
 	content_type = parser_content_type (parser, NULL);
@@ -1876,6 +2374,9 @@ parser_construct_part (GMimeParser *parser, GMimeParserOptions *options)
 	
 	content_type_destroy (content_type);
 	
+	/* the part's headers now own the arena */
+	parser_release_arena (priv);
+	
 	return object;
 }
 
@@ -1924,13 +2425,17 @@ parser_construct_message (GMimeParser *parser, GMimeParserOptions *options)
 	struct _GMimeParserPrivate *priv = parser->priv;
 	unsigned long content_length = ULONG_MAX;
 	ContentType *content_type;
+	gint64 headers_begin;
 	GMimeMessage *message;
 	GMimeObject *object;
 	GMimeStream *stream;
 	HeaderRaw *header;
+	const char *value;
 	char *endptr;
 	int found;
 	
+	parser_apply_options (parser, options);
+	
 	/* scan the from-line if we are parsing an mbox */
 	while (priv->state != GMIME_PARSER_STATE_MESSAGE_HEADERS) {
 		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR)
@@ -1939,23 +2444,30 @@ parser_construct_message (GMimeParser *parser, GMimeParserOptions *options)
 	
 	/* parse the headers */
 	while (priv->state < GMIME_PARSER_STATE_HEADERS_END) {
-		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR)
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			parser_release_arena (priv);
 			return NULL;
+		}
 	}
 	
+	headers_begin = priv->headers_begin;
+	
 	message = g_mime_message_new (FALSE);
+	_g_mime_header_list_set_arena (((GMimeObject *) message)->headers, priv->arena);
 	header = priv->headers;
 	while (header) {
-		if (priv->respect_content_length && !g_ascii_strcasecmp (header->name, "Content-Length")) {
-			content_length = strtoul (header->value, &endptr, 10);
-			if (endptr == header->value)
+		if (priv->respect_content_length && header->id == GMIME_HEADER_ID_CONTENT_LENGTH) {
+			value = header_raw_value (priv, header);
+			content_length = strtoul (value, &endptr, 10);
+			if (endptr == value)
 				content_length = ULONG_MAX;
 		}
 		
-		if (g_ascii_strncasecmp (header->name, "Content-", 8) != 0)
-			_g_mime_object_append_header ((GMimeObject *) message, header->name, header->value, header->raw_value, header->offset);
+		if (!_g_mime_header_id_is_content (header->id))
+			_g_mime_object_append_header ((GMimeObject *) message, header->name, header_raw_object_value (priv, header), header->raw_value, header->offset);
 		header = header->next;
 	}
+	_g_mime_header_list_set_arena (((GMimeObject *) message)->headers, NULL);
 	
 	if (priv->scan_from) {
 		parser_push_boundary (parser, MBOX_BOUNDARY);
@@ -1972,11 +2484,16 @@ parser_construct_message (GMimeParser *parser, GMimeParserOptions *options)
 	content_type_destroy (content_type);
 	message->mime_part = object;
 	
+	parser_set_raw (parser, (GMimeObject *) message, headers_begin, -1);
+	
 	if (priv->scan_from) {
 		priv->state = GMIME_PARSER_STATE_FROM;
 		parser_pop_boundary (parser);
 	}
 	
+	/* the message's headers now own the arena */
+	parser_release_arena (priv);
+	
 	return message;
 }
 
@@ -2016,6 +2533,824 @@ g_mime_parser_construct_message_with_options (GMimeParser *parser, GMimeParserOp
 }
 
 
+static void parser_events_part (GMimeParser *parser, GMimeParserOptions *options, GMimeContentType *parent, int *found);
+
+static GMimeContentType *
+parser_events_content_type (GMimeParser *parser, GMimeParserOptions *options, ContentType *content_type)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	const char *value = NULL;
+	HeaderRaw *header;
+	
+	if (!content_type->exists)
+		return g_mime_content_type_new (content_type->type, content_type->subtype);
+	
+	/* as with GMimeObject, the last Content-Type header wins */
+	for (header = priv->headers; header != NULL; header = header->next) {
+		if (header->id == GMIME_HEADER_ID_CONTENT_TYPE)
+			value = header_raw_value (priv, header);
+	}
+	
+	return g_mime_content_type_parse (options, value);
+}
+
+static void
+parser_events_headers (GMimeParser *parser, GMimeContentType *content_type)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeParserEvent event;
+	HeaderRaw *header;
+	
+	memset (&event, 0, sizeof (event));
+	event.type = GMIME_PARSER_EVENT_BEGIN_PART;
+	event.offset = priv->headers_begin;
+	parser_emit (parser, &event);
+	
+	for (header = priv->headers; header != NULL; header = header->next) {
+		memset (&event, 0, sizeof (event));
+		event.type = GMIME_PARSER_EVENT_HEADER;
+		event.offset = header->offset;
+		event.name = header->name;
+		event.value = header_raw_value (priv, header);
+		event.raw_value = header->raw_value;
+		parser_emit (parser, &event);
+	}
+	
+	memset (&event, 0, sizeof (event));
+	event.type = GMIME_PARSER_EVENT_END_HEADERS;
+	event.offset = priv->headers_end;
+	event.content_type = content_type;
+	parser_emit (parser, &event);
+	
+	/* nothing holds on to the headers, so don't let them pile up */
+	header_raw_clear (&priv->headers);
+	parser_release_arena (priv);
+}
+
+static void
+parser_events_boundary (GMimeParser *parser)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	register char *inptr = priv->inptr;
+	GMimeParserEvent event;
+	size_t len;
+	
+	/* Note: see optimization comment [1] */
+	*priv->inend = '\n';
+	while (*inptr != '\n')
+		inptr++;
+	
+	len = (size_t) (inptr - priv->inptr);
+	if (len > 0 && priv->inptr[len - 1] == '\r')
+		len--;
+	
+	memset (&event, 0, sizeof (event));
+	event.type = GMIME_PARSER_EVENT_BOUNDARY;
+	event.offset = parser_offset (priv, NULL);
+	event.data = priv->inptr;
+	event.len = len;
+	parser_emit (parser, &event);
+}
+
+static int
+parser_events_content (GMimeParser *parser)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GByteArray *chunk = priv->chunk;
+	guint crlf;
+	int found;
+	
+	priv->chunk_offset = parser_offset (priv, NULL);
+	
+	found = parser_scan_content (parser, chunk, &crlf);
+	if (found != FOUND_EOS) {
+		/* last '\n' belongs to the boundary */
+		g_byte_array_set_size (chunk, chunk->len > crlf ? chunk->len - crlf : 0);
+	}
+	
+	parser_emit_content (parser, (char *) chunk->data, chunk->len);
+	g_byte_array_set_size (chunk, 0);
+	
+	return found;
+}
+
+static void
+parser_events_message_part (GMimeParser *parser, GMimeParserOptions *options, int *found)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	
+	g_assert (priv->state == GMIME_PARSER_STATE_CONTENT);
+	
+	if (priv->bounds != NULL) {
+		/* Check for the possibility of an empty message/rfc822 part. */
+		register char *inptr;
+		size_t atleast;
+		char *inend;
+		
+		/* figure out minimum amount of data we need */
+		atleast = MAX (SCAN_HEAD, MAX_BOUNDARY_LEN (priv->bounds));
+		
+		if (parser_fill (parser, atleast) <= 0) {
+			*found = FOUND_EOS;
+			return;
+		}
+		
+		inptr = priv->inptr;
+		inend = priv->inend;
+		/* Note: see optimization comment [1] */
+		*inend = '\n';
+		
+		while (*inptr != '\n')
+			inptr++;
+		
+		*found = check_boundary (priv, priv->inptr, inptr - priv->inptr);
+		switch (*found) {
+		case FOUND_END_BOUNDARY:
+			/* ignore "From " boundaries, boken mailers tend to include these lines... */
+			if (strncmp (priv->inptr, "From ", 5) != 0)
+				return;
+			break;
+		case FOUND_BOUNDARY:
+			return;
+		}
+	}
+	
+	/* get the headers */
+	priv->state = GMIME_PARSER_STATE_HEADERS;
+	if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+		*found = FOUND_EOS;
+		return;
+	}
+	
+	priv->depth++;
+	parser_events_part (parser, options, NULL, found);
+	priv->depth--;
+}
+
+static int
+parser_events_subparts (GMimeParser *parser, GMimeParserOptions *options, GMimeContentType *content_type)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	int found;
+	
+	do {
+		parser_events_boundary (parser);
+		
+		/* skip over the boundary marker */
+		if (parser_skip_line (parser) == -1) {
+			found = FOUND_EOS;
+			break;
+		}
+		
+		/* get the headers */
+		priv->state = GMIME_PARSER_STATE_HEADERS;
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			found = FOUND_EOS;
+			break;
+		}
+		
+		if (priv->state == GMIME_PARSER_STATE_COMPLETE && priv->headers == NULL) {
+			found = FOUND_END_BOUNDARY;
+			break;
+		}
+		
+		priv->depth++;
+		parser_events_part (parser, options, content_type, &found);
+		priv->depth--;
+	} while (found == FOUND_BOUNDARY && found_immediate_boundary (priv, FALSE));
+	
+	return found;
+}
+
+static void
+parser_events_multipart (GMimeParser *parser, GMimeParserOptions *options, GMimeContentType *content_type, int *found)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	const char *boundary;
+	
+	if ((boundary = g_mime_content_type_get_parameter (content_type, "boundary"))) {
+		parser_push_boundary (parser, boundary);
+		
+		/* the preface */
+		*found = parser_events_content (parser);
+		
+		if (*found == FOUND_BOUNDARY)
+			*found = parser_events_subparts (parser, options, content_type);
+		
+		if (*found == FOUND_END_BOUNDARY && found_immediate_boundary (priv, TRUE)) {
+			parser_events_boundary (parser);
+			parser_skip_line (parser);
+			parser_pop_boundary (parser);
+			
+			/* the postface */
+			*found = parser_events_content (parser);
+		} else {
+			parser_pop_boundary (parser);
+		}
+	} else {
+		w(g_warning ("multipart without boundary encountered"));
+		/* this will scan everything into the preface */
+		*found = parser_events_content (parser);
+	}
+}
+
+/* the event-driven counterpart of parser_construct_leaf_part() and
+ * parser_construct_multipart(); the headers must already be parsed */
+static void
+parser_events_part (GMimeParser *parser, GMimeParserOptions *options, GMimeContentType *parent, int *found)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeContentType *mime_type;
+	ContentType *content_type;
+	GMimeParserEvent event;
+	GType type;
+	
+	g_assert (priv->state >= GMIME_PARSER_STATE_HEADERS_END);
+	
+	content_type = parser_content_type (parser, parent);
+	mime_type = parser_events_content_type (parser, options, content_type);
+	
+	parser_events_headers (parser, mime_type);
+	
+	if (priv->state == GMIME_PARSER_STATE_HEADERS_END) {
+		/* skip empty line after headers */
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			*found = FOUND_EOS;
+			goto end;
+		}
+	}
+	
+	if (content_type_is_type (content_type, "multipart", "*")) {
+		parser_events_multipart (parser, options, mime_type, found);
+	} else {
+		type = _g_mime_object_lookup_type (content_type->type, content_type->subtype);
+		
+		if (g_type_is_a (type, GMIME_TYPE_MESSAGE_PART))
+			parser_events_message_part (parser, options, found);
+		else
+			*found = parser_events_content (parser);
+	}
+	
+ end:
+	memset (&event, 0, sizeof (event));
+	event.type = GMIME_PARSER_EVENT_END_PART;
+	event.offset = parser_offset (priv, NULL);
+	event.content_type = mime_type;
+	parser_emit (parser, &event);
+	
+	content_type_destroy (content_type);
+	g_object_unref (mime_type);
+}
+
+static int
+parser_events_message (GMimeParser *parser, GMimeParserOptions *options)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	unsigned long content_length = ULONG_MAX;
+	HeaderRaw *header;
+	const char *value;
+	char *endptr;
+	int found;
+	
+	/* scan the from-line if we are parsing an mbox */
+	while (priv->state != GMIME_PARSER_STATE_MESSAGE_HEADERS) {
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR)
+			return -1;
+	}
+	
+	/* parse the headers */
+	while (priv->state < GMIME_PARSER_STATE_HEADERS_END) {
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			parser_release_arena (priv);
+			return -1;
+		}
+	}
+	
+	if (priv->scan_from) {
+		if (priv->respect_content_length) {
+			for (header = priv->headers; header != NULL; header = header->next) {
+				if (header->id == GMIME_HEADER_ID_CONTENT_LENGTH) {
+					value = header_raw_value (priv, header);
+					content_length = strtoul (value, &endptr, 10);
+					if (endptr == value)
+						content_length = ULONG_MAX;
+				}
+			}
+		}
+		
+		parser_push_boundary (parser, MBOX_BOUNDARY);
+		if (priv->respect_content_length && content_length < ULONG_MAX)
+			priv->bounds->content_end = parser_offset (priv, NULL) + content_length;
+	}
+	
+	parser_events_part (parser, options, NULL, &found);
+	
+	if (priv->scan_from) {
+		priv->state = GMIME_PARSER_STATE_FROM;
+		parser_pop_boundary (parser);
+	}
+	
+	return 0;
+}
+
+static int
+parser_events_toplevel_part (GMimeParser *parser, GMimeParserOptions *options)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	int found;
+	
+	/* get the headers */
+	priv->state = GMIME_PARSER_STATE_HEADERS;
+	while (priv->state < GMIME_PARSER_STATE_HEADERS_END) {
+		if (parser_step (parser) == GMIME_PARSER_STATE_ERROR) {
+			parser_release_arena (priv);
+			return -1;
+		}
+	}
+	
+	parser_events_part (parser, options, NULL, &found);
+	
+	return 0;
+}
+
+static int
+parser_scan_events (GMimeParser *parser, GMimeParserOptions *options, gboolean message,
+		    GMimeParserEventFunc callback, gpointer user_data)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	int rv;
+	
+	if (options == NULL)
+		options = g_mime_parser_options_get_default ();
+	
+	parser_apply_options (parser, options);
+	
+	priv->chunk = g_byte_array_sized_new (CONTENT_CHUNK_SIZE);
+	priv->event_data = user_data;
+	priv->event_cb = callback;
+	priv->depth = 0;
+	
+	if (message)
+		rv = parser_events_message (parser, options);
+	else
+		rv = parser_events_toplevel_part (parser, options);
+	
+	g_byte_array_free (priv->chunk, TRUE);
+	priv->event_data = NULL;
+	priv->event_cb = NULL;
+	priv->chunk = NULL;
+	
+	return rv;
+}
+
+
+/**
+ * g_mime_parser_scan_part:
+ * @parser: a #GMimeParser context
+ * @options: a #GMimeParserOptions or %NULL
+ * @callback: (scope call): the function to call for each event
+ * @user_data: user data to pass to @callback
+ *
+ * Scans a MIME part from @parser the same way that
+ * g_mime_parser_construct_part() would, but rather than constructing
+ * a #GMimePart tree, reports the structure of the part to @callback
+ * as a series of events. Content is passed to @callback in chunks as
+ * it is scanned, so the memory used does not depend on the size of
+ * the part.
+ *
+ * Returns: %0 on success or %-1 on fail.
+ **/
+int
+g_mime_parser_scan_part (GMimeParser *parser, GMimeParserOptions *options,
+			 GMimeParserEventFunc callback, gpointer user_data)
+{
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), -1);
+	g_return_val_if_fail (callback != NULL, -1);
+	
+	return parser_scan_events (parser, options, FALSE, callback, user_data);
+}
+
+
+/**
+ * g_mime_parser_scan_message:
+ * @parser: a #GMimeParser context
+ * @options: a #GMimeParserOptions or %NULL
+ * @callback: (scope call): the function to call for each event
+ * @user_data: user data to pass to @callback
+ *
+ * Scans a message from @parser the same way that
+ * g_mime_parser_construct_message() would, but rather than
+ * constructing a #GMimeMessage, reports the structure of the message
+ * to @callback as a series of events. The message's headers are
+ * reported as the headers of the outermost part.
+ *
+ * Content is passed to @callback in chunks as it is scanned, so the
+ * memory used does not depend on the size of the message.
+ *
+ * Returns: %0 on success or %-1 on fail.
+ **/
+int
+g_mime_parser_scan_message (GMimeParser *parser, GMimeParserOptions *options,
+			    GMimeParserEventFunc callback, gpointer user_data)
+{
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), -1);
+	g_return_val_if_fail (callback != NULL, -1);
+	
+	return parser_scan_events (parser, options, TRUE, callback, user_data);
+}
+
+
+/* an mbox message queued up to be parsed by a worker thread */
+typedef struct {
+	gint64 start, end, next;
+	
+	GMimeMessage *message;
+	gint64 message_end;
+	GByteArray *from_line;
+	gint64 from_offset;
+	gint64 headers_begin;
+	gint64 headers_end;
+	gboolean done;
+} MboxJob;
+
+typedef struct {
+	GMimeParser *parser;
+	GMimeParserOptions *options;
+	GMimeStream *stream;
+	GMutex lock;
+	GCond cond;
+} MboxContext;
+
+/* mbox messages in flight per worker thread */
+#define MBOX_JOBS_PER_THREAD 4
+
+/* returns the start of the first line at or after @inptr (which must
+ * be the start of a line) that begins with "From " or @inend if there
+ * is none */
+static const char *
+mbox_next_from (const char *inptr, const char *inend)
+{
+	const char *start;
+	
+	while (inend - inptr >= MBOX_BOUNDARY_LEN) {
+		if (!strncmp (inptr, MBOX_BOUNDARY, MBOX_BOUNDARY_LEN))
+			return inptr;
+		
+		/* Note: see optimization comment [2] */
+		start = inptr;
+		inptr = scan_lines (inptr, inend, TRUE);
+		
+		if (inptr == start) {
+			/* the line begins with 'F' (or "--") but isn't a From-line */
+			if (!(inptr = memchr (inptr, '\n', (size_t) (inend - inptr))))
+				break;
+			
+			inptr++;
+		}
+	}
+	
+	return inend;
+}
+
+/* guesses where the Content-Length of the message whose headers begin
+ * at @inptr says that its content ends, the way parser_construct_message()
+ * counts it (from the blank line after the headers), and returns the
+ * start of the first line at or after that point or %NULL if the
+ * message has no (valid) Content-Length */
+static const char *
+mbox_content_end (const char *inptr, const char *inend)
+{
+	unsigned long content_length = ULONG_MAX;
+	const char *eol, *value;
+	char *endptr;
+	
+	while (inptr < inend) {
+		if (!(eol = memchr (inptr, '\n', (size_t) (inend - inptr))))
+			return NULL;
+		
+		if (inptr == eol || (inptr[0] == '\r' && inptr + 1 == eol))
+			break;
+		
+		if (!strncmp (inptr, MBOX_BOUNDARY, MBOX_BOUNDARY_LEN))
+			return NULL;
+		
+		if (!g_ascii_strncasecmp (inptr, "Content-Length", 14)) {
+			value = inptr + 14;
+			while (value < eol && is_lwsp (*value))
+				value++;
+			
+			if (value < eol && *value == ':') {
+				value++;
+				while (value < eol && is_lwsp (*value))
+					value++;
+				
+				content_length = strtoul (value, &endptr, 10);
+				if (endptr == value)
+					content_length = ULONG_MAX;
+			}
+		}
+		
+		inptr = eol + 1;
+	}
+	
+	if (inptr >= inend || content_length == ULONG_MAX)
+		return NULL;
+	
+	if (content_length >= (unsigned long) (inend - inptr))
+		return inend;
+	
+	inptr += content_length;
+	if (inptr[-1] == '\n')
+		return inptr;
+	
+	if (!(eol = memchr (inptr, '\n', (size_t) (inend - inptr))))
+		return inend;
+	
+	return eol + 1;
+}
+
+static void
+mbox_job_free (MboxJob *job)
+{
+	if (job->message)
+		g_object_unref (job->message);
+	
+	if (job->from_line)
+		g_byte_array_free (job->from_line, TRUE);
+	
+	g_slice_free (MboxJob, job);
+}
+
+static void
+mbox_worker (gpointer data, gpointer user_data)
+{
+	MboxContext *ctx = (MboxContext *) user_data;
+	struct _GMimeParserPrivate *priv;
+	MboxJob *job = (MboxJob *) data;
+	GMimeParser *parser;
+	GMimeStream *stream;
+	
+	/* each message gets a parser of its own over just its part of the
+	 * map; since the bounds include the next message's From-line, the
+	 * parser ends the message exactly as it would have when parsing
+	 * the mbox serially */
+	stream = g_mime_stream_substream (ctx->stream, job->start, job->end);
+	parser = g_mime_parser_new_with_stream (stream);
+	g_object_unref (stream);
+	
+	priv = parser->priv;
+	priv->respect_content_length = ctx->parser->priv->respect_content_length;
+	priv->persist_stream = ctx->parser->priv->persist_stream;
+	priv->headers_only = ctx->parser->priv->headers_only;
+	priv->scan_from = TRUE;
+	
+	if ((job->message = parser_construct_message (parser, ctx->options))) {
+		job->from_line = g_byte_array_new ();
+		g_byte_array_append (job->from_line, priv->from_line->data, priv->from_line->len);
+		job->from_offset = priv->from_offset;
+		job->headers_begin = priv->message_headers_begin;
+		job->headers_end = priv->message_headers_end;
+		job->message_end = parser_offset (priv, NULL);
+	}
+	
+	g_object_unref (parser);
+	
+	g_mutex_lock (&ctx->lock);
+	job->done = TRUE;
+	g_cond_broadcast (&ctx->cond);
+	g_mutex_unlock (&ctx->lock);
+}
+
+static GMimeStream *
+mbox_map_stream (GMimeParser *parser)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeStream *stream = priv->stream;
+	
+	if (priv->mapped)
+		return g_object_ref (stream);
+	
+#ifdef HAVE_MMAP
+	if (priv->seekable && GMIME_IS_STREAM_FS (stream)) {
+		int fd;
+		
+		if ((fd = dup (((GMimeStreamFs *) stream)->fd)) == -1)
+			return NULL;
+		
+		if ((stream = g_mime_stream_mmap_new_with_bounds (fd, PROT_READ, MAP_PRIVATE, 0, stream->bound_end)))
+			return stream;
+		
+		close (fd);
+	}
+#endif
+	
+	return NULL;
+}
+
+static int
+parser_construct_mbox_serial (GMimeParser *parser, GMimeParserOptions *options,
+			      GMimeParserMessageFunc callback, gpointer user_data)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	GMimeMessage *message;
+	int count = 0;
+	
+	do {
+		if (!(message = parser_construct_message (parser, options)))
+			break;
+		
+		callback (parser, message, user_data);
+		g_object_unref (message);
+		count++;
+	} while (priv->scan_from && !g_mime_parser_eos (parser));
+	
+	return count;
+}
+
+static int
+parser_construct_mbox (GMimeParser *parser, GMimeParserOptions *options, int n_threads,
+		       GMimeParserMessageFunc callback, gpointer user_data)
+{
+	struct _GMimeParserPrivate *priv = parser->priv;
+	const char *map, *inptr, *inend, *next, *eol;
+	gboolean failed = FALSE;
+	GThreadPool *pool;
+	MboxContext ctx;
+	GQueue *queue;
+	MboxJob *job;
+	int count = 0;
+	
+	if (n_threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		n_threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+		n_threads = MAX (n_threads, 1);
+	}
+	
+	ctx.stream = NULL;
+	
+	/* the header regex callback is not expected to be called from
+	 * multiple threads, so those parsers get to work serially */
+	if (n_threads > 1 && priv->scan_from && !priv->have_regex
+#if defined (HAVE_GLIB_REGEX)
+	    && priv->regex == NULL
+#endif
+	    && (priv->state == GMIME_PARSER_STATE_INIT || priv->state == GMIME_PARSER_STATE_FROM))
+		ctx.stream = mbox_map_stream (parser);
+	
+	if (ctx.stream == NULL)
+		return parser_construct_mbox_serial (parser, options, callback, user_data);
+	
+	parser_apply_options (parser, options);
+	
+	map = ((GMimeStreamMmap *) ctx.stream)->map;
+	inend = map + ((GMimeStreamMmap *) ctx.stream)->maplen;
+	if (priv->stream->bound_end != -1 && priv->stream->bound_end < (gint64) (inend - map))
+		inend = map + priv->stream->bound_end;
+	
+	if ((inptr = mbox_next_from (map + parser_offset (priv, NULL), inend)) == inend) {
+		/* no messages to split; let the parser fail as it normally would */
+		g_object_unref (ctx.stream);
+		
+		return parser_construct_mbox_serial (parser, options, callback, user_data);
+	}
+	
+	ctx.parser = parser;
+	ctx.options = options;
+	g_mutex_init (&ctx.lock);
+	g_cond_init (&ctx.cond);
+	
+	pool = g_thread_pool_new (mbox_worker, &ctx, n_threads, TRUE, NULL);
+	queue = g_queue_new ();
+	
+	do {
+		/* keep the workers busy without letting parsed
+		 * messages pile up in memory */
+		while (inptr < inend && g_queue_get_length (queue) < (guint) n_threads * MBOX_JOBS_PER_THREAD) {
+			if (!(next = memchr (inptr, '\n', (size_t) (inend - inptr))))
+				next = inend;
+			else if (priv->respect_content_length && (eol = mbox_content_end (next + 1, inend)))
+				next = mbox_next_from (eol, inend);
+			else
+				next = mbox_next_from (next + 1, inend);
+			
+			job = g_slice_new0 (MboxJob);
+			job->start = (gint64) (inptr - map);
+			job->next = (gint64) (next - map);
+			
+			if ((eol = memchr (next, '\n', (size_t) (inend - next))))
+				job->end = (gint64) (eol + 1 - map);
+			else
+				job->end = (gint64) (inend - map);
+			
+			g_queue_push_tail (queue, job);
+			g_thread_pool_push (pool, job, NULL);
+			inptr = next;
+		}
+		
+		if (!(job = g_queue_pop_head (queue)))
+			break;
+		
+		g_mutex_lock (&ctx.lock);
+		while (!job->done)
+			g_cond_wait (&ctx.cond, &ctx.lock);
+		g_mutex_unlock (&ctx.lock);
+		
+		if (job->message == NULL || job->message_end != job->next) {
+			/* rewind to this message and let the parser fail on
+			 * it again so that it ends up in the same state; a
+			 * message that did not end where the mbox was split
+			 * (mbox_content_end() guessed wrong) gets the same
+			 * treatment so the rest is parsed serially */
+			priv->inptr = priv->inend = priv->inbuf;
+			priv->offset = g_mime_stream_seek (priv->stream, job->start, GMIME_STREAM_SEEK_SET);
+			priv->midline = FALSE;
+			failed = TRUE;
+			
+			mbox_job_free (job);
+			break;
+		}
+		
+		/* sync up with the end of the message so that the From-line
+		 * and offset getters work from within the callback */
+		priv->inptr = priv->inend = priv->inbuf;
+		priv->offset = g_mime_stream_seek (priv->stream, job->next, GMIME_STREAM_SEEK_SET);
+		priv->midline = FALSE;
+		
+		g_byte_array_set_size (priv->from_line, 0);
+		g_byte_array_append (priv->from_line, job->from_line->data, job->from_line->len);
+		priv->from_offset = job->from_offset;
+		priv->message_headers_begin = job->headers_begin;
+		priv->message_headers_end = job->headers_end;
+		
+		callback (parser, job->message, user_data);
+		count++;
+		
+		mbox_job_free (job);
+	} while (1);
+	
+	/* wait for any messages still being parsed */
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_queue_free_full (queue, (GDestroyNotify) mbox_job_free);
+	
+	g_cond_clear (&ctx.cond);
+	g_mutex_clear (&ctx.lock);
+	g_object_unref (ctx.stream);
+	
+	priv->state = GMIME_PARSER_STATE_FROM;
+	parser_fill (parser, 0);
+	
+	if (failed)
+		count += parser_construct_mbox_serial (parser, options, callback, user_data);
+	
+	return count;
+}
+
+
+/**
+ * g_mime_parser_construct_mbox:
+ * @parser: a #GMimeParser context
+ * @options: a #GMimeParserOptions or %NULL
+ * @n_threads: the number of worker threads to use or %0 for one per cpu
+ * @callback: (scope call): the function to call for each message
+ * @user_data: user data to pass to @callback
+ *
+ * Constructs each of the remaining messages in the mbox that @parser
+ * is scanning (see g_mime_parser_set_scan_from()) and passes them to
+ * @callback, in the order that they appear in the mbox.
+ *
+ * When possible, the mbox is split at its From-lines (skipping any
+ * within a message's Content-Length if @parser respects those, see
+ * g_mime_parser_set_respect_content_length()) and the messages
+ * are parsed in parallel by @n_threads worker threads, each using a
+ * #GMimeParser of its own. This requires the underlying stream to be a
+ * #GMimeStreamMmap or a seekable #GMimeStreamFs (which gets mapped
+ * into memory) and that no header regex is set. Otherwise, or if
+ * @parser isn't scanning From-lines, the messages are parsed serially
+ * just as repeated calls to g_mime_parser_construct_message() would.
+ * Either way, the messages (as well as the From-line and offsets
+ * reported by @parser from within @callback) are identical, although
+ * persistent content streams may be backed by a private mapping of
+ * the file.
+ *
+ * @callback is always called from the calling thread.
+ *
+ * Returns: the number of messages passed to @callback.
+ **/
+int
+g_mime_parser_construct_mbox (GMimeParser *parser, GMimeParserOptions *options, int n_threads,
+			      GMimeParserMessageFunc callback, gpointer user_data)
+{
+	g_return_val_if_fail (GMIME_IS_PARSER (parser), -1);
+	g_return_val_if_fail (callback != NULL, -1);
+	
+	if (options == NULL)
+		options = g_mime_parser_options_get_default ();
+	
+	return parser_construct_mbox (parser, options, n_threads, callback, user_data);
+}
+
+
 /**
  * g_mime_parser_get_from:
  * @parser: a #GMimeParser context
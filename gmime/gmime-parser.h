@@ -80,6 +80,81 @@ typedef void (* GMimeParserHeaderRegexFunc) (GMimeParser *parser, const char *he
 					     gpointer user_data);
 
 
+/**
+ * GMimeParserEventType:
+ * @GMIME_PARSER_EVENT_BEGIN_PART: The start of a MIME part (or message).
+ * @GMIME_PARSER_EVENT_HEADER: A header of the current part.
+ * @GMIME_PARSER_EVENT_END_HEADERS: The end of the current part's headers.
+ * @GMIME_PARSER_EVENT_CONTENT: A chunk of the current part's content.
+ * @GMIME_PARSER_EVENT_BOUNDARY: A multipart boundary marker.
+ * @GMIME_PARSER_EVENT_END_PART: The end of the current part.
+ *
+ * The type of event passed to a #GMimeParserEventFunc.
+ **/
+typedef enum {
+	GMIME_PARSER_EVENT_BEGIN_PART,
+	GMIME_PARSER_EVENT_HEADER,
+	GMIME_PARSER_EVENT_END_HEADERS,
+	GMIME_PARSER_EVENT_CONTENT,
+	GMIME_PARSER_EVENT_BOUNDARY,
+	GMIME_PARSER_EVENT_END_PART
+} GMimeParserEventType;
+
+
+/**
+ * GMimeParserEvent:
+ * @type: The type of event.
+ * @depth: The nesting depth of the part that the event belongs to.
+ * @offset: The stream offset of the event (or %-1 if unknown).
+ * @content_type: The Content-Type of the part (only set for
+ * %GMIME_PARSER_EVENT_END_HEADERS and %GMIME_PARSER_EVENT_END_PART).
+ * @name: The header name (only set for %GMIME_PARSER_EVENT_HEADER).
+ * @value: The unfolded header value (only set for %GMIME_PARSER_EVENT_HEADER).
+ * @raw_value: The raw header value (only set for %GMIME_PARSER_EVENT_HEADER).
+ * @data: The content chunk or boundary line (only set for
+ * %GMIME_PARSER_EVENT_CONTENT and %GMIME_PARSER_EVENT_BOUNDARY).
+ * @len: The length of @data.
+ *
+ * An event emitted by g_mime_parser_scan_message() or
+ * g_mime_parser_scan_part(). None of the data is valid beyond the
+ * callback that it was passed to.
+ **/
+typedef struct {
+	GMimeParserEventType type;
+	int depth;
+	gint64 offset;
+	GMimeContentType *content_type;
+	const char *name;
+	const char *value;
+	const char *raw_value;
+	const char *data;
+	size_t len;
+} GMimeParserEvent;
+
+
+/**
+ * GMimeParserEventFunc:
+ * @parser: The #GMimeParser object.
+ * @event: The #GMimeParserEvent.
+ * @user_data: The user-supplied callback data.
+ *
+ * Function signature for the callback to g_mime_parser_scan_message()
+ * and g_mime_parser_scan_part().
+ **/
+typedef void (* GMimeParserEventFunc) (GMimeParser *parser, const GMimeParserEvent *event, gpointer user_data);
+
+
+/**
+ * GMimeParserMessageFunc:
+ * @parser: The #GMimeParser object.
+ * @message: The #GMimeMessage that was constructed.
+ * @user_data: The user-supplied callback data.
+ *
+ * Function signature for the callback to g_mime_parser_construct_mbox().
+ **/
+typedef void (* GMimeParserMessageFunc) (GMimeParser *parser, GMimeMessage *message, gpointer user_data);
+
+
 GType g_mime_parser_get_type (void);
 
 GMimeParser *g_mime_parser_new (void);
@@ -90,6 +165,9 @@ void g_mime_parser_init_with_stream (GMimeParser *parser, GMimeStream *stream);
 gboolean g_mime_parser_get_persist_stream (GMimeParser *parser);
 void g_mime_parser_set_persist_stream (GMimeParser *parser, gboolean persist);
 
+gboolean g_mime_parser_get_headers_only (GMimeParser *parser);
+void g_mime_parser_set_headers_only (GMimeParser *parser, gboolean headers_only);
+
 gboolean g_mime_parser_get_scan_from (GMimeParser *parser);
 void g_mime_parser_set_scan_from (GMimeParser *parser, gboolean scan_from);
 
@@ -106,6 +184,14 @@ GMimeObject *g_mime_parser_construct_part_with_options (GMimeParser *parser, GMi
 GMimeMessage *g_mime_parser_construct_message (GMimeParser *parser);
 GMimeMessage *g_mime_parser_construct_message_with_options (GMimeParser *parser, GMimeParserOptions *options);
 
+int g_mime_parser_scan_part (GMimeParser *parser, GMimeParserOptions *options,
+			     GMimeParserEventFunc callback, gpointer user_data);
+int g_mime_parser_scan_message (GMimeParser *parser, GMimeParserOptions *options,
+				GMimeParserEventFunc callback, gpointer user_data);
+
+int g_mime_parser_construct_mbox (GMimeParser *parser, GMimeParserOptions *options, int n_threads,
+				  GMimeParserMessageFunc callback, gpointer user_data);
+
 gint64 g_mime_parser_tell (GMimeParser *parser);
 
 gboolean g_mime_parser_eos (GMimeParser *parser);
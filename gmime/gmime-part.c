@@ -38,6 +38,7 @@
 #include "gmime-filter-best.h"
 #include "gmime-filter-crlf.h"
 #include "gmime-filter-md5.h"
+#include "gmime-filter-text.h"
 #include "gmime-table-private.h"
 
 #define d(x)
@@ -363,17 +364,11 @@ mime_part_write_to_stream (GMimeObject *object, GMimeStream *stream, gboolean co
 	ssize_t nwritten, total = 0;
 	
 	if (!content_only) {
-		/* write the content headers */
-		if ((nwritten = g_mime_header_list_write_to_stream (object->headers, stream)) == -1)
+		/* write the content headers and the blank line terminating them */
+		if ((nwritten = _g_mime_header_list_write_to_stream (object->headers, stream, "\n")) == -1)
 			return -1;
 		
 		total += nwritten;
-		
-		/* terminate the headers */
-		if (g_mime_stream_write (stream, "\n", 1) == -1)
-			return -1;
-		
-		total++;
 	}
 	
 	if ((nwritten = write_content (mime_part, stream)) == -1)
@@ -906,6 +901,8 @@ g_mime_part_set_content_object (GMimePart *mime_part, GMimeDataWrapper *content)
 	if (mime_part->content == content)
 		return;
 	
+	_g_mime_object_set_dirty ((GMimeObject *) mime_part);
+	
 	GMIME_PART_GET_CLASS (mime_part)->set_content_object (mime_part, content);
 }
 
@@ -927,3 +924,64 @@ g_mime_part_get_content_object (GMimePart *mime_part)
 	
 	return mime_part->content;
 }
+
+
+/**
+ * g_mime_part_get_text_stream:
+ * @mime_part: a #GMimePart object
+ *
+ * Gets a stream which reads the content of @mime_part as UTF-8 text
+ * with UNIX line endings. The transfer decoding, charset conversion
+ * and line-ending canonicalization are all done in a single pass by a
+ * #GMimeFilterText.
+ *
+ * The charset is taken from the Content-Type's charset parameter. If
+ * there is none, the content is assumed to already be UTF-8 (or
+ * ASCII); if it is not supported, the content is converted as if it
+ * were ISO-8859-1.
+ *
+ * Returns: (transfer full): a new stream for reading the text content
+ * of @mime_part or %NULL if the part has no content.
+ **/
+GMimeStream *
+g_mime_part_get_text_stream (GMimePart *mime_part)
+{
+	GMimeContentEncoding encoding;
+	GMimeStream *stream, *filtered;
+	GMimeDataWrapper *content;
+	GMimeFilter *filter;
+	const char *charset;
+	
+	g_return_val_if_fail (GMIME_IS_PART (mime_part), NULL);
+	
+	if (!(content = mime_part->content) || !content->stream)
+		return NULL;
+	
+	/* use a substream so that the content stream's position is left alone */
+	if (!(stream = g_mime_stream_substream (content->stream, content->stream->bound_start, content->stream->bound_end))) {
+		stream = content->stream;
+		g_object_ref (stream);
+		g_mime_stream_reset (stream);
+	}
+	
+	filtered = g_mime_stream_filter_new (stream);
+	g_object_unref (stream);
+	
+	if ((encoding = content->encoding) == GMIME_CONTENT_ENCODING_UUENCODE) {
+		filter = g_mime_filter_basic_new (encoding, FALSE);
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+		g_object_unref (filter);
+		
+		encoding = GMIME_CONTENT_ENCODING_BINARY;
+	}
+	
+	charset = g_mime_object_get_content_type_parameter ((GMimeObject *) mime_part, "charset");
+	
+	if (!(filter = g_mime_filter_text_new (encoding, charset)))
+		filter = g_mime_filter_text_new (encoding, "iso-8859-1");
+	
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	return filtered;
+}
@@ -104,6 +104,8 @@ const char *g_mime_part_get_filename (GMimePart *mime_part);
 void g_mime_part_set_content_object (GMimePart *mime_part, GMimeDataWrapper *content);
 GMimeDataWrapper *g_mime_part_get_content_object (GMimePart *mime_part);
 
+GMimeStream *g_mime_part_get_text_stream (GMimePart *mime_part);
+
 G_END_DECLS
 
 #endif /* __GMIME_PART_H__ */
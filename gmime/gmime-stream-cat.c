@@ -54,6 +54,8 @@ static gint64 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence w
 static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
+static gint64 stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+static gint64 stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 
 
 static GMimeStreamClass *parent_class = NULL;
@@ -111,6 +113,8 @@ g_mime_stream_cat_class_init (GMimeStreamCatClass *klass)
 	stream_class->tell = stream_tell;
 	stream_class->length = stream_length;
 	stream_class->substream = stream_substream;
+	stream_class->readv = stream_readv;
+	stream_class->writev = stream_writev;
 }
 
 static void
@@ -240,6 +244,127 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	return nwritten;
 }
 
+static gint64
+stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamCat *cat = (GMimeStreamCat *) stream;
+	struct _cat_node *current;
+	gint64 nread = 0;
+	gint64 offset;
+	size_t len, i;
+	
+	/* reading up to a boundary would need a truncated copy of the vector */
+	if (stream->bound_end != -1)
+		return GMIME_STREAM_CLASS (parent_class)->readv (stream, vector, count);
+	
+	for (i = 0, len = 0; i < count; i++)
+		len += vector[i].len;
+	
+	if (len == 0)
+		return 0;
+	
+	if (!(current = cat->current))
+		return -1;
+	
+	/* make sure our stream position is where it should be */
+	offset = current->stream->bound_start + current->position;
+	if (g_mime_stream_seek (current->stream, offset, GMIME_STREAM_SEEK_SET) == -1)
+		return -1;
+	
+	do {
+		if ((nread = g_mime_stream_readv (current->stream, vector, count)) <= 0) {
+			cat->current = current = current->next;
+			if (current != NULL) {
+				if (g_mime_stream_reset (current->stream) == -1)
+					return -1;
+				current->position = 0;
+			}
+			nread = 0;
+		} else if (nread > 0) {
+			current->position += nread;
+		}
+	} while (nread == 0 && current != NULL);
+	
+	if (nread > 0)
+		stream->position += nread;
+	
+	return nread;
+}
+
+static gint64
+stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamCat *cat = (GMimeStreamCat *) stream;
+	GMimeStreamIOVector *rest = NULL;
+	struct _cat_node *current;
+	gint64 nwritten = 0;
+	gint64 n = -1;
+	gint64 offset;
+	size_t len, i;
+	
+	/* writing up to a boundary would need a truncated copy of the vector */
+	if (stream->bound_end != -1)
+		return GMIME_STREAM_CLASS (parent_class)->writev (stream, vector, count);
+	
+	if (!(current = cat->current))
+		return -1;
+	
+	for (i = 0, len = 0; i < count; i++)
+		len += vector[i].len;
+	
+	do {
+		/* make sure our stream position is where it should be */
+		offset = current->stream->bound_start + current->position;
+		if (g_mime_stream_seek (current->stream, offset, GMIME_STREAM_SEEK_SET) == -1)
+			break;
+		
+		/* hand as much of the vector as we can to the current stream in one go */
+		if ((n = g_mime_stream_writev (current->stream, vector, count)) > 0) {
+			current->position += n;
+			nwritten += n;
+		}
+		
+		if ((size_t) nwritten == len)
+			break;
+		
+		if (n > 0) {
+			/* skip over what has been written */
+			for (i = 0; n >= (gint64) vector[i].len; i++)
+				n -= vector[i].len;
+			
+			if (rest == NULL) {
+				rest = g_memdup (vector + i, (count - i) * sizeof (GMimeStreamIOVector));
+				vector = rest;
+			} else {
+				vector += i;
+			}
+			
+			vector[0].data = (char *) vector[0].data + n;
+			vector[0].len -= n;
+			count -= i;
+		}
+		
+		/* try spilling over into the next stream */
+		current = current->next;
+		if (current) {
+			current->position = 0;
+			if (g_mime_stream_reset (current->stream) == -1)
+				break;
+		}
+	} while (current != NULL);
+	
+	g_free (rest);
+	
+	stream->position += nwritten;
+	
+	cat->current = current;
+	
+	if (n == -1 && nwritten == 0)
+		return -1;
+	
+	return nwritten;
+}
+
 static int
 stream_flush (GMimeStream *stream)
 {
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "gmime-stream-filter.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -45,7 +46,7 @@
 
 
 #define READ_PAD (64)		/* bytes padded before buffer */
-#define READ_SIZE (4096)
+#define READ_SIZE (32768)	/* default number of bytes to read at a time */
 
 #define _PRIVATE(o) (((GMimeStreamFilter *)(o))->priv)
 
@@ -60,7 +61,9 @@ struct _GMimeStreamFilterPrivate {
 	int filterid;		/* next filter id */
 	
 	char *realbuffer;	/* buffer - READ_PAD */
-	char *buffer;		/* READ_SIZE bytes */
+	char *buffer;		/* buflen bytes */
+	size_t buflen;
+	size_t readsize;	/* number of bytes to read at a time */
 	
 	char *filtered;		/* the filtered data */
 	size_t filteredlen;
@@ -142,8 +145,10 @@ g_mime_stream_filter_init (GMimeStreamFilter *stream, GMimeStreamFilterClass *kl
 	stream->priv = g_new (struct _GMimeStreamFilterPrivate, 1);
 	stream->priv->filters = NULL;
 	stream->priv->filterid = 0;
-	stream->priv->realbuffer = g_malloc (READ_SIZE + READ_PAD);
-	stream->priv->buffer = stream->priv->realbuffer + READ_PAD;
+	stream->priv->realbuffer = NULL;
+	stream->priv->buffer = NULL;
+	stream->priv->buflen = 0;
+	stream->priv->readsize = READ_SIZE;
 	stream->priv->last_was_read = TRUE;
 	stream->priv->filteredlen = 0;
 	stream->priv->flushed = FALSE;
@@ -174,20 +179,54 @@ g_mime_stream_filter_finalize (GObject *object)
 }
 
 
+/* checks whether every filter in the chain can filter a buffer in place */
+static gboolean
+filters_in_place (struct _filter *f)
+{
+	while (f != NULL) {
+		if (!(g_mime_filter_get_flags (f->filter) & (GMIME_FILTER_FLAGS_PASS_THROUGH | GMIME_FILTER_FLAGS_IN_PLACE)))
+			return FALSE;
+		
+		f = f->next;
+	}
+	
+	return TRUE;
+}
+
 static ssize_t
 stream_read (GMimeStream *stream, char *buf, size_t n)
 {
 	GMimeStreamFilter *filter = (GMimeStreamFilter *) stream;
 	struct _GMimeStreamFilterPrivate *priv = filter->priv;
+	gboolean direct = FALSE;
 	struct _filter *f;
 	ssize_t nread;
 	
 	priv->last_was_read = TRUE;
 	
 	if (priv->filteredlen <= 0) {
+		/* the read buffer is ours, so filters that can work in
+		 * place may reuse it rather than copying into their own */
+		gboolean writable = TRUE;
 		size_t presize = READ_PAD;
 		
-		nread = g_mime_stream_read (filter->source, priv->buffer, READ_SIZE);
+		if (priv->buflen != priv->readsize) {
+			g_free (priv->realbuffer);
+			priv->realbuffer = g_malloc (priv->readsize + READ_PAD);
+			priv->buffer = priv->realbuffer + READ_PAD;
+			priv->buflen = priv->readsize;
+		}
+		
+		/* if the caller wants more than we would read anyway and
+		 * the filters can all work in place, read and filter the
+		 * data in the caller's buffer rather than in ours */
+		if (n >= priv->readsize + READ_PAD && filters_in_place (priv->filters)) {
+			nread = g_mime_stream_read (filter->source, buf + READ_PAD, n - READ_PAD);
+			direct = nread > 0;
+		} else {
+			nread = g_mime_stream_read (filter->source, priv->buffer, priv->readsize);
+		}
+		
 		if (nread <= 0) {
 			/* this is somewhat untested */
 			if (g_mime_stream_eos (filter->source) && !priv->flushed) {
@@ -196,9 +235,9 @@ stream_read (GMimeStream *stream, char *buf, size_t n)
 				f = priv->filters;
 				
 				while (f != NULL) {
-					g_mime_filter_complete (f->filter, priv->filtered, priv->filteredlen,
-								presize, &priv->filtered, &priv->filteredlen,
-								&presize);
+					_g_mime_filter_run (f->filter, TRUE, priv->filtered, priv->filteredlen,
+							    presize, &writable, &priv->filtered, &priv->filteredlen,
+							    &presize);
 					f = f->next;
 				}
 				
@@ -209,17 +248,27 @@ stream_read (GMimeStream *stream, char *buf, size_t n)
 			if (nread <= 0)
 				return nread;
 		} else {
-			priv->filtered = priv->buffer;
+			priv->filtered = direct ? buf + READ_PAD : priv->buffer;
 			priv->filteredlen = nread;
 			priv->flushed = FALSE;
 			f = priv->filters;
 			
 			while (f != NULL) {
-				g_mime_filter_filter (f->filter, priv->filtered, priv->filteredlen, presize,
-						      &priv->filtered, &priv->filteredlen, &presize);
+				_g_mime_filter_run (f->filter, FALSE, priv->filtered, priv->filteredlen, presize,
+						    &writable, &priv->filtered, &priv->filteredlen, &presize);
 				
 				f = f->next;
 			}
+			
+			if (direct && priv->filtered >= buf && priv->filtered < buf + n) {
+				/* the output was filtered in place and so is
+				 * guaranteed to fit in the caller's buffer */
+				nread = priv->filteredlen;
+				memmove (buf, priv->filtered, nread);
+				priv->filteredlen = 0;
+				
+				return nread;
+			}
 		}
 	}
 	
@@ -392,6 +441,8 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 		sub->priv->filterid = filter->priv->filterid;
 	}
 	
+	sub->priv->readsize = filter->priv->readsize;
+	
 	g_mime_stream_construct (GMIME_STREAM (filter), start, end);
 	
 	return GMIME_STREAM (sub);
@@ -497,3 +548,45 @@ g_mime_stream_filter_remove (GMimeStreamFilter *stream, int id)
 		f = f->next;
 	}
 }
+
+
+/**
+ * g_mime_stream_filter_set_read_size:
+ * @stream: a #GMimeStreamFilter
+ * @size: the number of bytes to read at a time
+ *
+ * Sets the number of bytes that @stream reads from its source stream
+ * at a time when it is read from. Larger sizes mean fewer calls into
+ * the filters, at the cost of a larger buffer.
+ *
+ * Reads that ask for more than this many bytes are filtered directly
+ * in the caller's buffer when all of the filters can filter in place
+ * (see #GMimeFilterFlags).
+ **/
+void
+g_mime_stream_filter_set_read_size (GMimeStreamFilter *stream, size_t size)
+{
+	g_return_if_fail (GMIME_IS_STREAM_FILTER (stream));
+	g_return_if_fail (size > 0);
+	
+	/* the buffer gets resized on the next read that needs it */
+	stream->priv->readsize = size;
+}
+
+
+/**
+ * g_mime_stream_filter_get_read_size:
+ * @stream: a #GMimeStreamFilter
+ *
+ * Gets the number of bytes that @stream reads from its source stream
+ * at a time.
+ *
+ * Returns: the read size of @stream.
+ **/
+size_t
+g_mime_stream_filter_get_read_size (GMimeStreamFilter *stream)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM_FILTER (stream), 0);
+	
+	return stream->priv->readsize;
+}
@@ -32,6 +32,11 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#include <limits.h>
+#endif
+
 #include "gmime-stream-fs.h"
 
 #ifndef HAVE_FSYNC
@@ -44,6 +49,10 @@ static int fsync (int fd) { return 0; }
 #endif
 #endif
 
+#if defined (HAVE_SYS_UIO_H) && !defined (IOV_MAX)
+#define IOV_MAX 16
+#endif
+
 
 /**
  * SECTION: gmime-stream-fs
@@ -70,6 +79,10 @@ static gint64 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence w
 static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
+#ifdef HAVE_SYS_UIO_H
+static gint64 stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+static gint64 stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+#endif
 
 
 static GMimeStreamClass *parent_class = NULL;
@@ -120,6 +133,10 @@ g_mime_stream_fs_class_init (GMimeStreamFsClass *klass)
 	stream_class->tell = stream_tell;
 	stream_class->length = stream_length;
 	stream_class->substream = stream_substream;
+#ifdef HAVE_SYS_UIO_H
+	stream_class->readv = stream_readv;
+	stream_class->writev = stream_writev;
+#endif
 }
 
 static void
@@ -221,6 +238,129 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	return nwritten;
 }
 
+#ifdef HAVE_SYS_UIO_H
+/* fills @iov with up to @max bytes of @vector, starting @offset bytes into the first block */
+static int
+iovec_init (struct iovec *iov, GMimeStreamIOVector *vector, size_t count, size_t offset, gint64 max)
+{
+	size_t len, i;
+	int n = 0;
+	
+	for (i = 0; i < count && n < IOV_MAX && max > 0; i++, offset = 0) {
+		if ((len = vector[i].len - offset) == 0)
+			continue;
+		
+		len = (size_t) MIN ((gint64) len, max);
+		iov[n].iov_base = (char *) vector[i].data + offset;
+		iov[n].iov_len = len;
+		max -= len;
+		n++;
+	}
+	
+	return n;
+}
+
+static gint64
+stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamFs *fs = (GMimeStreamFs *) stream;
+	struct iovec iov[IOV_MAX];
+	gint64 max = G_MAXINT64;
+	ssize_t nread;
+	int n;
+	
+	if (fs->fd == -1) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1 && stream->position >= stream->bound_end) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1)
+		max = stream->bound_end - stream->position;
+	
+	if ((n = iovec_init (iov, vector, count, 0, max)) == 0)
+		return 0;
+	
+	/* make sure we are at the right position */
+	lseek (fs->fd, (off_t) stream->position, SEEK_SET);
+	
+	do {
+		nread = readv (fs->fd, iov, n);
+	} while (nread == -1 && errno == EINTR);
+	
+	if (nread > 0) {
+		stream->position += nread;
+	} else if (nread == 0) {
+		fs->eos = TRUE;
+	}
+	
+	return nread;
+}
+
+static gint64
+stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamFs *fs = (GMimeStreamFs *) stream;
+	struct iovec iov[IOV_MAX];
+	gint64 max = G_MAXINT64;
+	gint64 nwritten = 0;
+	size_t offset = 0;
+	ssize_t n = 0;
+	int niov;
+	
+	if (fs->fd == -1) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1 && stream->position >= stream->bound_end) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1)
+		max = stream->bound_end - stream->position;
+	
+	/* make sure we are at the right position */
+	lseek (fs->fd, (off_t) stream->position, SEEK_SET);
+	
+	while ((niov = iovec_init (iov, vector, count, offset, max - nwritten)) > 0) {
+		do {
+			n = writev (fs->fd, iov, niov);
+		} while (n == -1 && (errno == EINTR || errno == EAGAIN));
+		
+		if (n <= 0)
+			break;
+		
+		nwritten += n;
+		
+		/* skip over the blocks that have been written */
+		offset += n;
+		while (count > 0 && offset >= vector->len) {
+			offset -= vector->len;
+			vector++;
+			count--;
+		}
+	}
+	
+	if (n == -1 && (errno == EFBIG || errno == ENOSPC))
+		fs->eos = TRUE;
+	
+	stream->position += nwritten;
+	
+	/* unlike write(), a failed writev() can't report a partial
+	 * write because the caller can't tell which blocks made it */
+	if (n == -1)
+		return -1;
+	
+	return nwritten;
+}
+#endif /* HAVE_SYS_UIO_H */
+
 static int
 stream_flush (GMimeStream *stream)
 {
@@ -54,6 +54,8 @@ static gint64 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence w
 static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
+static gint64 stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+static gint64 stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 
 
 static GMimeStreamClass *parent_class = NULL;
@@ -104,6 +106,8 @@ g_mime_stream_mem_class_init (GMimeStreamMemClass *klass)
 	stream_class->tell = stream_tell;
 	stream_class->length = stream_length;
 	stream_class->substream = stream_substream;
+	stream_class->readv = stream_readv;
+	stream_class->writev = stream_writev;
 }
 
 static void
@@ -183,6 +187,74 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	return n;
 }
 
+static gint64
+stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamMem *mem = (GMimeStreamMem *) stream;
+	gint64 bound_end, nread = 0;
+	size_t n, i;
+	
+	if (mem->buffer == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	bound_end = stream->bound_end != -1 ? stream->bound_end : (gint64) mem->buffer->len;
+	
+	if (bound_end < stream->position) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	for (i = 0; i < count && stream->position < bound_end; i++) {
+		n = (size_t) MIN (bound_end - stream->position, (gint64) vector[i].len);
+		memcpy (vector[i].data, mem->buffer->data + stream->position, n);
+		stream->position += n;
+		nread += n;
+	}
+	
+	return nread;
+}
+
+static gint64
+stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	GMimeStreamMem *mem = (GMimeStreamMem *) stream;
+	gint64 bound_end, nwritten = 0;
+	size_t len = 0, n, i;
+	
+	if (mem->buffer == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	if (stream->bound_end == -1) {
+		/* grow the buffer once for all of the blocks */
+		for (i = 0; i < count; i++)
+			len += vector[i].len;
+		
+		if (stream->position + len > mem->buffer->len)
+			g_byte_array_set_size (mem->buffer, (guint) stream->position + len);
+		
+		bound_end = mem->buffer->len;
+	} else
+		bound_end = stream->bound_end;
+	
+	if (bound_end < stream->position) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	for (i = 0; i < count && stream->position < bound_end; i++) {
+		n = (size_t) MIN (bound_end - stream->position, (gint64) vector[i].len);
+		memcpy (mem->buffer->data + stream->position, vector[i].data, n);
+		stream->position += n;
+		nwritten += n;
+	}
+	
+	return nwritten;
+}
+
 static int
 stream_flush (GMimeStream *stream)
 {
@@ -57,6 +57,8 @@ static gint64 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence w
 static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
+static gint64 stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+static gint64 stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 
 
 static GObjectClass *parent_class = NULL;
@@ -107,6 +109,8 @@ g_mime_stream_class_init (GMimeStreamClass *klass)
 	klass->tell = stream_tell;
 	klass->length = stream_length;
 	klass->substream = stream_substream;
+	klass->readv = stream_readv;
+	klass->writev = stream_writev;
 }
 
 static void
@@ -570,24 +574,56 @@ g_mime_stream_write_to_stream (GMimeStream *src, GMimeStream *dest)
 }
 
 
+static gint64
+stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	gint64 total = 0;
+	ssize_t n;
+	size_t i;
+	
+	for (i = 0; i < count; i++) {
+		if ((n = g_mime_stream_read (stream, vector[i].data, vector[i].len)) == -1)
+			return total > 0 ? total : -1;
+		
+		total += n;
+		
+		/* stop at the first short read, just like read() would */
+		if ((size_t) n < vector[i].len)
+			break;
+	}
+	
+	return total;
+}
+
+
 /**
- * g_mime_stream_writev:
+ * g_mime_stream_readv:
  * @stream: a #GMimeStream
  * @vector: a #GMimeStreamIOVector
  * @count: number of vector elements
  *
- * Writes at most @count blocks described by @vector to @stream.
+ * Attempts to read into the @count blocks described by @vector, in
+ * order, from @stream. Like g_mime_stream_read(), this may read less
+ * than the total length of the blocks.
  *
- * Returns: the number of bytes written or %-1 on fail.
+ * Returns: the number of bytes read or %-1 on fail.
  **/
 gint64
-g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+g_mime_stream_readv (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (vector != NULL || count == 0, -1);
+	
+	return GMIME_STREAM_GET_CLASS (stream)->readv (stream, vector, count);
+}
+
+
+static gint64
+stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
 {
 	gint64 total = 0;
 	size_t i;
 	
-	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
-	
 	for (i = 0; i < count; i++) {
 		char *buffer = vector[i].data;
 		size_t nwritten = 0;
@@ -598,6 +634,11 @@ g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t c
 						      vector[i].len - nwritten)) < 0)
 				return -1;
 			
+			if (n == 0) {
+				/* the stream is full */
+				return total + nwritten;
+			}
+			
 			nwritten += n;
 		}
 		
@@ -606,3 +647,27 @@ g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t c
 	
 	return total;
 }
+
+
+/**
+ * g_mime_stream_writev:
+ * @stream: a #GMimeStream
+ * @vector: a #GMimeStreamIOVector
+ * @count: number of vector elements
+ *
+ * Writes at most @count blocks described by @vector to @stream.
+ *
+ * Streams that can write several blocks at once (such as
+ * #GMimeStreamFs, using writev()) do so, which makes this much
+ * cheaper than writing each block with g_mime_stream_write().
+ *
+ * Returns: the number of bytes written or %-1 on fail.
+ **/
+gint64
+g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (vector != NULL || count == 0, -1);
+	
+	return GMIME_STREAM_GET_CLASS (stream)->writev (stream, vector, count);
+}
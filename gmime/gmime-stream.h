@@ -62,7 +62,8 @@ typedef enum {
  * @data: data to pass to the I/O function.
  * @len: length of the data, in bytes.
  *
- * An I/O vector for use with g_mime_stream_writev().
+ * An I/O vector for use with g_mime_stream_readv() and
+ * g_mime_stream_writev().
  **/
 typedef struct {
 	void *data;
@@ -104,6 +105,9 @@ struct _GMimeStreamClass {
 	gint64   (* tell)   (GMimeStream *stream);
 	gint64   (* length) (GMimeStream *stream);
 	GMimeStream * (* substream) (GMimeStream *stream, gint64 start, gint64 end);
+	
+	gint64   (* readv)  (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
+	gint64   (* writev) (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 };
 
 
@@ -132,6 +136,7 @@ ssize_t   g_mime_stream_printf       (GMimeStream *stream, const char *fmt, ...)
 
 gint64    g_mime_stream_write_to_stream (GMimeStream *src, GMimeStream *dest);
 
+gint64    g_mime_stream_readv  (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 gint64    g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 
 G_END_DECLS
@@ -58,6 +58,8 @@
 #include "gmime-charset.h"
 #include "gmime-iconv.h"
 #include "gmime-iconv-utils.h"
+#include "gmime-charset-native.h"
+#include "gmime-charset-detect.h"
 
 #ifdef ENABLE_WARNINGS
 #define w(x) x
@@ -1345,45 +1347,35 @@ g_mime_utils_best_encoding (const unsigned char *text, size_t len)
 
 /**
  * charset_convert:
+ * @native: the native charset to convert from or
+ *   %GMIME_CHARSET_NATIVE_NONE to use @cd
  * @cd: iconv converter
  * @inbuf: input text buffer to convert
  * @inleft: length of the input buffer
- * @outp: pointer to output buffer
- * @outlenp: pointer to output buffer length
- * @ninval: the number of invalid bytes in @inbuf
+ * @out: the string to append the converted text to
  *
  * Converts the input buffer from one charset to another using the
- * @cd. On completion, @outp will point to the output buffer
- * containing the converted text (nul-terminated), @outlenp will be
- * the size of the @outp buffer (note: not the strlen() of @outp) and
- * @ninval will contain the number of bytes which could not be
- * converted.
+ * @cd, appending the converted text directly to @out.
  *
  * Bytes which cannot be converted from @inbuf will appear as '?'
- * characters in the output buffer.
- *
- * If *@outp is non-NULL, then it is assumed that it points to a
- * pre-allocated buffer of length *@outlenp. This is done so that the
- * same output buffer can be reused multiple times.
+ * characters in @out.
  *
- * Returns: the string length of the output buffer.
+ * Returns: the number of bytes in @inbuf which could not be
+ * converted.
  **/
 static size_t
-charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size_t *outlenp, size_t *ninval)
+charset_convert (GMimeCharsetNative native, iconv_t cd, const char *inbuf, size_t inleft, GString *out)
 {
-	size_t outlen, outleft, rc, n = 0;
-	char *outbuf, *out;
+	size_t offset, outleft, rc, n = 0;
+	char *outbuf;
 	
-	if (*outp == NULL) {
-		outleft = outlen = (inleft * 2) + 16;
-		outbuf = out = g_malloc (outlen + 1);
-	} else {
-		outleft = outlen = *outlenp;
-		outbuf = out = *outp;
-	}
+	offset = out->len;
+	outleft = (inleft * 2) + 16;
+	g_string_set_size (out, offset + outleft);
+	outbuf = out->str + offset;
 	
 	do {
-		rc = iconv (cd, (char **) &inbuf, &inleft, &outbuf, &outleft);
+		rc = g_mime_charset_convert (native, cd, (char **) &inbuf, &inleft, &outbuf, &outleft);
 		if (rc == (size_t) -1) {
 			if (errno == EINVAL) {
 				/* incomplete sequence at the end of the input buffer */
@@ -1400,11 +1392,10 @@ charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size
 			
 			if (errno == E2BIG || outleft == 0) {
 				/* need to grow the output buffer */
-				outlen += (inleft * 2) + 16;
-				rc = (size_t) (outbuf - out);
-				out = g_realloc (out, outlen + 1);
-				outleft = outlen - rc;
-				outbuf = out + rc;
+				offset = (size_t) (outbuf - out->str);
+				g_string_set_size (out, out->len + (inleft * 2) + 16);
+				outleft = out->len - offset;
+				outbuf = out->str + offset;
 			}
 			
 			/* Note: GnuWin32's libiconv 1.9 can also set errno to ERANGE
@@ -1423,24 +1414,81 @@ charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size
 		}
 	} while (inleft > 0);
 	
-	while (iconv (cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+	while (g_mime_charset_convert (native, cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
 		if (errno != E2BIG)
 			break;
 		
-		outlen += 16;
-		rc = (size_t) (outbuf - out);
-		out = g_realloc (out, outlen + 1);
-		outleft = outlen - rc;
-		outbuf = out + rc;
+		offset = (size_t) (outbuf - out->str);
+		g_string_set_size (out, out->len + 16);
+		outleft = out->len - offset;
+		outbuf = out->str + offset;
 	}
 	
-	*outbuf = '\0';
+	g_string_truncate (out, (size_t) (outbuf - out->str));
 	
-	*outlenp = outlen;
-	*outp = out;
-	*ninval = n;
+	return n;
+}
+
+
+static void
+decode_8bit_append (GMimeParserOptions *options, const char *text, size_t len, GString *out)
+{
+	GMimeCharsetDetector *detector;
+	GMimeCharsetNative native;
+	iconv_t cd = (iconv_t) -1;
+	const char *inptr, *inend;
+	const char *charset;
+	size_t offset, ninval;
+	gboolean exact;
+	char *outbuf;
+	
+	detector = g_mime_charset_detector_new (g_mime_parser_options_get_fallback_charsets (options));
+	g_mime_charset_detector_step (detector, text, len);
+	offset = out->len;
+	
+	/* if none of the charsets fit the 8bit text flawlessly, this
+	 * converts from the one that fit the best, replacing any byte
+	 * we can't convert with a '?' */
+	while ((charset = g_mime_charset_detector_best (detector, &exact))) {
+		native = g_mime_charset_native (charset);
+		
+		if (!native && (cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1) {
+			g_mime_charset_detector_reject (detector, charset, (size_t) -1);
+			continue;
+		}
+		
+		ninval = charset_convert (native, cd, text, len, out);
+		
+		if (!native)
+			g_mime_iconv_close (cd);
+		
+		if (ninval == 0 || exact) {
+			g_mime_charset_detector_free (detector);
+			return;
+		}
+		
+		/* the detector can't tell which code points a multibyte
+		 * charset leaves unassigned, so it may fit less well
+		 * than it seemed to */
+		g_mime_charset_detector_reject (detector, charset, ninval);
+		g_string_truncate (out, offset);
+	}
 	
-	return (outbuf - out);
+	g_mime_charset_detector_free (detector);
+	
+	/* this shouldn't happen... but if we are here, then none of
+	 * the charsets could be converted from... the only thing we
+	 * can do at this point is replace the 8bit garbage and pray */
+	g_string_set_size (out, offset + len);
+	outbuf = out->str + offset;
+	inend = text + len;
+	
+	for (inptr = text; inptr < inend; inptr++) {
+		if (is_ascii (*inptr))
+			*outbuf++ = *inptr;
+		else
+			*outbuf++ = '?';
+	}
 }
 
 
@@ -1456,73 +1504,22 @@ charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size
  * it will choose the best match and convert invalid byte sequences
  * into question-marks (?) in the returned string buffer.
  *
+ * The candidate charsets are all scored in a single pass over @text,
+ * so normally only the chosen charset is converted from.
+ *
  * Returns: a UTF-8 string representation of @text.
  **/
 char *
 g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, size_t len)
 {
-	size_t outleft, outlen, min, ninval;
-	const char *best;
-	iconv_t cd;
-	char *out;
-	int i;
+	GString *out;
 	
 	g_return_val_if_fail (text != NULL, NULL);
 	
-	best = options->charsets[0];
-	min = len;
-	
-	outleft = (len * 2) + 16;
-	out = g_malloc (outleft + 1);
-	
-	for (i = 0; options->charsets[i]; i++) {
-		if ((cd = g_mime_iconv_open ("UTF-8", options->charsets[i])) == (iconv_t) -1)
-			continue;
-		
-		outlen = charset_convert (cd, text, len, &out, &outleft, &ninval);
-		
-		g_mime_iconv_close (cd);
-		
-		if (ninval == 0)
-			return g_realloc (out, outlen + 1);
-		
-		if (ninval < min) {
-			best = options->charsets[i];
-			min = ninval;
-		}
-	}
+	out = g_string_sized_new ((len * 2) + 16);
+	decode_8bit_append (options, text, len, out);
 	
-	/* if we get here, then none of the charsets fit the 8bit text flawlessly...
-	 * try to find the one that fit the best and use that to convert what we can,
-	 * replacing any byte we can't convert with a '?' */
-	
-	if ((cd = g_mime_iconv_open ("UTF-8", best)) == (iconv_t) -1) {
-		/* this shouldn't happen... but if we are here, then
-		 * it did...  the only thing we can do at this point
-		 * is replace the 8bit garbage and pray */
-		register const char *inptr = text;
-		const char *inend = inptr + len;
-		char *outbuf = out;
-		
-		while (inptr < inend) {
-			if (is_ascii (*inptr))
-				*outbuf++ = *inptr;
-			else
-				*outbuf++ = '?';
-			
-			inptr++;
-		}
-		
-		*outbuf++ = '\0';
-		
-		return g_realloc (out, (size_t) (outbuf - out));
-	}
-	
-	outlen = charset_convert (cd, text, len, &out, &outleft, &ninval);
-	
-	g_mime_iconv_close (cd);
-	
-	return g_realloc (out, outlen + 1);
+	return g_string_free (out, FALSE);
 }
 
 
@@ -1654,8 +1651,7 @@ is_rfc2047_token (const char *inptr, size_t len)
 #endif
 
 
-typedef struct _rfc2047_token {
-	struct _rfc2047_token *next;
+typedef struct {
 	const char *charset;
 	const char *text;
 	size_t length;
@@ -1663,25 +1659,70 @@ typedef struct _rfc2047_token {
 	char is_8bit;
 } rfc2047_token;
 
-#define rfc2047_token_list_free(tokens) g_slice_free_chain (rfc2047_token, tokens, next)
-#define rfc2047_token_free(token) g_slice_free (rfc2047_token, token)
+/* enough for all but the longest of headers */
+#define RFC2047_PREALLOC_TOKENS 32
+
+/* the tokens of a header, kept on the stack unless there are too many of them */
+typedef struct {
+	rfc2047_token *tokens;
+	size_t len, size;
+	
+	/* the most recent encoded-word charset, as written and as looked up */
+	const char *charset_name;
+	size_t charset_len;
+	const char *charset;
+	
+	rfc2047_token prealloc[RFC2047_PREALLOC_TOKENS];
+} rfc2047_token_list;
+
+static void
+rfc2047_token_list_init (rfc2047_token_list *list)
+{
+	list->tokens = list->prealloc;
+	list->size = RFC2047_PREALLOC_TOKENS;
+	list->len = 0;
+	
+	list->charset_name = NULL;
+	list->charset_len = 0;
+	list->charset = NULL;
+}
+
+static void
+rfc2047_token_list_clear (rfc2047_token_list *list)
+{
+	if (list->tokens != list->prealloc)
+		g_free (list->tokens);
+}
 
 static rfc2047_token *
-rfc2047_token_new (const char *text, size_t len)
+rfc2047_token_list_append (rfc2047_token_list *list, const char *text, size_t len)
 {
 	rfc2047_token *token;
 	
-	token = g_slice_new0 (rfc2047_token);
+	if (list->len == list->size) {
+		list->size *= 2;
+		
+		if (list->tokens == list->prealloc) {
+			list->tokens = g_new (rfc2047_token, list->size);
+			memcpy (list->tokens, list->prealloc, sizeof (list->prealloc));
+		} else {
+			list->tokens = g_renew (rfc2047_token, list->tokens, list->size);
+		}
+	}
+	
+	token = &list->tokens[list->len++];
+	token->charset = NULL;
 	token->length = len;
 	token->text = text;
+	token->encoding = 0;
+	token->is_8bit = 0;
 	
 	return token;
 }
 
-static rfc2047_token *
-rfc2047_token_new_encoded_word (const char *word, size_t len)
+static gboolean
+rfc2047_token_list_parse_encoded_word (rfc2047_token_list *list, rfc2047_token *token, const char *word, size_t len)
 {
-	rfc2047_token *token;
 	const char *payload;
 	const char *charset;
 	const char *inptr;
@@ -1691,7 +1732,7 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
 	
 	/* check that this could even be an encoded-word token */
 	if (len < 7 || strncmp (word, "=?", 2) != 0 || strncmp (word + len - 2, "?=", 2) != 0)
-		return NULL;
+		return FALSE;
 	
 	/* skip over '=?' */
 	inptr = word + 2;
@@ -1699,37 +1740,21 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
 	
 	if (*charset == '?' || *charset == '*') {
 		/* this would result in an empty charset */
-		return NULL;
+		return FALSE;
 	}
 	
 	/* skip to the end of the charset */
 	if (!(inptr = memchr (inptr, '?', len - 2)) || inptr[2] != '?')
-		return NULL;
+		return FALSE;
 	
-	/* copy the charset into a buffer */
 	n = (size_t) (inptr - charset);
-	buf = g_alloca (n + 1);
-	memcpy (buf, charset, n);
-	buf[n] = '\0';
-	charset = buf;
-	
-	/* rfc2231 updates rfc2047 encoded words...
-	 * The ABNF given in RFC 2047 for encoded-words is:
-	 *   encoded-word := "=?" charset "?" encoding "?" encoded-text "?="
-	 * This specification changes this ABNF to:
-	 *   encoded-word := "=?" charset ["*" language] "?" encoding "?" encoded-text "?="
-	 */
-	
-	/* trim off the 'language' part if it's there... */
-	if ((lang = strchr (charset, '*')))
-		*lang = '\0';
 	
 	/* skip over the '?' */
 	inptr++;
 	
 	/* make sure the first char after the encoding is another '?' */
 	if (inptr[1] != '?')
-		return NULL;
+		return FALSE;
 	
 	switch (*inptr++) {
 	case 'B': case 'b':
@@ -1739,7 +1764,7 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
 		encoding = 'Q';
 		break;
 	default:
-		return NULL;
+		return FALSE;
 	}
 	
 	/* the payload begins right after the '?' */
@@ -1750,43 +1775,71 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
 	
 	/* make sure that we don't have something like: =?iso-8859-1?Q?= */
 	if (payload > inptr)
-		return NULL;
+		return FALSE;
 	
-	token = rfc2047_token_new (payload, inptr - payload);
-	token->charset = g_mime_charset_iconv_name (charset);
+	token->charset = NULL;
+	token->text = payload;
+	token->length = inptr - payload;
 	token->encoding = encoding;
+	token->is_8bit = 0;
 	
-	return token;
+	/* the encoded-words in a header nearly always share a charset */
+	if (list->charset_name != NULL && list->charset_len == n && !strncmp (list->charset_name, charset, n)) {
+		token->charset = list->charset;
+		return TRUE;
+	}
+	
+	/* copy the charset into a buffer */
+	buf = g_alloca (n + 1);
+	memcpy (buf, charset, n);
+	buf[n] = '\0';
+	
+	/* rfc2231 updates rfc2047 encoded words...
+	 * The ABNF given in RFC 2047 for encoded-words is:
+	 *   encoded-word := "=?" charset "?" encoding "?" encoded-text "?="
+	 * This specification changes this ABNF to:
+	 *   encoded-word := "=?" charset ["*" language] "?" encoding "?" encoded-text "?="
+	 */
+	
+	/* trim off the 'language' part if it's there... */
+	if ((lang = strchr (buf, '*')))
+		*lang = '\0';
+	
+	token->charset = g_mime_charset_iconv_name (buf);
+	
+	list->charset_name = charset;
+	list->charset_len = n;
+	list->charset = token->charset;
+	
+	return TRUE;
 }
 
-static rfc2047_token *
-tokenize_rfc2047_phrase (GMimeParserOptions *options, const char *in, size_t *len)
+static void
+tokenize_rfc2047_phrase (GMimeParserOptions *options, rfc2047_token_list *list, const char *in, size_t *len)
 {
-	rfc2047_token list, *lwsp, *token, *tail;
+	GMimeRfcComplianceMode mode = g_mime_parser_options_get_rfc2047_compliance_mode (options);
 	register const char *inptr = in;
 	gboolean encoded = FALSE;
 	const char *text, *word;
+	rfc2047_token *token;
+	rfc2047_token encword;
+	const char *lwsp;
+	size_t lwsplen;
 	gboolean ascii;
 	size_t n;
 	
-	tail = (rfc2047_token *) &list;
-	list.next = NULL;
-	lwsp = NULL;
-	
 	while (*inptr != '\0') {
 		text = inptr;
 		while (is_lwsp (*inptr))
 			inptr++;
 		
-		if (inptr > text)
-			lwsp = rfc2047_token_new (text, inptr - text);
-		else
-			lwsp = NULL;
+		lwsp = inptr > text ? text : NULL;
+		lwsplen = inptr - text;
 		
 		word = inptr;
 		ascii = TRUE;
 		if (is_atom (*inptr)) {
-			if (G_LIKELY (options->rfc2047 == GMIME_RFC_COMPLIANCE_LOOSE)) {
+			if (G_LIKELY (mode == GMIME_RFC_COMPLIANCE_LOOSE)) {
 				/* Make an extra effort to detect and
 				 * separate encoded-word tokens that
 				 * have been merged with other
@@ -1835,40 +1888,30 @@ tokenize_rfc2047_phrase (GMimeParserOptions *options, const char *in, size_t *le
 			}
 			
 			n = (size_t) (inptr - word);
-			if ((token = rfc2047_token_new_encoded_word (word, n))) {
+			if (rfc2047_token_list_parse_encoded_word (list, &encword, word, n)) {
 				/* rfc2047 states that you must ignore all
 				 * whitespace between encoded words */
-				if (!encoded && lwsp != NULL) {
-					tail->next = lwsp;
-					tail = lwsp;
-				} else if (lwsp != NULL) {
-					rfc2047_token_free (lwsp);
-				}
+				if (!encoded && lwsp != NULL)
+					rfc2047_token_list_append (list, lwsp, lwsplen);
 				
-				tail->next = token;
-				tail = token;
+				token = rfc2047_token_list_append (list, NULL, 0);
+				*token = encword;
 				
 				encoded = TRUE;
 			} else {
 				/* append the lwsp and atom tokens */
-				if (lwsp != NULL) {
-					tail->next = lwsp;
-					tail = lwsp;
-				}
+				if (lwsp != NULL)
+					rfc2047_token_list_append (list, lwsp, lwsplen);
 				
-				token = rfc2047_token_new (word, n);
+				token = rfc2047_token_list_append (list, word, n);
 				token->is_8bit = ascii ? 0 : 1;
-				tail->next = token;
-				tail = token;
 				
 				encoded = FALSE;
 			}
 		} else {
 			/* append the lwsp token */
-			if (lwsp != NULL) {
-				tail->next = lwsp;
-				tail = lwsp;
-			}
+			if (lwsp != NULL)
+				rfc2047_token_list_append (list, lwsp, lwsplen);
 			
 			ascii = TRUE;
 			while (*inptr && !is_lwsp (*inptr) && !is_atom (*inptr)) {
@@ -1877,50 +1920,43 @@ tokenize_rfc2047_phrase (GMimeParserOptions *options, const char *in, size_t *le
 			}
 			
 			n = (size_t) (inptr - word);
-			token = rfc2047_token_new (word, n);
+			token = rfc2047_token_list_append (list, word, n);
 			token->is_8bit = ascii ? 0 : 1;
 			
-			tail->next = token;
-			tail = token;
-			
 			encoded = FALSE;
 		}
 	}
 	
 	*len = (size_t) (inptr - in);
-	
-	return list.next;
 }
 
-static rfc2047_token *
-tokenize_rfc2047_text (GMimeParserOptions *options, const char *in, size_t *len)
+static void
+tokenize_rfc2047_text (GMimeParserOptions *options, rfc2047_token_list *list, const char *in, size_t *len)
 {
-	rfc2047_token list, *lwsp, *token, *tail;
+	GMimeRfcComplianceMode mode = g_mime_parser_options_get_rfc2047_compliance_mode (options);
 	register const char *inptr = in;
 	gboolean encoded = FALSE;
 	const char *text, *word;
+	rfc2047_token *token;
+	rfc2047_token encword;
+	const char *lwsp;
+	size_t lwsplen;
 	gboolean ascii;
 	size_t n;
 	
-	tail = (rfc2047_token *) &list;
-	list.next = NULL;
-	lwsp = NULL;
-	
 	while (*inptr != '\0') {
 		text = inptr;
 		while (is_lwsp (*inptr))
 			inptr++;
 		
-		if (inptr > text)
-			lwsp = rfc2047_token_new (text, inptr - text);
-		else
-			lwsp = NULL;
+		lwsp = inptr > text ? text : NULL;
+		lwsplen = inptr - text;
 		
 		if (*inptr != '\0') {
 			word = inptr;
 			ascii = TRUE;
 			
-			if (G_LIKELY (options->rfc2047 == GMIME_RFC_COMPLIANCE_LOOSE)) {
+			if (G_LIKELY (mode == GMIME_RFC_COMPLIANCE_LOOSE)) {
 				if (!strncmp (inptr, "=?", 2)) {
 					inptr += 2;
 					
@@ -1969,39 +2005,30 @@ tokenize_rfc2047_text (GMimeParserOptions *options, const char *in, size_t *len)
 			}
 			
 			n = (size_t) (inptr - word);
-			if ((token = rfc2047_token_new_encoded_word (word, n))) {
+			if (rfc2047_token_list_parse_encoded_word (list, &encword, word, n)) {
 				/* rfc2047 states that you must ignore all
 				 * whitespace between encoded words */
-				if (!encoded && lwsp != NULL) {
-					tail->next = lwsp;
-					tail = lwsp;
-				} else if (lwsp != NULL) {
-					rfc2047_token_free (lwsp);
-				}
+				if (!encoded && lwsp != NULL)
+					rfc2047_token_list_append (list, lwsp, lwsplen);
 				
-				tail->next = token;
-				tail = token;
+				token = rfc2047_token_list_append (list, NULL, 0);
+				*token = encword;
 				
 				encoded = TRUE;
 			} else {
 				/* append the lwsp and atom tokens */
-				if (lwsp != NULL) {
-					tail->next = lwsp;
-					tail = lwsp;
-				}
+				if (lwsp != NULL)
+					rfc2047_token_list_append (list, lwsp, lwsplen);
 				
-				token = rfc2047_token_new (word, n);
+				token = rfc2047_token_list_append (list, word, n);
 				token->is_8bit = ascii ? 0 : 1;
-				tail->next = token;
-				tail = token;
 				
 				encoded = FALSE;
 			}
 		} else {
 			if (lwsp != NULL) {
 				/* appending trailing lwsp */
-				tail->next = lwsp;
-				tail = lwsp;
+				rfc2047_token_list_append (list, lwsp, lwsplen);
 			}
 			
 			break;
@@ -2009,8 +2036,6 @@ tokenize_rfc2047_text (GMimeParserOptions *options, const char *in, size_t *len)
 	}
 	
 	*len = (size_t) (inptr - in);
-	
-	return list.next;
 }
 
 static size_t
@@ -2025,27 +2050,25 @@ rfc2047_token_decode (rfc2047_token *token, unsigned char *outbuf, int *state, g
 		return quoted_decode (inbuf, len, outbuf, state, save);
 }
 
-static char *
-rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_t buflen)
+static void
+rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token_list *list, GString *decoded)
 {
-	rfc2047_token *token, *next;
-	size_t outlen, ninval, len;
-	unsigned char *outptr;
-	const char *charset;
-	GByteArray *outbuf;
-	GString *decoded;
+	rfc2047_token *token, *next, *end;
+	GMimeCharsetNative native = GMIME_CHARSET_NATIVE_NONE;
+	const char *charset, *converting = NULL;
+	unsigned char scratch[256], *raw;
+	iconv_t cd = (iconv_t) -1;
+	size_t rawlen, len, offset;
 	char encoding;
 	guint32 save;
-	iconv_t cd;
 	int state;
 	char *str;
 	
-	decoded = g_string_sized_new (buflen + 1);
-	outbuf = g_byte_array_sized_new (76);
+	token = list->tokens;
+	end = token + list->len;
 	
-	token = tokens;
-	while (token != NULL) {
-		next = token->next;
+	while (token < end) {
+		next = token + 1;
 		
 		if (token->encoding) {
 			/* In order to work around broken mailers, we need to combine
@@ -2058,83 +2081,97 @@ rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_
 			save = 0;
 			
 			/* find the end of the run (and measure the buffer length we'll need) */
-			while (next && next->encoding == encoding && !strcmp (next->charset, charset)) {
+			while (next < end && next->encoding == encoding &&
+			       (next->charset == charset || !strcmp (next->charset, charset))) {
 				len += next->length;
-				next = next->next;
+				next++;
 			}
 			
-			/* make sure our temporary output buffer is large enough... */
-			if (len > outbuf->len)
-				g_byte_array_set_size (outbuf, len);
+			if (!g_ascii_strcasecmp (charset, "UTF-8")) {
+				/* UTF-8 is decoded straight into the output... */
+				offset = decoded->len;
+				g_string_set_size (decoded, offset + len);
+				raw = (unsigned char *) decoded->str + offset;
+			} else if (len > sizeof (scratch)) {
+				raw = g_malloc (len);
+			} else {
+				raw = scratch;
+			}
 			
 			/* base64 / quoted-printable decode each of the tokens... */
-			outptr = outbuf->data;
-			outlen = 0;
+			rawlen = 0;
 			do {
 				/* Note: by not resetting state/save each loop, we effectively
 				 * treat the payloads as one continuous block, thus allowing
 				 * us to handle cases where a hex-encoded triplet of a
 				 * quoted-printable encoded payload is split between 2 or more
 				 * encoded-word tokens. */
-				len = rfc2047_token_decode (token, outptr, &state, &save);
-				token = token->next;
-				outptr += len;
-				outlen += len;
+				rawlen += rfc2047_token_decode (token, raw + rawlen, &state, &save);
+				token++;
 			} while (token != next);
-			outptr = outbuf->data;
 			
 			/* convert the raw decoded text into UTF-8 */
 			if (!g_ascii_strcasecmp (charset, "UTF-8")) {
-				/* slight optimization over going thru iconv */
-				str = (char *) outptr;
-				len = outlen;
+				/* ...where any invalid bytes just get replaced */
+				g_string_truncate (decoded, offset + rawlen);
+				str = (char *) raw;
+				len = rawlen;
 				
 				while (!g_utf8_validate (str, len, (const char **) &str)) {
-					len = outlen - (str - (char *) outptr);
+					len = rawlen - (str - (char *) raw);
 					*str = '?';
 				}
 				
-				g_string_append_len (decoded, (char *) outptr, outlen);
-			} else if ((cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1) {
+				continue;
+			}
+			
+			/* a header's encoded-words nearly always share a charset, so
+			 * hold on to the converter until it is done with */
+			if (charset != converting) {
+				if (cd != (iconv_t) -1)
+					g_mime_iconv_close (cd);
+				
+				if (!(native = g_mime_charset_native (charset)))
+					cd = g_mime_iconv_open ("UTF-8", charset);
+				else
+					cd = (iconv_t) -1;
+				
+				converting = charset;
+			} else if (cd != (iconv_t) -1) {
+				iconv (cd, NULL, NULL, NULL, NULL);
+			}
+			
+			if (!native && cd == (iconv_t) -1) {
 				w(g_warning ("Cannot convert from %s to UTF-8, header display may "
 					     "be corrupt: %s", charset[0] ? charset : "unspecified charset",
 					     g_strerror (errno)));
 				
-				str = g_mime_utils_decode_8bit (options, (char *) outptr, outlen);
-				g_string_append (decoded, str);
-				g_free (str);
+				decode_8bit_append (options, (char *) raw, rawlen, decoded);
 			} else {
-				str = g_malloc (outlen + 1);
-				len = outlen;
-				
-				len = charset_convert (cd, (char *) outptr, outlen, &str, &len, &ninval);
-				g_mime_iconv_close (cd);
-				
-				g_string_append_len (decoded, str, len);
-				g_free (str);
-				
 #if w(!)0
-				if (ninval > 0) {
+				if (charset_convert (native, cd, (char *) raw, rawlen, decoded) > 0) {
 					g_warning ("Failed to completely convert \"%.*s\" to UTF-8, display may be "
-						   "corrupt: %s", outlen, (char *) outptr, g_strerror (errno));
+						   "corrupt: %s", rawlen, (char *) raw, g_strerror (errno));
 				}
+#else
+				charset_convert (native, cd, (char *) raw, rawlen, decoded);
 #endif
 			}
+			
+			if (raw != scratch)
+				g_free (raw);
 		} else if (token->is_8bit) {
 			/* *sigh* I hate broken mailers... */
-			str = g_mime_utils_decode_8bit (options, token->text, token->length);
-			g_string_append (decoded, str);
-			g_free (str);
+			decode_8bit_append (options, token->text, token->length, decoded);
+			token = next;
 		} else {
 			g_string_append_len (decoded, token->text, token->length);
+			token = next;
 		}
-		
-		token = next;
 	}
 	
-	g_byte_array_free (outbuf, TRUE);
-	
-	return g_string_free (decoded, FALSE);
+	if (cd != (iconv_t) -1)
+		g_mime_iconv_close (cd);
 }
 
 
@@ -2151,18 +2188,48 @@ rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_
 char *
 g_mime_utils_header_decode_text (GMimeParserOptions *options, const char *text)
 {
-	rfc2047_token *tokens;
-	char *decoded;
+	rfc2047_token_list list;
+	GString *decoded;
 	size_t len;
 	
 	if (text == NULL)
 		return g_strdup ("");
 	
-	tokens = tokenize_rfc2047_text (options, text, &len);
-	decoded = rfc2047_decode_tokens (options, tokens, len);
-	rfc2047_token_list_free (tokens);
+	rfc2047_token_list_init (&list);
+	tokenize_rfc2047_text (options, &list, text, &len);
+	decoded = g_string_sized_new (len + 1);
+	rfc2047_decode_tokens (options, &list, decoded);
+	rfc2047_token_list_clear (&list);
 	
-	return decoded;
+	return g_string_free (decoded, FALSE);
+}
+
+
+/**
+ * g_mime_utils_header_decode_text_append:
+ * @options: a #GMimeParserOptions
+ * @text: header text to decode
+ * @decoded: the string to append the decoded text to
+ *
+ * Decodes an rfc2047 encoded 'text' header like
+ * g_mime_utils_header_decode_text(), but appends the UTF-8 result to
+ * @decoded so that the same string can be reused for many headers.
+ **/
+void
+g_mime_utils_header_decode_text_append (GMimeParserOptions *options, const char *text, GString *decoded)
+{
+	rfc2047_token_list list;
+	size_t len;
+	
+	g_return_if_fail (decoded != NULL);
+	
+	if (text == NULL)
+		return;
+	
+	rfc2047_token_list_init (&list);
+	tokenize_rfc2047_text (options, &list, text, &len);
+	rfc2047_decode_tokens (options, &list, decoded);
+	rfc2047_token_list_clear (&list);
 }
 
 
@@ -2179,18 +2246,48 @@ g_mime_utils_header_decode_text (GMimeParserOptions *options, const char *text)
 char *
 g_mime_utils_header_decode_phrase (GMimeParserOptions *options, const char *phrase)
 {
-	rfc2047_token *tokens;
-	char *decoded;
+	rfc2047_token_list list;
+	GString *decoded;
 	size_t len;
 	
 	if (phrase == NULL)
 		return g_strdup ("");
 	
-	tokens = tokenize_rfc2047_phrase (options, phrase, &len);
-	decoded = rfc2047_decode_tokens (options, tokens, len);
-	rfc2047_token_list_free (tokens);
+	rfc2047_token_list_init (&list);
+	tokenize_rfc2047_phrase (options, &list, phrase, &len);
+	decoded = g_string_sized_new (len + 1);
+	rfc2047_decode_tokens (options, &list, decoded);
+	rfc2047_token_list_clear (&list);
 	
-	return decoded;
+	return g_string_free (decoded, FALSE);
+}
+
+
+/**
+ * g_mime_utils_header_decode_phrase_append:
+ * @options: a #GMimeParserOptions
+ * @phrase: header to decode
+ * @decoded: the string to append the decoded phrase to
+ *
+ * Decodes an rfc2047 encoded 'phrase' header like
+ * g_mime_utils_header_decode_phrase(), but appends the UTF-8 result
+ * to @decoded so that the same string can be reused for many headers.
+ **/
+void
+g_mime_utils_header_decode_phrase_append (GMimeParserOptions *options, const char *phrase, GString *decoded)
+{
+	rfc2047_token_list list;
+	size_t len;
+	
+	g_return_if_fail (decoded != NULL);
+	
+	if (phrase == NULL)
+		return;
+	
+	rfc2047_token_list_init (&list);
+	tokenize_rfc2047_phrase (options, &list, phrase, &len);
+	rfc2047_decode_tokens (options, &list, decoded);
+	rfc2047_token_list_clear (&list);
 }
 
 
@@ -2677,10 +2774,10 @@ g_mime_utils_header_encode_text (const char *text, const char *charset)
 
 
 static char *
-header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_token *tokens, gboolean structured)
+header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_token_list *tokens, gboolean structured)
 {
-	rfc2047_token *token, *next;
-	size_t lwsp, tab, len, n;
+	rfc2047_token *token;
+	size_t lwsp, tab, len, n, i;
 	gboolean encoded = FALSE;
 	GString *output;
 	
@@ -2691,8 +2788,9 @@ header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_t
 	lwsp = 0;
 	tab = 0;
 	
-	token = tokens;
-	while (token != NULL) {
+	for (i = 0; i < tokens->len; i++) {
+		token = &tokens->tokens[i];
+		
 		if (is_lwsp (token->text[0])) {
 			for (n = 0; n < token->length; n++) {
 				if (token->text[n] == '\r')
@@ -2711,7 +2809,7 @@ header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_t
 				}
 			}
 			
-			if (len == 0 && token->next) {
+			if (len == 0 && i + 1 < tokens->len) {
 				g_string_append_c (output, structured ? '\t' : ' ');
 				len = 1;
 			}
@@ -2789,12 +2887,10 @@ header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_t
 			lwsp = 0;
 			tab = 0;
 		}
-		
-		next = token->next;
-		rfc2047_token_free (token);
-		token = next;
 	}
 	
+	rfc2047_token_list_clear (tokens);
+	
 	if (output->str[output->len - 1] != '\n')
 		g_string_append_c (output, '\n');
 	
@@ -2814,7 +2910,7 @@ header_fold_tokens (const char *field, const char *value, size_t vlen, rfc2047_t
 char *
 g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *header)
 {
-	rfc2047_token *tokens;
+	rfc2047_token_list tokens;
 	const char *value;
 	char *folded;
 	char *field;
@@ -2836,8 +2932,9 @@ g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *he
 	while (*value && is_lwsp (*value))
 		value++;
 	
-	tokens = tokenize_rfc2047_phrase (options, value, &len);
-	folded = header_fold_tokens (field, value, len, tokens, TRUE);
+	rfc2047_token_list_init (&tokens);
+	tokenize_rfc2047_phrase (options, &tokens, value, &len);
+	folded = header_fold_tokens (field, value, len, &tokens, TRUE);
 	g_free (field);
 	
 	return folded;
@@ -2857,7 +2954,7 @@ g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *he
 char *
 _g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *field, const char *value)
 {
-	rfc2047_token *tokens;
+	rfc2047_token_list tokens;
 	size_t len;
 	
 	if (field == NULL)
@@ -2866,9 +2963,10 @@ _g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *f
 	if (value == NULL)
 		return g_strdup_printf ("%s: \n", field);
 	
-	tokens = tokenize_rfc2047_phrase (options, value, &len);
+	rfc2047_token_list_init (&tokens);
+	tokenize_rfc2047_phrase (options, &tokens, value, &len);
 	
-	return header_fold_tokens (field, value, len, tokens, TRUE);
+	return header_fold_tokens (field, value, len, &tokens, TRUE);
 }
 
 
@@ -2884,7 +2982,7 @@ _g_mime_utils_structured_header_fold (GMimeParserOptions *options, const char *f
 char *
 g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char *header)
 {
-	rfc2047_token *tokens;
+	rfc2047_token_list tokens;
 	const char *value;
 	char *folded;
 	char *field;
@@ -2906,8 +3004,9 @@ g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char *
 	while (*value && is_lwsp (*value))
 		value++;
 	
-	tokens = tokenize_rfc2047_text (options, value, &len);
-	folded = header_fold_tokens (field, value, len, tokens, FALSE);
+	rfc2047_token_list_init (&tokens);
+	tokenize_rfc2047_text (options, &tokens, value, &len);
+	folded = header_fold_tokens (field, value, len, &tokens, FALSE);
 	g_free (field);
 	
 	return folded;
@@ -2927,7 +3026,7 @@ g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char *
 char *
 _g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char *field, const char *value)
 {
-	rfc2047_token *tokens;
+	rfc2047_token_list tokens;
 	size_t len;
 	
 	if (field == NULL)
@@ -2936,9 +3035,10 @@ _g_mime_utils_unstructured_header_fold (GMimeParserOptions *options, const char
 	if (value == NULL)
 		return g_strdup_printf ("%s: \n", field);
 	
-	tokens = tokenize_rfc2047_text (options, value, &len);
+	rfc2047_token_list_init (&tokens);
+	tokenize_rfc2047_text (options, &tokens, value, &len);
 	
-	return header_fold_tokens (field, value, len, tokens, FALSE);
+	return header_fold_tokens (field, value, len, &tokens, FALSE);
 }
 
 
@@ -80,9 +80,11 @@ char *g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, s
 
 /* utilities to (de/en)code headers */
 char *g_mime_utils_header_decode_text (GMimeParserOptions *options, const char *text);
+void g_mime_utils_header_decode_text_append (GMimeParserOptions *options, const char *text, GString *decoded);
 char *g_mime_utils_header_encode_text (const char *text, const char *charset);
 
 char *g_mime_utils_header_decode_phrase (GMimeParserOptions *options, const char *phrase);
+void g_mime_utils_header_decode_phrase_append (GMimeParserOptions *options, const char *phrase, GString *decoded);
 char *g_mime_utils_header_encode_phrase (const char *phrase, const char *charset);
 
 G_END_DECLS
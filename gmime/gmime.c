@@ -32,6 +32,7 @@
 
 #include "gmime.h"
 #include "gmime-internal.h"
+#include "gmime-charset-detect.h"
 
 #ifdef ENABLE_CRYPTOGRAPHY
 #include "gmime-pkcs7-context.h"
@@ -116,9 +117,12 @@ g_mime_init (void)
 #endif
 	
 	g_mime_parser_options_init ();
+	g_mime_encodings_init ();
+	g_mime_header_init ();
 	g_mime_charset_map_init ();
 	g_mime_iconv_utils_init ();
 	g_mime_iconv_init ();
+	g_mime_charset_detect_init ();
 	
 #ifdef ENABLE_CRYPTO
 	/* gpgme_check_version() initializes GpgMe */
@@ -128,9 +132,12 @@ g_mime_init (void)
 	gmime_gpgme_error_quark = g_quark_from_static_string ("gmime-gpgme");
 	gmime_error_quark = g_quark_from_static_string ("gmime");
 	
-	g_boxed_type_register_static ("GMimeReferences",
-				      (GBoxedCopyFunc) g_mime_references_copy,
-				      (GBoxedFreeFunc) g_mime_references_free);
+	/* types can't be unregistered, so this is still around if
+	 * GMime has been initialized before */
+	if (g_type_from_name ("GMimeReferences") == 0)
+		g_boxed_type_register_static ("GMimeReferences",
+					      (GBoxedCopyFunc) g_mime_references_copy,
+					      (GBoxedFreeFunc) g_mime_references_free);
 	
 	/* register our GObject types with the GType system */
 	g_mime_crypto_context_get_type ();
@@ -208,6 +215,8 @@ g_mime_shutdown (void)
 	
 	g_mime_object_type_registry_shutdown ();
 	g_mime_parser_options_shutdown ();
+	g_mime_header_shutdown ();
+	g_mime_charset_detect_shutdown ();
 	g_mime_charset_map_shutdown ();
 	g_mime_iconv_utils_shutdown ();
 	g_mime_iconv_shutdown ();
@@ -45,6 +45,7 @@
 #include <gmime/gmime-encodings.h>
 #include <gmime/gmime-parser-options.h>
 #include <gmime/gmime-parser.h>
+#include <gmime/gmime-mbox-index.h>
 #include <gmime/gmime-utils.h>
 #include <gmime/gmime-stream.h>
 #include <gmime/gmime-stream-buffer.h>
@@ -68,6 +69,7 @@
 #include <gmime/gmime-filter-html.h>
 #include <gmime/gmime-filter-md5.h>
 #include <gmime/gmime-filter-strip.h>
+#include <gmime/gmime-filter-text.h>
 #include <gmime/gmime-filter-windows.h>
 #include <gmime/gmime-filter-yenc.h>
 #include <gmime/gmime-crypto-context.h>
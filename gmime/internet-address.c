@@ -1562,7 +1562,7 @@ mailbox_parse (GMimeParserOptions *options, const char **in, const char *name, I
 	
 	/* Note: check for excessive angle brackets like the example described in section 7.1.2 of rfc7103... */
 	if (*inptr == '<') {
-		if (options->addresses != GMIME_RFC_COMPLIANCE_LOOSE)
+		if (g_mime_parser_options_get_address_parser_compliance_mode (options) != GMIME_RFC_COMPLIANCE_LOOSE)
 			goto error;
 		
 		do {
@@ -1601,7 +1601,7 @@ mailbox_parse (GMimeParserOptions *options, const char **in, const char *name, I
 		goto error;
 	
 	if (*inptr != '>') {
-		if (options->addresses != GMIME_RFC_COMPLIANCE_LOOSE)
+		if (g_mime_parser_options_get_address_parser_compliance_mode (options) != GMIME_RFC_COMPLIANCE_LOOSE)
 			goto error;
 	} else {
 		/* skip over the '>' */
@@ -1609,7 +1609,7 @@ mailbox_parse (GMimeParserOptions *options, const char **in, const char *name, I
 		
 		/* Note: check for excessive angle brackets like the example described in section 7.1.2 of rfc7103... */
 		if (*inptr == '>') {
-			if (options->addresses != GMIME_RFC_COMPLIANCE_LOOSE)
+			if (g_mime_parser_options_get_address_parser_compliance_mode (options) != GMIME_RFC_COMPLIANCE_LOOSE)
 				goto error;
 			
 			do {
@@ -1661,7 +1661,7 @@ group_parse (InternetAddressGroup *group, GMimeParserOptions *options, const cha
 static gboolean
 address_parse (GMimeParserOptions *options, AddressParserFlags flags, const char **in, InternetAddress **address)
 {
-	gboolean strict = options->addresses != GMIME_RFC_COMPLIANCE_LOOSE;
+	gboolean strict = g_mime_parser_options_get_address_parser_compliance_mode (options) != GMIME_RFC_COMPLIANCE_LOOSE;
 	gboolean trim_leading_quote = FALSE;
 	const char *inptr = *in;
 	const char *start;
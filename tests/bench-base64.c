@@ -0,0 +1,330 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gmime/gmime.h>
+
+#include "benchsuite.h"
+
+#define DEFAULT_SIZE_MB    32
+#define DEFAULT_ITERATIONS 5
+
+typedef size_t (* Base64StepFunc) (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, int *state, guint32 *save);
+
+
+/* the original byte-at-a-time implementations, for comparison */
+static char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static unsigned char base64_rank[256];
+
+static void
+base64_rank_init (void)
+{
+	int i;
+
+	memset (base64_rank, 0xff, sizeof (base64_rank));
+	for (i = 0; i < 64; i++)
+		base64_rank[(unsigned char) base64_alphabet[i]] = i;
+	base64_rank['='] = 0;
+}
+
+static size_t
+base64_encode_step_ref (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, int *state, guint32 *save)
+{
+	register const unsigned char *inptr;
+	register unsigned char *outptr;
+
+	if (inlen == 0)
+		return 0;
+
+	outptr = outbuf;
+	inptr = inbuf;
+
+	if (inlen + ((unsigned char *)save)[0] > 2) {
+		const unsigned char *inend = inbuf + inlen - 2;
+		register int c1 = 0, c2 = 0, c3 = 0;
+		register int already;
+
+		already = *state;
+
+		switch (((char *)save)[0]) {
+		case 1:	c1 = ((unsigned char *)save)[1]; goto skip1;
+		case 2:	c1 = ((unsigned char *)save)[1];
+			c2 = ((unsigned char *)save)[2]; goto skip2;
+		}
+
+		while (inptr < inend) {
+			c1 = *inptr++;
+		skip1:
+			c2 = *inptr++;
+		skip2:
+			c3 = *inptr++;
+			*outptr++ = base64_alphabet [c1 >> 2];
+			*outptr++ = base64_alphabet [(c2 >> 4) | ((c1 & 0x3) << 4)];
+			*outptr++ = base64_alphabet [((c2 & 0x0f) << 2) | (c3 >> 6)];
+			*outptr++ = base64_alphabet [c3 & 0x3f];
+			if ((++already) >= 19) {
+				*outptr++ = '\n';
+				already = 0;
+			}
+		}
+
+		((unsigned char *)save)[0] = 0;
+		inlen = 2 - (inptr - inend);
+		*state = already;
+	}
+
+	if (inlen > 0) {
+		register char *saveout;
+
+		saveout = & (((char *)save)[1]) + ((char *)save)[0];
+
+		switch (inlen) {
+		case 2:	*saveout++ = *inptr++;
+		case 1:	*saveout++ = *inptr++;
+		}
+		((char *)save)[0] += (char) inlen;
+	}
+
+	return (outptr - outbuf);
+}
+
+static size_t
+base64_decode_step_ref (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, int *state, guint32 *save)
+{
+	register const unsigned char *inptr;
+	register unsigned char *outptr;
+	const unsigned char *inend;
+	register guint32 saved;
+	unsigned char c;
+	int npad, n, i;
+
+	inend = inbuf + inlen;
+	outptr = outbuf;
+	inptr = inbuf;
+
+	npad = (*state >> 8) & 0xff;
+	n = *state & 0xff;
+	saved = *save;
+
+	while (inptr < inend) {
+		c = base64_rank[*inptr++];
+		if (c != 0xff) {
+			saved = (saved << 6) | c;
+			n++;
+			if (n == 4) {
+				*outptr++ = saved >> 16;
+				*outptr++ = saved >> 8;
+				*outptr++ = saved;
+				n = 0;
+
+				if (npad > 0) {
+					outptr -= npad;
+					npad = 0;
+				}
+			}
+		}
+	}
+
+	for (i = 2; inptr > inbuf && i; ) {
+		inptr--;
+		if (base64_rank[*inptr] != 0xff) {
+			if (*inptr == '=' && outptr > outbuf) {
+				if (n == 0) {
+					outptr--;
+				} else if (npad < 2) {
+					npad++;
+				}
+			}
+
+			i--;
+		}
+	}
+
+	*state = (npad << 8) | n;
+	*save = n ? saved : 0;
+
+	return (outptr - outbuf);
+}
+
+
+/* runs @step over @inbuf in @chunk sized pieces (the whole buffer if 0) */
+static size_t
+base64_run (Base64StepFunc step, const unsigned char *inbuf, size_t inlen, size_t chunk, unsigned char *outbuf, int *state, guint32 *save)
+{
+	unsigned char *outptr = outbuf;
+	size_t n, i;
+
+	*state = 0;
+	*save = 0;
+
+	if (chunk == 0)
+		chunk = inlen;
+
+	for (i = 0; i < inlen; i += n) {
+		n = MIN (chunk, inlen - i);
+		outptr += step (inbuf + i, n, outptr, state, save);
+	}
+
+	return outptr - outbuf;
+}
+
+static gboolean
+base64_verify (const char *what, Base64StepFunc step, Base64StepFunc ref, const unsigned char *inbuf, size_t inlen, size_t chunk)
+{
+	unsigned char *outbuf, *refbuf;
+	guint32 save, refsave;
+	int state, refstate;
+	size_t n, refn;
+	gboolean match;
+
+	outbuf = g_malloc (GMIME_BASE64_ENCODE_LEN (inlen) + 16);
+	refbuf = g_malloc (GMIME_BASE64_ENCODE_LEN (inlen) + 16);
+
+	n = base64_run (step, inbuf, inlen, chunk, outbuf, &state, &save);
+	refn = base64_run (ref, inbuf, inlen, chunk, refbuf, &refstate, &refsave);
+
+	match = n == refn && state == refstate && save == refsave && !memcmp (outbuf, refbuf, n);
+
+	if (!match)
+		benchsuite_failed ("%s: output differs from the original implementation (chunk size %u)", what, (unsigned int) chunk);
+
+	g_free (outbuf);
+	g_free (refbuf);
+
+	return match;
+}
+
+typedef struct {
+	Base64StepFunc step;
+	const unsigned char *inbuf;
+	size_t inlen, chunk;
+	unsigned char *outbuf;
+} Base64Bench;
+
+static void
+base64_bench_step (gpointer user_data)
+{
+	Base64Bench *bench = user_data;
+	guint32 save;
+	int state;
+
+	base64_run (bench->step, bench->inbuf, bench->inlen, bench->chunk, bench->outbuf, &state, &save);
+}
+
+static void
+bench_base64 (const char *name, Base64StepFunc step, const unsigned char *inbuf, size_t inlen, size_t chunk)
+{
+	Base64Bench bench;
+
+	bench.outbuf = g_malloc (GMIME_BASE64_ENCODE_LEN (inlen) + 16);
+	bench.step = step;
+	bench.inbuf = inbuf;
+	bench.inlen = inlen;
+	bench.chunk = chunk;
+
+	benchsuite_run (name, base64_bench_step, &bench, inlen, 0, NULL);
+
+	g_free (bench.outbuf);
+}
+
+/* chunk sizes to feed the step functions; 0 feeds the whole buffer at once */
+static size_t chunk_sizes[] = { 4096, 0 };
+
+/* chunk sizes to check that the state/save continuation is identical */
+static size_t verify_sizes[] = { 1, 2, 3, 5, 16, 57, 77, 1000, 4096, 0 };
+
+int main (int argc, char **argv)
+{
+	unsigned char *data, *encoded, *crlf, *inptr, *outptr;
+	size_t len, enclen, crlflen, i;
+	guint32 save;
+	char name[64];
+	int state;
+
+	g_mime_init ();
+	base64_rank_init ();
+
+	benchsuite_init (argc, argv, DEFAULT_SIZE_MB, DEFAULT_ITERATIONS);
+
+	len = benchsuite_get_size () * 1024 * 1024;
+	data = g_malloc (len);
+
+	srand (1);
+	for (i = 0; i < len; i++)
+		data[i] = (unsigned char) (rand () & 0xff);
+
+	encoded = g_malloc (GMIME_BASE64_ENCODE_LEN (len));
+	state = 0;
+	save = 0;
+	enclen = g_mime_encoding_base64_encode_close (data, len, encoded, &state, &save);
+
+	/* the same, with CRLF line endings */
+	crlf = g_malloc (enclen + enclen / 76 + 2);
+	for (inptr = encoded, outptr = crlf; inptr < encoded + enclen; inptr++) {
+		if (*inptr == '\n')
+			*outptr++ = '\r';
+		*outptr++ = *inptr;
+	}
+	crlflen = outptr - crlf;
+
+	/* make sure that the output is identical to the original implementation */
+	for (i = 0; i < G_N_ELEMENTS (verify_sizes); i++) {
+		base64_verify ("encode", g_mime_encoding_base64_encode_step, base64_encode_step_ref,
+			       data, MIN (len, 256 * 1024), verify_sizes[i]);
+		base64_verify ("decode", g_mime_encoding_base64_decode_step, base64_decode_step_ref,
+			       encoded, MIN (enclen, 256 * 1024), verify_sizes[i]);
+		base64_verify ("decode (crlf)", g_mime_encoding_base64_decode_step, base64_decode_step_ref,
+			       crlf, MIN (crlflen, 256 * 1024), verify_sizes[i]);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++) {
+		const char *suffix = chunk_sizes[i] ? "4K steps" : "one step";
+
+		g_snprintf (name, sizeof (name), "encode original (%s)", suffix);
+		bench_base64 (name, base64_encode_step_ref, data, len, chunk_sizes[i]);
+		g_snprintf (name, sizeof (name), "encode (%s)", suffix);
+		bench_base64 (name, g_mime_encoding_base64_encode_step, data, len, chunk_sizes[i]);
+
+		g_snprintf (name, sizeof (name), "decode original (%s)", suffix);
+		bench_base64 (name, base64_decode_step_ref, encoded, enclen, chunk_sizes[i]);
+		g_snprintf (name, sizeof (name), "decode (%s)", suffix);
+		bench_base64 (name, g_mime_encoding_base64_decode_step, encoded, enclen, chunk_sizes[i]);
+
+		g_snprintf (name, sizeof (name), "decode crlf original (%s)", suffix);
+		bench_base64 (name, base64_decode_step_ref, crlf, crlflen, chunk_sizes[i]);
+		g_snprintf (name, sizeof (name), "decode crlf (%s)", suffix);
+		bench_base64 (name, g_mime_encoding_base64_decode_step, crlf, crlflen, chunk_sizes[i]);
+	}
+
+	g_free (encoded);
+	g_free (crlf);
+	g_free (data);
+
+	g_mime_shutdown ();
+
+	return benchsuite_exit ();
+}
@@ -0,0 +1,193 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gmime/gmime.h>
+
+#include "benchsuite.h"
+
+#define DEFAULT_SIZE_MB    16
+#define DEFAULT_ITERATIONS 5
+
+/* GMimeContentEncoding has no value for yEnc */
+#define ENCODING_YENC ((GMimeContentEncoding) -1)
+
+typedef struct {
+	GMimeContentEncoding encoding;
+	gboolean encode;
+	const unsigned char *inbuf;
+	size_t inlen;
+	unsigned char *outbuf;
+	size_t outlen;
+} CodecBench;
+
+static size_t
+codec_convert (CodecBench *bench)
+{
+	GMimeEncoding state;
+	guint32 pcrc, crc;
+	int ystate;
+	
+	if (bench->encoding == ENCODING_YENC) {
+		pcrc = crc = GMIME_YENCODE_CRC_INIT;
+		
+		if (bench->encode) {
+			ystate = GMIME_YENCODE_STATE_INIT;
+			return g_mime_yencode_close (bench->inbuf, bench->inlen, bench->outbuf, &ystate, &pcrc, &crc);
+		}
+		
+		ystate = GMIME_YDECODE_STATE_INIT;
+		return g_mime_ydecode_step (bench->inbuf, bench->inlen, bench->outbuf, &ystate, &pcrc, &crc);
+	}
+	
+	if (bench->encode) {
+		g_mime_encoding_init_encode (&state, bench->encoding);
+	} else {
+		g_mime_encoding_init_decode (&state, bench->encoding);
+		
+		/* we don't generate the "begin" line */
+		if (bench->encoding == GMIME_CONTENT_ENCODING_UUENCODE)
+			state.state = GMIME_UUDECODE_STATE_BEGIN;
+	}
+	
+	return g_mime_encoding_flush (&state, (const char *) bench->inbuf, bench->inlen, (char *) bench->outbuf);
+}
+
+static void
+codec_step (gpointer user_data)
+{
+	codec_convert (user_data);
+}
+
+/* text with long lines, trailing whitespace and the odd 8bit character */
+static unsigned char *
+generate_text (size_t len)
+{
+	static const char *words[] = {
+		"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+		"naïve", "café", "résumé", "=", "tab\t", "trailing ", "über", "smörgåsbord"
+	};
+	unsigned char *text;
+	size_t n, i = 0, col = 0;
+	const char *word;
+	
+	text = g_malloc (len);
+	
+	while (i < len) {
+		word = words[rand () % G_N_ELEMENTS (words)];
+		n = MIN (strlen (word), len - i);
+		memcpy (text + i, word, n);
+		col += n;
+		i += n;
+		
+		if (i < len) {
+			text[i++] = col > 60 + (size_t) (rand () % 60) ? '\n' : ' ';
+			if (text[i - 1] == '\n')
+				col = 0;
+		}
+	}
+	
+	return text;
+}
+
+static unsigned char *
+generate_binary (size_t len)
+{
+	unsigned char *data;
+	size_t i;
+	
+	data = g_malloc (len);
+	for (i = 0; i < len; i++)
+		data[i] = (unsigned char) (rand () & 0xff);
+	
+	return data;
+}
+
+static void
+bench_codec (const char *name, GMimeContentEncoding encoding, const unsigned char *data, size_t len)
+{
+	CodecBench encode, decode;
+	unsigned char *decoded;
+	char label[64];
+	
+	/* yEnc can double the size of its input, plus line breaks */
+	encode.outbuf = g_malloc (len * 3 + 1024);
+	encode.encoding = encoding;
+	encode.encode = TRUE;
+	encode.inbuf = data;
+	encode.inlen = len;
+	encode.outlen = codec_convert (&encode);
+	
+	decoded = g_malloc (len + 1024);
+	decode.encoding = encoding;
+	decode.encode = FALSE;
+	decode.inbuf = encode.outbuf;
+	decode.inlen = encode.outlen;
+	decode.outbuf = decoded;
+	decode.outlen = codec_convert (&decode);
+	
+	if (decode.outlen != len || memcmp (decoded, data, len) != 0)
+		benchsuite_failed ("%s: decoding the encoded data does not give back the original", name);
+	
+	g_snprintf (label, sizeof (label), "%s encode", name);
+	benchsuite_run (label, codec_step, &encode, encode.inlen, 0, NULL);
+	
+	g_snprintf (label, sizeof (label), "%s decode", name);
+	benchsuite_run (label, codec_step, &decode, decode.inlen, 0, NULL);
+	
+	g_free (encode.outbuf);
+	g_free (decoded);
+}
+
+int main (int argc, char **argv)
+{
+	unsigned char *text, *binary;
+	size_t len;
+	
+	g_mime_init ();
+	
+	benchsuite_init (argc, argv, DEFAULT_SIZE_MB, DEFAULT_ITERATIONS);
+	
+	len = benchsuite_get_size () * 1024 * 1024;
+	
+	srand (1);
+	binary = generate_binary (len);
+	text = generate_text (len);
+	
+	bench_codec ("base64", GMIME_CONTENT_ENCODING_BASE64, binary, len);
+	bench_codec ("quoted-printable", GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, text, len);
+	bench_codec ("uuencode", GMIME_CONTENT_ENCODING_UUENCODE, binary, len);
+	bench_codec ("yEnc", ENCODING_YENC, binary, len);
+	
+	g_free (binary);
+	g_free (text);
+	
+	g_mime_shutdown ();
+	
+	return benchsuite_exit ();
+}
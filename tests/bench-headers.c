@@ -0,0 +1,182 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gmime/gmime.h>
+
+#include "benchsuite.h"
+
+/* the "size" is the number of header values (in thousands) to generate */
+#define DEFAULT_SIZE       16
+#define DEFAULT_ITERATIONS 5
+
+static const char *addresses[] = {
+	"Jeffrey Stedfast <fejj@gnome.org>",
+	"\"Stedfast, Jeffrey\" <fejj@gnome.org>, gaute@example.org",
+	"=?iso-8859-1?q?Andr=E9s_Mart=EDnez?= <andres@example.org>",
+	"=?utf-8?b?WsO2ZSBCZWF1bW9udA==?= <zoe@example.org>, =?utf-8?q?Bj=C3=B8rn?= <bjorn@example.org>",
+	"undisclosed-recipients:;",
+	"Team: alice@example.org, \"Bob (the builder)\" <bob@example.org>, carol@example.org;",
+	"dave@example.org (Dave Jones), <erin@example.org>",
+	"Ludwig van Beethoven <ludwig@[192.168.0.1]>, frank@example.org, grace@example.org, heidi@example.org",
+};
+
+static const char *texts[] = {
+	"Re: meeting notes for the quarterly release schedule",
+	"=?utf-8?b?TWVldGluZyBub3RlcyDigJQgY2Fmw6kgYXQgbm9vbg==?=",
+	"=?iso-8859-1?q?caf=E9_au_lait?= and =?iso-8859-1?q?cr=E8me_br=FBl=E9e?=",
+	"=?utf-8?q?Gr=C3=BC=C3=9Fe?= =?utf-8?q?_aus_M=C3=BCnchen?=",
+	"=?windows-1252?q?=93smart_quotes=94_=96_and_dashes?=",
+	"=?iso-2022-jp?b?GyRCJEskWyRzJDQbKEI=?= (nihongo)",
+	"Fwd: [gmime-devel] =?utf-8?b?cGFyc2VyIGJlbmNobWFyaw==?= results",
+	"an unencoded subject with an =?invalid?x?encoded word?= in it",
+};
+
+static const char *dates[] = {
+	"Fri, 23 Aug 2002 02:32:53 -0400",
+	"23 Aug 2002 02:32:53 GMT",
+	"Fri, 23 Aug 2002 2:32:53 PDT",
+	"Friday, 23 Aug 02 02:32:53 +0200 (CEST)",
+	"Fri Aug 23 02:32:53 2002",
+	"Fri, 23-Aug-2002 02:32:53 EST",
+	"2002-08-23 02:32:53",
+	"Fri, 23 Aug 2002 02:32 +0000",
+};
+
+/* makes @n distinct strings out of @templates */
+static char **
+generate (const char **templates, guint ntemplates, guint n)
+{
+	char **strings;
+	guint i;
+	
+	strings = g_new (char *, n + 1);
+	for (i = 0; i < n; i++)
+		strings[i] = g_strdup_printf ("%s%s", templates[i % ntemplates], i % 2 ? "" : " ");
+	strings[n] = NULL;
+	
+	return strings;
+}
+
+static GMimeParserOptions *options;
+
+static void
+parse_addresses (gpointer user_data)
+{
+	InternetAddressList *list;
+	char **strings = user_data;
+	guint i;
+	
+	for (i = 0; strings[i] != NULL; i++) {
+		if ((list = internet_address_list_parse (options, strings[i])))
+			g_object_unref (list);
+	}
+}
+
+static void
+decode_texts (gpointer user_data)
+{
+	char **strings = user_data;
+	guint i;
+	
+	for (i = 0; strings[i] != NULL; i++)
+		g_free (g_mime_utils_header_decode_text (options, strings[i]));
+}
+
+static void
+encode_texts (gpointer user_data)
+{
+	char **strings = user_data;
+	guint i;
+	
+	for (i = 0; strings[i] != NULL; i++)
+		g_free (g_mime_utils_header_encode_text (strings[i], NULL));
+}
+
+static void
+decode_dates (gpointer user_data)
+{
+	char **strings = user_data;
+	int tz_offset;
+	guint i;
+	
+	for (i = 0; strings[i] != NULL; i++)
+		g_mime_utils_header_decode_date (strings[i], &tz_offset);
+}
+
+static size_t
+total_length (char **strings)
+{
+	size_t len = 0;
+	guint i;
+	
+	for (i = 0; strings[i] != NULL; i++)
+		len += strlen (strings[i]);
+	
+	return len;
+}
+
+int main (int argc, char **argv)
+{
+	char **strings, **decoded;
+	guint n, i;
+	
+	g_mime_init ();
+	
+	benchsuite_init (argc, argv, DEFAULT_SIZE, DEFAULT_ITERATIONS);
+	
+	n = benchsuite_get_size () * 1000;
+	options = g_mime_parser_options_new ();
+	
+	strings = generate (addresses, G_N_ELEMENTS (addresses), n);
+	benchsuite_run ("internet_address_list_parse", parse_addresses, strings, total_length (strings), n, "lists");
+	g_strfreev (strings);
+	
+	strings = generate (texts, G_N_ELEMENTS (texts), n);
+	benchsuite_run ("header_decode_text", decode_texts, strings, total_length (strings), n, "headers");
+	
+	/* re-encode what we decoded */
+	decoded = g_new (char *, n + 1);
+	for (i = 0; i < n; i++)
+		decoded[i] = g_mime_utils_header_decode_text (options, strings[i]);
+	decoded[n] = NULL;
+	
+	benchsuite_run ("header_encode_text", encode_texts, decoded, total_length (decoded), n, "headers");
+	g_strfreev (decoded);
+	g_strfreev (strings);
+	
+	strings = generate (dates, G_N_ELEMENTS (dates), n);
+	benchsuite_run ("header_decode_date", decode_dates, strings, total_length (strings), n, "dates");
+	g_strfreev (strings);
+	
+	g_mime_parser_options_free (options);
+	
+	g_mime_shutdown ();
+	
+	return benchsuite_exit ();
+}
@@ -0,0 +1,454 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <gmime/gmime.h>
+
+#include "benchsuite.h"
+
+#define DEFAULT_SIZE_MB    32
+#define DEFAULT_ITERATIONS 5
+#define N_ATTACHMENTS      4
+
+/* the size of the generated mailbox relative to the single message */
+#define MBOX_FRACTION      4
+
+static const char headers[] =
+	"From: Jeffrey Stedfast <fejj@gnome.org>\n"
+	"To: Jeffrey Stedfast <fejj@gnome.org>\n"
+	"Subject: parser benchmark\n"
+	"Date: Fri, 23 Aug 2002 2:32:53 -0400\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"=-bench-boundary\"\n"
+	"\n"
+	"This is a multi-part message in MIME format.\n";
+
+static const char text_part[] =
+	"--=-bench-boundary\n"
+	"Content-Type: text/plain; charset=us-ascii\n"
+	"\n"
+	"Please find the attached files.\n";
+
+static const char attachment_headers[] =
+	"--=-bench-boundary\n"
+	"Content-Type: application/octet-stream; name=\"attachment.bin\"\n"
+	"Content-Disposition: attachment; filename=\"attachment.bin\"\n"
+	"Content-Transfer-Encoding: base64\n"
+	"\n";
+
+static const char end_boundary[] = "--=-bench-boundary--\n";
+
+static GByteArray *
+generate_message (size_t size)
+{
+	unsigned char *inbuf, *outbuf;
+	size_t attsize, n, i;
+	GByteArray *message;
+	guint32 save = 0;
+	int state = 0;
+	
+	attsize = size / N_ATTACHMENTS;
+	inbuf = g_malloc (attsize);
+	outbuf = g_malloc (GMIME_BASE64_ENCODE_LEN (attsize));
+	
+	srand (1);
+	for (i = 0; i < attsize; i++)
+		inbuf[i] = (unsigned char) (rand () & 0xff);
+	
+	message = g_byte_array_new ();
+	g_byte_array_append (message, (unsigned char *) headers, sizeof (headers) - 1);
+	g_byte_array_append (message, (unsigned char *) text_part, sizeof (text_part) - 1);
+	
+	for (i = 0; i < N_ATTACHMENTS; i++) {
+		g_byte_array_append (message, (unsigned char *) attachment_headers, sizeof (attachment_headers) - 1);
+	
+		state = 0;
+		save = 0;
+		n = g_mime_encoding_base64_encode_close (inbuf, attsize, outbuf, &state, &save);
+		g_byte_array_append (message, outbuf, n);
+	}
+	
+	g_byte_array_append (message, (unsigned char *) end_boundary, sizeof (end_boundary) - 1);
+	
+	g_free (outbuf);
+	g_free (inbuf);
+	
+	return message;
+}
+
+static const char *names[] = {
+	"Jeffrey Stedfast", "Gaute Hope", "Andrés Martínez", "Zoë Beaumont",
+	"Kōhei Tanaka", "Ana María Pérez", "Bjørn Olsen", "Ludwig van Beethoven"
+};
+
+static const char *words[] = {
+	"re:", "meeting", "notes", "for", "the", "quarterly", "release", "schedule",
+	"naïve", "café", "résumé", "über", "patch", "review", "parser", "benchmark"
+};
+
+static const char body_line[] =
+	"The quick brown fox jumps over the lazy dog while the parser keeps counting lines.\n";
+
+static void
+append_header (GByteArray *mbox, GMimeParserOptions *options, const char *name, const char *value)
+{
+	char *folded;
+	
+	folded = g_mime_utils_header_printf (options, "%s: %s\n", name, value);
+	g_byte_array_append (mbox, (unsigned char *) folded, strlen (folded));
+	g_free (folded);
+}
+
+static char *
+random_mailbox (void)
+{
+	const char *name = names[rand () % G_N_ELEMENTS (names)];
+	InternetAddress *ia;
+	char *str, *addr;
+	
+	addr = g_strdup_printf ("user%d@example%d.org", rand () % 1000, rand () % 10);
+	ia = internet_address_mailbox_new (name, addr);
+	str = internet_address_to_string (ia, TRUE);
+	g_object_unref (ia);
+	g_free (addr);
+	
+	return str;
+}
+
+/* a mailbox full of typical messages (lots of headers, short bodies) */
+static GByteArray *
+generate_mbox (GMimeParserOptions *options, size_t size, guint *count)
+{
+	char *subject, *value, *encoded;
+	GByteArray *mbox;
+	GString *str;
+	guint i, j, n;
+	
+	mbox = g_byte_array_new ();
+	str = g_string_new ("");
+	
+	srand (1);
+	for (*count = 0; mbox->len < size; (*count)++) {
+		g_byte_array_append (mbox, (unsigned char *) "From - Fri Aug 23 02:32:53 2002\n", 32);
+		
+		value = random_mailbox ();
+		append_header (mbox, options, "From", value);
+		g_free (value);
+		
+		g_string_truncate (str, 0);
+		for (j = 0, n = 1 + rand () % 6; j < n; j++) {
+			value = random_mailbox ();
+			g_string_append_printf (str, "%s%s", j > 0 ? ", " : "", value);
+			g_free (value);
+		}
+		append_header (mbox, options, "To", str->str);
+		
+		g_string_truncate (str, 0);
+		for (j = 0, n = 3 + rand () % 8; j < n; j++)
+			g_string_append_printf (str, "%s%s", j > 0 ? " " : "", words[rand () % G_N_ELEMENTS (words)]);
+		subject = g_mime_utils_header_encode_text (str->str, NULL);
+		append_header (mbox, options, "Subject", subject);
+		g_free (subject);
+		
+		append_header (mbox, options, "Date", "Fri, 23 Aug 2002 02:32:53 -0400");
+		
+		value = g_strdup_printf ("<%u.%d@example.org>", *count, rand ());
+		append_header (mbox, options, "Message-Id", value);
+		g_free (value);
+		
+		g_string_truncate (str, 0);
+		for (j = 0, n = rand () % 12; j < n; j++)
+			g_string_append_printf (str, "%s<%d.%d@example.org>", j > 0 ? " " : "", rand (), rand ());
+		if (n > 0)
+			append_header (mbox, options, "References", str->str);
+		
+		for (j = 0, n = 4 + rand () % 16; j < n; j++) {
+			value = g_strdup_printf ("X-Bench-Header-%u", rand () % 64);
+			encoded = g_strdup_printf ("value %d", rand ());
+			append_header (mbox, options, value, encoded);
+			g_free (encoded);
+			g_free (value);
+		}
+		
+		append_header (mbox, options, "MIME-Version", "1.0");
+		append_header (mbox, options, "Content-Type", "text/plain; charset=utf-8");
+		append_header (mbox, options, "Content-Transfer-Encoding", "8bit");
+		g_byte_array_append (mbox, (unsigned char *) "\n", 1);
+		
+		for (j = 0, n = 1 + rand () % 64; j < n; j++)
+			g_byte_array_append (mbox, (unsigned char *) body_line, sizeof (body_line) - 1);
+		g_byte_array_append (mbox, (unsigned char *) "\n", 1);
+	}
+	
+	g_string_free (str, TRUE);
+	
+	return mbox;
+}
+
+typedef struct {
+	GMimeParserOptions *options;
+	GMimeParser *parser;
+	GMimeStream *stream;
+	gboolean mbox;
+} ParserBench;
+
+static void
+parse (gpointer user_data)
+{
+	ParserBench *bench = user_data;
+	GMimeMessage *message;
+	
+	g_mime_stream_reset (bench->stream);
+	g_mime_parser_init_with_stream (bench->parser, bench->stream);
+	g_mime_parser_set_scan_from (bench->parser, bench->mbox);
+	
+	do {
+		if (!(message = g_mime_parser_construct_message_with_options (bench->parser, bench->options))) {
+			benchsuite_failed ("failed to parse message");
+			break;
+		}
+		
+		g_object_unref (message);
+	} while (bench->mbox && !g_mime_parser_eos (bench->parser));
+}
+
+static void
+bench_parser (const char *name, GMimeStream *stream, GMimeParserOptions *options, gboolean persist, gboolean headers_only, size_t size)
+{
+	ParserBench bench;
+	
+	bench.parser = g_mime_parser_new ();
+	g_mime_parser_set_persist_stream (bench.parser, persist);
+	g_mime_parser_set_headers_only (bench.parser, headers_only);
+	bench.options = options;
+	bench.stream = stream;
+	bench.mbox = FALSE;
+	
+	benchsuite_run (name, parse, &bench, size, 0, NULL);
+	
+	g_object_unref (bench.parser);
+}
+
+static void
+bench_mbox (const char *name, GMimeStream *stream, GMimeParserOptions *options, gboolean persist, size_t size, guint count)
+{
+	ParserBench bench;
+	
+	bench.parser = g_mime_parser_new ();
+	g_mime_parser_set_persist_stream (bench.parser, persist);
+	bench.options = options;
+	bench.stream = stream;
+	bench.mbox = TRUE;
+	
+	benchsuite_run (name, parse, &bench, size, count, "messages");
+	
+	g_object_unref (bench.parser);
+}
+
+typedef struct {
+	GMimeStream *stream;
+	GPtrArray *messages;
+} WriteBench;
+
+static void
+write_messages (gpointer user_data)
+{
+	WriteBench *bench = user_data;
+	guint i;
+	
+	for (i = 0; i < bench->messages->len; i++)
+		g_mime_object_write_to_stream (bench->messages->pdata[i], bench->stream);
+}
+
+/* parses all of the messages in the mbox and serializes them again;
+ * untouched messages get written back out from their source, while
+ * modified ones have to be serialized from scratch */
+static void
+bench_write (GMimeStream *stream, GMimeParserOptions *options, size_t size, gboolean modified)
+{
+	GMimeMessage *message;
+	GMimeParser *parser;
+	WriteBench bench;
+	guint i;
+	
+	bench.messages = g_ptr_array_new ();
+	bench.stream = g_mime_stream_null_new ();
+	
+	parser = g_mime_parser_new ();
+	g_mime_parser_set_persist_stream (parser, TRUE);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	g_mime_stream_reset (stream);
+	g_mime_parser_init_with_stream (parser, stream);
+	
+	while (!g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message_with_options (parser, options)))
+			break;
+		
+		if (modified)
+			g_mime_message_set_subject (message, "modified", NULL);
+		
+		g_ptr_array_add (bench.messages, message);
+	}
+	
+	benchsuite_run (modified ? "mbox write (modified)" : "mbox write (pristine)", write_messages,
+			&bench, size, bench.messages->len, "messages");
+	
+	for (i = 0; i < bench.messages->len; i++)
+		g_object_unref (bench.messages->pdata[i]);
+	g_ptr_array_free (bench.messages, TRUE);
+	g_object_unref (bench.stream);
+	g_object_unref (parser);
+}
+
+enum {
+	STREAM_FILE,
+	STREAM_FS,
+	STREAM_MMAP
+};
+
+static const char *stream_names[] = { "file", "fs", "mmap" };
+
+static GMimeStream *
+open_stream (int fd, int kind)
+{
+	FILE *fp;
+	
+	if ((fd = dup (fd)) == -1)
+		return NULL;
+	
+	lseek (fd, 0, SEEK_SET);
+	
+	switch (kind) {
+	case STREAM_FILE:
+		if ((fp = fdopen (fd, "rb")) != NULL)
+			return g_mime_stream_file_new (fp);
+		break;
+	case STREAM_FS:
+		return g_mime_stream_fs_new (fd);
+	case STREAM_MMAP:
+		return g_mime_stream_mmap_new (fd, PROT_READ, MAP_PRIVATE);
+	}
+	
+	close (fd);
+	
+	return NULL;
+}
+
+/* scan buffer sizes to compare; 0 lets the parser grow its buffer */
+static size_t buffer_sizes[] = { 4096, 64 * 1024, 256 * 1024, 0 };
+
+int main (int argc, char **argv)
+{
+	char filename[] = "bench-parser.XXXXXX";
+	GMimeParserOptions *options;
+	GByteArray *message, *mbox;
+	GMimeStream *stream;
+	gboolean persist;
+	char name[64];
+	int fd, kind;
+	size_t size;
+	guint i, n;
+	
+	g_mime_init ();
+	
+	benchsuite_init (argc, argv, DEFAULT_SIZE_MB, DEFAULT_ITERATIONS);
+	size = benchsuite_get_size ();
+	
+	benchsuite_printf ("Generating a message with %u x %u MB base64 attachments...\n",
+			   N_ATTACHMENTS, (unsigned int) (size / N_ATTACHMENTS));
+	
+	message = generate_message (size * 1024 * 1024);
+	options = g_mime_parser_options_new ();
+	
+	/* parse from memory */
+	stream = g_mime_stream_mem_new_with_byte_array (message);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	bench_parser ("mem (load content)", stream, options, FALSE, FALSE, message->len);
+	bench_parser ("mem (persist)", stream, options, TRUE, FALSE, message->len);
+	bench_parser ("mem (headers only)", stream, options, FALSE, TRUE, message->len);
+	g_object_unref (stream);
+	
+	/* parse a mailbox of small messages, where the cost is in the headers */
+	mbox = generate_mbox (options, MAX (size * 1024 * 1024 / MBOX_FRACTION, 1), &n);
+	benchsuite_printf ("Generated a %.2f MB mailbox with %u messages\n", (double) mbox->len / (1024.0 * 1024.0), n);
+	
+	stream = g_mime_stream_mem_new_with_byte_array (mbox);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	bench_mbox ("mbox (load content)", stream, options, FALSE, mbox->len, n);
+	bench_mbox ("mbox (persist)", stream, options, TRUE, mbox->len, n);
+	bench_write (stream, options, mbox->len, FALSE);
+	bench_write (stream, options, mbox->len, TRUE);
+	g_object_unref (stream);
+	g_byte_array_free (mbox, TRUE);
+	
+	/* parse from a file on disk using various scan buffer sizes */
+	if ((fd = g_mkstemp (filename)) != -1) {
+		if (write (fd, message->data, message->len) == (ssize_t) message->len) {
+			for (kind = STREAM_FILE; kind <= STREAM_MMAP; kind++) {
+				if (!(stream = open_stream (fd, kind)))
+					continue;
+				
+				for (persist = FALSE; persist <= TRUE; persist++) {
+					for (i = 0; i < G_N_ELEMENTS (buffer_sizes); i++) {
+						g_mime_parser_options_set_scan_buffer_size (options, buffer_sizes[i]);
+						
+						if (buffer_sizes[i] > 0)
+							g_snprintf (name, sizeof (name), "%s %uK", stream_names[kind], (guint) (buffer_sizes[i] / 1024));
+						else
+							g_snprintf (name, sizeof (name), "%s auto", stream_names[kind]);
+						
+						g_strlcat (name, persist ? " (persist)" : " (load content)", sizeof (name));
+						bench_parser (name, stream, options, persist, FALSE, message->len);
+					}
+				}
+				
+				g_mime_parser_options_set_scan_buffer_size (options, 0);
+				g_snprintf (name, sizeof (name), "%s auto (headers only)", stream_names[kind]);
+				bench_parser (name, stream, options, FALSE, TRUE, message->len);
+				
+				g_object_unref (stream);
+			}
+		}
+		
+		close (fd);
+		unlink (filename);
+	}
+	
+	g_mime_parser_options_free (options);
+	g_byte_array_free (message, TRUE);
+	
+	g_mime_shutdown ();
+	
+	return benchsuite_exit ();
+}
@@ -0,0 +1,193 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gmime/gmime.h>
+
+#include "benchsuite.h"
+
+#define DEFAULT_SIZE_MB    32
+#define DEFAULT_ITERATIONS 5
+
+/* the number of bytes the caller asks g_mime_stream_read() for */
+#define SMALL_READ  4096
+#define LARGE_READ  (1024 * 1024)
+
+/* read sizes to configure the filter stream with */
+static size_t read_sizes[] = { 1024, 4096, 16384, 32768, 65536, 262144 };
+
+
+/* builds the chain used to decode a base64 encoded attachment with CRLF line endings */
+static GMimeStream *
+decode_stream_new (GMimeStream *source, size_t readsize, gboolean md5)
+{
+	GMimeStream *stream;
+	GMimeFilter *filter;
+	
+	stream = g_mime_stream_filter_new (source);
+	g_mime_stream_filter_set_read_size ((GMimeStreamFilter *) stream, readsize);
+	
+	filter = g_mime_filter_crlf_new (FALSE, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_BASE64, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	if (md5) {
+		/* the md5 filter passes its input through, so the chain can still be read in place */
+		filter = g_mime_filter_md5_new ();
+		g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+		g_object_unref (filter);
+	}
+	
+	return stream;
+}
+
+typedef struct {
+	GMimeStream *source;
+	size_t readsize;
+	size_t bufsize;
+	gboolean md5;
+	char *buf;
+} DecodeBench;
+
+static void
+decode (gpointer user_data)
+{
+	DecodeBench *bench = user_data;
+	GMimeStream *stream;
+	
+	g_mime_stream_reset (bench->source);
+	stream = decode_stream_new (bench->source, bench->readsize, bench->md5);
+	
+	while (g_mime_stream_read (stream, bench->buf, bench->bufsize) > 0)
+		;
+	
+	g_object_unref (stream);
+}
+
+static void
+verify (GMimeStream *source, const char *data, size_t len, size_t readsize, size_t bufsize, char *buf)
+{
+	GMimeStream *stream;
+	gboolean match = TRUE;
+	size_t total = 0;
+	ssize_t nread;
+	
+	g_mime_stream_reset (source);
+	stream = decode_stream_new (source, readsize, TRUE);
+	
+	while (match && (nread = g_mime_stream_read (stream, buf, bufsize)) > 0) {
+		match = total + nread <= len && !memcmp (buf, data + total, nread);
+		total += nread;
+	}
+	
+	g_object_unref (stream);
+	
+	if (!match || total != len)
+		benchsuite_failed ("%uK reads into %uK: decoded output does not match the original data",
+				   (unsigned int) (readsize / 1024), (unsigned int) (bufsize / 1024));
+}
+
+static void
+bench_decode (GMimeStream *source, size_t len, size_t readsize, size_t bufsize, gboolean md5, char *buf)
+{
+	DecodeBench bench;
+	char name[64];
+	
+	bench.source = source;
+	bench.readsize = readsize;
+	bench.bufsize = bufsize;
+	bench.md5 = md5;
+	bench.buf = buf;
+	
+	g_snprintf (name, sizeof (name), "%s%6uK reads into %uK", md5 ? "md5 " : "",
+		    (unsigned int) (readsize / 1024), (unsigned int) (bufsize / 1024));
+	
+	benchsuite_run (name, decode, &bench, len, 0, NULL);
+}
+
+int main (int argc, char **argv)
+{
+	GMimeStream *stream, *source;
+	GMimeFilter *filter;
+	size_t len, i;
+	char *data, *buf;
+	
+	g_mime_init ();
+	
+	benchsuite_init (argc, argv, DEFAULT_SIZE_MB, DEFAULT_ITERATIONS);
+	
+	len = benchsuite_get_size () * 1024 * 1024;
+	data = g_malloc (len);
+	
+	srand (1);
+	for (i = 0; i < len; i++)
+		data[i] = (char) (rand () & 0xff);
+	
+	/* base64 encode the data with CRLF line endings */
+	source = g_mime_stream_mem_new ();
+	stream = g_mime_stream_filter_new (source);
+	
+	filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_BASE64, TRUE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_crlf_new (TRUE, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	g_mime_stream_write (stream, data, len);
+	g_mime_stream_flush (stream);
+	g_object_unref (stream);
+	
+	buf = g_malloc (LARGE_READ);
+	
+	/* make sure that every read size gives back what we started with */
+	for (i = 0; i < G_N_ELEMENTS (read_sizes); i++) {
+		verify (source, data, len, read_sizes[i], SMALL_READ, buf);
+		verify (source, data, len, read_sizes[i], LARGE_READ, buf);
+	}
+	
+	for (i = 0; i < G_N_ELEMENTS (read_sizes); i++)
+		bench_decode (source, len, read_sizes[i], SMALL_READ, FALSE, buf);
+	
+	for (i = 0; i < G_N_ELEMENTS (read_sizes); i++)
+		bench_decode (source, len, read_sizes[i], LARGE_READ, FALSE, buf);
+	
+	for (i = 0; i < G_N_ELEMENTS (read_sizes); i++)
+		bench_decode (source, len, read_sizes[i], LARGE_READ, TRUE, buf);
+	
+	g_object_unref (source);
+	g_free (data);
+	g_free (buf);
+	
+	g_mime_shutdown ();
+	
+	return benchsuite_exit ();
+}
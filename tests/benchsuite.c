@@ -0,0 +1,221 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if !defined (G_OS_WIN32) || defined (__MINGW32__)
+#define ENABLE_ZENTIMER
+#include "zentimer.h"
+#endif
+
+#include "benchsuite.h"
+
+#define DEFAULT_REPEAT 3
+
+static const char *suite = NULL;
+static const char *filter = NULL;
+static gboolean machine = FALSE;
+static int iterations = 0;
+static int repeat = DEFAULT_REPEAT;
+static size_t size = 0;
+static int failures = 0;
+
+
+static void
+usage (void)
+{
+	fprintf (stderr, "Usage: %s [-m] [-f substring] [-r repeat] [-s size] [-n iterations] [size [iterations]]\n\n"
+		 "  -m  print tab separated results for regression tracking\n"
+		 "  -f  only run the benchmarks whose names contain substring\n"
+		 "  -r  time each benchmark this many times and report the fastest (default %d)\n"
+		 "  -s  the amount of input to generate (in MB for most benchmarks)\n"
+		 "  -n  the number of iterations per timing\n", suite, DEFAULT_REPEAT);
+	exit (EXIT_FAILURE);
+}
+
+void
+benchsuite_init (int argc, char **argv, size_t default_size, int default_iterations)
+{
+	int npositional = 0;
+	int i;
+	
+	if ((suite = strrchr (argv[0], '/')))
+		suite++;
+	else
+		suite = argv[0];
+	
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			/* the old positional [size [iterations]] arguments */
+			if (npositional == 0)
+				size = strtoul (argv[i], NULL, 10);
+			else if (npositional == 1)
+				iterations = atoi (argv[i]);
+			else
+				usage ();
+			
+			npositional++;
+		} else if (!strcmp (argv[i], "-m")) {
+			machine = TRUE;
+		} else if (i + 1 < argc && !strcmp (argv[i], "-f")) {
+			filter = argv[++i];
+		} else if (i + 1 < argc && !strcmp (argv[i], "-r")) {
+			repeat = atoi (argv[++i]);
+		} else if (i + 1 < argc && !strcmp (argv[i], "-s")) {
+			size = strtoul (argv[++i], NULL, 10);
+		} else if (i + 1 < argc && !strcmp (argv[i], "-n")) {
+			iterations = atoi (argv[++i]);
+		} else {
+			usage ();
+		}
+	}
+	
+	if (repeat < 1)
+		repeat = 1;
+	
+	if (size == 0)
+		size = default_size;
+	
+	if (iterations <= 0)
+		iterations = default_iterations;
+	
+	if (machine)
+		fprintf (stdout, "# suite\tbenchmark\titerations\tbytes\titems\tunits\tseconds\tMB/s\titems/s\n");
+}
+
+int
+benchsuite_exit (void)
+{
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+size_t
+benchsuite_get_size (void)
+{
+	return size;
+}
+
+int
+benchsuite_get_iterations (void)
+{
+	return iterations;
+}
+
+void
+benchsuite_printf (const char *fmt, ...)
+{
+	va_list args;
+	
+	/* keep stdout parseable in machine-readable mode */
+	va_start (args, fmt);
+	vfprintf (machine ? stderr : stdout, fmt, args);
+	va_end (args);
+}
+
+void
+benchsuite_failed (const char *fmt, ...)
+{
+	va_list args;
+	
+	fprintf (stderr, "%s: ", suite);
+	va_start (args, fmt);
+	vfprintf (stderr, fmt, args);
+	va_end (args);
+	fputc ('\n', stderr);
+	
+	failures++;
+}
+
+/**
+ * benchsuite_run:
+ * @name: the name of the benchmark
+ * @func: runs a single iteration of the benchmark
+ * @user_data: user data for @func
+ * @bytes: the number of bytes that one iteration processes (or 0)
+ * @items: the number of @units that one iteration processes (or 0)
+ * @units: what @items counts, e.g. "messages" (or %NULL for "items")
+ *
+ * Calls @func once to warm up and then times the configured number of
+ * iterations, repeating the timing and keeping the fastest one to
+ * smooth out noise from the rest of the system.
+ *
+ * Returns: the fastest time taken (in seconds), or 0 if the benchmark
+ * was filtered out.
+ **/
+double
+benchsuite_run (const char *name, BenchFunc func, gpointer user_data, size_t bytes, size_t items, const char *units)
+{
+	double elapsed, best = 0.0;
+	double mbps, ips;
+	int i, r;
+	
+	if (filter != NULL && !strstr (name, filter))
+		return 0.0;
+	
+	func (user_data);
+	
+	for (r = 0; r < repeat; r++) {
+		ZenTimerStart (NULL);
+		for (i = 0; i < iterations; i++)
+			func (user_data);
+		ZenTimerStop (NULL);
+		
+		elapsed = ZenTimerElapsed (NULL, NULL);
+		if (r == 0 || elapsed < best)
+			best = elapsed;
+	}
+	
+	/* don't divide by zero on a coarse clock */
+	elapsed = MAX (best, 1e-6);
+	mbps = ((double) bytes * iterations) / (elapsed * 1024.0 * 1024.0);
+	ips = ((double) items * iterations) / elapsed;
+	
+	if (machine) {
+		fprintf (stdout, "%s\t%s\t%d\t%lu\t%lu\t%s\t%.6f\t%.3f\t%.1f\n", suite, name, iterations,
+			 (unsigned long) bytes, (unsigned long) items, units ? units : "",
+			 best, mbps, ips);
+	} else {
+		fprintf (stdout, "%-32s", name);
+		
+		if (bytes > 0)
+			fprintf (stdout, " %8.2f MB/s", mbps);
+		
+		if (items > 0)
+			fprintf (stdout, " %10.0f %s/s", ips, units ? units : "items");
+		
+		if (bytes > 0)
+			fprintf (stdout, " (%d x %.2f MB in %.3f seconds)\n", iterations, (double) bytes / (1024.0 * 1024.0), best);
+		else
+			fprintf (stdout, " (%d x %lu %s in %.3f seconds)\n", iterations, (unsigned long) items, units ? units : "items", best);
+	}
+	
+	fflush (stdout);
+	
+	return best;
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifndef __BENCH_SUITE_H__
+#define __BENCH_SUITE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* one iteration of a benchmark */
+typedef void (* BenchFunc) (gpointer user_data);
+
+/* @default_size (in MB) and @default_iterations are used unless
+ * overridden on the command line */
+void benchsuite_init (int argc, char **argv, size_t default_size, int default_iterations);
+int benchsuite_exit (void);
+
+size_t benchsuite_get_size (void);
+int benchsuite_get_iterations (void);
+
+void benchsuite_printf (const char *fmt, ...) G_GNUC_PRINTF (1, 2);
+
+/* a benchmark that found the code under test to be broken */
+void benchsuite_failed (const char *fmt, ...) G_GNUC_PRINTF (1, 2);
+
+double benchsuite_run (const char *name, BenchFunc func, gpointer user_data,
+		       size_t bytes, size_t items, const char *units);
+
+G_END_DECLS
+
+#endif /* __BENCH_SUITE_H__ */
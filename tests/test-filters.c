@@ -0,0 +1,416 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gmime/gmime.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testsuite.h"
+
+extern int verbose;
+
+#define d(x)
+#define v(x) if (verbose > 3) x
+
+
+/* an in-place filter that doubles every byte, so that it always needs
+ * more room than filtering in place gives it */
+typedef struct {
+	GMimeFilter parent_object;
+} TestFilterDouble;
+
+typedef struct {
+	GMimeFilterClass parent_class;
+} TestFilterDoubleClass;
+
+static void test_filter_double_class_init (TestFilterDoubleClass *klass);
+static void test_filter_double_init (TestFilterDouble *filter, TestFilterDoubleClass *klass);
+
+static GType
+test_filter_double_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (TestFilterDoubleClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) test_filter_double_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (TestFilterDouble),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) test_filter_double_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "TestFilterDouble", &info, 0);
+	}
+	
+	return type;
+}
+
+static GMimeFilter *
+filter_double_copy (GMimeFilter *filter)
+{
+	return g_object_newv (test_filter_double_get_type (), 0, NULL);
+}
+
+static void
+filter_double_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		      char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	size_t i;
+	
+	/* the first copy may well be written in place... */
+	g_mime_filter_set_size (filter, inlen, FALSE);
+	memmove (filter->outbuf, inbuf, inlen);
+	
+	/* ...but then the output has to move somewhere bigger */
+	g_mime_filter_set_size (filter, inlen * 2, TRUE);
+	for (i = inlen; i > 0; i--) {
+		filter->outbuf[i * 2 - 1] = filter->outbuf[i - 1];
+		filter->outbuf[i * 2 - 2] = filter->outbuf[i - 1];
+	}
+	
+	*outbuf = filter->outbuf;
+	*outlen = inlen * 2;
+	*outprespace = filter->outpre;
+}
+
+static void
+filter_double_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+			char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	filter_double_filter (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+}
+
+static void
+filter_double_reset (GMimeFilter *filter)
+{
+}
+
+static void
+test_filter_double_class_init (TestFilterDoubleClass *klass)
+{
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+	
+	filter_class->copy = filter_double_copy;
+	filter_class->filter = filter_double_filter;
+	filter_class->complete = filter_double_complete;
+	filter_class->reset = filter_double_reset;
+}
+
+static void
+test_filter_double_init (TestFilterDouble *filter, TestFilterDoubleClass *klass)
+{
+	g_mime_filter_set_flags ((GMimeFilter *) filter, GMIME_FILTER_FLAGS_IN_PLACE);
+}
+
+
+typedef struct {
+	const char *name;
+	GMimeContentEncoding encoding;
+	gboolean crlf;
+	gboolean twice;
+} FilterChain;
+
+static FilterChain chains[] = {
+	{ "base64",            GMIME_CONTENT_ENCODING_BASE64,          FALSE, FALSE },
+	{ "quoted-printable",  GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, FALSE, FALSE },
+	{ "crlf",              GMIME_CONTENT_ENCODING_DEFAULT,         TRUE,  FALSE },
+	{ "base64, crlf",      GMIME_CONTENT_ENCODING_BASE64,          TRUE,  FALSE },
+	{ "qp, crlf",          GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, TRUE,  FALSE },
+	{ "double",            GMIME_CONTENT_ENCODING_DEFAULT,         FALSE, TRUE  },
+	{ "base64, double",    GMIME_CONTENT_ENCODING_BASE64,          FALSE, TRUE  },
+	{ "crlf, double",      GMIME_CONTENT_ENCODING_DEFAULT,         TRUE,  TRUE  },
+};
+
+/* chunk sizes on either side of the slack (and of a couple of its multiples) */
+static size_t chunk_sizes[] = {
+	1, 3,
+	GMIME_FILTER_IN_PLACE_SLACK - 1,
+	GMIME_FILTER_IN_PLACE_SLACK,
+	GMIME_FILTER_IN_PLACE_SLACK + 1,
+	GMIME_FILTER_IN_PLACE_SLACK * 2 - 1,
+	GMIME_FILTER_IN_PLACE_SLACK * 2 + 1,
+	4095, 4097
+};
+
+static GPtrArray *
+chain_new (FilterChain *chain)
+{
+	GPtrArray *filters;
+	
+	filters = g_ptr_array_new ();
+	
+	if (chain->encoding != GMIME_CONTENT_ENCODING_DEFAULT)
+		g_ptr_array_add (filters, g_mime_filter_basic_new (chain->encoding, FALSE));
+	
+	if (chain->crlf)
+		g_ptr_array_add (filters, g_mime_filter_crlf_new (FALSE, FALSE));
+	
+	if (chain->twice)
+		g_ptr_array_add (filters, g_object_newv (test_filter_double_get_type (), 0, NULL));
+	
+	return filters;
+}
+
+static void
+chain_free (GPtrArray *filters)
+{
+	guint i;
+	
+	for (i = 0; i < filters->len; i++)
+		g_object_unref (filters->pdata[i]);
+	
+	g_ptr_array_free (filters, TRUE);
+}
+
+/* g_mime_filter_filter() never gets to filter in place */
+static GByteArray *
+filter_copying (FilterChain *chain, const char *input, size_t inlen, size_t chunk)
+{
+	size_t outlen, outpre, len, n;
+	GPtrArray *filters;
+	GByteArray *output;
+	char *outbuf;
+	guint i;
+	
+	output = g_byte_array_new ();
+	filters = chain_new (chain);
+	
+	for (n = 0; n <= inlen; n += chunk) {
+		len = MIN (chunk, inlen - n);
+		outbuf = (char *) input + n;
+		outlen = len;
+		outpre = 0;
+		
+		for (i = 0; i < filters->len; i++) {
+			if (n + len < inlen)
+				g_mime_filter_filter (filters->pdata[i], outbuf, outlen, outpre, &outbuf, &outlen, &outpre);
+			else
+				g_mime_filter_complete (filters->pdata[i], outbuf, outlen, outpre, &outbuf, &outlen, &outpre);
+		}
+		
+		g_byte_array_append (output, (guint8 *) outbuf, outlen);
+		
+		if (n + len == inlen)
+			break;
+	}
+	
+	chain_free (filters);
+	
+	return output;
+}
+
+/* reading through a GMimeStreamFilter lets the chain filter its own
+ * read buffer in place; a cat stream delivers the input one chunk at
+ * a time */
+static GByteArray *
+filter_in_place (FilterChain *chain, const char *input, size_t inlen, size_t chunk)
+{
+	GMimeStream *cat, *mem, *filtered;
+	GPtrArray *filters;
+	GByteArray *output;
+	char buf[4096];
+	ssize_t nread;
+	size_t n, len;
+	guint i;
+	
+	cat = g_mime_stream_cat_new ();
+	for (n = 0; n < inlen; n += len) {
+		len = MIN (chunk, inlen - n);
+		mem = g_mime_stream_mem_new_with_buffer (input + n, len);
+		g_mime_stream_cat_add_source ((GMimeStreamCat *) cat, mem);
+		g_object_unref (mem);
+	}
+	
+	filtered = g_mime_stream_filter_new (cat);
+	g_object_unref (cat);
+	
+	filters = chain_new (chain);
+	for (i = 0; i < filters->len; i++)
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filters->pdata[i]);
+	chain_free (filters);
+	
+	output = g_byte_array_new ();
+	while (!g_mime_stream_eos (filtered)) {
+		/* a chunk may well filter down to nothing */
+		if ((nread = g_mime_stream_read (filtered, buf, sizeof (buf))) < 0)
+			break;
+		
+		g_byte_array_append (output, (guint8 *) buf, nread);
+	}
+	
+	g_object_unref (filtered);
+	
+	return output;
+}
+
+static GByteArray *
+encode (GMimeContentEncoding encoding, const char *text, size_t len)
+{
+	GMimeStream *stream, *filtered;
+	GMimeFilter *filter;
+	GByteArray *output;
+	
+	output = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (output);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	
+	filtered = g_mime_stream_filter_new (stream);
+	filter = g_mime_filter_basic_new (encoding, TRUE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	g_mime_stream_write (filtered, text, len);
+	g_mime_stream_flush (filtered);
+	g_object_unref (filtered);
+	g_object_unref (stream);
+	
+	return output;
+}
+
+static GByteArray *
+expected_output (FilterChain *chain, const char *text, size_t len)
+{
+	GByteArray *expected;
+	size_t i;
+	
+	expected = g_byte_array_new ();
+	
+	for (i = 0; i < len; i++) {
+		if (text[i] == '\r' && i + 1 < len && text[i + 1] == '\n') {
+			/* quoted-printable encodes a CRLF as a plain line break */
+			if (chain->crlf || chain->encoding == GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE)
+				continue;
+		} else if (text[i] == '\r' && i + 1 == len) {
+			/* the crlf filter drops a '\r' left over at the end */
+			if (chain->crlf)
+				continue;
+		}
+		
+		g_byte_array_append (expected, (guint8 *) text + i, 1);
+		if (chain->twice)
+			g_byte_array_append (expected, (guint8 *) text + i, 1);
+	}
+	
+	return expected;
+}
+
+static void
+test_in_place (const char *text, size_t len)
+{
+	GByteArray *input, *expected, *copied, *in_place;
+	Exception *ex;
+	guint i, j;
+	
+	for (i = 0; i < G_N_ELEMENTS (chains); i++) {
+		testsuite_check ("%s", chains[i].name);
+		
+		if (chains[i].encoding != GMIME_CONTENT_ENCODING_DEFAULT) {
+			input = encode (chains[i].encoding, text, len);
+		} else {
+			input = g_byte_array_new ();
+			g_byte_array_append (input, (guint8 *) text, len);
+		}
+		
+		expected = expected_output (&chains[i], text, len);
+		ex = NULL;
+		
+		for (j = 0; ex == NULL && j < G_N_ELEMENTS (chunk_sizes); j++) {
+			copied = filter_copying (&chains[i], (char *) input->data, input->len, chunk_sizes[j]);
+			in_place = filter_in_place (&chains[i], (char *) input->data, input->len, chunk_sizes[j]);
+			
+			if (copied->len != expected->len || memcmp (copied->data, expected->data, expected->len) != 0)
+				ex = exception_new ("copying output is wrong for %zu byte chunks", chunk_sizes[j]);
+			else if (in_place->len != copied->len || memcmp (in_place->data, copied->data, copied->len) != 0)
+				ex = exception_new ("in-place output differs for %zu byte chunks", chunk_sizes[j]);
+			
+			g_byte_array_free (in_place, TRUE);
+			g_byte_array_free (copied, TRUE);
+		}
+		
+		g_byte_array_free (expected, TRUE);
+		g_byte_array_free (input, TRUE);
+		
+		if (ex == NULL) {
+			testsuite_check_passed ();
+		} else {
+			testsuite_check_failed ("%s: %s", chains[i].name, ex->message);
+			exception_free (ex);
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	GString *text;
+	guint32 seed;
+	int i;
+	
+	g_mime_init ();
+	
+	testsuite_init (argc, argv);
+	
+	/* CRLF-terminated lines with some 8bit text and long runs thrown in */
+	text = g_string_new ("");
+	seed = 1;
+	for (i = 0; i < 400; i++) {
+		seed = seed * 1103515245 + 12345;
+		
+		switch ((seed >> 16) % 4) {
+		case 0:
+			g_string_append (text, "From here to there and back again.\r\n");
+			break;
+		case 1:
+			g_string_append (text, "Caf\xc3\xa9 cr\xc3\xa8me = br\xc3\xbbl\xc3\xa9""e\r\n");
+			break;
+		case 2:
+			g_string_append_printf (text, "%.*s\r\n", (int) ((seed >> 8) % 120),
+						"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+						"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+			break;
+		default:
+			g_string_append (text, "\r\n");
+			break;
+		}
+	}
+	
+	/* a trailing '\r' that the crlf filter has to hold on to */
+	g_string_append (text, "no newline at the end\r");
+	
+	testsuite_start ("filtering in place");
+	test_in_place (text->str, text->len);
+	testsuite_end ();
+	
+	g_string_free (text, TRUE);
+	
+	g_mime_shutdown ();
+	
+	return testsuite_exit ();
+}
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "testsuite.h"
 
@@ -162,6 +163,129 @@ test_remove_at (void)
 	g_mime_header_list_destroy (list);
 }
 
+/* well-known names in odd cases, unknown names and names that differ
+ * from well-known ones (or from each other) by a single character */
+static Header names[] = {
+	{ "SUBJECT",      "first subject"      },
+	{ "Subjekt",      "not a subject"      },
+	{ "content-TYPE", "text/plain"         },
+	{ "Content-Typo", "not a content type" },
+	{ "Content-Foo",  "first foo"          },
+	{ "Content-Bar",  "bar"                },
+	{ "X-Foo",        "first x-foo"        },
+	{ "X-Fop",        "x-fop"              },
+	{ "Tx",           "not a to"           },
+	{ "subject",      "second subject"     },
+	{ "CONTENT-foo",  "second foo"         },
+	{ "x-FOO",        "second x-foo"       },
+	{ "Content-Type", "text/html"          },
+};
+
+static Exception *
+check_names (GMimeHeaderList *list, Header *expected, guint n)
+{
+	GMimeHeader *header;
+	const char *value;
+	guint i;
+	
+	if (g_mime_header_list_get_count (list) != (int) n)
+		return exception_new ("expected %u headers but have %d", n, g_mime_header_list_get_count (list));
+	
+	for (i = 0; i < n; i++) {
+		header = g_mime_header_list_get_header (list, i);
+		
+		if (strcmp (g_mime_header_get_name (header), expected[i].name) != 0 ||
+		    strcmp (g_mime_header_get_value (header), expected[i].value) != 0)
+			return exception_new ("headers[%u] is %s instead of %s", i,
+					      g_mime_header_get_name (header), expected[i].name);
+	}
+	
+	/* whatever the case, a lookup has to find the first header with that name */
+	for (i = 0; i < n; i++) {
+		char *upper = g_ascii_strup (expected[i].name, -1);
+		guint j;
+		
+		for (j = 0; g_ascii_strcasecmp (expected[j].name, upper) != 0; j++)
+			;
+		
+		value = g_mime_header_list_get (list, upper);
+		g_free (upper);
+		
+		if (value == NULL || strcmp (value, expected[j].value) != 0)
+			return exception_new ("lookup of %s found %s instead of %s", expected[i].name,
+					      value ? value : "nothing", expected[j].value);
+	}
+	
+	return NULL;
+}
+
+static void
+test_header_names (void)
+{
+	static Header removed[] = {
+		{ "Subjekt",      "not a subject"      },
+		{ "content-TYPE", "text/plain"         },
+		{ "Content-Typo", "not a content type" },
+		{ "Content-Bar",  "bar"                },
+		{ "X-Foo",        "first x-foo"        },
+		{ "X-Fop",        "x-fop"              },
+		{ "Tx",           "not a to"           },
+		{ "subject",      "second subject"     },
+		{ "CONTENT-foo",  "second foo"         },
+		{ "x-FOO",        "second x-foo"       },
+		{ "Content-Type", "text/html"          },
+	};
+	static Header set[] = {
+		{ "Subjekt",      "not a subject"      },
+		{ "content-TYPE", "text/plain"         },
+		{ "Content-Typo", "not a content type" },
+		{ "Content-Bar",  "bar"                },
+		{ "X-Foo",        "new x-foo"          },
+		{ "X-Fop",        "x-fop"              },
+		{ "Tx",           "not a to"           },
+		{ "subject",      "second subject"     },
+		{ "CONTENT-foo",  "new foo"            },
+	};
+	GMimeHeaderList *list;
+	Exception *ex;
+	guint i;
+	
+	list = g_mime_header_list_new (g_mime_parser_options_get_default ());
+	for (i = 0; i < G_N_ELEMENTS (names); i++)
+		g_mime_header_list_append (list, names[i].name, names[i].value);
+	
+	testsuite_check ("looking up names");
+	if ((ex = check_names (list, names, G_N_ELEMENTS (names))) == NULL) {
+		testsuite_check_passed ();
+	} else {
+		testsuite_check_failed ("looking up names: %s", ex->message);
+		exception_free (ex);
+	}
+	
+	testsuite_check ("removing by name");
+	g_mime_header_list_remove (list, "Subject");
+	g_mime_header_list_remove (list, "content-foo");
+	if ((ex = check_names (list, removed, G_N_ELEMENTS (removed))) == NULL) {
+		testsuite_check_passed ();
+	} else {
+		testsuite_check_failed ("removing by name: %s", ex->message);
+		exception_free (ex);
+	}
+	
+	testsuite_check ("setting by name");
+	g_mime_header_list_set (list, "x-foo", "new x-foo");
+	g_mime_header_list_set (list, "Content-Foo", "new foo");
+	g_mime_header_list_set (list, "CONTENT-Type", "text/plain");
+	if ((ex = check_names (list, set, G_N_ELEMENTS (set))) == NULL) {
+		testsuite_check_passed ();
+	} else {
+		testsuite_check_failed ("setting by name: %s", ex->message);
+		exception_free (ex);
+	}
+	
+	g_mime_header_list_destroy (list);
+}
+
 static void
 test_header_sync (void)
 {
@@ -335,6 +459,559 @@ test_header_sync (void)
 	g_object_unref (message);
 }
 
+static void
+test_cached_values (void)
+{
+	InternetAddressList *addrlist;
+	const char *value, *decoded;
+	GMimeHeaderList *list;
+	GMimeHeader *header;
+	time_t date;
+	int offset;
+	
+	list = header_list_new ();
+	
+	testsuite_check ("decoded value");
+	try {
+		header = g_mime_header_list_get_header (list, 7);
+		g_mime_header_set_value (header, "=?iso-8859-1?Q?Caf=E9?=");
+		
+		if (!(decoded = g_mime_header_get_decoded_value (header)))
+			throw (exception_new ("decoded value unexpectedly null"));
+		
+		if (strcmp ("Caf\xc3\xa9", decoded) != 0)
+			throw (exception_new ("unexpected decoded value: %s", decoded));
+		
+		if (g_mime_header_get_decoded_value (header) != decoded)
+			throw (exception_new ("decoded value was not cached"));
+		
+		/* setting the header to its own decoded value must be safe */
+		g_mime_header_set_value (header, decoded);
+		value = g_mime_header_get_decoded_value (header);
+		
+		if (strcmp ("Caf\xc3\xa9", value) != 0)
+			throw (exception_new ("unexpected decoded value after set: %s", value));
+		
+		g_mime_header_set_value (header, "something else");
+		value = g_mime_header_get_decoded_value (header);
+		
+		if (strcmp ("something else", value) != 0)
+			throw (exception_new ("stale decoded value after set: %s", value));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("decoded value: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("addresses");
+	try {
+		header = g_mime_header_list_get_header (list, 6);
+		
+		if (!(addrlist = g_mime_header_get_addresses (header)))
+			throw (exception_new ("address list unexpectedly null"));
+		
+		if (internet_address_list_length (addrlist) != 1)
+			throw (exception_new ("unexpected number of addresses"));
+		
+		if (g_mime_header_get_addresses (header) != addrlist)
+			throw (exception_new ("address list was not cached"));
+		
+		g_mime_header_set_value (header, "a@example.com, b@example.com");
+		
+		if (!(addrlist = g_mime_header_get_addresses (header)))
+			throw (exception_new ("address list unexpectedly null after set"));
+		
+		if (internet_address_list_length (addrlist) != 2)
+			throw (exception_new ("stale address list after set"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("addresses: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("date");
+	try {
+		header = g_mime_header_list_get_header (list, 3);
+		date = g_mime_header_get_date (header, &offset);
+		
+		if (date != g_mime_utils_header_decode_date (initial[3].value, NULL) || offset != -500)
+			throw (exception_new ("unexpected date"));
+		
+		g_mime_header_set_value (header, "Thu, 1 Jan 1970 00:01:00 +0100");
+		date = g_mime_header_get_date (header, &offset);
+		
+		if (date != -3540 || offset != 100)
+			throw (exception_new ("stale date after set"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("date: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("message-id");
+	try {
+		header = g_mime_header_list_get_header (list, 8);
+		
+		if (!(value = g_mime_header_get_message_id (header)))
+			throw (exception_new ("message-id unexpectedly null"));
+		
+		if (strcmp ("136734928.123728@localhost.com", value) != 0)
+			throw (exception_new ("unexpected message-id: %s", value));
+		
+		g_mime_header_set_value (header, "<new@localhost.com>");
+		
+		if (!(value = g_mime_header_get_message_id (header)))
+			throw (exception_new ("message-id unexpectedly null after set"));
+		
+		if (strcmp ("new@localhost.com", value) != 0)
+			throw (exception_new ("stale message-id after set: %s", value));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("message-id: %s", ex->message);
+	} finally;
+	
+	g_mime_header_list_destroy (list);
+}
+
+static const char folded_headers[] =
+	"From: someone@example.com\n"
+	"X-Folded: first line\n\tsecond line  \n   third line\n"
+	"X-Crlf: one\r\n two\r\n\tthree\r\n"
+	"X-Leading:     \n  value after an empty first line\n"
+	"X-Trailing: value with trailing blanks \t \n"
+	"Received: from a.example.com (a.example.com [10.0.0.1])\n"
+	"\tby b.example.com with ESMTP id 12345\n"
+	"\tfor <someone@example.com>; Sat, 31 May 2008 08:56:43 -0500\n"
+	"Subject: hello\n";
+
+/* what the parser used to store when it unfolded every value up front */
+static Header unfolded[] = {
+	{ "From",       "someone@example.com"                  },
+	{ "X-Folded",   "first line\tsecond line     third line" },
+	{ "X-Crlf",     "one two\tthree"                       },
+	{ "X-Leading",  "value after an empty first line"      },
+	{ "X-Trailing", "value with trailing blanks"           },
+	{ "Received",   "from a.example.com (a.example.com [10.0.0.1])\tby b.example.com "
+	  "with ESMTP id 12345\tfor <someone@example.com>; Sat, 31 May 2008 08:56:43 -0500" },
+	{ "Subject",    "hello"                                },
+};
+
+static GMimeMessage *
+parse_message (const char *headers)
+{
+	GMimeMessage *message;
+	GMimeParser *parser;
+	GMimeStream *stream;
+	GByteArray *buffer;
+	
+	buffer = g_byte_array_new ();
+	g_byte_array_append (buffer, (guint8 *) headers, strlen (headers));
+	g_byte_array_append (buffer, (guint8 *) "\nbody\n", 6);
+	
+	stream = g_mime_stream_mem_new_with_byte_array (buffer);
+	parser = g_mime_parser_new_with_stream (stream);
+	g_object_unref (stream);
+	
+	message = g_mime_parser_construct_message (parser);
+	g_object_unref (parser);
+	
+	return message;
+}
+
+static gpointer
+get_value_thread (gpointer user_data)
+{
+	return (gpointer) g_mime_header_get_value ((GMimeHeader *) user_data);
+}
+
+static void
+test_lazy_unfold (void)
+{
+	GMimeHeaderList *list;
+	GMimeMessage *message;
+	GMimeHeader *header;
+	GThread *threads[4];
+	const char *value;
+	char *str;
+	guint i;
+	
+	testsuite_check ("unfolded values");
+	message = parse_message (folded_headers);
+	try {
+		if (message == NULL)
+			throw (exception_new ("failed to parse message"));
+		
+		list = GMIME_OBJECT (message)->headers;
+		
+		if (g_mime_header_list_get_count (list) != G_N_ELEMENTS (unfolded))
+			throw (exception_new ("unexpected header count: %d", g_mime_header_list_get_count (list)));
+		
+		for (i = 0; i < G_N_ELEMENTS (unfolded); i++) {
+			header = g_mime_header_list_get_header (list, i);
+			
+			if (strcmp (unfolded[i].name, g_mime_header_get_name (header)) != 0)
+				throw (exception_new ("unexpected name for header #%u: %s", i, g_mime_header_get_name (header)));
+			
+			value = g_mime_header_get_value (header);
+			
+			if (strcmp (unfolded[i].value, value) != 0)
+				throw (exception_new ("unexpected value for %s: \"%s\"", unfolded[i].name, value));
+			
+			if (g_mime_header_get_value (header) != value)
+				throw (exception_new ("value for %s was unfolded twice", unfolded[i].name));
+		}
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("unfolded values: %s", ex->message);
+	} finally;
+	
+	if (message != NULL)
+		g_object_unref (message);
+	
+	testsuite_check ("concurrent readers");
+	message = parse_message (folded_headers);
+	try {
+		if (message == NULL)
+			throw (exception_new ("failed to parse message"));
+		
+		header = g_mime_header_list_get_header (GMIME_OBJECT (message)->headers, 1);
+		
+		for (i = 0; i < G_N_ELEMENTS (threads); i++)
+			threads[i] = g_thread_new ("unfold", get_value_thread, header);
+		
+		value = g_mime_header_get_value (header);
+		
+		for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+			if (g_thread_join (threads[i]) != (gpointer) value)
+				throw (exception_new ("readers saw different values"));
+		}
+		
+		if (strcmp (unfolded[1].value, value) != 0)
+			throw (exception_new ("unexpected value: \"%s\"", value));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("concurrent readers: %s", ex->message);
+	} finally;
+	
+	if (message != NULL)
+		g_object_unref (message);
+	
+	testsuite_check ("writing unread headers");
+	message = parse_message (folded_headers);
+	try {
+		if (message == NULL)
+			throw (exception_new ("failed to parse message"));
+		
+		str = g_mime_header_list_to_string (GMIME_OBJECT (message)->headers);
+		i = strcmp (folded_headers, str);
+		g_free (str);
+		
+		if (i != 0)
+			throw (exception_new ("raw headers were not preserved"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("writing unread headers: %s", ex->message);
+	} finally;
+	
+	if (message != NULL)
+		g_object_unref (message);
+}
+
+static const char cached_headers[] =
+	"From: =?iso-8859-1?Q?Caf=E9?= <cafe@example.com>\n"
+	"To: a@example.com, =?utf-8?B?Q2Fmw6k=?= <b@example.com>\n"
+	"Date: Thu, 1 Jan 1970 00:01:00 +0100\n"
+	"Resent-Date: Sat, 31 May 2008 08:56:43 -0500\n"
+	"Message-Id: <136734928.123728@localhost.com>\n"
+	"In-Reply-To: <new@localhost.com>\n"
+	"Subject: =?iso-8859-1?Q?Caf=E9?= and =?utf-8?B?Q2Fmw6k=?=\n";
+
+/* what each of the cached getters returned for a header */
+typedef struct {
+	InternetAddressList *addresses;
+	const char *decoded;
+	const char *message_id;
+	time_t date;
+	int tz_offset;
+} CachedValues;
+
+typedef struct {
+	GMimeHeaderList *list;
+	volatile int waiting;
+} CachedReaders;
+
+static CachedValues *
+get_cached_values (GMimeHeaderList *list)
+{
+	int count = g_mime_header_list_get_count (list);
+	CachedValues *values;
+	GMimeHeader *header;
+	int i;
+	
+	values = g_new (CachedValues, count);
+	
+	for (i = 0; i < count; i++) {
+		header = g_mime_header_list_get_header (list, i);
+		
+		values[i].addresses = g_mime_header_get_addresses (header);
+		values[i].decoded = g_mime_header_get_decoded_value (header);
+		values[i].message_id = g_mime_header_get_message_id (header);
+		values[i].date = g_mime_header_get_date (header, &values[i].tz_offset);
+	}
+	
+	return values;
+}
+
+static gpointer
+get_cached_values_thread (gpointer user_data)
+{
+	CachedReaders *readers = user_data;
+	
+	/* wait for all of the readers, so that they race for every header */
+	g_atomic_int_add (&readers->waiting, -1);
+	while (g_atomic_int_get (&readers->waiting) > 0)
+		g_thread_yield ();
+	
+	return get_cached_values (readers->list);
+}
+
+static void
+test_cached_readers (void)
+{
+	CachedValues *expected, *values, *results[4];
+	GMimeMessage *message, *reference;
+	CachedReaders readers;
+	GThread *threads[4];
+	char *str, *addrs;
+	int count, i, j, k;
+	GString *headers;
+	gboolean same;
+	
+	/* plenty of headers to race for */
+	headers = g_string_new ("");
+	for (i = 0; i < 50; i++)
+		g_string_append (headers, cached_headers);
+	
+	reference = parse_message (headers->str);
+	
+	for (i = 0; i < 25; i++) {
+		testsuite_check ("concurrent readers #%d", i);
+		
+		message = parse_message (headers->str);
+		readers.list = GMIME_OBJECT (message)->headers;
+		readers.waiting = G_N_ELEMENTS (threads);
+		
+		for (j = 0; j < G_N_ELEMENTS (threads); j++)
+			threads[j] = g_thread_new ("cache", get_cached_values_thread, &readers);
+		
+		for (j = 0; j < G_N_ELEMENTS (threads); j++)
+			results[j] = g_thread_join (threads[j]);
+		
+		/* by now everything is cached, so this is what everybody should have got */
+		values = get_cached_values (readers.list);
+		expected = get_cached_values (GMIME_OBJECT (reference)->headers);
+		count = g_mime_header_list_get_count (readers.list);
+		
+		try {
+			for (j = 0; j < count; j++) {
+				if (g_strcmp0 (values[j].decoded, expected[j].decoded) != 0)
+					throw (exception_new ("unexpected decoded value for header #%d: %s", j, values[j].decoded));
+				
+				if (g_strcmp0 (values[j].message_id, expected[j].message_id) != 0)
+					throw (exception_new ("unexpected message-id for header #%d: %s", j, values[j].message_id));
+				
+				if (values[j].date != expected[j].date || values[j].tz_offset != expected[j].tz_offset)
+					throw (exception_new ("unexpected date for header #%d", j));
+				
+				if ((values[j].addresses == NULL) != (expected[j].addresses == NULL))
+					throw (exception_new ("unexpected addresses for header #%d", j));
+				
+				if (values[j].addresses != NULL) {
+					str = internet_address_list_to_string (values[j].addresses, FALSE);
+					addrs = internet_address_list_to_string (expected[j].addresses, FALSE);
+					same = strcmp (str, addrs) == 0;
+					g_free (addrs);
+					g_free (str);
+					
+					if (!same)
+						throw (exception_new ("unexpected addresses for header #%d", j));
+				}
+				
+				for (k = 0; k < G_N_ELEMENTS (threads); k++) {
+					if (results[k][j].addresses != values[j].addresses ||
+					    results[k][j].decoded != values[j].decoded ||
+					    results[k][j].message_id != values[j].message_id ||
+					    results[k][j].date != values[j].date ||
+					    results[k][j].tz_offset != values[j].tz_offset)
+						throw (exception_new ("readers got different values for header #%d", j));
+				}
+			}
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("concurrent readers #%d: %s", i, ex->message);
+		} finally;
+		
+		for (j = 0; j < G_N_ELEMENTS (threads); j++)
+			g_free (results[j]);
+		
+		g_free (expected);
+		g_free (values);
+		
+		g_object_unref (message);
+	}
+	
+	g_object_unref (reference);
+	g_string_free (headers, TRUE);
+}
+
+/* well-known and made-up names, some only differing in case */
+static const char *pool_names[] = {
+	"Subject", "subject", "From", "Content-Type", "CONTENT-TYPE", "Message-Id",
+	"X-Mailer", "X-Spam-Score", "x-spam-score", "List-Id", "X-Made-Up-Name",
+};
+
+static gpointer
+intern_names_thread (gpointer user_data)
+{
+	guint offset = GPOINTER_TO_UINT (user_data);
+	GMimeHeaderList *list;
+	guint i, j;
+	
+	list = g_mime_header_list_new (g_mime_parser_options_get_default ());
+	
+	/* every thread adds the names in a different order, several times over */
+	for (i = 0; i < 100; i++) {
+		for (j = 0; j < G_N_ELEMENTS (pool_names); j++)
+			g_mime_header_list_append (list, pool_names[(j + offset) % G_N_ELEMENTS (pool_names)], "value");
+	}
+	
+	return list;
+}
+
+static const char *
+find_name (GMimeHeaderList *list, const char *name)
+{
+	const char *str;
+	int i;
+	
+	for (i = 0; i < g_mime_header_list_get_count (list); i++) {
+		str = g_mime_header_get_name (g_mime_header_list_get_header (list, i));
+		if (!strcmp (str, name))
+			return str;
+	}
+	
+	return NULL;
+}
+
+static void
+test_name_pool (void)
+{
+	const char *interned[G_N_ELEMENTS (pool_names)];
+	GMimeHeaderList *lists[4], *list;
+	GThread *threads[4];
+	GMimeMessage *message;
+	const char *name;
+	Exception *ex;
+	guint i, j, k;
+	
+	testsuite_check ("interning names across threads");
+	for (i = 0; i < G_N_ELEMENTS (lists); i++)
+		threads[i] = g_thread_new ("intern", intern_names_thread, GUINT_TO_POINTER (i * 3));
+	for (i = 0; i < G_N_ELEMENTS (lists); i++)
+		lists[i] = g_thread_join (threads[i]);
+	
+	ex = NULL;
+	for (j = 0; ex == NULL && j < G_N_ELEMENTS (pool_names); j++) {
+		interned[j] = find_name (lists[0], pool_names[j]);
+		
+		/* the same name has to be the same pointer in every header... */
+		for (i = 0; ex == NULL && i < G_N_ELEMENTS (lists); i++) {
+			for (k = 0; k < (guint) g_mime_header_list_get_count (lists[i]); k++) {
+				name = g_mime_header_get_name (g_mime_header_list_get_header (lists[i], k));
+				if (!strcmp (name, pool_names[j]) && name != interned[j]) {
+					ex = exception_new ("%s was interned more than once", pool_names[j]);
+					break;
+				}
+			}
+		}
+		
+		/* ...and different names have to be different pointers */
+		for (k = 0; ex == NULL && k < j; k++) {
+			if (interned[k] == interned[j])
+				ex = exception_new ("%s and %s share a pointer", pool_names[k], pool_names[j]);
+		}
+	}
+	
+	if (ex == NULL) {
+		testsuite_check_passed ();
+	} else {
+		testsuite_check_failed ("interning names across threads: %s", ex->message);
+		exception_free (ex);
+	}
+	
+	testsuite_check ("known names");
+	try {
+		message = parse_message (folded_headers);
+		list = g_mime_object_get_header_list ((GMimeObject *) message);
+		
+		/* the parser interns names the same way header lists do */
+		if (find_name (list, "Subject") != interned[0] || find_name (list, "From") != interned[2])
+			throw (exception_new ("parsed names are not interned"));
+		
+		if (!(name = g_mime_header_list_get (list, "SUBJECT")) || strcmp (name, "hello") != 0)
+			throw (exception_new ("lookup of SUBJECT failed"));
+		
+		if (!(name = g_mime_header_list_get (list, "from")) || strcmp (name, "someone@example.com") != 0)
+			throw (exception_new ("lookup of from failed"));
+		
+		g_object_unref (message);
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("known names: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("names outliving g_mime_shutdown()");
+	try {
+		g_mime_shutdown ();
+		g_mime_init ();
+		
+		/* headers added after g_mime_init() go to a new pool */
+		for (i = 0; i < G_N_ELEMENTS (lists); i++)
+			g_mime_header_list_append (lists[i], "X-After-Init", "value");
+		
+		list = g_mime_header_list_new (g_mime_parser_options_get_default ());
+		g_mime_header_list_append (list, "Subject", "value");
+		
+		if (find_name (list, "Subject") == interned[0])
+			throw (exception_new ("the old name pool was reused"));
+		
+		for (i = 0; i < G_N_ELEMENTS (lists); i++) {
+			for (j = 0; j < G_N_ELEMENTS (pool_names); j++) {
+				if (!find_name (lists[i], pool_names[j]))
+					throw (exception_new ("%s went missing", pool_names[j]));
+			}
+			
+			if (!find_name (lists[i], "X-After-Init"))
+				throw (exception_new ("X-After-Init went missing"));
+		}
+		
+		g_mime_header_list_destroy (list);
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("names outliving g_mime_shutdown(): %s", ex->message);
+	} finally;
+	
+	for (i = 0; i < G_N_ELEMENTS (lists); i++)
+		g_mime_header_list_destroy (lists[i]);
+}
+
 int main (int argc, char **argv)
 {
 	g_mime_init ();
@@ -349,10 +1026,30 @@ int main (int argc, char **argv)
 	test_remove_at ();
 	testsuite_end ();
 	
+	testsuite_start ("header names");
+	test_header_names ();
+	testsuite_end ();
+	
 	testsuite_start ("header synchronization");
 	test_header_sync ();
 	testsuite_end ();
 	
+	testsuite_start ("cached header values");
+	test_cached_values ();
+	testsuite_end ();
+	
+	testsuite_start ("lazy header unfolding");
+	test_lazy_unfold ();
+	testsuite_end ();
+	
+	testsuite_start ("concurrent cached header values");
+	test_cached_readers ();
+	testsuite_end ();
+	
+	testsuite_start ("header name pool");
+	test_name_pool ();
+	testsuite_end ();
+	
 	g_mime_shutdown ();
 	
 	return testsuite_exit ();
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <gmime/gmime.h>
 
@@ -204,9 +205,464 @@ test_utils (void)
 	testsuite_end ();
 }
 
+static GByteArray *
+filter_content (GByteArray *content, GMimeFilter **filters, int n_filters)
+{
+	GMimeStream *stream, *filtered, *mem;
+	GByteArray *array;
+	int i;
+	
+	stream = g_mime_stream_mem_new_with_buffer ((char *) content->data, content->len);
+	filtered = g_mime_stream_filter_new (stream);
+	g_object_unref (stream);
+	
+	for (i = 0; i < n_filters; i++) {
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filters[i]);
+		g_object_unref (filters[i]);
+	}
+	
+	array = g_byte_array_new ();
+	mem = g_mime_stream_mem_new_with_byte_array (array);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) mem, FALSE);
+	g_mime_stream_write_to_stream (filtered, mem);
+	g_object_unref (filtered);
+	g_object_unref (mem);
+	
+	return array;
+}
+
+static const char *native_charsets[] = {
+	"us-ascii",
+	"iso-8859-1",
+	"iso-8859-15",
+	"windows-1252",
+	"utf-8",
+};
+
+/* converts @input with iconv, skipping over the bytes that cannot be converted like #GMimeFilterCharset does */
+static GByteArray *
+iconv_content (iconv_t cd, GByteArray *input)
+{
+	size_t inleft, outleft;
+	char *inbuf, *outbuf;
+	GByteArray *output;
+	
+	output = g_byte_array_sized_new (input->len * 3);
+	g_byte_array_set_size (output, input->len * 3);
+	
+	inbuf = (char *) input->data;
+	inleft = input->len;
+	outbuf = (char *) output->data;
+	outleft = output->len;
+	
+	while (inleft > 0) {
+		if (iconv (cd, &inbuf, &inleft, &outbuf, &outleft) != (size_t) -1)
+			continue;
+		
+		if (errno != EILSEQ)
+			break;
+		
+		inbuf++;
+		inleft--;
+	}
+	
+	g_byte_array_set_size (output, output->len - outleft);
+	
+	return output;
+}
+
+static void
+test_native_filter (void)
+{
+	GByteArray *input, *expected, *actual;
+	GMimeFilter *filter;
+	iconv_t cd;
+	int i, c;
+	
+	testsuite_start ("native charset filters");
+	
+	/* every byte value, each in a run of ASCII long enough to take the word-at-a-time path */
+	input = g_byte_array_new ();
+	for (c = 1; c < 256; c++) {
+		g_byte_array_append (input, (unsigned char *) "some ascii text ", 16);
+		g_byte_array_append (input, (unsigned char *) &c, 1);
+	}
+	
+	/* and some valid UTF-8 */
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		if (!g_ascii_strcasecmp (tests[i].charset, "utf-8"))
+			g_byte_array_append (input, (unsigned char *) tests[i].text, strlen (tests[i].text));
+	}
+	
+	for (i = 0; i < G_N_ELEMENTS (native_charsets); i++) {
+		testsuite_check ("%s to UTF-8", native_charsets[i]);
+		
+		if ((cd = g_mime_iconv_open ("UTF-8", native_charsets[i])) == (iconv_t) -1) {
+			testsuite_check_failed ("could not open conversion for %s to UTF-8", native_charsets[i]);
+			continue;
+		}
+		
+		expected = iconv_content (cd, input);
+		g_mime_iconv_close (cd);
+		
+		filter = g_mime_filter_charset_new (native_charsets[i], "UTF-8");
+		actual = filter_content (input, &filter, 1);
+		
+		try {
+			if (actual->len != expected->len)
+				throw (exception_new ("lengths do not match: expected %u, got %u",
+						      expected->len, actual->len));
+			
+			if (memcmp (actual->data, expected->data, actual->len) != 0)
+				throw (exception_new ("text does not match"));
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("%s to UTF-8 failed: %s", native_charsets[i], ex->message);
+		} finally;
+		
+		g_byte_array_free (expected, TRUE);
+		g_byte_array_free (actual, TRUE);
+	}
+	
+	g_byte_array_free (input, TRUE);
+	
+	testsuite_end ();
+}
+
+static const char *ties_text = "caf\xe9 \x81\xa5";
+
+static struct {
+	const char *first, *second;
+	const char *decoded;
+} ties[] = {
+	{ "windows-1252", "windows-1250", "\xc2\xa5" },
+	{ "windows-1250", "windows-1252", "\xc4\x84" },
+};
+
+static void
+test_detect (void)
+{
+	GByteArray *input, *expected, *actual;
+	GMimeParserOptions *options;
+	const char *charsets[4];
+	GMimeFilter *filter;
+	char *utf8;
+	iconv_t cd;
+	int i, j;
+	
+	testsuite_start ("charset detection");
+	
+	options = g_mime_parser_options_new ();
+	charsets[0] = "utf-8";
+	charsets[2] = "iso-8859-1";
+	charsets[3] = NULL;
+	
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		testsuite_check ("test #%d: %s", i, tests[i].charset);
+		
+		if ((cd = g_mime_iconv_open ("UTF-8", tests[i].charset)) == (iconv_t) -1) {
+			testsuite_check_failed ("could not open conversion for %s to UTF-8", tests[i].charset);
+			continue;
+		}
+		
+		charsets[1] = tests[i].charset;
+		g_mime_parser_options_set_fallback_charsets (options, charsets);
+		
+		/* long enough for the filter to have to sample it */
+		input = g_byte_array_new ();
+		for (j = 0; j < 1000; j++) {
+			g_byte_array_append (input, (unsigned char *) tests[i].text, strlen (tests[i].text));
+			g_byte_array_append (input, (unsigned char *) "\n", 1);
+		}
+		
+		expected = iconv_content (cd, input);
+		g_mime_iconv_close (cd);
+		
+		utf8 = g_mime_utils_decode_8bit (options, (char *) input->data, input->len);
+		
+		filter = g_mime_filter_charset_new_detect (options, "UTF-8");
+		actual = filter_content (input, &filter, 1);
+		
+		try {
+			if (strlen (utf8) != expected->len || memcmp (utf8, expected->data, expected->len) != 0)
+				throw (exception_new ("g_mime_utils_decode_8bit() did not detect %s", tests[i].charset));
+			
+			if (actual->len != expected->len || memcmp (actual->data, expected->data, actual->len) != 0)
+				throw (exception_new ("the charset filter did not detect %s", tests[i].charset));
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("test #%d failed: %s", i, ex->message);
+		} finally;
+		
+		g_byte_array_free (expected, TRUE);
+		g_byte_array_free (actual, TRUE);
+		g_byte_array_free (input, TRUE);
+		g_free (utf8);
+	}
+	
+	/* input that fits several charsets equally badly is decoded as
+	 * whichever of them comes first, even if it reads as letters in
+	 * a later one (0x81 is unassigned in both windows-1252 and
+	 * windows-1250, but 0xa5 is a yen sign in the former and a
+	 * letter in the latter) */
+	for (i = 0; i < G_N_ELEMENTS (ties); i++) {
+		testsuite_check ("ties: %s before %s", ties[i].first, ties[i].second);
+		
+		charsets[1] = ties[i].first;
+		charsets[2] = ties[i].second;
+		g_mime_parser_options_set_fallback_charsets (options, charsets);
+		
+		input = g_byte_array_new ();
+		g_byte_array_append (input, (unsigned char *) ties_text, strlen (ties_text));
+		
+		utf8 = g_mime_utils_decode_8bit (options, (char *) input->data, input->len);
+		
+		filter = g_mime_filter_charset_new_detect (options, "UTF-8");
+		actual = filter_content (input, &filter, 1);
+		g_byte_array_append (actual, (unsigned char *) "", 1);
+		
+		try {
+			if (!strstr (utf8, ties[i].decoded))
+				throw (exception_new ("g_mime_utils_decode_8bit() did not decode as %s: %s",
+						      ties[i].first, utf8));
+			
+			if (!strstr ((char *) actual->data, ties[i].decoded))
+				throw (exception_new ("the charset filter did not decode as %s", ties[i].first));
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("ties: %s before %s failed: %s", ties[i].first,
+						ties[i].second, ex->message);
+		} finally;
+		
+		g_byte_array_free (actual, TRUE);
+		g_byte_array_free (input, TRUE);
+		g_free (utf8);
+	}
+	
+	g_mime_parser_options_free (options);
+	
+	testsuite_end ();
+}
+
+static struct {
+	GMimeContentEncoding encoding;
+	const char *name;
+} text_encodings[] = {
+	{ GMIME_CONTENT_ENCODING_8BIT, "8bit" },
+	{ GMIME_CONTENT_ENCODING_BASE64, "base64" },
+	{ GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, "quoted-printable" },
+};
+
+static void
+test_text_filter (void)
+{
+	GByteArray *native, *encoded, *expected, *actual;
+	GMimeFilter *filters[3];
+	GMimeEncoding encoder;
+	int i, j, k;
+	
+	testsuite_start ("text extraction filter");
+	
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		for (j = 0; j < G_N_ELEMENTS (text_encodings); j++) {
+			testsuite_check ("test #%d: %s %s to UTF-8", i, text_encodings[j].name, tests[i].charset);
+			
+			/* make it big enough to span a number of reads and mix the line endings */
+			native = g_byte_array_new ();
+			for (k = 0; k < 500; k++) {
+				g_byte_array_append (native, (unsigned char *) tests[i].text, strlen (tests[i].text));
+				g_byte_array_append (native, (unsigned char *) "\r\n", (k % 3) ? 2 : 1);
+			}
+			
+			g_mime_encoding_init_encode (&encoder, text_encodings[j].encoding);
+			encoded = g_byte_array_sized_new (g_mime_encoding_outlen (&encoder, native->len));
+			encoded->len = g_mime_encoding_flush (&encoder, (char *) native->data, native->len, (char *) encoded->data);
+			
+			filters[0] = g_mime_filter_basic_new (text_encodings[j].encoding, FALSE);
+			filters[1] = g_mime_filter_charset_new (tests[i].charset, "UTF-8");
+			filters[2] = g_mime_filter_crlf_new (FALSE, FALSE);
+			expected = filter_content (encoded, filters, 3);
+			
+			filters[0] = g_mime_filter_text_new (text_encodings[j].encoding, tests[i].charset);
+			actual = filter_content (encoded, filters, 1);
+			
+			try {
+				if (actual->len != expected->len)
+					throw (exception_new ("lengths do not match: expected %u, got %u",
+							      expected->len, actual->len));
+				
+				if (memcmp (actual->data, expected->data, actual->len) != 0)
+					throw (exception_new ("text does not match"));
+				
+				testsuite_check_passed ();
+			} catch (ex) {
+				testsuite_check_failed ("test #%d failed: %s", i, ex->message);
+			} finally;
+			
+			g_byte_array_free (expected, TRUE);
+			g_byte_array_free (encoded, TRUE);
+			g_byte_array_free (native, TRUE);
+			g_byte_array_free (actual, TRUE);
+		}
+	}
+	
+	testsuite_end ();
+}
+
+/* more charset pairs than a thread keeps descriptors for */
+static const char *thread_charsets[] = {
+	"iso-8859-1", "iso-8859-2", "iso-8859-3", "iso-8859-4", "iso-8859-9",
+	"iso-8859-10", "iso-8859-13", "iso-8859-15", "windows-1250", "windows-1252",
+};
+
+/* converts "Caf" to each charset and back again, returning the number of failures */
+static int
+convert_round_trips (int rounds)
+{
+	const char *text = "Caf\xc3\xa9";
+	char *native, *utf8;
+	int failed = 0;
+	iconv_t cd;
+	int i;
+	
+	for (i = 0; i < rounds * G_N_ELEMENTS (thread_charsets); i++) {
+		const char *charset = thread_charsets[(i * 7) % G_N_ELEMENTS (thread_charsets)];
+		
+		if ((cd = g_mime_iconv_open (charset, "UTF-8")) == (iconv_t) -1) {
+			failed++;
+			continue;
+		}
+		
+		native = g_mime_iconv_strdup (cd, text);
+		g_mime_iconv_close (cd);
+		
+		if (native == NULL || (cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1) {
+			g_free (native);
+			failed++;
+			continue;
+		}
+		
+		utf8 = g_mime_iconv_strdup (cd, native);
+		g_mime_iconv_close (cd);
+		g_free (native);
+		
+		if (utf8 == NULL || strcmp (utf8, text) != 0)
+			failed++;
+		
+		g_free (utf8);
+	}
+	
+	return failed;
+}
+
+static gpointer
+round_trip_thread (gpointer user_data)
+{
+	return GINT_TO_POINTER (convert_round_trips (GPOINTER_TO_INT (user_data)));
+}
+
+typedef struct {
+	GAsyncQueue *ready;
+	GAsyncQueue *wake;
+} IdleThread;
+
+/* keeps its descriptors across a g_mime_shutdown() and g_mime_init() */
+static gpointer
+idle_thread (gpointer user_data)
+{
+	IdleThread *idle = user_data;
+	int failed = 0;
+	iconv_t cd;
+	
+	/* fill this thread's descriptor slots and keep one of them open
+	 * while waiting to be woken up */
+	failed += convert_round_trips (2);
+	cd = g_mime_iconv_open ("UTF-8", "iso-8859-2");
+	g_async_queue_push (idle->ready, GINT_TO_POINTER (1));
+	g_async_queue_pop (idle->wake);
+	
+	if (cd == (iconv_t) -1 || g_mime_iconv_close (cd) != 0)
+		failed++;
+	
+	failed += convert_round_trips (2);
+	
+	return GINT_TO_POINTER (failed);
+}
+
+static void
+test_threads (void)
+{
+	GThread *threads[4];
+	IdleThread idle;
+	int failed, i;
+	iconv_t cd;
+	
+	testsuite_start ("iconv descriptors across threads");
+	
+	testsuite_check ("opening and closing in several threads");
+	for (i = 0; i < G_N_ELEMENTS (threads); i++)
+		threads[i] = g_thread_new ("iconv", round_trip_thread, GINT_TO_POINTER (50));
+	
+	for (i = 0, failed = 0; i < G_N_ELEMENTS (threads); i++)
+		failed += GPOINTER_TO_INT (g_thread_join (threads[i]));
+	
+	if (failed == 0)
+		testsuite_check_passed ();
+	else
+		testsuite_check_failed ("opening and closing in several threads: %d conversions failed", failed);
+	
+	testsuite_check ("closing in another thread");
+	try {
+		/* descriptors opened here are owned by this thread's slots */
+		if ((cd = g_mime_iconv_open ("UTF-8", "iso-8859-1")) == (iconv_t) -1)
+			throw (exception_new ("could not open conversion for iso-8859-1 to UTF-8"));
+		
+		threads[0] = g_thread_new ("iconv", (GThreadFunc) g_mime_iconv_close, cd);
+		if (g_thread_join (threads[0]) != NULL)
+			throw (exception_new ("g_mime_iconv_close() failed"));
+		
+		if (convert_round_trips (2) != 0)
+			throw (exception_new ("conversions failed after closing in another thread"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("closing in another thread: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("reinitializing");
+	try {
+		idle.ready = g_async_queue_new ();
+		idle.wake = g_async_queue_new ();
+		threads[0] = g_thread_new ("iconv", idle_thread, &idle);
+		g_async_queue_pop (idle.ready);
+		
+		g_mime_shutdown ();
+		g_mime_init ();
+		
+		/* both threads have to discard their stale descriptors */
+		g_async_queue_push (idle.wake, GINT_TO_POINTER (1));
+		failed = convert_round_trips (2);
+		failed += GPOINTER_TO_INT (g_thread_join (threads[0]));
+		g_async_queue_unref (idle.ready);
+		g_async_queue_unref (idle.wake);
+		
+		if (failed != 0)
+			throw (exception_new ("%d conversions failed", failed));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("reinitializing: %s", ex->message);
+	} finally;
+	
+	testsuite_end ();
+}
+
 int main (int argc, char **argv)
 {
-	g_mime_iconv_init ();
+	g_mime_init ();
 	
 	testsuite_init (argc, argv);
 	
@@ -218,8 +674,12 @@ int main (int argc, char **argv)
 #endif
 	
 	test_utils ();
+	test_native_filter ();
+	test_detect ();
+	test_text_filter ();
+	test_threads ();
 	
-	g_mime_iconv_shutdown ();
+	g_mime_shutdown ();
 	
 	return testsuite_exit ();
 }
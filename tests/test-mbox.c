@@ -87,70 +87,837 @@ print_mime_struct (GMimeStream *stream, GMimeObject *part, int depth)
 }
 
 static void
-test_parser (GMimeParser *parser, GMimeStream *mbox, GMimeStream *summary)
+print_message_summary (GMimeParser *parser, GMimeMessage *message, gint64 message_begin, GMimeStream *summary)
 {
-	gint64 message_begin, message_end, headers_begin, headers_end;
+	gint64 message_end, headers_begin, headers_end;
 	InternetAddressList *list;
-	GMimeMessage *message;
-	char *marker, *buf;
 	const char *subject;
+	char *marker, *buf;
 	int tz_offset;
-	int nmsg = 0;
 	time_t date;
 	
+	message_end = g_mime_parser_tell (parser);
+	
+	headers_begin = g_mime_parser_get_headers_begin (parser);
+	headers_end = g_mime_parser_get_headers_end (parser);
+	
+	g_mime_stream_printf (summary, "message offsets: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT "\n",
+			      message_begin, message_end);
+	g_mime_stream_printf (summary, "header offsets: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT "\n",
+			      headers_begin, headers_end);
+	
+	marker = g_mime_parser_get_from (parser);
+	g_mime_stream_printf (summary, "%s\n", marker);
+	g_free (marker);
+	
+	if ((list = g_mime_message_get_from (message)) != NULL &&
+	    internet_address_list_length (list) > 0) {
+		buf = internet_address_list_to_string (list, FALSE);
+		g_mime_stream_printf (summary, "From: %s\n", buf);
+		g_free (buf);
+	}
+	
+	if ((list = g_mime_message_get_addresses (message, GMIME_ADDRESS_TYPE_TO)) != NULL &&
+	    internet_address_list_length (list) > 0) {
+		buf = internet_address_list_to_string (list, FALSE);
+		g_mime_stream_printf (summary, "To: %s\n", buf);
+		g_free (buf);
+	}
+	
+	if (!(subject = g_mime_message_get_subject (message)))
+		subject = "";
+	g_mime_stream_printf (summary, "Subject: %s\n", subject);
+	
+	g_mime_message_get_date (message, &date, &tz_offset);
+	buf = g_mime_utils_header_format_date (date, tz_offset);
+	g_mime_stream_printf (summary, "Date: %s\n", buf);
+	g_free (buf);
+	
+	print_mime_struct (summary, message->mime_part, 0);
+	g_mime_stream_write (summary, "\n", 1);
+}
+
+static void
+test_parser (GMimeParser *parser, GMimeStream *mbox, GMimeStream *summary)
+{
+	GMimeMessage *message;
+	gint64 message_begin;
+	char *marker;
+	int nmsg = 0;
+	
 	while (!g_mime_parser_eos (parser)) {
 		message_begin = g_mime_parser_tell (parser);
 		if (!(message = g_mime_parser_construct_message (parser)))
 			throw (exception_new ("failed to parse message #%d", nmsg));
 		
-		message_end = g_mime_parser_tell (parser);
+		print_message_summary (parser, message, message_begin, summary);
 		
-		headers_begin = g_mime_parser_get_headers_begin (parser);
-		headers_end = g_mime_parser_get_headers_end (parser);
+		if (mbox) {
+			marker = g_mime_parser_get_from (parser);
+			g_mime_stream_printf (mbox, "%s%s\n", nmsg > 0 ? "\n" : "", marker);
+			g_mime_object_write_to_stream ((GMimeObject *) message, mbox);
+			g_free (marker);
+		}
 		
-		g_mime_stream_printf (summary, "message offsets: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT "\n",
-				      message_begin, message_end);
-		g_mime_stream_printf (summary, "header offsets: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT "\n",
-				      headers_begin, headers_end);
+		g_object_unref (message);
+		nmsg++;
+	}
+}
+
+typedef struct {
+	GMimeStream *summary;
+	gint64 message_begin;
+} ThreadedSummary;
+
+static void
+threaded_message_cb (GMimeParser *parser, GMimeMessage *message, gpointer user_data)
+{
+	ThreadedSummary *ts = user_data;
+	
+	print_message_summary (parser, message, ts->message_begin, ts->summary);
+	ts->message_begin = g_mime_parser_tell (parser);
+}
+
+static void
+test_parser_threaded (GMimeParser *parser, GMimeStream *summary)
+{
+	ThreadedSummary ts;
+	int nmsg;
+	
+	ts.summary = summary;
+	ts.message_begin = g_mime_parser_tell (parser);
+	
+	nmsg = g_mime_parser_construct_mbox (parser, NULL, 4, threaded_message_cb, &ts);
+	
+	if (!g_mime_parser_eos (parser))
+		throw (exception_new ("failed to parse message #%d", nmsg));
+}
+
+static Exception *
+check_index (GMimeMboxIndex *index, GMimeStream *mbox, gboolean respect_content_length)
+{
+	const GMimeMboxIndexEntry *entry;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	Exception *ex = NULL;
+	guint n = 0;
+	
+	g_mime_stream_reset (mbox);
+	parser = g_mime_parser_new_with_stream (mbox);
+	g_mime_parser_set_respect_content_length (parser, respect_content_length);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	
+	while (!g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message (parser)))
+			break;
 		
-		marker = g_mime_parser_get_from (parser);
-		g_mime_stream_printf (summary, "%s\n", marker);
+		g_object_unref (message);
 		
-		if ((list = g_mime_message_get_from (message)) != NULL &&
-		    internet_address_list_length (list) > 0) {
-			buf = internet_address_list_to_string (list, FALSE);
-			g_mime_stream_printf (summary, "From: %s\n", buf);
-			g_free (buf);
+		if (!(entry = g_mime_mbox_index_get_entry (index, n))) {
+			ex = exception_new ("message #%u is missing from the index", n);
+			break;
 		}
 		
-		if ((list = g_mime_message_get_addresses (message, GMIME_ADDRESS_TYPE_TO)) != NULL &&
-		    internet_address_list_length (list) > 0) {
-			buf = internet_address_list_to_string (list, FALSE);
-			g_mime_stream_printf (summary, "To: %s\n", buf);
-			g_free (buf);
+		if (entry->start != g_mime_parser_get_from_offset (parser) ||
+		    entry->headers_end != g_mime_parser_get_headers_end (parser) ||
+		    entry->end != g_mime_parser_tell (parser)) {
+			ex = exception_new ("wrong offsets for message #%u", n);
+			break;
 		}
 		
-		if (!(subject = g_mime_message_get_subject (message)))
-			subject = "";
-		g_mime_stream_printf (summary, "Subject: %s\n", subject);
+		n++;
+	}
+	
+	g_object_unref (parser);
+	
+	if (ex == NULL && n != g_mime_mbox_index_get_count (index))
+		ex = exception_new ("index has %u messages, expected %u", g_mime_mbox_index_get_count (index), n);
+	
+	return ex;
+}
+
+static void
+test_mbox_index (GMimeStream *mbox, gboolean respect_content_length)
+{
+	char idxname[] = "mbox-index.XXXXXX", tmpname[] = "mbox-append.XXXXXX";
+	const GMimeMboxIndexEntry *entry;
+	GMimeMboxIndex *index, *loaded;
+	GMimeStream *stream, *tmp;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	Exception *error;
+	GError *err = NULL;
+	gint64 len;
+	guint n;
+	int fd;
+	
+	parser = g_mime_parser_new ();
+	g_mime_parser_set_respect_content_length (parser, respect_content_length);
+	
+	index = g_mime_mbox_index_new ();
+	g_mime_mbox_index_update (index, parser, mbox);
+	if ((error = check_index (index, mbox, respect_content_length)) != NULL)
+		throw (error);
+	
+	/* round-trip the index through the disk */
+	if ((fd = g_mkstemp (idxname)) == -1)
+		throw (exception_new ("could not create `%s'", idxname));
+	close (fd);
+	
+	if (!g_mime_mbox_index_save (index, idxname, &err) || !(loaded = g_mime_mbox_index_load (idxname, &err))) {
+		unlink (idxname);
+		throw (exception_new ("%s", err->message));
+	}
+	
+	unlink (idxname);
+	
+	if (g_mime_mbox_index_update (loaded, parser, mbox) != 0)
+		throw (exception_new ("loaded index was not up to date"));
+	
+	if ((error = check_index (loaded, mbox, respect_content_length)) != NULL)
+		throw (error);
+	
+	g_mime_mbox_index_free (loaded);
+	
+	/* seek straight to each message, last to first */
+	for (n = g_mime_mbox_index_get_count (index); n > 0; n--) {
+		entry = g_mime_mbox_index_get_entry (index, n - 1);
+		
+		if (!g_mime_mbox_index_seek (index, n - 1, parser, mbox))
+			throw (exception_new ("could not seek to message #%u", n - 1));
 		
-		g_mime_message_get_date (message, &date, &tz_offset);
-		buf = g_mime_utils_header_format_date (date, tz_offset);
-		g_mime_stream_printf (summary, "Date: %s\n", buf);
-		g_free (buf);
+		if (!(message = g_mime_parser_construct_message (parser)))
+			throw (exception_new ("failed to parse message #%u", n - 1));
 		
-		print_mime_struct (summary, message->mime_part, 0);
-		g_mime_stream_write (summary, "\n", 1);
+		g_object_unref (message);
 		
-		if (mbox) {
-			g_mime_stream_printf (mbox, "%s%s\n", nmsg > 0 ? "\n" : "", marker);
-			g_mime_object_write_to_stream ((GMimeObject *) message, mbox);
+		if (g_mime_parser_tell (parser) != entry->end)
+			throw (exception_new ("message #%u did not end where the index says", n - 1));
+	}
+	
+	/* index the first message of a growing mbox, then the rest */
+	if (g_mime_mbox_index_get_count (index) > 1) {
+		if ((fd = g_mkstemp (tmpname)) == -1)
+			throw (exception_new ("could not create `%s'", tmpname));
+		
+		tmp = g_mime_stream_fs_new (fd);
+		
+		len = g_mime_mbox_index_get_entry (index, 1)->start;
+		stream = g_mime_stream_substream (mbox, 0, len);
+		g_mime_stream_write_to_stream (stream, tmp);
+		g_object_unref (stream);
+		
+		loaded = g_mime_mbox_index_new ();
+		n = g_mime_mbox_index_update (loaded, parser, tmp);
+		
+		g_mime_stream_seek (tmp, 0, GMIME_STREAM_SEEK_END);
+		stream = g_mime_stream_substream (mbox, len, -1);
+		g_mime_stream_write_to_stream (stream, tmp);
+		g_object_unref (stream);
+		
+		n += g_mime_mbox_index_update (loaded, parser, tmp);
+		
+		if (n != g_mime_mbox_index_get_count (index) + 1)
+			error = exception_new ("appended messages were not scanned incrementally");
+		else
+			error = check_index (loaded, tmp, respect_content_length);
+		
+		g_mime_mbox_index_free (loaded);
+		g_object_unref (tmp);
+		unlink (tmpname);
+		
+		if (error != NULL)
+			throw (error);
+	}
+	
+	g_mime_mbox_index_free (index);
+	g_object_unref (parser);
+}
+
+static GByteArray *
+message_to_bytes (GMimeMessage *message)
+{
+	GMimeStream *stream;
+	GByteArray *bytes;
+	
+	bytes = g_byte_array_new ();
+	stream = g_mime_stream_mem_new ();
+	g_mime_stream_mem_set_byte_array ((GMimeStreamMem *) stream, bytes);
+	g_mime_object_write_to_stream ((GMimeObject *) message, stream);
+	g_object_unref (stream);
+	
+	return bytes;
+}
+
+static void
+test_rewrite (GMimeStream *mbox, gboolean respect_content_length)
+{
+	GMimeMessage *message, *reparsed;
+	GMimeParser *parser, *reparser;
+	GByteArray *bytes, *orig;
+	GMimeStream *stream;
+	Exception *ex = NULL;
+	gint64 begin, end;
+	guint n = 0;
+	
+	g_mime_stream_reset (mbox);
+	parser = g_mime_parser_new_with_stream (mbox);
+	g_mime_parser_set_respect_content_length (parser, respect_content_length);
+	g_mime_parser_set_persist_stream (parser, TRUE);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	
+	orig = g_byte_array_new ();
+	
+	while (ex == NULL && !g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message (parser)))
+			break;
+		
+		begin = g_mime_parser_get_headers_begin (parser);
+		end = g_mime_parser_tell (parser);
+		
+		/* an untouched message gets written back out verbatim */
+		bytes = message_to_bytes (message);
+		g_byte_array_set_size (orig, bytes->len);
+		stream = g_mime_stream_substream (mbox, begin, end);
+		
+		if (begin + bytes->len > end || g_mime_stream_read (stream, (char *) orig->data, orig->len) != (ssize_t) orig->len ||
+		    memcmp (orig->data, bytes->data, bytes->len) != 0)
+			ex = exception_new ("message #%u was not written back out verbatim", n);
+		
+		g_byte_array_free (bytes, TRUE);
+		g_object_unref (stream);
+		
+		/* ...but a modified one must not be */
+		if (ex == NULL) {
+			g_mime_message_set_subject (message, "rewritten", NULL);
+			bytes = message_to_bytes (message);
+			
+			stream = g_mime_stream_mem_new_with_buffer ((char *) bytes->data, bytes->len);
+			reparser = g_mime_parser_new_with_stream (stream);
+			reparsed = g_mime_parser_construct_message (reparser);
+			g_byte_array_free (bytes, TRUE);
+			g_object_unref (reparser);
+			g_object_unref (stream);
+			
+			if (reparsed == NULL || g_strcmp0 (g_mime_message_get_subject (reparsed), "rewritten") != 0)
+				ex = exception_new ("message #%u lost its modification", n);
+			
+			if (reparsed != NULL)
+				g_object_unref (reparsed);
 		}
 		
 		g_object_unref (message);
-		g_free (marker);
-		nmsg++;
+		n++;
+	}
+	
+	g_byte_array_free (orig, TRUE);
+	g_object_unref (parser);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
+static GByteArray *
+stream_to_bytes (GMimeStream *stream)
+{
+	GMimeStream *mem;
+	GByteArray *bytes;
+	
+	bytes = g_byte_array_new ();
+	mem = g_mime_stream_mem_new ();
+	g_mime_stream_mem_set_byte_array ((GMimeStreamMem *) mem, bytes);
+	g_mime_stream_reset (stream);
+	g_mime_stream_write_to_stream (stream, mem);
+	g_mime_stream_reset (stream);
+	g_object_unref (mem);
+	
+	return bytes;
+}
+
+static gboolean
+headers_match (GMimeObject *full, GMimeObject *partial)
+{
+	char *a, *b;
+	int rv;
+	
+	a = g_mime_header_list_to_string (full->headers);
+	b = g_mime_header_list_to_string (partial->headers);
+	rv = strcmp (a, b);
+	g_free (a);
+	g_free (b);
+	
+	return rv == 0;
+}
+
+static gboolean
+bytes_match (GByteArray *a, GByteArray *b)
+{
+	return a->len == b->len && memcmp (a->data, b->data, a->len) == 0;
+}
+
+/* compares a headers-only tree against a fully parsed one and makes
+ * sure that none of its content was copied out of @source */
+static const char *
+compare_headers_only (GMimeObject *full, GMimeObject *partial, GMimeStream *source)
+{
+	GMimeMessagePart *fpart, *ppart;
+	GByteArray *fbytes, *pbytes;
+	GMimeDataWrapper *wrapper;
+	const char *reason;
+	GMimeStream *stream;
+	gboolean match;
+	int i, n;
+	
+	if (G_OBJECT_TYPE (full) != G_OBJECT_TYPE (partial))
+		return "structure differs";
+	
+	if (!headers_match (full, partial))
+		return "headers differ";
+	
+	if (GMIME_IS_MULTIPART (full)) {
+		n = g_mime_multipart_get_count ((GMimeMultipart *) full);
+		if (g_mime_multipart_get_count ((GMimeMultipart *) partial) != n)
+			return "number of subparts differs";
+		
+		for (i = 0; i < n; i++) {
+			reason = compare_headers_only (g_mime_multipart_get_part ((GMimeMultipart *) full, i),
+						       g_mime_multipart_get_part ((GMimeMultipart *) partial, i),
+						       source);
+			if (reason != NULL)
+				return reason;
+		}
+	} else if (GMIME_IS_MESSAGE_PART (full)) {
+		fpart = (GMimeMessagePart *) full;
+		ppart = (GMimeMessagePart *) partial;
+		
+		if ((fpart->message == NULL) != (ppart->message == NULL))
+			return "embedded message differs";
+		
+		if (fpart->message != NULL)
+			return compare_headers_only ((GMimeObject *) fpart->message, (GMimeObject *) ppart->message, source);
+	} else if (GMIME_IS_MESSAGE (full)) {
+		return compare_headers_only (((GMimeMessage *) full)->mime_part, ((GMimeMessage *) partial)->mime_part, source);
+	} else if (GMIME_IS_PART (full)) {
+		if (!(wrapper = g_mime_part_get_content_object ((GMimePart *) partial)))
+			return "content is missing";
+		
+		stream = g_mime_data_wrapper_get_stream (wrapper);
+		
+		/* the content must still be a window onto the source */
+		if (GMIME_IS_STREAM_MEM (stream) && (!GMIME_IS_STREAM_MEM (source) ||
+		    ((GMimeStreamMem *) stream)->buffer != ((GMimeStreamMem *) source)->buffer))
+			return "content was loaded";
+		
+		fbytes = stream_to_bytes (g_mime_data_wrapper_get_stream (g_mime_part_get_content_object ((GMimePart *) full)));
+		pbytes = stream_to_bytes (stream);
+		match = bytes_match (fbytes, pbytes);
+		g_byte_array_free (fbytes, TRUE);
+		g_byte_array_free (pbytes, TRUE);
+		
+		if (!match)
+			return "content differs";
+	}
+	
+	return NULL;
+}
+
+static const char *
+parse_headers_only (GMimeStream *stream)
+{
+	GMimeMessage *full, *message;
+	GMimeParser *parser;
+	const char *reason;
+	
+	parser = g_mime_parser_new_with_stream (stream);
+	if (!(full = g_mime_parser_construct_message (parser))) {
+		g_object_unref (parser);
+		return "failed to parse";
+	}
+	
+	g_mime_stream_reset (stream);
+	g_mime_parser_init_with_stream (parser, stream);
+	g_mime_parser_set_headers_only (parser, TRUE);
+	
+	if ((message = g_mime_parser_construct_message (parser)) != NULL) {
+		if (!g_mime_parser_eos (parser))
+			reason = "end of stream was not reached";
+		else
+			reason = compare_headers_only ((GMimeObject *) full, (GMimeObject *) message, stream);
+		
+		g_object_unref (message);
+	} else {
+		reason = "failed to parse headers only";
+	}
+	
+	g_object_unref (parser);
+	g_object_unref (full);
+	
+	return reason;
+}
+
+static void
+test_headers_only (GMimeStream *mbox, gboolean respect_content_length)
+{
+	char tmpname[] = "headers-only.XXXXXX";
+	GMimeStream *stream, *fs, *mem;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	Exception *ex = NULL;
+	const char *reason;
+	gint64 begin, end;
+	guint n = 0;
+	int fd;
+	
+	g_mime_stream_reset (mbox);
+	parser = g_mime_parser_new_with_stream (mbox);
+	g_mime_parser_set_respect_content_length (parser, respect_content_length);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	
+	while (ex == NULL && !g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message (parser)))
+			break;
+		
+		begin = g_mime_parser_get_headers_begin (parser);
+		end = g_mime_parser_tell (parser);
+		g_object_unref (message);
+		
+		stream = g_mime_stream_substream (mbox, begin, end);
+		
+		/* parse the message on its own, from a file of its own... */
+		if ((fd = g_mkstemp (tmpname)) == -1) {
+			ex = exception_new ("could not create `%s'", tmpname);
+		} else {
+			fs = g_mime_stream_fs_new (fd);
+			g_mime_stream_write_to_stream (stream, fs);
+			g_mime_stream_reset (fs);
+			
+			if ((reason = parse_headers_only (fs)) != NULL)
+				ex = exception_new ("message #%u (fs): %s", n, reason);
+			
+			g_object_unref (fs);
+			unlink (tmpname);
+			strcpy (tmpname + strlen (tmpname) - 6, "XXXXXX");
+		}
+		
+		/* ...and out of memory */
+		if (ex == NULL) {
+			mem = g_mime_stream_mem_new ();
+			g_mime_stream_reset (stream);
+			g_mime_stream_write_to_stream (stream, mem);
+			g_mime_stream_reset (mem);
+			
+			if ((reason = parse_headers_only (mem)) != NULL)
+				ex = exception_new ("message #%u (mem): %s", n, reason);
+			
+			g_object_unref (mem);
+		}
+		
+		g_object_unref (stream);
+		n++;
+	}
+	
+	g_object_unref (parser);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
+/* a part as reconstructed from the parser's scan events */
+typedef struct _ScanNode {
+	struct _ScanNode *parent;
+	GPtrArray *children;
+	GString *headers;
+	GByteArray *content;
+	gint64 content_begin;
+	char *mime_type;
+	guint boundaries;
+} ScanNode;
+
+typedef struct {
+	ScanNode *root;
+	ScanNode *current;
+	const char *error;
+	int depth;
+} ScanContext;
+
+static ScanNode *
+scan_node_new (ScanNode *parent)
+{
+	ScanNode *node;
+	
+	node = g_new0 (ScanNode, 1);
+	node->children = g_ptr_array_new ();
+	node->headers = g_string_new ("");
+	node->content = g_byte_array_new ();
+	node->content_begin = -1;
+	node->parent = parent;
+	
+	if (parent != NULL)
+		g_ptr_array_add (parent->children, node);
+	
+	return node;
+}
+
+static void
+scan_node_free (ScanNode *node)
+{
+	guint i;
+	
+	for (i = 0; i < node->children->len; i++)
+		scan_node_free (node->children->pdata[i]);
+	
+	g_ptr_array_free (node->children, TRUE);
+	g_string_free (node->headers, TRUE);
+	g_byte_array_free (node->content, TRUE);
+	g_free (node->mime_type);
+	g_free (node);
+}
+
+static void
+scan_event_cb (GMimeParser *parser, const GMimeParserEvent *event, gpointer user_data)
+{
+	ScanContext *ctx = user_data;
+	ScanNode *node = ctx->current;
+	
+	if (ctx->error != NULL)
+		return;
+	
+	if (event->type != GMIME_PARSER_EVENT_BEGIN_PART && node == NULL) {
+		ctx->error = "event outside of a part";
+		return;
+	}
+	
+	switch (event->type) {
+	case GMIME_PARSER_EVENT_BEGIN_PART:
+		if (node == NULL && ctx->root != NULL) {
+			ctx->error = "more than one toplevel part";
+			return;
+		}
+		
+		node = scan_node_new (node);
+		if (ctx->root == NULL)
+			ctx->root = node;
+		
+		ctx->current = node;
+		ctx->depth++;
+		break;
+	case GMIME_PARSER_EVENT_HEADER:
+		g_string_append_printf (node->headers, "%" G_GINT64_FORMAT " %s: %s\n",
+					event->offset, event->name, event->value);
+		break;
+	case GMIME_PARSER_EVENT_END_HEADERS:
+		node->mime_type = g_mime_content_type_to_string (event->content_type);
+		break;
+	case GMIME_PARSER_EVENT_CONTENT:
+		if (node->content->len == 0)
+			node->content_begin = event->offset;
+		else if (event->offset != node->content_begin + node->content->len)
+			ctx->error = "content chunks are not contiguous";
+		
+		g_byte_array_append (node->content, (guint8 *) event->data, event->len);
+		break;
+	case GMIME_PARSER_EVENT_BOUNDARY:
+		if (event->len < 2 || strncmp (event->data, "--", 2) != 0)
+			ctx->error = "boundary event without a boundary marker";
+		
+		node->boundaries++;
+		break;
+	case GMIME_PARSER_EVENT_END_PART:
+		ctx->current = node->parent;
+		ctx->depth--;
+		break;
+	}
+	
+	/* BEGIN_PART has already entered the part */
+	if (ctx->error == NULL && event->depth != ctx->depth - (event->type == GMIME_PARSER_EVENT_END_PART ? 0 : 1))
+		ctx->error = "unexpected event depth";
+}
+
+static void
+append_header_event (GString *str, GMimeHeader *header)
+{
+	g_string_append_printf (str, "%" G_GINT64_FORMAT " %s: %s\n", g_mime_header_get_offset (header),
+				g_mime_header_get_name (header), g_mime_header_get_value (header));
+}
+
+/* a message's headers are split between the message and its toplevel
+ * part, but the parser reports them as a single block in stream order */
+static char *
+header_lists_to_events (GMimeHeaderList *list, GMimeHeaderList *more)
+{
+	GMimeHeader *a, *b;
+	GString *str;
+	int i = 0, j = 0;
+	int n, m;
+	
+	str = g_string_new ("");
+	
+	n = g_mime_header_list_get_count (list);
+	m = more ? g_mime_header_list_get_count (more) : 0;
+	
+	while (i < n || j < m) {
+		a = i < n ? g_mime_header_list_get_header (list, i) : NULL;
+		b = j < m ? g_mime_header_list_get_header (more, j) : NULL;
+		
+		if (b == NULL || (a != NULL && g_mime_header_get_offset (a) < g_mime_header_get_offset (b))) {
+			append_header_event (str, a);
+			i++;
+		} else {
+			append_header_event (str, b);
+			j++;
+		}
+	}
+	
+	return g_string_free (str, FALSE);
+}
+
+static const char *
+compare_scan (ScanNode *node, GMimeObject *object, gboolean headers)
+{
+	GMimeMessagePart *mpart;
+	GMimeDataWrapper *wrapper;
+	GMimeStream *stream;
+	GByteArray *content;
+	const char *reason;
+	gboolean match;
+	char *str;
+	int i, n;
+	
+	if (GMIME_IS_MESSAGE (object) && !((GMimeMessage *) object)->mime_part)
+		return "message has no toplevel part";
+	
+	if (headers) {
+		if (GMIME_IS_MESSAGE (object))
+			str = header_lists_to_events (object->headers, ((GMimeMessage *) object)->mime_part->headers);
+		else
+			str = header_lists_to_events (object->headers, NULL);
+		
+		match = !strcmp (str, node->headers->str);
+		g_free (str);
+		
+		if (!match)
+			return "headers differ";
+	}
+	
+	if (GMIME_IS_MESSAGE (object))
+		return compare_scan (node, ((GMimeMessage *) object)->mime_part, FALSE);
+	
+	str = g_mime_content_type_to_string (g_mime_object_get_content_type (object));
+	match = node->mime_type != NULL && !strcmp (str, node->mime_type);
+	g_free (str);
+	
+	if (!match)
+		return "content types differ";
+	
+	if (GMIME_IS_MULTIPART (object)) {
+		n = g_mime_multipart_get_count ((GMimeMultipart *) object);
+		
+		if (node->children->len != (guint) n)
+			return "number of subparts differs";
+		
+		/* every subpart is introduced by a boundary, and the end boundary is optional */
+		if (node->boundaries != (guint) n && node->boundaries != (guint) n + 1)
+			return "unexpected number of boundaries";
+		
+		for (i = 0; i < n; i++) {
+			if ((reason = compare_scan (node->children->pdata[i], g_mime_multipart_get_part ((GMimeMultipart *) object, i), TRUE)))
+				return reason;
+		}
+	} else if (GMIME_IS_MESSAGE_PART (object)) {
+		mpart = (GMimeMessagePart *) object;
+		
+		if (node->children->len != (mpart->message ? 1 : 0))
+			return "embedded message differs";
+		
+		if (mpart->message != NULL)
+			return compare_scan (node->children->pdata[0], (GMimeObject *) mpart->message, TRUE);
+	} else if (GMIME_IS_PART (object)) {
+		if (node->children->len != 0)
+			return "leaf part has subparts";
+		
+		if (!(wrapper = g_mime_part_get_content_object ((GMimePart *) object)))
+			return node->content->len > 0 ? "content differs" : NULL;
+		
+		stream = g_mime_data_wrapper_get_stream (wrapper);
+		
+		if (node->content->len > 0 && (stream->bound_start != node->content_begin ||
+		    stream->bound_end != node->content_begin + node->content->len))
+			return "content offsets differ";
+		
+		content = stream_to_bytes (stream);
+		match = bytes_match (content, node->content);
+		g_byte_array_free (content, TRUE);
+		
+		if (!match)
+			return "content differs";
+	}
+	
+	return NULL;
+}
+
+static void
+test_scan_events (GMimeStream *mbox, gboolean respect_content_length)
+{
+	GMimeMessage *message;
+	GMimeParser *parser;
+	GPtrArray *messages;
+	Exception *ex = NULL;
+	const char *reason;
+	ScanContext ctx;
+	guint n = 0;
+	
+	/* build the trees to compare against... */
+	g_mime_stream_reset (mbox);
+	parser = g_mime_parser_new_with_stream (mbox);
+	g_mime_parser_set_respect_content_length (parser, respect_content_length);
+	g_mime_parser_set_persist_stream (parser, TRUE);
+	g_mime_parser_set_scan_from (parser, TRUE);
+	messages = g_ptr_array_new ();
+	
+	while (!g_mime_parser_eos (parser)) {
+		if (!(message = g_mime_parser_construct_message (parser)))
+			break;
+		
+		g_ptr_array_add (messages, message);
+	}
+	
+	/* ...then replay the events for the same messages */
+	g_mime_stream_reset (mbox);
+	g_mime_parser_init_with_stream (parser, mbox);
+	
+	while (ex == NULL && !g_mime_parser_eos (parser)) {
+		memset (&ctx, 0, sizeof (ctx));
+		
+		if (g_mime_parser_scan_message (parser, NULL, scan_event_cb, &ctx) == -1) {
+			if (n < messages->len)
+				ex = exception_new ("failed to scan message #%u", n);
+		} else if (n >= messages->len) {
+			ex = exception_new ("scanned more messages than were constructed");
+		} else if (ctx.error != NULL) {
+			ex = exception_new ("message #%u: %s", n, ctx.error);
+		} else if (ctx.root == NULL || ctx.current != NULL) {
+			ex = exception_new ("message #%u: unbalanced parts", n);
+		} else if ((reason = compare_scan (ctx.root, messages->pdata[n], TRUE)) != NULL) {
+			ex = exception_new ("message #%u: %s", n, reason);
+		}
+		
+		if (ctx.root != NULL)
+			scan_node_free (ctx.root);
+		
+		n++;
 	}
+	
+	if (ex == NULL && n != messages->len)
+		ex = exception_new ("scanned %u messages, expected %u", n, messages->len);
+	
+	for (n = 0; n < messages->len; n++)
+		g_object_unref (messages->pdata[n]);
+	
+	g_ptr_array_free (messages, TRUE);
+	g_object_unref (parser);
+	
+	if (ex != NULL)
+		throw (ex);
 }
 
 static gboolean
@@ -248,6 +1015,55 @@ streams_match (GMimeStream *istream, GMimeStream *ostream)
 	return FALSE;
 }
 
+static void
+test_scan_buffer_size (GMimeStream *mbox, GMimeStream *expected, gboolean respect_content_length)
+{
+	/* 1 gets rounded up to the smallest buffer the parser will use */
+	static const size_t sizes[] = { 0, 1, 4096, 65536 };
+	GMimeParserOptions *options;
+	GMimeStream *summary;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	Exception *ex = NULL;
+	gint64 message_begin;
+	guint i;
+	
+	for (i = 0; ex == NULL && i < G_N_ELEMENTS (sizes); i++) {
+		options = g_mime_parser_options_new ();
+		g_mime_parser_options_set_scan_buffer_size (options, sizes[i]);
+		
+		g_mime_stream_reset (mbox);
+		parser = g_mime_parser_new_with_stream (mbox);
+		g_mime_parser_set_respect_content_length (parser, respect_content_length);
+		g_mime_parser_set_persist_stream (parser, TRUE);
+		g_mime_parser_set_scan_from (parser, TRUE);
+		summary = g_mime_stream_mem_new ();
+		
+		while (!g_mime_parser_eos (parser)) {
+			message_begin = g_mime_parser_tell (parser);
+			if (!(message = g_mime_parser_construct_message_with_options (parser, options))) {
+				ex = exception_new ("failed to parse with a %zu byte scan buffer", sizes[i]);
+				break;
+			}
+			
+			print_message_summary (parser, message, message_begin, summary);
+			g_object_unref (message);
+		}
+		
+		g_mime_stream_reset (expected);
+		g_mime_stream_reset (summary);
+		if (ex == NULL && !streams_match (expected, summary))
+			ex = exception_new ("summaries do not match with a %zu byte scan buffer", sizes[i]);
+		
+		g_mime_parser_options_free (options);
+		g_object_unref (summary);
+		g_object_unref (parser);
+	}
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
 int main (int argc, char **argv)
 {
 	const char *datadir = "data/mbox";
@@ -362,6 +1178,24 @@ int main (int argc, char **argv)
 				if (!streams_match (ostream, pstream))
 					throw (exception_new ("summaries do not match for `%s'", dent));
 				
+				/* parsing the mbox in parallel must give the same results */
+				g_object_unref (pstream);
+				pstream = g_mime_stream_mem_new ();
+				g_mime_stream_reset (istream);
+				g_mime_parser_init_with_stream (parser, istream);
+				test_parser_threaded (parser, pstream);
+				
+				g_mime_stream_reset (ostream);
+				g_mime_stream_reset (pstream);
+				if (!streams_match (ostream, pstream))
+					throw (exception_new ("threaded summaries do not match for `%s'", dent));
+				
+				test_mbox_index (istream, strstr (dent, "content-length") != NULL);
+				test_rewrite (istream, strstr (dent, "content-length") != NULL);
+				test_headers_only (istream, strstr (dent, "content-length") != NULL);
+				test_scan_events (istream, strstr (dent, "content-length") != NULL);
+				test_scan_buffer_size (istream, ostream, strstr (dent, "content-length") != NULL);
+				
 				testsuite_check_passed ();
 				
 #ifdef ENABLE_MBOX_MATCH
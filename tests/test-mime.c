@@ -414,7 +414,9 @@ static struct {
 static void
 test_rfc2047 (GMimeParserOptions *options, gboolean test_broken)
 {
+	GString *decoded, *expected;
 	char *enc, *dec;
+	size_t len;
 	guint i;
 	
 	for (i = 0; i < G_N_ELEMENTS (rfc2047_text); i++) {
@@ -463,6 +465,57 @@ test_rfc2047 (GMimeParserOptions *options, gboolean test_broken)
 		g_free (enc);
 	}
 	
+	/* decode all of the headers onto the end of the same string,
+	 * which must leave whatever was already there alone */
+	decoded = g_string_new ("Subject: ");
+	expected = g_string_new ("Subject: ");
+	
+	for (i = 0; i < G_N_ELEMENTS (rfc2047_text); i++) {
+		testsuite_check ("rfc2047_text[%u] (appended)", i);
+		try {
+			len = decoded->len;
+			g_mime_utils_header_decode_text_append (options, rfc2047_text[i].input, decoded);
+			if (decoded->len < len || memcmp (decoded->str, expected->str, len) != 0)
+				throw (exception_new ("preceding text was modified: %s", decoded->str));
+			
+			if (strcmp (rfc2047_text[i].decoded, decoded->str + len) != 0)
+				throw (exception_new ("decoded text does not match: %s", decoded->str + len));
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("rfc2047_text[%u] (appended): %s", i, ex->message);
+		} finally;
+		
+		g_string_assign (expected, decoded->str);
+	}
+	
+	g_string_assign (decoded, "From: ");
+	g_string_assign (expected, "From: ");
+	
+	for (i = 0; i < G_N_ELEMENTS (rfc2047_text); i++) {
+		testsuite_check ("rfc2047_text[%u] (appended phrase)", i);
+		dec = g_mime_utils_header_decode_phrase (options, rfc2047_text[i].input);
+		try {
+			len = decoded->len;
+			g_mime_utils_header_decode_phrase_append (options, rfc2047_text[i].input, decoded);
+			if (decoded->len < len || memcmp (decoded->str, expected->str, len) != 0)
+				throw (exception_new ("preceding text was modified: %s", decoded->str));
+			
+			if (strcmp (dec, decoded->str + len) != 0)
+				throw (exception_new ("decoded phrase does not match: %s", decoded->str + len));
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("rfc2047_text[%u] (appended phrase): %s", i, ex->message);
+		} finally;
+		
+		g_string_assign (expected, decoded->str);
+		g_free (dec);
+	}
+	
+	g_string_free (expected, TRUE);
+	g_string_free (decoded, TRUE);
+	
 #if 0
 	for (i = 0; i < G_N_ELEMENTS (rfc2047_phrase); i++) {
 		dec = enc = NULL;
@@ -634,12 +687,12 @@ int main (int argc, char **argv)
 	testsuite_init (argc, argv);
 	
 	testsuite_start ("addr-spec parser (strict)");
-	options->rfc2047 = GMIME_RFC_COMPLIANCE_STRICT;
+	g_mime_parser_options_set_rfc2047_compliance_mode (options, GMIME_RFC_COMPLIANCE_STRICT);
 	test_addrspec (options, FALSE);
 	testsuite_end ();
 	
 	testsuite_start ("addr-spec parser (loose)");
-	options->rfc2047 = GMIME_RFC_COMPLIANCE_LOOSE;
+	g_mime_parser_options_set_rfc2047_compliance_mode (options, GMIME_RFC_COMPLIANCE_LOOSE);
 	test_addrspec (options, TRUE);
 	testsuite_end ();
 	
@@ -648,12 +701,12 @@ int main (int argc, char **argv)
 	testsuite_end ();
 	
 	testsuite_start ("rfc2047 encoding/decoding (strict)");
-	options->rfc2047 = GMIME_RFC_COMPLIANCE_STRICT;
+	g_mime_parser_options_set_rfc2047_compliance_mode (options, GMIME_RFC_COMPLIANCE_STRICT);
 	test_rfc2047 (options, FALSE);
 	testsuite_end ();
 	
 	testsuite_start ("rfc2047 encoding/decoding (loose)");
-	options->rfc2047 = GMIME_RFC_COMPLIANCE_LOOSE;
+	g_mime_parser_options_set_rfc2047_compliance_mode (options, GMIME_RFC_COMPLIANCE_LOOSE);
 	test_rfc2047 (options, TRUE);
 	testsuite_end ();
 	
@@ -519,6 +519,203 @@ test_streams (GDir *dir, const char *datadir, const char *filename)
 }
 
 
+static const char *vector_blocks[] = {
+	"Subject: ", "vectored I/O", "\n", "", "\n", "body text\n", "--", "boundary", "--\n"
+};
+
+static void
+check_stream_vectors (GMimeStream *stream, const char *what)
+{
+	GMimeStreamIOVector vector[G_N_ELEMENTS (vector_blocks)];
+	GMimeStreamIOVector rvector[3];
+	char expected[256], buf[256];
+	size_t len = 0, i;
+	gint64 n;
+	
+	testsuite_check ("%s vectored I/O", what);
+	try {
+		for (i = 0; i < G_N_ELEMENTS (vector_blocks); i++) {
+			vector[i].data = (char *) vector_blocks[i];
+			vector[i].len = strlen (vector_blocks[i]);
+			memcpy (expected + len, vector_blocks[i], vector[i].len);
+			len += vector[i].len;
+		}
+		
+		if ((n = g_mime_stream_writev (stream, vector, G_N_ELEMENTS (vector))) != (gint64) len)
+			throw (exception_new ("writev() returned %" G_GINT64_FORMAT " instead of %u", n, (unsigned int) len));
+		
+		if (g_mime_stream_reset (stream) == -1)
+			throw (exception_new ("reset() failed"));
+		
+		/* read it back in differently sized pieces */
+		for (i = 0, n = 0; n < (gint64) len && i < 16; i++) {
+			size_t left = len - (size_t) n;
+			gint64 nread;
+			
+			rvector[0].data = buf + n;
+			rvector[0].len = MIN (left, 5);
+			rvector[1].data = buf + n + rvector[0].len;
+			rvector[1].len = 0;
+			rvector[2].data = rvector[1].data;
+			rvector[2].len = left - rvector[0].len;
+			
+			if ((nread = g_mime_stream_readv (stream, rvector, 3)) <= 0)
+				break;
+			
+			n += nread;
+		}
+		
+		if (n != (gint64) len || memcmp (buf, expected, len) != 0)
+			throw (exception_new ("readv() did not read back what was written"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("%s vectored I/O failed: %s", what, ex->message);
+	} finally;
+}
+
+static void
+test_stream_vectors (void)
+{
+	GMimeStream *stream, *source;
+	char *filename;
+	int fd, i;
+	
+	stream = g_mime_stream_mem_new ();
+	check_stream_vectors (stream, "GMimeStreamMem");
+	g_object_unref (stream);
+	
+	/* make sure the writes spill over from one source to the next */
+	stream = g_mime_stream_cat_new ();
+	for (i = 0; i < 3; i++) {
+		GByteArray *array = g_byte_array_new ();
+		
+		g_byte_array_set_size (array, i < 2 ? 7 : 0);
+		source = g_mime_stream_mem_new_with_byte_array (array);
+		if (i < 2)
+			g_mime_stream_set_bounds (source, 0, 7);
+		
+		g_mime_stream_cat_add_source ((GMimeStreamCat *) stream, source);
+		g_object_unref (source);
+	}
+	
+	check_stream_vectors (stream, "GMimeStreamCat");
+	g_object_unref (stream);
+	
+	if ((fd = g_file_open_tmp ("gmime-test-streams-XXXXXX", &filename, NULL)) != -1) {
+		stream = g_mime_stream_fs_new (fd);
+		check_stream_vectors (stream, "GMimeStreamFs");
+		g_object_unref (stream);
+		
+		unlink (filename);
+		g_free (filename);
+	}
+}
+
+
+/* reads that are at least as big as the read size (plus its padding)
+ * get filtered in the caller's buffer */
+static size_t filter_read_sizes[] = { 100, 4096 + 64, 4096 + 65, 70000 };
+
+static struct {
+	const char *what;
+	size_t first, count;
+} filter_reads[] = {
+	{ "small reads", 0, 1 },
+	{ "large reads", 1, 1 },
+	{ "larger reads", 2, 2 },
+	{ "mixed reads", 0, 4 },
+};
+
+static GByteArray *
+read_filtered (GMimeStream *source, size_t first, size_t count)
+{
+	GMimeStream *stream;
+	GMimeFilter *filter;
+	GByteArray *output;
+	size_t size, i = 0;
+	ssize_t nread;
+	char *buf;
+	
+	g_mime_stream_reset (source);
+	stream = g_mime_stream_filter_new (source);
+	g_mime_stream_filter_set_read_size ((GMimeStreamFilter *) stream, 4096);
+	
+	filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_BASE64, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_crlf_new (FALSE, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) stream, filter);
+	g_object_unref (filter);
+	
+	buf = g_malloc (filter_read_sizes[G_N_ELEMENTS (filter_read_sizes) - 1]);
+	output = g_byte_array_new ();
+	
+	while (!g_mime_stream_eos (stream)) {
+		size = filter_read_sizes[first + (i++ % count)];
+		
+		if ((nread = g_mime_stream_read (stream, buf, size)) < 0)
+			break;
+		
+		g_byte_array_append (output, (guint8 *) buf, nread);
+	}
+	
+	g_object_unref (stream);
+	g_free (buf);
+	
+	return output;
+}
+
+static void
+test_stream_filter_reads (void)
+{
+	GMimeStream *source, *encoded;
+	GByteArray *expected, *output;
+	GMimeFilter *filter;
+	GString *text;
+	guint i;
+	
+	text = g_string_new ("");
+	for (i = 0; i < 6000; i++)
+		g_string_append_printf (text, "line %u of the text %.*s\r\n", i, (int) (i % 64),
+					"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+	
+	expected = g_byte_array_new ();
+	for (i = 0; i < text->len; i++) {
+		if (text->str[i] != '\r')
+			g_byte_array_append (expected, (guint8 *) text->str + i, 1);
+	}
+	
+	source = g_mime_stream_mem_new ();
+	encoded = g_mime_stream_filter_new (source);
+	filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_BASE64, TRUE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) encoded, filter);
+	g_mime_stream_write (encoded, text->str, text->len);
+	g_mime_stream_flush (encoded);
+	g_object_unref (encoded);
+	g_object_unref (filter);
+	g_string_free (text, TRUE);
+	
+	for (i = 0; i < G_N_ELEMENTS (filter_reads); i++) {
+		testsuite_check ("GMimeStreamFilter %s", filter_reads[i].what);
+		
+		output = read_filtered (source, filter_reads[i].first, filter_reads[i].count);
+		
+		if (output->len == expected->len && !memcmp (output->data, expected->data, expected->len))
+			testsuite_check_passed ();
+		else
+			testsuite_check_failed ("GMimeStreamFilter %s failed: read %u bytes, expected %u",
+						filter_reads[i].what, output->len, expected->len);
+		
+		g_byte_array_free (output, TRUE);
+	}
+	
+	g_byte_array_free (expected, TRUE);
+	g_object_unref (source);
+}
+
+
 static size_t
 gen_random_stream (GMimeStream *stream)
 {
@@ -718,6 +915,9 @@ int main (int argc, char **argv)
 	g_dir_close (outdir);
 	g_dir_close (dir);
 	
+	test_stream_vectors ();
+	test_stream_filter_reads ();
+	
 exit:
 	
 	testsuite_end ();
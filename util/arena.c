@@ -0,0 +1,165 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "arena.h"
+
+/* allocations are aligned to a multiple of this */
+#define ARENA_ALIGN (2 * sizeof (void *))
+#define ARENA_ALIGN_SIZE(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* blocks never grow larger than this (unless a single allocation needs it) */
+#define ARENA_BLOCK_MAX (64 * 1024)
+
+struct _ArenaBlock {
+	ArenaBlock *next;
+	size_t size;
+	size_t used;
+};
+
+#define ARENA_BLOCK_HEADER ARENA_ALIGN_SIZE (sizeof (ArenaBlock))
+#define arena_block_data(block) (((char *) (block)) + ARENA_BLOCK_HEADER)
+
+
+Arena *
+arena_new (size_t block_size)
+{
+	Arena *arena;
+	
+	arena = g_new (Arena, 1);
+	arena->block_size = ARENA_ALIGN_SIZE (MAX (block_size, 256));
+	arena->blocks = NULL;
+	arena->ref_count = 1;
+	
+	return arena;
+}
+
+
+Arena *
+arena_ref (Arena *arena)
+{
+	g_atomic_int_inc (&arena->ref_count);
+	
+	return arena;
+}
+
+
+void
+arena_unref (Arena *arena)
+{
+	ArenaBlock *block, *next;
+	
+	if (!g_atomic_int_dec_and_test (&arena->ref_count))
+		return;
+	
+	block = arena->blocks;
+	while (block != NULL) {
+		next = block->next;
+		g_free (block);
+		block = next;
+	}
+	
+	g_free (arena);
+}
+
+
+gpointer
+arena_alloc (Arena *arena, size_t size)
+{
+	ArenaBlock *block = arena->blocks;
+	size_t block_size;
+	gpointer mem;
+	
+	size = ARENA_ALIGN_SIZE (size);
+	
+	if (block == NULL || block->size - block->used < size) {
+		/* each new block is twice as big as the last one so that
+		 * large messages don't end up with long block chains */
+		block_size = arena->block_size;
+		if (arena->blocks && block_size < ARENA_BLOCK_MAX)
+			arena->block_size = block_size = MIN (block_size * 2, ARENA_BLOCK_MAX);
+		
+		block_size = MAX (block_size, size);
+		
+		block = g_malloc (ARENA_BLOCK_HEADER + block_size);
+		block->size = block_size;
+		block->used = 0;
+		
+		if (arena->blocks && arena->blocks->size - arena->blocks->used > block_size - size) {
+			/* the current block has more room left than the
+			 * new one will, so keep allocating from that */
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+	
+	mem = arena_block_data (block) + block->used;
+	block->used += size;
+	
+	return mem;
+}
+
+
+char *
+arena_strndup (Arena *arena, const char *str, size_t n)
+{
+	char *dup;
+	
+	dup = arena_alloc (arena, n + 1);
+	memcpy (dup, str, n);
+	dup[n] = '\0';
+	
+	return dup;
+}
+
+
+char *
+arena_strdup (Arena *arena, const char *str)
+{
+	return arena_strndup (arena, str, strlen (str));
+}
+
+
+gboolean
+arena_contains (Arena *arena, gconstpointer mem)
+{
+	ArenaBlock *block = arena->blocks;
+	const char *data;
+	
+	while (block != NULL) {
+		data = arena_block_data (block);
+		
+		if ((const char *) mem >= data && (const char *) mem < data + block->used)
+			return TRUE;
+		
+		block = block->next;
+	}
+	
+	return FALSE;
+}
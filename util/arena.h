@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2014 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <glib.h>
+
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ArenaBlock ArenaBlock;
+
+/* A reference-counted bump allocator: memory allocated from an arena
+ * cannot be freed individually, it all gets released in one shot when
+ * the last reference to the arena is dropped. */
+typedef struct {
+	ArenaBlock *blocks;
+	size_t block_size;
+	volatile int ref_count;
+} Arena;
+
+
+G_GNUC_INTERNAL Arena *arena_new (size_t block_size);
+
+G_GNUC_INTERNAL Arena *arena_ref (Arena *arena);
+G_GNUC_INTERNAL void arena_unref (Arena *arena);
+
+G_GNUC_INTERNAL gpointer arena_alloc (Arena *arena, size_t size);
+
+G_GNUC_INTERNAL char *arena_strndup (Arena *arena, const char *str, size_t n);
+G_GNUC_INTERNAL char *arena_strdup (Arena *arena, const char *str);
+
+G_GNUC_INTERNAL gboolean arena_contains (Arena *arena, gconstpointer mem);
+
+G_END_DECLS
+
+#endif /* __ARENA_H__ */